@@ -0,0 +1,393 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+#include "stdafx.h"
+
+#include <algorithm>
+
+#include <giomm/file.h>
+#include <glib/gstdio.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "batchserver.h"
+#include "model.h"
+#include "shape.h"
+#include "files.h"
+#include "ui/progress.h"
+
+const uint MAX_CACHED_MESHES = 32;
+
+static double now()
+{
+  Glib::TimeVal t;
+  t.assign_current_time();
+  return t.as_double();
+}
+
+static Glib::TimeVal modification_time(const string &path)
+{
+  Glib::RefPtr<Gio::File> file = Gio::File::create_for_path(path);
+  return file->query_info(G_FILE_ATTRIBUTE_TIME_MODIFIED)->modification_time();
+}
+
+BatchServer::BatchServer(const string &spooldir, uint num_workers,
+			 const string &default_settings)
+  : spooldir(spooldir), default_settings(default_settings), use_count(0)
+{
+  int procs = 1;
+#ifdef _OPENMP
+  procs = omp_get_num_procs();
+#endif
+  if (num_workers == 0) num_workers = procs;
+  omp_threads = MAX(1, procs / (int)num_workers);
+
+  for (uint i = 0; i < num_workers; i++) {
+    Worker *worker = new Worker();
+    worker->server = this;
+    worker->progress = new ViewProgress(); // without widgets, no display
+    worker->progress->set_terminal_output(false);
+    worker->model = new Model();
+    worker->model->SetViewProgress(worker->progress);
+    worker->model->statusbar = NULL;
+    worker->job = NULL;
+    worker->quit = false;
+    worker->state = IDLE;
+    mutex_init(&worker->mutex);
+    cond_init(&worker->cond);
+    thread_create(&worker->thread, WorkerMainStatic, worker);
+    workers.push_back(worker);
+  }
+}
+
+BatchServer::~BatchServer()
+{
+  for (uint i = 0; i < workers.size(); i++) {
+    Worker *worker = workers[i];
+    mutex_lock(&worker->mutex);
+    worker->quit = true;
+    cond_signal(&worker->cond);
+    mutex_unlock(&worker->mutex);
+    thread_join(worker->thread);
+    mutex_destroy(&worker->mutex);
+    cond_destroy(&worker->cond);
+    delete worker->model;
+    delete worker->progress;
+    delete worker;
+  }
+  for (map<string, CachedMesh>::iterator m = meshes.begin();
+       m != meshes.end(); m++)
+    for (uint s = 0; s < m->second.shapes.size(); s++)
+      delete m->second.shapes[s];
+}
+
+void *BatchServer::WorkerMainStatic(void *arg)
+{
+  Worker *worker = (Worker *) arg;
+  worker->server->WorkerMain(worker);
+  return NULL;
+}
+
+// slice and write, nothing else
+void BatchServer::WorkerMain(Worker *worker)
+{
+#ifdef _OPENMP
+  omp_set_num_threads(omp_threads);
+#endif
+  while (true) {
+    mutex_lock(&worker->mutex);
+    while (!worker->quit && g_atomic_int_get(&worker->state) != BUSY)
+      cond_wait(&worker->cond, &worker->mutex);
+    Job *job = worker->job;
+    const bool quit = worker->quit;
+    mutex_unlock(&worker->mutex);
+    if (quit) break;
+
+    job->ok = worker->model->SliceMain();
+    job->layers = worker->model->layers.size();
+    job->sliced = now();
+    if (job->ok) {
+      try {
+	job->bytes = worker->model->WriteSlicedGCode(job->output_path);
+      } catch (Glib::FileError &e) {
+	job->ok = false;
+	job->error = e.what();
+      }
+    } else
+      job->error = _("Slicing cancelled");
+    job->written = now();
+    g_atomic_int_set(&worker->state, DONE);
+  }
+}
+
+int BatchServer::run()
+{
+  cerr << _("Slicing jobs from ") << spooldir << _(" with ")
+       << workers.size() << _(" workers") << endl;
+  const string quitfile = Glib::build_filename(spooldir, "quit");
+  while (true) {
+    bool busy = false, changed = false;
+    for (uint i = 0; i < workers.size(); i++)
+      switch (g_atomic_int_get(&workers[i]->state)) {
+      case DONE: finishJob(workers[i]); changed = true; break;
+      case BUSY: busy = true; break;
+      }
+    if (Glib::file_test(quitfile, Glib::FILE_TEST_EXISTS)) {
+      if (!busy) break;
+    } else {
+      vector<string> jobs = findJobs();
+      uint next = 0;
+      for (uint i = 0; i < workers.size() && next < jobs.size(); i++) {
+	if (g_atomic_int_get(&workers[i]->state) != IDLE) continue;
+	Job *job = readJob(jobs[next++]);
+	if (!job) continue;
+	if (!startJob(workers[i], job)) {
+	  writeReport(job);
+	  delete job;
+	}
+	changed = true;
+      }
+    }
+    if (!changed)
+      Glib::usleep(100000);
+  }
+  g_remove(quitfile.c_str());
+  return 0;
+}
+
+// the job files waiting in the spool, oldest name first
+vector<string> BatchServer::findJobs() const
+{
+  vector<string> jobs;
+  try {
+    Glib::Dir dir(spooldir);
+    for (Glib::DirIterator i = dir.begin(); i != dir.end(); i++) {
+      const string name = *i;
+      if (name.size() > 4 && name.substr(name.size() - 4) == ".job")
+	jobs.push_back(name.substr(0, name.size() - 4));
+    }
+  } catch (Glib::FileError &e) {
+    cerr << e.what() << endl;
+  }
+  sort(jobs.begin(), jobs.end());
+  return jobs;
+}
+
+// take a job file out of the spool and read it
+BatchServer::Job *BatchServer::readJob(const string &name) const
+{
+  const string path = Glib::build_filename(spooldir, name + ".job");
+  Job *job = new Job();
+  job->name = name;
+  job->jobfile = path + ".running";
+  job->started = now();
+  job->queued = job->loaded = job->sliced = job->written = job->started;
+  job->mesh_cached = job->settings_cached = false;
+  job->ok = false;
+  job->bytes = 0;
+  job->layers = 0;
+  job->printtime = 0;
+  try {
+    job->queued = modification_time(path).as_double();
+  } catch (Glib::Error &e) {
+    // then it waited for nothing
+  }
+  if (g_rename(path.c_str(), job->jobfile.c_str()) != 0) {
+    delete job; // gone or taken by someone else
+    return NULL;
+  }
+  try {
+    Glib::KeyFile keyfile;
+    keyfile.load_from_file(job->jobfile);
+    job->model_path = keyfile.get_string("Job", "Model");
+    job->output_path = keyfile.get_string("Job", "Output");
+    if (keyfile.has_key("Job", "Settings"))
+      job->settings_path = keyfile.get_string("Job", "Settings");
+  } catch (Glib::Error &e) {
+    job->error = e.what();
+    return job;
+  }
+  if (job->settings_path.empty())
+    job->settings_path = default_settings;
+  if (!job->settings_path.empty() && !Glib::path_is_absolute(job->settings_path))
+    job->settings_path = Glib::build_filename(spooldir, job->settings_path);
+  if (!Glib::path_is_absolute(job->model_path))
+    job->model_path = Glib::build_filename(spooldir, job->model_path);
+  if (!Glib::path_is_absolute(job->output_path))
+    job->output_path = Glib::build_filename(spooldir, job->output_path);
+  return job;
+}
+
+// load the job into the worker's model, in the main thread
+bool BatchServer::startJob(Worker *worker, Job *job)
+{
+  if (!job->error.empty()) return false;
+  Model *model = worker->model;
+  try {
+    model->objtree.clear();
+    model->ClearGCode();
+    model->ClearLayers();
+    model->settings = getSettings(job->settings_path, job->settings_cached);
+    model->settings.Display.TerminalProgress = false;
+    // jobs run at once and would share the trace, only --trace applies
+    model->settings.Misc.TraceFile = "";
+    const vector<Shape*> &shapes = getMesh(job->model_path, job->mesh_cached);
+    if (shapes.empty()) {
+      job->error = _("No shapes in model");
+      return false;
+    }
+    // as in Model::ReadStl, do not autoplace in multishape files
+    const bool autoplace = model->settings.Misc.ShapeAutoplace && shapes.size() == 1;
+    const Vector3d volume = model->settings.getPrintVolume()
+      - model->settings.getPrintMargin()*2.;
+    model->m_inhibit_modelchange = true;
+    for (uint i = 0; i < shapes.size(); i++) {
+      Shape *shape = new Shape(*shapes[i]); // shares the triangles
+      shape->FitToVolume(volume);
+      model->AddShape(NULL, shape, shape->filename, autoplace);
+    }
+    model->m_inhibit_modelchange = false;
+    model->CalcBoundingBoxAndCenter();
+  } catch (Glib::Error &e) {
+    model->m_inhibit_modelchange = false;
+    job->error = e.what();
+    return false;
+  }
+  if (!model->PrepareConvertToGCode()) {
+    job->error = _("Model is busy");
+    return false;
+  }
+  job->loaded = now();
+  mutex_lock(&worker->mutex);
+  worker->job = job;
+  g_atomic_int_set(&worker->state, BUSY);
+  cond_signal(&worker->cond);
+  mutex_unlock(&worker->mutex);
+  return true;
+}
+
+void BatchServer::finishJob(Worker *worker)
+{
+  Job *job = worker->job;
+  Model *model = worker->model;
+  model->FinishConvertToGCode();
+  if (job->ok)
+    job->printtime = model->gcode.GetTimeEstimation(model->settings);
+  model->objtree.clear();
+  model->ClearGCode();
+  model->ClearLayers();
+  writeReport(job);
+  mutex_lock(&worker->mutex);
+  worker->job = NULL;
+  g_atomic_int_set(&worker->state, IDLE);
+  mutex_unlock(&worker->mutex);
+  delete job;
+}
+
+// NAME.report, and the job file renamed to its result
+void BatchServer::writeReport(const Job *job) const
+{
+  Glib::KeyFile report;
+  report.set_string("Report", "Model", job->model_path);
+  report.set_string("Report", "Output", job->output_path);
+  report.set_string("Report", "Status", job->ok ? "done" : "failed");
+  if (!job->error.empty())
+    report.set_string("Report", "Error", job->error);
+  report.set_double("Report", "WaitSeconds", job->started - job->queued);
+  report.set_double("Report", "LoadSeconds", job->loaded - job->started);
+  report.set_double("Report", "SliceSeconds", job->sliced - job->loaded);
+  report.set_double("Report", "WriteSeconds", job->written - job->sliced);
+  report.set_double("Report", "TotalSeconds", now() - job->started);
+  report.set_boolean("Report", "MeshCached", job->mesh_cached);
+  report.set_boolean("Report", "SettingsCached", job->settings_cached);
+  report.set_integer("Report", "Layers", job->layers);
+  report.set_double("Report", "Bytes", job->bytes);
+  report.set_double("Report", "PrintSeconds", job->printtime);
+  const string base = Glib::build_filename(spooldir, job->name);
+  try {
+    Glib::file_set_contents(base + ".report", report.to_data());
+  } catch (Glib::FileError &e) {
+    cerr << e.what() << endl;
+  }
+  const string result = base + (job->ok ? ".job.done" : ".job.failed");
+  g_rename(job->jobfile.c_str(), result.c_str());
+  cerr << job->name << ": " << (job->ok ? _("done") : job->error)
+       << " " << (now() - job->started) << "s" << endl;
+}
+
+const vector<Shape*> &BatchServer::getMesh(const string &path, bool &cached)
+{
+  const Glib::TimeVal modified = modification_time(path);
+  map<string, CachedMesh>::iterator found = meshes.find(path);
+  cached = (found != meshes.end() && found->second.modified == modified);
+  if (!cached) {
+    if (found == meshes.end()) {
+      // make room, least recently used first
+      while (meshes.size() >= MAX_CACHED_MESHES) {
+	map<string, CachedMesh>::iterator oldest = meshes.begin();
+	for (map<string, CachedMesh>::iterator m = meshes.begin();
+	     m != meshes.end(); m++)
+	  if (m->second.used < oldest->second.used) oldest = m;
+	for (uint s = 0; s < oldest->second.shapes.size(); s++)
+	  delete oldest->second.shapes[s];
+	meshes.erase(oldest);
+      }
+      found = meshes.insert(make_pair(path, CachedMesh())).first;
+    }
+    CachedMesh &mesh = found->second;
+    for (uint s = 0; s < mesh.shapes.size(); s++)
+      delete mesh.shapes[s];
+    mesh.shapes.clear();
+    mesh.modified = modified;
+    File sfile(Gio::File::create_for_path(path));
+    vector< vector<Triangle> > triangles;
+    vector<ustring> shapenames;
+    sfile.loadTriangles(triangles, shapenames, 0);
+    for (uint i = 0; i < triangles.size(); i++) {
+      if (triangles[i].size() > 0) {
+	Shape *shape = new Shape();
+	shape->setTriangles(triangles[i]);
+	shape->filename = shapenames[i];
+	mesh.shapes.push_back(shape);
+      }
+    }
+  }
+  found->second.used = ++use_count;
+  return found->second.shapes;
+}
+
+const Settings &BatchServer::getSettings(const string &path, bool &cached)
+{
+  const Glib::TimeVal modified =
+    path.empty() ? Glib::TimeVal() : modification_time(path);
+  map<string, CachedSettings>::iterator found = settings.find(path);
+  cached = (found != settings.end() && found->second.modified == modified);
+  if (!cached) {
+    if (found == settings.end())
+      found = settings.insert(make_pair(path, CachedSettings())).first;
+    found->second.modified = modified;
+    found->second.settings = Settings();
+    if (!path.empty())
+      found->second.settings.load_settings(Gio::File::create_for_path(path));
+  }
+  return found->second.settings;
+}
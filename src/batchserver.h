@@ -0,0 +1,117 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <map>
+
+#include "stdafx.h"
+#include "settings.h"
+#include "printer/thread.h"
+
+// Head-less slicing of jobs from a spool directory.
+//
+// A job is a key file NAME.job in the spool directory:
+//   [Job]
+//   Model=part.stl
+//   Settings=petg.conf
+//   Output=part.gcode
+// Relative paths are taken from the spool directory.  A job being sliced
+// is renamed to NAME.job.running, then to NAME.job.done or
+// NAME.job.failed, next to its timing report NAME.report.
+// The server stops when a file named "quit" appears in the spool.
+//
+// Every worker thread has its own Model.  Everything touching gtk
+// (loading settings and meshes, the object tree, the text buffers)
+// is done in the main thread, workers only slice and write the output:
+// the GCode texts of the settings, which are text buffers, are copied
+// to strings by PrepareConvertToGCode before a worker gets the job.
+// Meshes and settings are cached between jobs while their files
+// don't change, and copies of a cached mesh share its triangles.
+// A job's Model gets a copy of the cached settings, with text buffers
+// of its own.
+class BatchServer
+{
+ public:
+  // num_workers 0: one per processor.  Jobs without settings use
+  // default_settings.
+  BatchServer(const string &spooldir, uint num_workers,
+	      const string &default_settings);
+  ~BatchServer();
+
+  int run();
+
+ private:
+  struct Job {
+    string name;
+    string jobfile;  // while running
+    string model_path, settings_path, output_path;
+    double queued, started, loaded, sliced, written; // seconds
+    bool mesh_cached, settings_cached;
+    bool ok;
+    string error;
+    size_t bytes;
+    uint layers;
+    double printtime;
+  };
+
+  enum { IDLE, BUSY, DONE };
+  struct Worker {
+    BatchServer *server;
+    Model *model;
+    ViewProgress *progress;
+    thread_t thread;
+    mutex_t mutex;
+    cond_t cond;
+    Job *job;
+    bool quit;
+    volatile gint state;
+  };
+
+  string spooldir;
+  string default_settings;
+  vector<Worker*> workers;
+  int omp_threads; // per worker
+
+  // cached by path, valid while the file is not modified
+  struct CachedMesh {
+    Glib::TimeVal modified;
+    vector<Shape*> shapes; // as read, not fit to the volume
+    unsigned long used;
+  };
+  struct CachedSettings {
+    Glib::TimeVal modified;
+    Settings settings;
+  };
+  map<string, CachedMesh> meshes;
+  map<string, CachedSettings> settings;
+  unsigned long use_count;
+
+  vector<string> findJobs() const;
+  Job *readJob(const string &name) const;
+  bool startJob(Worker *worker, Job *job);
+  void finishJob(Worker *worker);
+  void writeReport(const Job *job) const;
+
+  const vector<Shape*> &getMesh(const string &path, bool &cached);
+  const Settings &getSettings(const string &path, bool &cached);
+
+  static void *WorkerMainStatic(void *arg);
+  void WorkerMain(Worker *worker);
+};
@@ -0,0 +1,316 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Slicing benchmark: converts a fixed set of generated models to gcode
+// head-less and writes the wall time, cpu time and peak memory of every
+// stage as JSON, to compare builds over time.
+
+#include "config.h"
+#include "stdafx.h"
+
+#include <fstream>
+#include <cstring>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "model.h"
+#include "shape.h"
+#include "ui/progress.h"
+#include "profile.h"
+#include "gitversion.h"
+
+// with the normal pointing away from inside
+static void addTriangle(vector<Triangle> &tr, const Vector3d &inside,
+			const Vector3d &A, const Vector3d &B, const Vector3d &C)
+{
+  Triangle t(A, B, C);
+  if (!(t.area() > 0)) return;
+  if (t.Normal.dot((A + B + C) / 3. - inside) < 0)
+    t = Triangle(A, C, B);
+  tr.push_back(t);
+}
+
+static void addBox(vector<Triangle> &tr, const Vector3d &min, const Vector3d &max)
+{
+  Vector3d p[8];
+  for (uint i = 0; i < 8; i++)
+    p[i] = Vector3d(i&1 ? max.x() : min.x(),
+		    i&2 ? max.y() : min.y(),
+		    i&4 ? max.z() : min.z());
+  const uint faces[6][4] = { {0,1,3,2}, {4,5,7,6}, {0,1,5,4},
+			     {2,3,7,6}, {0,2,6,4}, {1,3,7,5} };
+  const Vector3d center = (min + max) / 2.;
+  for (uint f = 0; f < 6; f++) {
+    addTriangle(tr, center, p[faces[f][0]], p[faces[f][1]], p[faces[f][2]]);
+    addTriangle(tr, center, p[faces[f][0]], p[faces[f][2]], p[faces[f][3]]);
+  }
+}
+
+// standing on z=0 with its bounding box from the origin
+static void addSphere(vector<Triangle> &tr, double radius,
+		      uint slices, uint stacks)
+{
+  const Vector3d center(radius, radius, radius);
+  vector<Vector3d> p((slices + 1) * (stacks + 1));
+  for (uint j = 0; j <= stacks; j++) {
+    const double theta = M_PI * j / stacks;
+    for (uint i = 0; i <= slices; i++) {
+      const double phi = 2 * M_PI * i / slices;
+      p[j * (slices+1) + i] = center + radius *
+	Vector3d(sin(theta)*cos(phi), sin(theta)*sin(phi), cos(theta));
+    }
+  }
+  for (uint j = 0; j < stacks; j++)
+    for (uint i = 0; i < slices; i++) {
+      const Vector3d &a = p[j * (slices+1) + i],     &b = p[j * (slices+1) + i+1];
+      const Vector3d &c = p[(j+1) * (slices+1) + i+1], &d = p[(j+1) * (slices+1) + i];
+      addTriangle(tr, center, a, b, c);
+      addTriangle(tr, center, a, c, d);
+    }
+}
+
+static Shape *makeShape(const vector<Triangle> &triangles, const string &name)
+{
+  Shape *shape = new Shape();
+  shape->setTriangles(triangles);
+  shape->filename = name;
+  return shape;
+}
+
+static void addToModel(Model *model, Shape *shape, const Vector3d &where)
+{
+  model->AddShape(NULL, shape, shape->filename, false);
+  shape->transform3D.move(where);
+}
+
+// one finely tessellated sphere
+static void buildSphere(Model *model)
+{
+  vector<Triangle> tr;
+  addSphere(tr, 30, 512, 256);
+  addToModel(model, makeShape(tr, "sphere"), Vector3d(20, 20, 0));
+}
+
+// pillars connected by beams on every level, many small islands
+// and bridges
+static void buildLattice(Model *model)
+{
+  const uint cells = 8, levels = 8;
+  const double pitch = 8, strut = 1.6;
+  vector<Triangle> tr;
+  for (uint x = 0; x <= cells; x++)
+    for (uint y = 0; y <= cells; y++) {
+      const Vector3d base(x * pitch, y * pitch, 0);
+      addBox(tr, base, base + Vector3d(strut, strut, levels * pitch + strut));
+      for (uint z = 1; z <= levels; z++) {
+	const Vector3d level = base + Vector3d(0, 0, z * pitch);
+	if (x < cells)
+	  addBox(tr, level + Vector3d(strut, 0, 0),
+		 level + Vector3d(pitch, strut, strut));
+	if (y < cells)
+	  addBox(tr, level + Vector3d(0, strut, 0),
+		 level + Vector3d(strut, pitch, strut));
+      }
+    }
+  addToModel(model, makeShape(tr, "lattice"), Vector3d(20, 20, 0));
+}
+
+// raised 5x7 pixel letters on a thin plate
+static void buildTextPlate(Model *model)
+{
+  const char *glyphs[][7] = {
+    { "1111.", "1...1", "1...1", "1111.", "1.1..", "1..1.", "1...1" }, // R
+    { "11111", "1....", "1....", "1111.", "1....", "1....", "11111" }, // E
+    { "1111.", "1...1", "1...1", "1111.", "1....", "1....", "1...." }, // P
+    { ".1111", "1....", "1....", ".111.", "....1", "....1", "1111." }, // S
+    { "1...1", "11..1", "1.1.1", "1..11", "1...1", "1...1", "1...1" }, // N
+    { ".111.", "1...1", "1...1", "11111", "1...1", "1...1", "1...1" }, // A
+  };
+  const uint text[] = { 0, 1, 2, 3, 4, 5, 2, 2, 1, 0 }; // REPSNAPPER
+  const uint nletters = sizeof(text) / sizeof(text[0]);
+  const uint lines = 3;
+  const double pixel = 1.5, plate = 1.5, relief = 1.5, margin = 4;
+  vector<Triangle> tr;
+  const double width = nletters * 6 * pixel + 2 * margin;
+  const double height = lines * 9 * pixel + 2 * margin;
+  addBox(tr, Vector3d(0, 0, 0), Vector3d(width, height, plate));
+  for (uint l = 0; l < lines; l++)
+    for (uint n = 0; n < nletters; n++)
+      for (uint row = 0; row < 7; row++) {
+	const char *bits = glyphs[text[n]][row];
+	const double y = margin + (l * 9 + 6 - row) * pixel;
+	for (uint col = 0; col < 5; ) {
+	  if (bits[col] != '1') { col++; continue; }
+	  uint end = col;
+	  while (end < 5 && bits[end] == '1') end++;
+	  const double x = margin + (n * 6 + col) * pixel;
+	  addBox(tr, Vector3d(x, y, plate),
+		 Vector3d(x + (end - col) * pixel, y + pixel, plate + relief));
+	  col = end;
+	}
+      }
+  addToModel(model, makeShape(tr, "textplate"), Vector3d(20, 20, 0));
+}
+
+// a grid of copies sharing one mesh
+static void buildInstances(Model *model)
+{
+  const uint rows = 8;
+  const double pitch = 14;
+  vector<Triangle> tr;
+  addSphere(tr, 5, 48, 24);
+  Shape *first = makeShape(tr, "instance");
+  for (uint x = 0; x < rows; x++)
+    for (uint y = 0; y < rows; y++) {
+      Shape *shape = (x == 0 && y == 0) ? first : new Shape(*first);
+      addToModel(model, shape, Vector3d(20 + x * pitch, 20 + y * pitch, 0));
+    }
+}
+
+struct BenchmarkCase {
+  const char *name;
+  void (*build)(Model *model);
+};
+
+static const BenchmarkCase cases[] = {
+  { "sphere",    buildSphere },
+  { "lattice",   buildLattice },
+  { "textplate", buildTextPlate },
+  { "instances", buildInstances },
+};
+
+static void usage()
+{
+  fprintf (stderr, _("Usage: repsnapper-benchmark [OPTION]...\n"
+		     "Slice generated models and write the times of the stages as JSON\n"
+		     "Options:\n"
+		     "  -o, --output [file]    write to [file] (default: benchmark.json)\n"
+		     "  -s, --settings [file]  slice with the settings in [file]\n"
+		     "  -c, --case [name]      only this case: sphere, lattice,\n"
+		     "                         textplate or instances\n"
+		     "  -r, --repeat [n]       slice every case [n] times\n"
+		     "  -h, --help             show this help\n"));
+  exit (1);
+}
+
+int main(int argc, char **argv)
+{
+  Glib::thread_init();
+  // no display needed: the model has text buffers, but no widgets
+  gtk_init_check(&argc, &argv);
+  Gtk::Main::init_gtkmm_internals();
+  save_locales();
+
+  string output = "benchmark.json", settings_path, only;
+  int repeat = 1;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const bool param = i < argc - 1;
+    if (param && (!strcmp(arg, "-o") || !strcmp(arg, "--output")))
+      output = argv[++i];
+    else if (param && (!strcmp(arg, "-s") || !strcmp(arg, "--settings")))
+      settings_path = argv[++i];
+    else if (param && (!strcmp(arg, "-c") || !strcmp(arg, "--case")))
+      only = argv[++i];
+    else if (param && (!strcmp(arg, "-r") || !strcmp(arg, "--repeat")))
+      repeat = MAX(1, atoi(argv[++i]));
+    else
+      usage();
+  }
+
+  Model *model = new Model();
+  if (settings_path.size() > 0)
+    model->LoadConfig(Gio::File::create_for_path(settings_path));
+  model->settings.Display.TerminalProgress = false;
+  model->profile.setMeasureMemory(true);
+  ViewProgress vprog; // without widgets
+  vprog.set_terminal_output(false);
+  model->SetViewProgress(&vprog);
+  model->statusbar = NULL;
+
+  int threads = 1;
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#endif
+
+  ostringstream json;
+  json.imbue(std::locale::classic());
+  json << "{\n  \"version\": \"" << VERSION << "\",\n"
+       << "  \"commit\": \"" << GIT_COMMIT << "\",\n"
+       << "  \"threads\": " << threads << ",\n"
+       << "  \"cases\": [";
+  bool first_case = true;
+  for (uint c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+    if (only.size() > 0 && only != cases[c].name) continue;
+
+    model->m_inhibit_modelchange = true;
+    model->objtree.clear();
+    model->ClearGCode();
+    model->ClearLayers();
+    cases[c].build(model);
+    model->m_inhibit_modelchange = false;
+    model->CalcBoundingBoxAndCenter();
+
+    vector<Shape*> shapes;
+    vector<Matrix4d> transforms;
+    model->objtree.get_all_shapes(shapes, transforms);
+    size_t triangles = 0;
+    for (uint s = 0; s < shapes.size(); s++)
+      triangles += shapes[s]->size();
+
+    json << (first_case ? "" : ",") << "\n    {\"name\": \"" << cases[c].name
+	 << "\", \"shapes\": " << shapes.size()
+	 << ", \"triangles\": " << triangles << ",\n     \"runs\": [";
+    first_case = false;
+    for (int r = 0; r < repeat; r++) {
+      StageProfile::Stage total;
+      total.name = "total";
+      const double wall = StageProfile::wallTime(), cpu = StageProfile::cpuTime();
+      model->ConvertToGCode();
+      total.wall = StageProfile::wallTime() - wall;
+      total.cpu  = StageProfile::cpuTime() - cpu;
+      total.peak_rss = 0;
+      const vector<StageProfile::Stage> &stages = model->profile.stages();
+      json << (r > 0 ? "," : "") << "\n      {\"layers\": " << model->layers.size()
+	   << ", \"commands\": " << model->gcode.commands.size() << ",\n"
+	   << "       \"stages\": [";
+      for (uint s = 0; s < stages.size(); s++) {
+	total.peak_rss = MAX(total.peak_rss, stages[s].peak_rss);
+	json << (s > 0 ? "," : "") << "\n         " << StageProfile::json(stages[s]);
+      }
+      json << "],\n       \"total\": " << StageProfile::json(total) << "}";
+      cerr << cases[c].name << ": " << total.wall << _(" seconds") << endl;
+    }
+    json << "]}";
+  }
+  json << "\n  ]\n}\n";
+
+  delete model;
+
+  ofstream file(output.c_str(), ios::out | ios::trunc);
+  file << json.str();
+  file.close();
+  if (file.fail()) {
+    cerr << _("Could not write ") << output << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -21,6 +21,8 @@
 #include "files.h"
 
 #include <iostream>
+#include <cstring>
+#include <locale>
 
 
 static string numlocale   = "";
@@ -516,6 +518,7 @@ bool File::load_VRML(vector<Triangle> &triangles, uint max_triangles)
 
 #if ENABLE_AMF
 #include "amf/amftools-code/include/AMF_File.h"
+#include <zip.h>
  class AMFLoader : public AmfFile
  {
    double _scale;
@@ -567,42 +570,6 @@ bool File::load_VRML(vector<Triangle> &triangles, uint max_triangles)
    }
 
  };
- class AMFWriter : public AmfFile
- {
- public:
-   AMFWriter() {};
-   ~AMFWriter() {};
-
-   nVertex vertex(const Vector3d &v) const {
-     return nVertex(v.x(), v.y(), v.z());
-   }
-
-   bool AddObject(const vector<Triangle> &triangles,
-		  const ustring name)
-   {
-     int num = AmfFile::AddObject(string(name));
-     if (num<0) return false;
-     nObject* object = GetObject(num, true);
-     if (!object) return false;
-     nMesh mesh;
-     for (uint t = 0; t <  triangles.size(); t++) {
-       nVertex A = vertex(triangles[t].A);
-       mesh.AddVertex(A);
-       nVertex B = vertex(triangles[t].B);
-       mesh.AddVertex(B);
-       nVertex C = vertex(triangles[t].C);
-       mesh.AddVertex(C);
-     }
-     nVolume* vol = mesh.NewVolume(name);
-     for (uint t = 0; t <  triangles.size(); t++) {
-       nTriangle tr(3*t, 3*t+1, 3*t+2);
-       vol->AddTriangle(tr);
-     }
-     object->Meshes.push_back(mesh);
-     return true;
-   }
-
- };
 #endif
 
 bool File::load_AMF(vector< vector<Triangle> > &triangles,
@@ -627,29 +594,233 @@ bool File::load_AMF(vector< vector<Triangle> > &triangles,
 #endif
 }
 
+const uint EXPORT_BLOCK = 65536; // triangles formatted at once
+const uint EXPORT_CHUNK = 1024;  // triangles per thread
+const uint STL_FACET = 50;       // bytes of a binary stl facet
+
+static string xml_escape(const string &text)
+{
+  string escaped;
+  for (uint i = 0; i < text.size(); i++)
+    switch (text[i]) {
+    case '<': escaped += "&lt;";   break;
+    case '>': escaped += "&gt;";   break;
+    case '&': escaped += "&amp;";  break;
+    case '"': escaped += "&quot;"; break;
+    default:  escaped += text[i];
+    }
+  return escaped;
+}
+
+// The text of an AMF file made piece by piece, each piece the vertices
+// or triangles of up to EXPORT_BLOCK triangles, formatted in parallel.
+// Vertices are not shared, triangle t has the vertices 3t, 3t+1, 3t+2.
+class AMFText
+{
+public:
+  AMFText(const vector<const vector<Triangle>*> &meshes,
+	  const vector<Matrix4d> &transforms,
+	  const vector<ustring> &names)
+    : meshes(meshes), transforms(transforms), names(names),
+      stage(HEADER), object(0), start(0) {}
+
+  // false at the end
+  bool next(string &text);
+
+private:
+  const vector<const vector<Triangle>*> &meshes;
+  const vector<Matrix4d> &transforms;
+  const vector<ustring> &names;
+  enum { HEADER, OBJECT, VERTICES, TRIANGLES, FOOTER, DONE } stage;
+  uint object, start;
+  string block(uint end, bool vertices) const;
+};
+
+string AMFText::block(uint end, bool vertices) const
+{
+  const vector<Triangle> &triangles = *meshes[object];
+  const Matrix4d &T = transforms[object];
+  const int nchunks = (end - start + EXPORT_CHUNK - 1) / EXPORT_CHUNK;
+  vector<string> parts(nchunks);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int c = 0; c < nchunks; c++) {
+    ostringstream ostr;
+    ostr.imbue(std::locale::classic());
+    ostr.precision(9);
+    const uint cend = MIN(end, start + (c+1)*EXPORT_CHUNK);
+    for (uint t = start + c*EXPORT_CHUNK; t < cend; t++) {
+      if (vertices)
+	for (uint v = 0; v < 3; v++) {
+	  const Vector3d p = T * triangles[t][v];
+	  ostr << "    <vertex><coordinates><x>" << p.x() << "</x><y>" << p.y()
+	       << "</y><z>" << p.z() << "</z></coordinates></vertex>\n";
+	}
+      else
+	ostr << "    <triangle><v1>" << 3*t << "</v1><v2>" << 3*t+1
+	     << "</v2><v3>" << 3*t+2 << "</v3></triangle>\n";
+    }
+    parts[c] = ostr.str();
+  }
+  size_t size = 0;
+  for (int c = 0; c < nchunks; c++) size += parts[c].size();
+  string text;
+  text.reserve(size);
+  for (int c = 0; c < nchunks; c++) text += parts[c];
+  return text;
+}
+
+bool AMFText::next(string &text)
+{
+  const uint size = object < meshes.size() ? meshes[object]->size() : 0;
+  const uint end = MIN(size, start + EXPORT_BLOCK);
+  ostringstream ostr;
+  switch (stage) {
+  case HEADER:
+    ostr << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+	 << "<!-- Created by Repsnapper -->\n"
+	 << "<amf unit=\"millimeter\">\n";
+    stage = meshes.empty() ? FOOTER : OBJECT;
+    break;
+  case OBJECT:
+    ostr << " <object id=\"" << object << "\">\n"
+	 << "  <metadata type=\"name\">" << xml_escape(names[object])
+	 << "</metadata>\n"
+	 << "  <mesh>\n   <vertices>\n";
+    stage = VERTICES;
+    start = 0;
+    break;
+  case VERTICES:
+    ostr << block(end, true);
+    start = end;
+    if (start >= size) {
+      ostr << "   </vertices>\n   <volume>\n"
+	   << "    <metadata type=\"name\">" << xml_escape(names[object])
+	   << "</metadata>\n";
+      stage = TRIANGLES;
+      start = 0;
+    }
+    break;
+  case TRIANGLES:
+    ostr << block(end, false);
+    start = end;
+    if (start >= size) {
+      ostr << "   </volume>\n  </mesh>\n </object>\n";
+      object++;
+      stage = object < meshes.size() ? OBJECT : FOOTER;
+    }
+    break;
+  case FOOTER:
+    ostr << "</amf>\n";
+    stage = DONE;
+    break;
+  case DONE:
+    return false;
+  }
+  text = ostr.str();
+  return true;
+}
+
+#if ENABLE_AMF
+// the AMF text as a zip source, made while libzip compresses it
+struct AMFZipSource {
+  AMFText *amf;
+  string piece;
+  size_t pos;
+};
+
+static zip_int64_t amf_zip_callback(void *state, void *data, zip_uint64_t len,
+				    enum zip_source_cmd cmd)
+{
+  AMFZipSource *source = (AMFZipSource *) state;
+  switch (cmd) {
+  case ZIP_SOURCE_OPEN:
+  case ZIP_SOURCE_CLOSE:
+  case ZIP_SOURCE_FREE:
+    return 0;
+  case ZIP_SOURCE_READ: {
+    zip_uint64_t n = 0;
+    while (n < len) {
+      if (source->pos >= source->piece.size()) {
+	source->pos = 0;
+	if (!source->amf->next(source->piece)) {
+	  source->piece.clear();
+	  break;
+	}
+	continue;
+      }
+      const size_t count = MIN(len - n, source->piece.size() - source->pos);
+      memcpy((char *)data + n, source->piece.data() + source->pos, count);
+      n += count;
+      source->pos += count;
+    }
+    return n;
+  }
+  case ZIP_SOURCE_STAT: // size unknown
+    zip_stat_init((struct zip_stat *) data);
+    return sizeof(struct zip_stat);
+  case ZIP_SOURCE_ERROR: {
+    int *error = (int *) data;
+    error[0] = error[1] = 0;
+    return 2 * sizeof(int);
+  }
+  default:
+    return -1;
+  }
+}
+#endif
+
+// The text is written as it is made, or compressed into a zip archive
+// holding filename.
 bool File::save_AMF (ustring filename,
-		     const vector< vector<Triangle> > &triangles,
+		     const vector<const vector<Triangle>*> &meshes,
+		     const vector<Matrix4d> &transforms,
 		     const vector<ustring> &names,
 		     bool compressed)
 {
+  AMFText amf(meshes, transforms, names);
 #if ENABLE_AMF
-  AMFWriter amf;
-  amf.SetUnits(UNIT_MM);
-  uint nobjs = triangles.size();
-  for (uint o = 0; o < nobjs; o++) {
-    bool ok = amf.AddObject(triangles[o],names[o]);
-    if (!ok) return false;
+  if (compressed) {
+    remove(filename.c_str());
+    int err;
+    struct zip *archive = zip_open(filename.c_str(), ZIP_CREATE, &err);
+    if (!archive) {
+      cerr << _("Error: Unable to create amf file - ") << filename << endl;
+      return false;
+    }
+    AMFZipSource state = { &amf, "", 0 };
+    struct zip_source *source = zip_source_function(archive, amf_zip_callback, &state);
+    const string name = Glib::path_get_basename(filename);
+    if (!source || zip_add(archive, name.c_str(), source) < 0) {
+      if (source) zip_source_free(source);
+      zip_unchange_all(archive);
+      zip_close(archive);
+      return false;
+    }
+    if (zip_close(archive) != 0) { // compresses the whole text
+      cerr << _("Error: Unable to write amf file - ") << filename << endl;
+      zip_unchange_all(archive);
+      zip_close(archive);
+      return false;
+    }
+    return true;
   }
-  amf.Save(filename, compressed);
-  return true;
-#else
-  return false;
 #endif
+  ofstream file(filename.c_str(), ios::out | ios::trunc);
+  string text;
+  while (file.good() && amf.next(text))
+    file << text;
+  file.close();
+  return !file.fail();
 }
 
 
-bool File::saveBinarySTL(ustring filename, const vector<Triangle> &triangles,
-			 const Matrix4d &T)
+// Facets are made in blocks, in parallel, and each block is written
+// with a single fwrite.
+bool File::saveBinarySTL(ustring filename,
+			 const vector<const vector<Triangle>*> &meshes,
+			 const vector<Matrix4d> &transforms)
 {
 
   FILE *file  = fopen(filename.c_str(),"wb");
@@ -659,7 +830,9 @@ bool File::saveBinarySTL(ustring filename, const vector<Triangle> &triangles,
     return false;
   }
 
-  int num_tri = (int)triangles.size();
+  guint32 num_tri = 0;
+  for (uint m = 0; m < meshes.size(); m++)
+    num_tri += meshes[m]->size();
 
   // Write Header
   string tmp = "solid binary by Repsnapper                                                     ";
@@ -667,27 +840,38 @@ bool File::saveBinarySTL(ustring filename, const vector<Triangle> &triangles,
   fwrite(tmp.c_str(), 80, 1, file);
 
   // write number of triangles
-  fwrite(&num_tri, 1, sizeof(int), file);
-
-  for(int i=0; i<num_tri; i++){
-    Vector3f
-      TA = T*triangles[i].A,
-      TB = T*triangles[i].B,
-      TC = T*triangles[i].C,
-      TN = T*triangles[i].Normal; TN.normalize();
-    float N[3] = {TN.x(), TN.y(), TN.z()};
-    float P[9] = {TA.x(), TA.y(), TA.z(),
-		  TB.x(), TB.y(), TB.z(),
-		  TC.x(), TC.y(), TC.z()};
-
-    // write the normal, the three coords and a short set to zero
-    fwrite(&N,3,sizeof(float),file);
-    for(int k=0; k<3; k++) { fwrite(&P[3*k], 3, sizeof(float), file); }
-    unsigned short attributes = 0;
-    fwrite(&attributes, 1, sizeof(short), file);
+  fwrite(&num_tri, 1, sizeof(guint32), file);
+
+  vector<char> block(STL_FACET * EXPORT_BLOCK);
+  bool ok = true;
+  for (uint m = 0; ok && m < meshes.size(); m++) {
+    const vector<Triangle> &triangles = *meshes[m];
+    const Matrix4d &T = transforms[m];
+    for (uint start = 0; ok && start < triangles.size(); start += EXPORT_BLOCK) {
+      const int count = MIN(EXPORT_BLOCK, triangles.size() - start);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+      for (int i = 0; i < count; i++) {
+	// normal from the transformed vertices
+	const Triangle tr = triangles[start+i].transformed(T);
+	// the normal, the three coords and a short set to zero
+	const float facet[12] = {
+	  (float)tr.Normal.x(), (float)tr.Normal.y(), (float)tr.Normal.z(),
+	  (float)tr.A.x(), (float)tr.A.y(), (float)tr.A.z(),
+	  (float)tr.B.x(), (float)tr.B.y(), (float)tr.B.z(),
+	  (float)tr.C.x(), (float)tr.C.y(), (float)tr.C.z() };
+	char *dest = &block[i * STL_FACET];
+	memcpy(dest, facet, sizeof(facet));
+	dest[48] = dest[49] = 0;
+      }
+      ok = fwrite(&block[0], STL_FACET, count, file) == (size_t)count;
+    }
   }
 
-  fclose(file);
-  return true;
+  if (fclose(file) != 0) ok = false;
+  if (!ok)
+    cerr << _("Error: Unable to write stl file - ") << filename << endl;
+  return ok;
 
 }
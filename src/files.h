@@ -74,8 +74,10 @@ public:
 		 vector<ustring> &names,
 		 uint max_triangles=0);
 
+  // meshes each with its transform, formatted and written block by block
   static bool save_AMF (ustring filename,
-			const vector< vector<Triangle> > &triangles,
+			const vector<const vector<Triangle>*> &meshes,
+			const vector<Matrix4d> &transforms,
 			const vector<ustring> &names,
 			bool compressed = true);
 
@@ -91,7 +93,8 @@ public:
 
 
 
-  static bool saveBinarySTL(ustring filename, const vector<Triangle> &triangles,
-			    const Matrix4d &T);
+  static bool saveBinarySTL(ustring filename,
+			    const vector<const vector<Triangle>*> &meshes,
+			    const vector<Matrix4d> &transforms);
 
 };
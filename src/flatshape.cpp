@@ -29,7 +29,6 @@
 
 FlatShape::FlatShape()
 {
-  slow_drawing = false;
   Min.set(0,0,0);
   Max.set(200,200,0);
   CalcBBox();
@@ -38,14 +37,12 @@ FlatShape::FlatShape()
 
 FlatShape::FlatShape(string filename)
 {
-  slow_drawing = false;
   this->filename = filename;
   loadSVG(filename);
 }
 
 // FlatShape::FlatShape(const FlatShape &rhs)
 // {
-//   slow_drawing = false;
 //   polygons = rhs.polygons;
 //   scale_factor_x = rhs.scale_factor_x;
 //   scale_factor_y = rhs.scale_factor_y;
@@ -186,7 +183,7 @@ void FlatShape::clear()
   polygons.clear();
 }
 
-void FlatShape::draw_geometry(uint max_polygons) {
+void FlatShape::draw_geometry(uint max_polygons, bool /*interactive*/) {
   const Matrix4d invT = transform3D.getInverse();
   const Vector3d minT = invT*Min;
   const Vector3d maxT = invT*Max;
@@ -194,7 +191,7 @@ void FlatShape::draw_geometry(uint max_polygons) {
   const Vector2d max2d(maxT.x(), maxT.y());
   glDrawPolySurfaceRastered(polygons, min2d, max2d, 0, 0.1);
   uint step = 1;
-  if (max_polygons > 0) step = polygons.size()/max_polygons;
+  if (max_polygons > 0) step = MAX(1u, uint(polygons.size()/max_polygons));
   for (uint i = 0; i < polygons.size(); i+=step) {
     polygons[i].draw(GL_LINE_LOOP,false);
     // Poly p;
@@ -206,6 +203,19 @@ void FlatShape::draw_geometry(uint max_polygons) {
   }
 }
 
+bool FlatShape::intersectRay(const Vector3d &origin, const Vector3d &dir,
+			     double &t) const
+{
+  if (dir.z() == 0) return false;
+  t = -origin.z() / dir.z();
+  if (t < 0) return false;
+  const Vector2d p(origin.x() + t * dir.x(), origin.y() + t * dir.y());
+  for (uint i = 0; i < polygons.size(); i++)
+    if (polygons[i].vertexInside(p))
+      return true;
+  return false;
+}
+
 void FlatShape::CalcBBox()
 {
   Min.set(INFTY,INFTY,0);
@@ -222,6 +232,18 @@ void FlatShape::CalcBBox()
   Center = (Max + Min )/2;
 }
 
+bool FlatShape::getOutlineBounds(Vector2d &min, Vector2d &max) const
+{
+  min.set(INFTY,INFTY);
+  max.set(-INFTY,-INFTY);
+  for(size_t i = 0; i < polygons.size(); i++)
+    for(size_t j = 0; j < polygons[i].size(); j++) {
+      const Vector2d &v = polygons[i][j];
+      min.x() = MIN(min.x(), v.x()); min.y() = MIN(min.y(), v.y());
+      max.x() = MAX(max.x(), v.x()); max.y() = MAX(max.y(), v.y());
+    }
+  return min.x() <= max.x();
+}
 
 void FlatShape::invertNormals()
 {
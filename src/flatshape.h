@@ -55,7 +55,10 @@ class FlatShape : public Shape
   /* void draw (const Model *model, const Settings &settings, */
   /* 	     bool highlight=false); */
 
-  void draw_geometry (uint max_triangles=0);
+  void draw_geometry (uint max_triangles=0, bool interactive=false);
+  // hit with the plane z=0 inside a polygon
+  bool intersectRay(const Vector3d &origin, const Vector3d &dir,
+		    double &t) const;
   /* void drawBBox() const;  */
   /*void CenterAroundXY();*/
 
@@ -64,6 +67,7 @@ class FlatShape : public Shape
   // Auto-Rotate object to have the largest area surface down for printing:
   /* void OptimizeRotation();  */
   void CalcBBox();
+  bool getOutlineBounds(Vector2d &min, Vector2d &max) const;
 
   // Rotation for manual rotate and used by OptimizeRotation:
   void Rotate(const Vector3d & axis, const double &angle);
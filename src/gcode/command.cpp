@@ -28,6 +28,7 @@
 
 #include "model.h"
 #include "ui/progress.h"
+#include "profile.h"
 #include "geometry.h"
 #include "ctype.h"
 
@@ -294,6 +295,7 @@ string Command::GetGCodeText(Vector3d &LastPos, double &lastE, double &lastF,
 			     bool relativeEcode, const char E_letter,
 			     bool speedAlways) const
 {
+  TRACE_SCOPE("Command::GetGCodeText");
   ostringstream ostr;
   if (Code > NUM_GCODES || MCODES[Code]=="") {
     cerr << "Don't know GCode for Command type "<< Code <<endl;
@@ -444,7 +446,9 @@ string Command::GetGCodeText(Vector3d &LastPos, double &lastE, double &lastF,
 }
 
 
-void draw_arc(Vector3d &lastPos, Vector3d center, double angle, double dz, short ccw)
+// line segments of an arc, appended as pairs of end points
+void arc_points(Vector3d &lastPos, Vector3d center, double angle, double dz, short ccw,
+		vector<Vector3d> &points)
 {
   Vector3d arcpoint;
   Vector3d radiusv = lastPos-center;
@@ -457,12 +461,57 @@ void draw_arc(Vector3d &lastPos, Vector3d center, double angle, double dz, short
   for (long double a = 0; abs(a) < abs(angle); a+=astep){
     arcpoint = center + radiusv.rotate(a, axis);
     if (dz!=0 && angle!=0) arcpoint.z() = startZ + dz*a/angle;
-    glVertex3dv(lastPos);
-    glVertex3dv(arcpoint);
+    points.push_back(lastPos);
+    points.push_back(arcpoint);
     lastPos = arcpoint;
   }
 }
 
+void draw_arc(Vector3d &lastPos, Vector3d center, double angle, double dz, short ccw)
+{
+  vector<Vector3d> points;
+  arc_points(lastPos, center, angle, dz, ccw, points);
+  for (uint i = 0; i < points.size(); i++)
+    glVertex3dv(points[i]);
+}
+
+long double arc_angle(const Vector3d &P, const Vector3d &Q, bool ccw)
+{
+  long double angle;
+  if (P==Q) angle = 2*M_PI;
+  else {
+#if 0  // marlin calculation (motion_control.cpp)
+    angle = atan2(P.x()*Q.y()-P.y()*Q.x(), P.x()*Q.x()+P.y()*Q.y());
+    if (angle < 0) angle += 2*M_PI;
+    if (!ccw) angle-=2*M_PI; // angle sign determines rotation
+#else
+    angle = angleBetween(P,Q); // ccw angle
+    if (!ccw) angle=-angle;
+    if (angle < 0) angle += 2*M_PI;  // alway positive, ccw determines rotation
+#endif
+  }
+  return angle;
+}
+
+void Command::getLinePoints(Vector3d &lastPos, const Vector3d &offset,
+			    vector<Vector3d> &points) const
+{
+  Vector3d off_where = where + offset;
+  Vector3d off_lastPos = lastPos + offset;
+  if (Code == ARC_CW || Code == ARC_CCW) {
+    Vector3d center = off_lastPos + arcIJK;
+    Vector3d P = -arcIJK, Q = off_where-center; // arc endpoints
+    bool ccw = (Code == ARC_CCW);
+    double dz = off_where.z()-(off_lastPos).z(); // z move with arc
+    arc_points(off_lastPos, center, arc_angle(P, Q, ccw), dz, ccw, points);
+  }
+  if (off_lastPos != off_where) {
+    points.push_back(off_lastPos);
+    points.push_back(off_where);
+  }
+  lastPos = where;
+}
+
 void Command::draw(Vector3d &lastPos, const Vector3d &offset,
 		   double extrwidth,
 		   bool arrows,  bool debug_arcs) const
@@ -493,19 +542,7 @@ void Command::draw(Vector3d &lastPos, const Vector3d &offset,
       else
 	glColor4f(1.f,0.5f,0.0f,lum);
     }
-    long double angle;
-    if (P==Q) angle = 2*M_PI;
-    else {
-#if 0  // marlin calculation (motion_control.cpp)
-      angle = atan2(P.x()*Q.y()-P.y()*Q.x(), P.x()*Q.x()+P.y()*Q.y());
-      if (angle < 0) angle += 2*M_PI;
-      if (!ccw) angle-=2*M_PI; // angle sign determines rotation
-#else
-      angle = angleBetween(P,Q); // ccw angle
-      if (!ccw) angle=-angle;
-      if (angle < 0) angle += 2*M_PI;  // alway positive, ccw determines rotation
-#endif
-    }
+    long double angle = arc_angle(P, Q, ccw);
     //if (abs(angle) < 0.00001) angle = 0;
     double dz = off_where.z()-(off_lastPos).z(); // z move with arc
     Vector3d arcstart = off_lastPos;
@@ -139,6 +139,9 @@ const string MCODES[] = {"G92", "", "",
 class Model;
 class ViewProgress;
 
+// rotation angle of an arc from P to Q around the center (always positive)
+long double arc_angle(const Vector3d &P, const Vector3d &Q, bool ccw);
+
 class Command
 {
 public:
@@ -173,6 +176,10 @@ public:
 		  bool debug_arcs = false) const;
 	void draw(Vector3d &lastPos, const Vector3d &offset, double extrwidth,
 		  bool arrows=true, bool debug_arcs = false) const;
+	// line segments as drawn by draw(), appended as pairs of end points;
+	// without arrows, arc debugging and extrusion boundaries
+	void getLinePoints(Vector3d &lastPos, const Vector3d &offset,
+			   vector<Vector3d> &points) const;
 
 	bool hasNoEffect(const Vector3d LastPos, const double lastE,
 			 const double lastF, const bool relativeEcode) const;
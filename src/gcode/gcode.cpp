@@ -28,6 +28,7 @@
 #include "model.h"
 #include "ui/progress.h"
 #include "geometry.h"
+#include "motionplanner.h"
 #include "ctype.h"
 #include "settings.h"
 #include "render.h"
@@ -42,6 +43,11 @@ GCode::GCode()
   buffer = Gtk::TextBuffer::create();
 }
 
+GCode::~GCode()
+{
+  clearDisplayBuffers();
+}
+
 
 void GCode::clear()
 {
@@ -55,6 +61,7 @@ void GCode::clear()
   if (gl_List>=0)
     glDeleteLists(gl_List,1);
   gl_List = -1;
+  clearDisplayBuffers();
 }
 
 
@@ -82,24 +89,82 @@ void GCode::translate(Vector3d trans)
   Min+=trans;
   Max+=trans;
   Center+=trans;
+  clearDisplayBuffers();
 }
 
 
-double GCode::GetTimeEstimation() const
+// simulate the movements with the acceleration of the printer,
+// optionally giving the time of each layer (from layerchanges)
+double GCode::GetTimeEstimation(const Settings &settings,
+				vector<double> *layertimes) const
 {
-  Vector3d where(0,0,0);
-  double time = 0, feedrate=0, distance=0;
+  MotionPlanner planner(settings.Hardware);
+  const bool relativeE = settings.Slicing.RelativeEcode;
+  double feedrate = 0, lastE = 0;
+  uint layer = 0; // tag: layers started before command
   for (uint i=0; i<commands.size(); i++)
 	{
-	  if(commands[i].f!=0)
-		feedrate = commands[i].f;
-	  if (feedrate!=0) {
-	    distance = (commands[i].where - where).length();
-	    time += distance/feedrate*60.;
+	  const Command &command = commands[i];
+	  while (layer < layerchanges.size() && layerchanges[layer] <= i)
+	    layer++;
+	  if (command.f!=0)
+	    feedrate = command.f;
+	  switch (command.Code) {
+	  case GOTO:
+	  case SETCURRENTPOS:
+	    planner.flush();
+	    planner.setPosition(command.where);
+	    lastE = command.e;
+	    break;
+	  case RESET_E:
+	    lastE = 0;
+	    break;
+	  case GOHOME:
+	    planner.flush();
+	    planner.setPosition(Vector3d::ZERO);
+	    break;
+	  case ARC_CW:
+	  case ARC_CCW:
+	    {
+	      const Vector3d from = planner.getPosition();
+	      const Vector3d center = from + command.arcIJK;
+	      const Vector3d P = -command.arcIJK, Q = command.where - center;
+	      const bool ccw = (command.Code == ARC_CCW);
+	      const double angle = arc_angle(P, Q, ccw);
+	      const double dz = command.where.z() - from.z();
+	      const double arclen = P.length() * angle;
+	      // tangents at start and end
+	      Vector3d startdir(-P.y(), P.x(), 0), enddir(-Q.y(), Q.x(), 0);
+	      if (!ccw) { startdir = -startdir; enddir = -enddir; }
+	      startdir.normalize(); enddir.normalize();
+	      planner.move(sqrt(arclen*arclen + dz*dz), startdir, enddir,
+			   feedrate, layer);
+	      planner.setPosition(command.where);
+	      if (command.e != 0) lastE = command.e;
+	      break;
+	    }
+	  case COORDINATEDMOTION:
+	  case RAPIDMOTION:
+	    if (command.where == planner.getPosition()) {
+	      // extruder only
+	      if (command.e != 0) {
+		const double de = relativeE ? command.e : command.e - lastE;
+		planner.extrude(abs(de), feedrate, layer);
+	      }
+	    } else
+	      planner.move(command.where, feedrate, layer);
+	    if (command.e != 0) lastE = command.e;
+	    break;
+	  default:
+	    break;
 	  }
-	  where = commands[i].where ;
 	}
-  return time;
+  if (layertimes) {
+    layertimes->assign(layerchanges.size(), 0.);
+    for (uint l = 0; l < layerchanges.size(); l++)
+      (*layertimes)[l] = planner.tagTime(l+1);
+  }
+  return planner.totalTime();
 }
 
 string getLineAt(const Glib::RefPtr<Gtk::TextBuffer> buffer, int lineno)
@@ -321,6 +386,7 @@ void GCode::Read(Model *model, const vector<char> E_letters,
 	reset_locales();
 
 	commands = loaded_commands;
+	clearDisplayBuffers();
 
 	buffer->set_text(alltext.str());
 
@@ -328,7 +394,7 @@ void GCode::Read(Model *model, const vector<char> E_letters,
 
 	model->m_signal_gcode_changed.emit();
 
-	double time = GetTimeEstimation();
+	double time = GetTimeEstimation(model->settings);
 	int h = (int)time/3600;
 	int min = ((int)time%3600)/60;
 	int sec = ((int)time-3600*h-60*min);
@@ -428,9 +494,16 @@ void GCode::draw(const Settings &settings, int layer,
           }
 	}
 
-	drawCommands(settings, start, end, liveprinting, linewidth,
-		     arrows && settings.Display.DisplayGCodeArrows,
-		     !liveprinting && settings.Display.DisplayGCodeBorders);
+	arrows = arrows && settings.Display.DisplayGCodeArrows;
+	bool boundary = !liveprinting && settings.Display.DisplayGCodeBorders;
+	// buffers have plain lines only
+	if (liveprinting || arrows || boundary
+	    || settings.Display.DisplayDebugArcs
+	    || settings.Display.DebugGCodeExtruders)
+	  drawCommands(settings, start, end, liveprinting, linewidth,
+		       arrows, boundary);
+	else
+	  drawBuffered(settings, start, end, linewidth);
 
 	if (currentCursorWhere!=Vector3d::ZERO) {
 	  glDisable(GL_DEPTH_TEST);
@@ -475,8 +548,6 @@ void GCode::drawCommands(const Settings &settings, uint start, uint end,
 	Vector3d defaultpos(0,0,0);
 	Vector3d pos(0,0,0);
 
-	bool relativeE = settings.Slicing.RelativeEcode;
-
 	bool debug_arcs = settings.Display.DisplayDebugArcs;
 
 	double extrusionwidth = 0;
@@ -552,36 +623,19 @@ void GCode::drawCommands(const Settings &settings, uint start, uint end,
 		  }
 		case COORDINATEDMOTION:
 		  {
-		    double speed = commands[i].f;
-		    double luma = 1.;
-		    if( (!relativeE && commands[i].e == LastE)
-			|| (relativeE && commands[i].e == 0) ) // move only
-		      {
-			if (settings.Display.DisplayGCodeMoves) {
-			  luma = 0.3 + 0.7 * speed / settings.Hardware.MaxMoveSpeedXY / 60;
-			  Color = settings.Display.GCodeMoveColour;
-			  extrwidth = 0;
-			} else {
-			   pos = commands[i].where;
-			   break;
-			}
-		      }
-		    else
-		      {
-			luma = 0.3 + 0.7 * speed / settings.Extruder.MaxLineSpeed / 60;
-			if (liveprinting) {
-			  Color = settings.Display.GCodePrintingColour;
-			} else {
-			  Color = settings.Extruders[commands[i].extruder_no].DisplayColour;
-			}
-			if (settings.Display.DebugGCodeExtruders) {
-			  ostringstream o; o << commands[i].extruder_no+1;
-			  Render::draw_string( (pos + commands[i].where) / 2. + extruder_offset,
-					       o.str());
-			}
-		      }
-		    if (settings.Display.LuminanceShowsSpeed)
-		      Color *= luma;
+		    bool is_move;
+		    if (!getCommandColour(settings, commands[i], LastE, liveprinting,
+					  Color, is_move)) {
+		      pos = commands[i].where;
+		      break;
+		    }
+		    if (is_move)
+		      extrwidth = 0;
+		    else if (settings.Display.DebugGCodeExtruders) {
+		      ostringstream o; o << commands[i].extruder_no+1;
+		      Render::draw_string( (pos + commands[i].where) / 2. + extruder_offset,
+					   o.str());
+		    }
 		    commands[i].draw(pos, extruder_offset, linewidth,
 				     Color, extrwidth, arrows, debug_arcs);
 		    LastE=commands[i].e;
@@ -606,6 +660,151 @@ void GCode::drawCommands(const Settings &settings, uint start, uint end,
   // glCallList(gl_List);
 }
 
+// Display colour of a line or arc, returns false if it is not displayed
+bool GCode::getCommandColour(const Settings &settings, const Command &command,
+			     double lastE, bool liveprinting,
+			     Vector4f &colour, bool &is_move) const
+{
+  const bool relativeE = settings.Slicing.RelativeEcode;
+  double luma = 1.;
+  is_move = (!relativeE && command.e == lastE) || (relativeE && command.e == 0);
+  if (is_move) {
+    if (!settings.Display.DisplayGCodeMoves) return false;
+    luma = 0.3 + 0.7 * command.f / settings.Hardware.MaxMoveSpeedXY / 60;
+    colour = settings.Display.GCodeMoveColour;
+  } else {
+    luma = 0.3 + 0.7 * command.f / settings.Extruder.MaxLineSpeed / 60;
+    if (liveprinting)
+      colour = settings.Display.GCodePrintingColour;
+    else
+      colour = settings.Extruders[command.extruder_no].DisplayColour;
+  }
+  if (settings.Display.LuminanceShowsSpeed)
+    colour *= luma;
+  return true;
+}
+
+// all display settings that go into the buffers
+string GCode::getBuffersKey(const Settings &settings) const
+{
+  ostringstream key;
+  key << commands.size() << " "
+      << settings.Slicing.RelativeEcode
+      << settings.Display.DisplayGCodeMoves
+      << settings.Display.LuminanceShowsSpeed
+      << settings.Display.DebugGCodeOffset << " "
+      << settings.Hardware.MaxMoveSpeedXY << " "
+      << settings.Extruder.MaxLineSpeed << " "
+      << settings.Display.GCodeMoveColour;
+  for (uint e = 0; e < settings.Extruders.size(); e++)
+    key << " " << settings.Extruders[e].DisplayColour
+	<< settings.Extruders[e].OffsetX << "," << settings.Extruders[e].OffsetY;
+  return key.str();
+}
+
+void GCode::clearDisplayBuffers()
+{
+  for (uint b = 0; b < NUM_LINEBUFFERS; b++) {
+    line_buffers[b].clear();
+    buffer_starts[b].clear();
+  }
+  buffers_key = "";
+}
+
+// same walk as drawCommands() over all commands, collecting the lines
+void GCode::makeDisplayBuffers(const Settings &settings)
+{
+  clearDisplayBuffers();
+  const uint n_cmds = commands.size();
+  for (uint b = 0; b < NUM_LINEBUFFERS; b++)
+    buffer_starts[b].resize(n_cmds + 1);
+
+  Vector3d pos(0,0,0);
+  Vector3d last_extruder_offset = Vector3d::ZERO;
+  double LastE = 0.0;
+  Vector4f Color;
+  vector<Vector3d> points;
+  for (uint i = 0; i < n_cmds; i++) {
+    for (uint b = 0; b < NUM_LINEBUFFERS; b++)
+      buffer_starts[b][i] = line_buffers[b].size();
+    Vector3d extruder_offset = Vector3d::ZERO;
+    if (!settings.Display.DebugGCodeOffset) {
+      extruder_offset = settings.get_extruder_offset(commands[i].extruder_no);
+      pos -= extruder_offset - last_extruder_offset;
+      last_extruder_offset = extruder_offset;
+    }
+    if (commands[i].is_value) continue;
+    const GCodes code = commands[i].Code;
+    if (code == ARC_CW || code == ARC_CCW || code == COORDINATEDMOTION) {
+      if (i == 0 && code != COORDINATEDMOTION) continue;
+      bool is_move;
+      if (!getCommandColour(settings, commands[i], LastE, false,
+			    Color, is_move)) {
+	pos = commands[i].where;
+	continue;
+      }
+      LastE = commands[i].e;
+    } else if (code == RAPIDMOTION) {
+      Color = settings.Display.GCodeMoveColour;
+    } else
+      continue;
+    uint b = (code == RAPIDMOTION) ? LINES_RAPID : LINES_NORMAL;
+    if (commands[i].abs_extr != 0) b++; // drawn double width
+    points.clear();
+    commands[i].getLinePoints(pos, extruder_offset, points);
+    for (uint p = 0; p < points.size(); p++)
+      line_buffers[b].add(points[p], Color);
+  }
+  for (uint b = 0; b < NUM_LINEBUFFERS; b++)
+    buffer_starts[b][n_cmds] = line_buffers[b].size();
+  buffers_key = getBuffersKey(settings);
+}
+
+// like drawCommands(settings, start, end, false, linewidth, false, false)
+void GCode::drawBuffered(const Settings &settings, uint start, uint end, int linewidth)
+{
+  uint n_cmds = commands.size();
+  if (n_cmds==0) return;
+  start = CLAMP (start, 0, n_cmds-1);
+  end = CLAMP (end, 0, n_cmds-1);
+  if (end<=start) return;
+
+  if (buffers_key != getBuffersKey(settings))
+    makeDisplayBuffers(settings);
+
+  // drawCommands starts at the first position in range
+  Vector3d pos(0,0,0);
+  uint first = start;
+  if (start>0) {
+    Vector3d defaultpos(0,0,0);
+    while ((commands[first].is_value || commands[first].where == defaultpos)
+	   && first < end)
+      first++;
+    pos = commands[first].where;
+    first++;
+  }
+
+  glEnable(GL_BLEND);
+  glDisable(GL_CULL_FACE);
+  glDisable(GL_LIGHTING);
+
+  // draw begin
+  glPointSize(20);
+  glBegin(GL_POINTS);
+  glVertex3dv((GLdouble*)&pos);
+  glEnd();
+
+  const float widths[NUM_LINEBUFFERS] = { (float)linewidth, 2.f*linewidth, 1.f, 2.f };
+  for (uint b = 0; b < NUM_LINEBUFFERS; b++) {
+    const uint from = buffer_starts[b][first];
+    const uint to   = buffer_starts[b][end+1];
+    if (to <= from) continue;
+    glLineWidth(widths[b]);
+    line_buffers[b].draw(GL_LINES, from, to - from);
+  }
+  glLineWidth(1);
+}
+
 // bool add_text_filter_nan(string str, string &GcodeTxt)
 // {
 //   if (int(str.find("nan"))<0)
@@ -624,10 +823,22 @@ void GCode::MakeText(string &GcodeTxt,
 		     const Settings &settings,
 		     ViewProgress * progress)
 {
-  string GcodeStart = settings.GCode.getStartText();
-  string GcodeLayer = settings.GCode.getLayerText();
-  string GcodeEnd   = settings.GCode.getEndText();
+  MakeCommandText(GcodeTxt, settings, settings.GCode.getStartText(),
+		  settings.GCode.getLayerText(), settings.GCode.getEndText(),
+		  progress);
+  SetText(GcodeTxt);
+  if (progress) progress->stop();
+}
 
+// the text of the commands, without touching the text buffer,
+// so it can be made in a worker thread
+void GCode::MakeCommandText(string &GcodeTxt,
+			    const Settings &settings,
+			    const string &GcodeStart,
+			    const string &GcodeLayer,
+			    const string &GcodeEnd,
+			    ViewProgress * progress)
+{
 	double lastE = -10;
 	double lastF = 0; // last Feedrate (can be omitted when same)
 	Vector3d pos(0,0,0);
@@ -677,7 +888,10 @@ void GCode::MakeText(string &GcodeTxt,
 	}
 
 	GcodeTxt += "\n; End GCode\n" + GcodeEnd + "\n";
+}
 
+void GCode::SetText(const string &GcodeTxt)
+{
 	buffer->set_text (GcodeTxt);
 
 	// save zpos line numbers for faster finding
@@ -689,9 +903,20 @@ void GCode::MakeText(string &GcodeTxt,
 	      line.find("z") != string::npos)
 	    buffer_zpos_lines.push_back(i);
 	}
+}
 
-	if (progress) progress->stop();
-
+// take over the commands of another GCode, in the main thread
+void GCode::swapCommands(GCode &other)
+{
+  commands.swap(other.commands);
+  layerchanges.swap(other.layerchanges);
+  std::swap(Min, other.Min);
+  std::swap(Max, other.Max);
+  std::swap(Center, other.Center);
+  if (gl_List>=0)
+    glDeleteLists(gl_List,1);
+  gl_List = -1;
+  clearDisplayBuffers();
 }
 
 // void GCode::Write (Model *model, string filename)
@@ -769,10 +994,10 @@ bool GCodeIter::finished()
   return m_cur_line > m_line_count;
 }
 
-GCodeIter *GCode::get_iter ()
+GCodeIter *GCode::get_iter (const Settings &settings)
 {
   GCodeIter *iter = new GCodeIter (buffer);
-  iter->time_estimation = GetTimeEstimation();
+  iter->time_estimation = GetTimeEstimation(settings);
   return iter;
 }
 
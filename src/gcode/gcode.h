@@ -27,6 +27,7 @@
 #include <sstream>
 
 #include "command.h"
+#include "vertexbuffer.h"
 
 class GCodeImpl;
 class RepRapSerial;
@@ -54,8 +55,26 @@ class GCode
 
     int gl_List;
 
+    // Preview lines of all commands, one buffer per line width
+    // (normal/thick extrusion, normal/thick rapid moves).
+    // Rebuilt only when the commands or display settings change,
+    // drawing a range of commands just selects a range of vertices.
+    enum { LINES_NORMAL, LINES_THICK, LINES_RAPID, LINES_RAPID_THICK, NUM_LINEBUFFERS };
+    VertexBuffer line_buffers[NUM_LINEBUFFERS];
+    vector<uint> buffer_starts[NUM_LINEBUFFERS]; // first vertex of each command
+    string buffers_key;
+    string getBuffersKey(const Settings &settings) const;
+    void makeDisplayBuffers(const Settings &settings);
+    void clearDisplayBuffers();
+    void drawBuffered(const Settings &settings, uint start, uint end, int linewidth);
+
+    bool getCommandColour(const Settings &settings, const Command &command,
+			  double lastE, bool liveprinting,
+			  Vector4f &colour, bool &is_move) const;
+
 public:
   GCode();
+  ~GCode();
 
   void Read  (Model *model, const vector<char> E_letters,
 	      ViewProgress *progress, string filename);
@@ -67,6 +86,13 @@ public:
 		    bool liveprinting, int linewidth, bool arrows, bool boundary=false);
   void MakeText(string &GcodeTxt, const Settings &settings,
 		ViewProgress * progress);
+  // start, layer and end texts given, as they are read from the
+  // settings' text buffers, which must be done in the gui thread
+  void MakeCommandText(string &GcodeTxt, const Settings &settings,
+		       const string &GcodeStart, const string &GcodeLayer,
+		       const string &GcodeEnd, ViewProgress * progress);
+  void SetText(const string &GcodeTxt);
+  void swapCommands(GCode &other);
 
   //bool append_text (const std::string &line);
   std::string get_text() const;
@@ -80,10 +106,12 @@ public:
   void translate(Vector3d trans);
 
   Glib::RefPtr<Gtk::TextBuffer> buffer;
-  GCodeIter *get_iter ();
+  GCodeIter *get_iter (const Settings &settings);
 
   double GetTotalExtruded(bool relativeEcode) const;
-  double GetTimeEstimation() const;
+  // seconds, with acceleration from the hardware settings
+  double GetTimeEstimation(const Settings &settings,
+			   vector<double> *layertimes = NULL) const;
 
   void updateWhereAtCursor(const vector<char> &E_letters);
   Vector3d currentCursorWhere;
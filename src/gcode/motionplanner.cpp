@@ -0,0 +1,183 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "motionplanner.h"
+
+
+double trapezoidTime(double length, double entry, double nominal, double exit,
+		     double acceleration)
+{
+  if (length <= 0 || nominal <= 0) return 0;
+  if (acceleration <= 0) return length / nominal;
+  entry = MIN(entry, nominal);
+  exit  = MIN(exit,  nominal);
+  const double twoa = 2 * acceleration;
+  const double accel_dist = (nominal*nominal - entry*entry) / twoa;
+  const double decel_dist = (nominal*nominal - exit*exit)   / twoa;
+  if (accel_dist + decel_dist <= length) // reaches nominal speed
+    return (nominal - entry) / acceleration + (nominal - exit) / acceleration
+      + (length - accel_dist - decel_dist) / nominal;
+  // triangle: accelerate to peak, then decelerate
+  double peak = sqrt((twoa * length + entry*entry + exit*exit) / 2);
+  peak = MAX(peak, MAX(entry, exit));
+  return (peak - entry) / acceleration + (peak - exit) / acceleration;
+}
+
+
+MotionPlanner::MotionPlanner(const Settings::HardwareSettings &hardware)
+  : acceleration(hardware.Acceleration),
+    junction_deviation(hardware.JunctionDeviation),
+    max_speed_z(hardware.MaxMoveSpeedZ),
+    position(0,0,0), total_time(0)
+{
+}
+
+MotionPlanner::MotionPlanner(double acceleration, double junction_deviation,
+			     double max_speed_z)
+  : acceleration(acceleration), junction_deviation(junction_deviation),
+    max_speed_z(max_speed_z),
+    position(0,0,0), total_time(0)
+{
+}
+
+void MotionPlanner::move(const Vector3d &to, double feedrate, uint tag)
+{
+  const Vector3d d = to - position;
+  position = to;
+  const double length = d.length();
+  if (length == 0) return;
+  const Vector3d dir = d / length;
+  move(length, dir, dir, feedrate, tag);
+}
+
+void MotionPlanner::move(double length, const Vector3d &startdir,
+			 const Vector3d &enddir, double feedrate, uint tag)
+{
+  if (length <= 0 || feedrate <= 0) return;
+  Block block;
+  block.length = length;
+  block.nominal_speed = feedrate / 60.;
+  if (max_speed_z > 0 && abs(startdir.z()) > 0.0001)
+    block.nominal_speed = MIN(block.nominal_speed, max_speed_z / abs(startdir.z()));
+  block.startdir = startdir;
+  block.enddir   = enddir;
+  block.tag = tag;
+  addBlock(block);
+}
+
+void MotionPlanner::extrude(double length, double feedrate, uint tag)
+{
+  if (length <= 0 || feedrate <= 0) return;
+  Block block;
+  block.length = length;
+  block.nominal_speed = feedrate / 60.;
+  block.startdir = block.enddir = Vector3d::ZERO;
+  block.tag = tag;
+  addBlock(block);
+}
+
+void MotionPlanner::dwell(double seconds, uint tag)
+{
+  flush();
+  addTime(seconds, tag);
+}
+
+double MotionPlanner::tagTime(uint tag)
+{
+  flush();
+  if (tag < tag_times.size()) return tag_times[tag];
+  return 0;
+}
+
+void MotionPlanner::addTime(double time, uint tag)
+{
+  if (tag >= tag_times.size()) tag_times.resize(tag+1, 0.);
+  tag_times[tag] += time;
+  total_time += time;
+}
+
+// highest speed (mm/s) to go from prev to next, by the deviation
+// of a circle touching both directions (as in grbl)
+double MotionPlanner::junctionSpeed(const Block &prev, const Block &next) const
+{
+  if (prev.enddir == Vector3d::ZERO || next.startdir == Vector3d::ZERO)
+    return 0;
+  const double cos_theta = -prev.enddir.dot(next.startdir);
+  if (cos_theta > 0.999999)  return 0;     // reversal
+  if (cos_theta < -0.999999) return INFTY; // straight on
+  const double sin_half = sqrt(0.5 * (1 - cos_theta));
+  return sqrt(acceleration * junction_deviation * sin_half / (1 - sin_half));
+}
+
+void MotionPlanner::addBlock(Block &block)
+{
+  if (acceleration <= 0) {
+    addTime(block.length / block.nominal_speed, block.tag);
+    return;
+  }
+  if (blocks.empty()) { // starting from rest
+    block.max_entry = 0;
+  } else {
+    const Block &prev = blocks.back();
+    block.max_entry = MIN(junctionSpeed(prev, block),
+			  MIN(prev.nominal_speed, block.nominal_speed));
+  }
+  block.entry = 0;
+  blocks.push_back(block);
+  if (blocks.size() > LOOKAHEAD) {
+    plan();
+    retire(blocks[1].entry);
+  }
+}
+
+// entry speeds for the buffered blocks, stopping after the last one;
+// the first block's entry is fixed, it has been started already
+void MotionPlanner::plan()
+{
+  const uint n = blocks.size();
+  double next_entry = 0;
+  for (int k = n-1; k > 0; k--) {
+    Block &b = blocks[k];
+    b.entry = MIN(b.max_entry,
+		  sqrt(next_entry*next_entry + 2 * acceleration * b.length));
+    next_entry = b.entry;
+  }
+  for (uint k = 1; k < n; k++) {
+    const Block &prev = blocks[k-1];
+    blocks[k].entry = MIN(blocks[k].entry,
+			  sqrt(prev.entry*prev.entry
+			       + 2 * acceleration * prev.length));
+  }
+}
+
+void MotionPlanner::retire(double exit_speed)
+{
+  const Block &b = blocks.front();
+  addTime(trapezoidTime(b.length, b.entry, b.nominal_speed, exit_speed,
+			acceleration), b.tag);
+  blocks.pop_front();
+}
+
+void MotionPlanner::flush()
+{
+  if (blocks.empty()) return;
+  plan();
+  while (!blocks.empty())
+    retire(blocks.size() > 1 ? blocks[1].entry : 0.);
+}
@@ -0,0 +1,92 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+#include <deque>
+
+#include "stdafx.h"
+#include "settings.h"
+
+// Simulates the motion planner of the firmware to estimate print times:
+// moves accelerate and decelerate with constant acceleration (trapezoids),
+// the speed through a corner is limited by the junction deviation,
+// and a few moves are planned ahead as in the firmware's buffer.
+// Feedrates are in mm/min as in the GCode, times in seconds.
+// Each move's time is summed up for a tag given with it (a layer
+// number, extruding or not, ...).
+class MotionPlanner
+{
+ public:
+  MotionPlanner(const Settings::HardwareSettings &hardware);
+  MotionPlanner(double acceleration, double junction_deviation,
+		double max_speed_z = 0);
+
+  void setPosition(const Vector3d &pos) { position = pos; }
+  const Vector3d &getPosition() const { return position; }
+
+  // straight move from the current position
+  void move(const Vector3d &to, double feedrate, uint tag = 0);
+  // move of given length and directions at start and end (arcs)
+  void move(double length, const Vector3d &startdir, const Vector3d &enddir,
+	    double feedrate, uint tag = 0);
+  // extruder-only move (retract), the axes stop before and after
+  void extrude(double length, double feedrate, uint tag = 0);
+  // pause after all moves are done
+  void dwell(double seconds, uint tag = 0);
+
+  // stop at the end of the last move and count all buffered moves
+  void flush();
+
+  double totalTime() { flush(); return total_time; }
+  const vector<double> &tagTimes() { flush(); return tag_times; }
+  double tagTime(uint tag);
+
+  static const uint LOOKAHEAD = 16;
+
+ private:
+  double acceleration;       // mm/s^2, 0: no acceleration limit
+  double junction_deviation; // mm
+  double max_speed_z;        // mm/s, 0: none
+  Vector3d position;
+
+  struct Block {
+    double length;
+    double nominal_speed; // mm/s
+    double max_entry;     // limit from speeds and junction
+    double entry;         // planned entry speed
+    Vector3d startdir, enddir; // unit vectors, zero: stop at both ends
+    uint tag;
+  };
+  std::deque<Block> blocks;
+  double total_time;
+  vector<double> tag_times;
+
+  void addBlock(Block &block);
+  void plan();
+  void retire(double exit_speed);
+  double junctionSpeed(const Block &prev, const Block &next) const;
+  void addTime(double time, uint tag);
+};
+
+// time (s) to move length with entry, nominal and exit speeds (mm/s)
+// at constant acceleration (mm/s^2)
+double trapezoidTime(double length, double entry, double nominal, double exit,
+		     double acceleration);
@@ -0,0 +1,622 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "stdafx.h"
+#include "meshlod.h"
+#include "vertexbuffer.h"
+#include "printer/thread.h"
+
+#include <string.h>
+
+
+////////////////////////////// simplification ////////////////////////////
+
+namespace {
+
+// symmetric 4x4 matrix of the quadric error, upper triangle
+struct SymMat
+{
+  double m[10];
+  SymMat() { memset(m, 0, sizeof(m)); }
+  // quadric of the plane ax+by+cz+d=0
+  SymMat(double a, double b, double c, double d) {
+    m[0] = a*a; m[1] = a*b; m[2] = a*c; m[3] = a*d;
+    m[4] = b*b; m[5] = b*c; m[6] = b*d;
+    m[7] = c*c; m[8] = c*d;
+    m[9] = d*d;
+  }
+  double det(int a11, int a12, int a13,
+	     int a21, int a22, int a23,
+	     int a31, int a32, int a33) const {
+    return m[a11]*m[a22]*m[a33] + m[a13]*m[a21]*m[a32] + m[a12]*m[a23]*m[a31]
+      - m[a13]*m[a22]*m[a31] - m[a11]*m[a23]*m[a32] - m[a12]*m[a21]*m[a33];
+  }
+  SymMat operator+(const SymMat &o) const {
+    SymMat s;
+    for (uint i = 0; i < 10; i++) s.m[i] = m[i] + o.m[i];
+    return s;
+  }
+  SymMat &operator+=(const SymMat &o) {
+    for (uint i = 0; i < 10; i++) m[i] += o.m[i];
+    return *this;
+  }
+  // squared distance sum of p to the planes
+  double error(const Vector3d &p) const {
+    const double x = p.x(), y = p.y(), z = p.z();
+    return m[0]*x*x + 2*m[1]*x*y + 2*m[2]*x*z + 2*m[3]*x
+      + m[4]*y*y + 2*m[5]*y*z + 2*m[6]*y
+      + m[7]*z*z + 2*m[8]*z + m[9];
+  }
+};
+
+struct QTriangle
+{
+  int v[3];
+  double err[4]; // of the 3 edges, minimum
+  bool deleted, dirty;
+  Vector3d n;
+};
+
+struct QVertex
+{
+  Vector3d p;
+  int tstart, tcount; // range in refs
+  SymMat q;
+  bool border;
+};
+
+struct QRef
+{
+  int tid, tvertex;
+};
+
+// position order for welding the triangle soup
+struct PositionLess
+{
+  const vector<Vector3d> &pos;
+  PositionLess(const vector<Vector3d> &pos) : pos(pos) {}
+  bool operator()(uint a, uint b) const {
+    const Vector3d &A = pos[a], &B = pos[b];
+    if (A.x() != B.x()) return A.x() < B.x();
+    if (A.y() != B.y()) return A.y() < B.y();
+    return A.z() < B.z();
+  }
+};
+
+// The iterative threshold variant of quadric edge collapse:
+// instead of a priority queue all edges below a growing error
+// threshold are collapsed in each pass, which is much faster
+// and needs no extra memory.
+class QuadricSimplifier
+{
+  vector<QTriangle> tris;
+  vector<QVertex> verts;
+  vector<QRef> refs;
+  Vector3d offset;
+  double scale;
+
+  double vertexError(const SymMat &q, const Vector3d &p) const { return q.error(p); }
+  double calculateError(int id_v1, int id_v2, Vector3d &p_result) const;
+  bool flipped(const Vector3d &p, int i1, const QVertex &v0,
+	       vector<char> &deleted) const;
+  void updateTriangles(int i0, const QVertex &v, const vector<char> &deleted,
+		       uint &deleted_triangles);
+  void updateMesh(int iteration);
+  void compactMesh();
+
+public:
+  QuadricSimplifier(const vector<Triangle> &triangles);
+  void simplify(uint target_count, volatile gint *cancel);
+  void getTriangles(vector<Triangle> &result) const;
+};
+
+QuadricSimplifier::QuadricSimplifier(const vector<Triangle> &triangles)
+{
+  const uint n_tr = triangles.size();
+  vector<Vector3d> pos(3*n_tr);
+  Vector3d min(INFTY,INFTY,INFTY), max(-INFTY,-INFTY,-INFTY);
+  for (uint i = 0; i < n_tr; i++)
+    for (uint j = 0; j < 3; j++) {
+      const Vector3d &p = triangles[i][j];
+      pos[3*i+j] = p;
+      for (uint c = 0; c < 3; c++) {
+	if (p[c] < min[c]) min[c] = p[c];
+	if (p[c] > max[c]) max[c] = p[c];
+      }
+    }
+  // work in unit size so the error thresholds don't depend on the model size
+  offset = (min + max) / 2.;
+  scale = 1;
+  if (n_tr > 0) {
+    const Vector3d size = max - min;
+    const double maxsize = MAX(size.x(), MAX(size.y(), size.z()));
+    if (maxsize > 0) scale = maxsize;
+  }
+
+  // weld equal points to shared vertices
+  vector<uint> order(pos.size());
+  for (uint i = 0; i < order.size(); i++) order[i] = i;
+  std::sort(order.begin(), order.end(), PositionLess(pos));
+  vector<int> vertex_of(pos.size());
+  for (uint i = 0; i < order.size(); i++) {
+    if (i == 0 || pos[order[i]] != pos[order[i-1]]) {
+      QVertex v;
+      v.p = (pos[order[i]] - offset) / scale;
+      v.tstart = v.tcount = 0;
+      v.border = false;
+      verts.push_back(v);
+    }
+    vertex_of[order[i]] = verts.size() - 1;
+  }
+  tris.reserve(n_tr);
+  for (uint i = 0; i < n_tr; i++) {
+    QTriangle t;
+    for (uint j = 0; j < 3; j++) t.v[j] = vertex_of[3*i+j];
+    if (t.v[0] == t.v[1] || t.v[1] == t.v[2] || t.v[2] == t.v[0])
+      continue; // degenerate
+    t.deleted = t.dirty = false;
+    tris.push_back(t);
+  }
+}
+
+// error of collapsing edge v1-v2 and the best new position
+double QuadricSimplifier::calculateError(int id_v1, int id_v2, Vector3d &p_result) const
+{
+  const SymMat q = verts[id_v1].q + verts[id_v2].q;
+  const bool border = verts[id_v1].border && verts[id_v2].border;
+  const double det = q.det(0, 1, 2, 1, 4, 5, 2, 5, 7);
+  if (det != 0 && !border) {
+    // minimum of the quadric
+    p_result = Vector3d(-1/det * q.det(1, 2, 3, 4, 5, 6, 5, 7, 8),
+			 1/det * q.det(0, 2, 3, 1, 5, 6, 2, 7, 8),
+			-1/det * q.det(0, 1, 3, 1, 4, 6, 2, 5, 8));
+    return vertexError(q, p_result);
+  }
+  // singular or border: best of the end points and the middle
+  const Vector3d &p1 = verts[id_v1].p;
+  const Vector3d &p2 = verts[id_v2].p;
+  const Vector3d p3 = (p1 + p2) / 2.;
+  const double error1 = vertexError(q, p1);
+  const double error2 = vertexError(q, p2);
+  const double error3 = vertexError(q, p3);
+  const double error = MIN(error1, MIN(error2, error3));
+  if (error1 == error) p_result = p1;
+  else if (error2 == error) p_result = p2;
+  else p_result = p3;
+  return error;
+}
+
+// would moving v0 to p flip or squash one of its triangles?
+// marks the triangles that get removed by the collapse to i1
+bool QuadricSimplifier::flipped(const Vector3d &p, int i1, const QVertex &v0,
+				vector<char> &deleted) const
+{
+  for (int k = 0; k < v0.tcount; k++) {
+    const QRef &r = refs[v0.tstart + k];
+    const QTriangle &t = tris[r.tid];
+    if (t.deleted) continue;
+    const int id1 = t.v[(r.tvertex + 1) % 3];
+    const int id2 = t.v[(r.tvertex + 2) % 3];
+    if (id1 == i1 || id2 == i1) { // shares the collapsed edge
+      deleted[k] = 1;
+      continue;
+    }
+    Vector3d d1 = verts[id1].p - p;
+    Vector3d d2 = verts[id2].p - p;
+    const double l1 = d1.length(), l2 = d2.length();
+    if (l1 == 0 || l2 == 0) return true;
+    d1 /= l1; d2 /= l2;
+    if (fabs(d1.dot(d2)) > 0.999) return true;
+    Vector3d n = d1.cross(d2);
+    n.normalize();
+    deleted[k] = 0;
+    if (n.dot(t.n) < 0.2) return true;
+  }
+  return false;
+}
+
+// move the triangles of v to vertex i0 and add their refs
+void QuadricSimplifier::updateTriangles(int i0, const QVertex &v,
+					const vector<char> &deleted,
+					uint &deleted_triangles)
+{
+  Vector3d p;
+  for (int k = 0; k < v.tcount; k++) {
+    const QRef r = refs[v.tstart + k];
+    QTriangle &t = tris[r.tid];
+    if (t.deleted) continue;
+    if (deleted[k]) {
+      t.deleted = true;
+      deleted_triangles++;
+      continue;
+    }
+    t.v[r.tvertex] = i0;
+    t.dirty = true;
+    t.err[0] = calculateError(t.v[0], t.v[1], p);
+    t.err[1] = calculateError(t.v[1], t.v[2], p);
+    t.err[2] = calculateError(t.v[2], t.v[0], p);
+    t.err[3] = MIN(t.err[0], MIN(t.err[1], t.err[2]));
+    refs.push_back(r);
+  }
+}
+
+// remove deleted triangles and rebuild the vertex->triangle refs
+void QuadricSimplifier::updateMesh(int iteration)
+{
+  if (iteration > 0) {
+    uint dst = 0;
+    for (uint i = 0; i < tris.size(); i++)
+      if (!tris[i].deleted)
+	tris[dst++] = tris[i];
+    tris.resize(dst);
+  }
+
+  for (uint i = 0; i < verts.size(); i++) {
+    verts[i].tstart = 0;
+    verts[i].tcount = 0;
+  }
+  for (uint i = 0; i < tris.size(); i++)
+    for (uint j = 0; j < 3; j++)
+      verts[tris[i].v[j]].tcount++;
+  int tstart = 0;
+  for (uint i = 0; i < verts.size(); i++) {
+    verts[i].tstart = tstart;
+    tstart += verts[i].tcount;
+    verts[i].tcount = 0;
+  }
+  refs.resize(tris.size() * 3);
+  for (uint i = 0; i < tris.size(); i++)
+    for (uint j = 0; j < 3; j++) {
+      QVertex &v = verts[tris[i].v[j]];
+      refs[v.tstart + v.tcount].tid = i;
+      refs[v.tstart + v.tcount].tvertex = j;
+      v.tcount++;
+    }
+
+  if (iteration > 0) return;
+
+  // border vertices: edges used by only one triangle
+  vector<int> vcount, vids;
+  for (uint i = 0; i < verts.size(); i++) {
+    const QVertex &v = verts[i];
+    vcount.clear();
+    vids.clear();
+    for (int k = 0; k < v.tcount; k++) {
+      const QTriangle &t = tris[refs[v.tstart + k].tid];
+      for (uint j = 0; j < 3; j++) {
+	const int id = t.v[j];
+	uint ofs = 0;
+	while (ofs < vids.size() && vids[ofs] != id) ofs++;
+	if (ofs == vids.size()) {
+	  vids.push_back(id);
+	  vcount.push_back(1);
+	} else
+	  vcount[ofs]++;
+      }
+    }
+    for (uint j = 0; j < vids.size(); j++)
+      if (vcount[j] == 1)
+	verts[vids[j]].border = true;
+  }
+
+  // initial quadrics from the triangle planes
+  for (uint i = 0; i < tris.size(); i++) {
+    QTriangle &t = tris[i];
+    const Vector3d &p0 = verts[t.v[0]].p;
+    Vector3d n = (verts[t.v[1]].p - p0).cross(verts[t.v[2]].p - p0);
+    const double len = n.length();
+    if (len > 0) n /= len;
+    t.n = n;
+    const SymMat q(n.x(), n.y(), n.z(), -n.dot(p0));
+    for (uint j = 0; j < 3; j++)
+      verts[t.v[j]].q += q;
+  }
+  Vector3d p;
+  for (uint i = 0; i < tris.size(); i++) {
+    QTriangle &t = tris[i];
+    for (uint j = 0; j < 3; j++)
+      t.err[j] = calculateError(t.v[j], t.v[(j+1)%3], p);
+    t.err[3] = MIN(t.err[0], MIN(t.err[1], t.err[2]));
+  }
+}
+
+void QuadricSimplifier::compactMesh()
+{
+  uint dst = 0;
+  for (uint i = 0; i < verts.size(); i++) verts[i].tcount = 0;
+  for (uint i = 0; i < tris.size(); i++)
+    if (!tris[i].deleted) {
+      tris[dst++] = tris[i];
+      for (uint j = 0; j < 3; j++) verts[tris[i].v[j]].tcount = 1;
+    }
+  tris.resize(dst);
+  dst = 0;
+  for (uint i = 0; i < verts.size(); i++)
+    if (verts[i].tcount) {
+      verts[i].tstart = dst;
+      verts[dst].p = verts[i].p;
+      dst++;
+    }
+  for (uint i = 0; i < tris.size(); i++)
+    for (uint j = 0; j < 3; j++)
+      tris[i].v[j] = verts[tris[i].v[j]].tstart;
+  verts.resize(dst);
+  refs.clear();
+}
+
+void QuadricSimplifier::simplify(uint target_count, volatile gint *cancel)
+{
+  const uint triangle_count = tris.size();
+  uint deleted_triangles = 0;
+  vector<char> deleted0, deleted1;
+  const double aggressiveness = 7;
+
+  for (int iteration = 0; iteration < 100; iteration++) {
+    if (triangle_count - deleted_triangles <= target_count) break;
+    if (cancel && g_atomic_int_get(cancel)) break;
+
+    if (iteration % 5 == 0)
+      updateMesh(iteration);
+
+    for (uint i = 0; i < tris.size(); i++)
+      tris[i].dirty = false;
+
+    // edges with an error below this get collapsed in this pass
+    const double threshold = 1e-9 * pow(double(iteration + 3), aggressiveness);
+
+    for (uint i = 0; i < tris.size(); i++) {
+      const QTriangle &t = tris[i];
+      if (t.err[3] > threshold || t.deleted || t.dirty) continue;
+
+      for (uint j = 0; j < 3; j++) {
+	if (t.err[j] >= threshold) continue;
+	const int i0 = t.v[j];
+	const int i1 = t.v[(j+1)%3];
+	if (verts[i0].border != verts[i1].border) continue;
+
+	Vector3d p;
+	calculateError(i0, i1, p);
+	deleted0.assign(verts[i0].tcount, 0);
+	deleted1.assign(verts[i1].tcount, 0);
+	if (flipped(p, i1, verts[i0], deleted0)) continue;
+	if (flipped(p, i0, verts[i1], deleted1)) continue;
+
+	// collapse i1 into i0
+	QVertex &v0 = verts[i0];
+	v0.p = p;
+	v0.q += verts[i1].q;
+	const int tstart = refs.size();
+	updateTriangles(i0, v0, deleted0, deleted_triangles);
+	updateTriangles(i0, verts[i1], deleted1, deleted_triangles);
+	const int tcount = refs.size() - tstart;
+	if (tcount <= v0.tcount) { // reuse the old ref range
+	  if (tcount > 0)
+	    std::copy(refs.begin() + tstart, refs.end(), refs.begin() + v0.tstart);
+	  refs.resize(tstart);
+	} else
+	  v0.tstart = tstart;
+	v0.tcount = tcount;
+	break;
+      }
+      if (triangle_count - deleted_triangles <= target_count) break;
+    }
+  }
+  compactMesh();
+}
+
+void QuadricSimplifier::getTriangles(vector<Triangle> &result) const
+{
+  result.clear();
+  result.reserve(tris.size());
+  for (uint i = 0; i < tris.size(); i++)
+    result.push_back(Triangle(verts[tris[i].v[0]].p * scale + offset,
+			      verts[tris[i].v[1]].p * scale + offset,
+			      verts[tris[i].v[2]].p * scale + offset));
+}
+
+} // namespace
+
+
+void simplifyMesh(const vector<Triangle> &triangles, uint target_triangles,
+		  vector<Triangle> &result, volatile gint *cancel)
+{
+  QuadricSimplifier simplifier(triangles);
+  simplifier.simplify(target_triangles, cancel);
+  simplifier.getTriangles(result);
+}
+
+
+////////////////////////////// MeshLOD ///////////////////////////////////
+
+// don't simplify below this
+const uint MIN_LOD_TRIANGLES = 2000;
+
+// the coarser levels, simplified from a copy of the full mesh
+struct MeshLOD::Simplification
+{
+  vector<Triangle> source;
+  vector< vector<Triangle> > meshes;
+  thread_t thread;
+  volatile gint done;
+  volatile gint cancel;
+};
+
+MeshLOD::MeshLOD()
+  : job(NULL), complete(false)
+{
+}
+
+MeshLOD::MeshLOD(const MeshLOD &)
+  : job(NULL), complete(false)
+{
+}
+
+MeshLOD &MeshLOD::operator=(const MeshLOD &other)
+{
+  if (this != &other)
+    clear();
+  return *this;
+}
+
+MeshLOD::~MeshLOD()
+{
+  clear();
+}
+
+void MeshLOD::clear()
+{
+  stopJob();
+  for (uint i = 0; i < levels.size(); i++)
+    delete levels[i];
+  levels.clear();
+  complete = false;
+}
+
+uint MeshLOD::levelSize(uint level) const
+{
+  return levels[level]->size() / 3;
+}
+
+void MeshLOD::addLevel(const vector<Triangle> &triangles)
+{
+  VertexBuffer *buffer = new VertexBuffer(VertexBuffer::POSITION_NORMAL);
+  buffer->reserve(3 * triangles.size());
+  for (uint i = 0; i < triangles.size(); i++) {
+    const Vector3d &N = triangles[i].Normal;
+    const Vector3f normal(N.x(), N.y(), N.z());
+    for (uint j = 0; j < 3; j++) {
+      const Vector3d &P = triangles[i][j];
+      buffer->add(Vector3f(P.x(), P.y(), P.z()), normal);
+    }
+  }
+  levels.push_back(buffer);
+}
+
+// runs in the job's thread, no GL calls here
+void *MeshLOD::simplifyLevels(void *arg)
+{
+  Simplification *job = (Simplification *)arg;
+  while (!g_atomic_int_get(&job->cancel)) {
+    const vector<Triangle> &finer =
+      job->meshes.empty() ? job->source : job->meshes.back();
+    const uint finer_size = finer.size();
+    const uint target = finer_size / 4;
+    if (target < MIN_LOD_TRIANGLES) break;
+    vector<Triangle> mesh;
+    simplifyMesh(finer, target, mesh, &job->cancel);
+    if (g_atomic_int_get(&job->cancel) || mesh.size() >= finer_size) break;
+    job->meshes.push_back(mesh);
+    // stop if the mesh can't be reduced much more
+    if (mesh.size() > finer_size * 0.8) break;
+  }
+  g_atomic_int_set(&job->done, 1);
+  return NULL;
+}
+
+// upload the levels of a finished job
+void MeshLOD::finishJob()
+{
+  if (!job || !g_atomic_int_get(&job->done)) return;
+  thread_join(job->thread);
+  for (uint i = 0; i < job->meshes.size(); i++)
+    addLevel(job->meshes[i]);
+  delete job;
+  job = NULL;
+  complete = true;
+}
+
+void MeshLOD::stopJob()
+{
+  if (!job) return;
+  g_atomic_int_set(&job->cancel, 1);
+  thread_join(job->thread);
+  delete job;
+  job = NULL;
+}
+
+void MeshLOD::draw(const vector<Triangle> &triangles, uint max_triangles)
+{
+  if (levels.empty()) {
+    Min.set(INFTY,INFTY,INFTY);
+    Max.set(-INFTY,-INFTY,-INFTY);
+    for (uint i = 0; i < triangles.size(); i++)
+      for (uint j = 0; j < 3; j++)
+	for (uint c = 0; c < 3; c++) {
+	  Min[c] = MIN(Min[c], triangles[i][j][c]);
+	  Max[c] = MAX(Max[c], triangles[i][j][c]);
+	}
+    addLevel(triangles);
+  }
+
+  finishJob();
+  if (max_triangles > 0 && !complete && !job
+      && levelSize(levels.size()-1) > max_triangles) {
+    if (triangles.size() / 4 < MIN_LOD_TRIANGLES)
+      complete = true;
+    else {
+      job = new Simplification;
+      job->source = triangles;
+      job->done = 0;
+      job->cancel = 0;
+      thread_create(&job->thread, simplifyLevels, job);
+    }
+  }
+
+  uint level = 0;
+  if (max_triangles > 0)
+    while (level + 1 < levels.size() && levelSize(level) > max_triangles)
+      level++;
+  levels[level]->draw(GL_TRIANGLES);
+}
+
+uint MeshLOD::screenTriangles(bool interactive) const
+{
+  if (levels.empty()) return 0; // bbox not known before first draw
+  GLdouble mv[16], proj[16];
+  GLint viewport[4];
+  glGetDoublev(GL_MODELVIEW_MATRIX, mv);
+  glGetDoublev(GL_PROJECTION_MATRIX, proj);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  Matrix4d MV, P; // both column major
+  for (uint i = 0; i < 16; i++) {
+    MV.array[i] = mv[i];
+    P.array[i] = proj[i];
+  }
+  const Matrix4d T = P * MV;
+  Vector2d smin(INFTY,INFTY), smax(-INFTY,-INFTY);
+  for (uint c = 0; c < 8; c++) {
+    const Vector4d corner((c&1) ? Max.x() : Min.x(),
+			  (c&2) ? Max.y() : Min.y(),
+			  (c&4) ? Max.z() : Min.z(), 1);
+    const Vector4d clip = T * corner;
+    if (clip.w() <= 0) return 0; // near the eye, draw all
+    const Vector2d win(viewport[2] * (clip.x() / clip.w() + 1) / 2,
+		       viewport[3] * (clip.y() / clip.w() + 1) / 2);
+    smin.x() = MIN(smin.x(), win.x()); smin.y() = MIN(smin.y(), win.y());
+    smax.x() = MAX(smax.x(), win.x()); smax.y() = MAX(smax.y(), win.y());
+  }
+  // visible part
+  const double width  = MIN(smax.x(), (double)viewport[2]) - MAX(smin.x(), 0.);
+  const double height = MIN(smax.y(), (double)viewport[3]) - MAX(smin.y(), 0.);
+  if (width <= 0 || height <= 0) return MIN_LOD_TRIANGLES;
+  // more than a few triangles per pixel make no difference,
+  // while rotating the view use much less
+  const double per_pixel = interactive ? 0.25 : 2.;
+  return MAX(MIN_LOD_TRIANGLES, (uint)(width * height * per_pixel));
+}
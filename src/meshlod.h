@@ -0,0 +1,70 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "stdafx.h"
+#include "triangle.h"
+
+class VertexBuffer;
+
+// Reduce a triangle mesh to about target_triangles triangles
+// by quadric error edge collapse (Garland/Heckbert).
+// Open borders are kept in place, so no holes open up.
+// Stops early when *cancel gets set from another thread.
+void simplifyMesh(const vector<Triangle> &triangles, uint target_triangles,
+		  vector<Triangle> &result, volatile gint *cancel = NULL);
+
+// Vertex buffers of a mesh in several levels of detail for drawing.
+// Level 0 is the full mesh, each further level has about a quarter
+// of the triangles of the previous one.  The coarser levels are made
+// in a background thread when first needed; until they are ready the
+// finest level is drawn.  A copy starts empty, buffers are not shared.
+class MeshLOD
+{
+ public:
+  MeshLOD();
+  MeshLOD(const MeshLOD &other);
+  MeshLOD &operator=(const MeshLOD &other);
+  ~MeshLOD();
+
+  void clear();
+
+  // draw the finest level with not more than max_triangles (0: full mesh)
+  void draw(const vector<Triangle> &triangles, uint max_triangles);
+
+  // number of triangles worth drawing for the size of the mesh on screen,
+  // using the current GL matrices (0: no limit)
+  uint screenTriangles(bool interactive) const;
+
+ private:
+  struct Simplification; // the background job
+  vector<VertexBuffer*> levels;
+  Simplification *job;
+  bool complete; // no coarser level possible
+  Vector3d Min, Max; // of the full mesh
+
+  void addLevel(const vector<Triangle> &triangles);
+  uint levelSize(uint level) const;
+  void finishJob();
+  void stopJob();
+  static void *simplifyLevels(void *arg);
+};
@@ -34,6 +34,8 @@
 #include "shape.h"
 #include "flatshape.h"
 #include "render.h"
+#include "slicer/nesting.h"
+#include "projectfile.h"
 
 Model::Model() :
   m_previewLayer(NULL),
@@ -45,7 +47,14 @@ Model::Model() :
   errlog (Gtk::TextBuffer::create()),
   echolog (Gtk::TextBuffer::create()),
   is_calculating(false),
-  is_printing(false)
+  is_printing(false),
+  changed_while_calculating(false),
+  lastlayer(NULL),
+  cached_layers(false),
+  slicing_done(0),
+  sliced_gcode(NULL),
+  slicing_ok(false),
+  sliced_timeused(0)
 {
   // Variable defaults
   Center.set(100.,100.,0.);
@@ -54,6 +63,12 @@ Model::Model() :
 
 Model::~Model()
 {
+  if (is_calculating && sliced_gcode) { // worker still running
+    m_progress->stop_running();
+    slicing_timeout.disconnect();
+    thread_join(slicing_thread);
+    delete sliced_gcode;
+  }
   ClearLayers();
   ClearGCode();
   delete m_previewLayer;
@@ -105,6 +120,8 @@ void Model::ClearLayers()
     delete *i;
   }
   layers.clear();
+  lastlayer = NULL;
+  cached_layers = false;
   Infill::clearPatterns();
   ClearPreview();
 }
@@ -200,6 +217,7 @@ vector<Shape*> Model::ReadShapes(Glib::RefPtr<Gio::File> file,
 
 void Model::ReadStl(Glib::RefPtr<Gio::File> file)
 {
+  if (!CanEdit()) return;
   bool autoplace = settings.Misc.ShapeAutoplace;
   vector<Shape*> shapes = ReadShapes(file, 0);
   // do not autoplace in multishape files
@@ -211,60 +229,409 @@ void Model::ReadStl(Glib::RefPtr<Gio::File> file)
   ModelChanged();
 }
 
-void Model::SaveStl(Glib::RefPtr<Gio::File> file)
+// the meshes of the shapes, not copied, with their full transforms
+static void exportMeshes(const ObjectsTree &objtree,
+			 vector<const vector<Triangle>*> &meshes,
+			 vector<Matrix4d> &transforms, vector<ustring> &names)
 {
   vector<Shape*> shapes;
-  vector<Matrix4d> transforms;
   objtree.get_all_shapes(shapes,transforms);
+  meshes.resize(shapes.size());
+  names.resize(shapes.size());
+  for(uint s = 0; s < shapes.size(); s++) {
+    meshes[s] = &shapes[s]->getUntransformedTriangles();
+    transforms[s] = transforms[s] * shapes[s]->transform3D.transform;
+    names[s] = shapes[s]->filename;
+  }
+}
+
+void Model::SaveStl(Glib::RefPtr<Gio::File> file)
+{
+  vector<const vector<Triangle>*> meshes;
+  vector<Matrix4d> transforms;
+  vector<ustring> names;
+  exportMeshes(objtree, meshes, transforms, names);
 
-  if(shapes.size() == 1) {
-    shapes[0]->saveBinarySTL(file->get_path());
+  if(meshes.size() == 1 || settings.Misc.SaveSingleShapeSTL) {
+    File::saveBinarySTL(file->get_path(), meshes, transforms);
   }
   else {
-    if (settings.Misc.SaveSingleShapeSTL) {
-      Shape single = GetCombinedShape();
-      single.saveBinarySTL(file->get_path());
-    } else {
-      set_locales("C");
-      stringstream sstr;
-      for(uint s=0; s < shapes.size(); s++) {
-	sstr << shapes[s]->getSTLsolid() << endl;
-      }
-      Glib::file_set_contents (file->get_path(), sstr.str());
-      reset_locales();
+    vector<Shape*> shapes;
+    vector<Matrix4d> shapetransforms; // getSTLsolid() uses its own
+    objtree.get_all_shapes(shapes,shapetransforms);
+    set_locales("C");
+    ofstream ofile(file->get_path().c_str(), ios::out | ios::trunc);
+    for(uint s=0; s < shapes.size(); s++) {
+      ofile << shapes[s]->getSTLsolid() << endl;
     }
+    ofile.close();
+    reset_locales();
   }
   settings.STLPath = file->get_parent()->get_path();
 }
 
-// everything in one shape
-Shape Model::GetCombinedShape() const
+void Model::SaveAMF(Glib::RefPtr<Gio::File> file)
+{
+  vector<const vector<Triangle>*> meshes;
+  vector<Matrix4d> transforms;
+  vector<ustring> names;
+  exportMeshes(objtree, meshes, transforms, names);
+  File::save_AMF(file->get_path(), meshes, transforms, names);
+}
+
+// Project files
+
+// the settings the sliced outlines depend on
+string Model::sliceKey() const
+{
+  const Settings::SlicingSettings &s = settings.Slicing;
+  ostringstream ostr;
+  ostr.precision(10);
+  ostr << s.LayerThickness << " " << s.FirstLayerHeight << " "
+       << s.Varslicing << " " << s.MinLayerThickness << " "
+       << s.CuspHeight << " " << s.Skins << " " << s.BuildSerial << " "
+       << s.Support << " " << s.SupportAngle << " "
+       << settings.getPrintVolume() << " " << settings.getPrintMargin() << " "
+       << settings.Raft.Size * settings.Raft.Enable;
+  return Glib::Checksum::compute_checksum(Glib::Checksum::CHECKSUM_SHA1,
+					  ostr.str());
+}
+
+// all settings the gcode depends on
+string Model::settingsKey()
+{
+  Glib::KeyFile cfg;
+  settings.save_settings_as(cfg);
+  if (cfg.has_group("Display")) cfg.remove_group("Display");
+  if (cfg.has_group("Misc"))    cfg.remove_group("Misc");
+  return Glib::Checksum::compute_checksum(Glib::Checksum::CHECKSUM_SHA1,
+					  cfg.to_data());
+}
+
+static void putTransform(ProjectSection &s, const Transform3D &transform)
 {
-  Shape shape;
-  for (uint o = 0; o<objtree.Objects.size(); o++) {
-    for (uint s = 0; s<objtree.Objects[o]->shapes.size(); s++) {
-      vector<Triangle> tr =
-	objtree.Objects[o]->shapes[s]->getTriangles(objtree.Objects[o]->transform3D.transform);
-      shape.addTriangles(tr);
+  s.putMatrix(transform.getBase());
+  s.putVector3d(transform.getScales());
+}
+
+static void getTransform(ProjectSection &s, Transform3D &transform)
+{
+  const Matrix4d base = s.getMatrix();
+  const Vector3d scales = s.getVector3d();
+  if (s.good()) transform.set(base, scales);
+}
+
+struct VertexLess
+{
+  const vector<Vector3d> &v;
+  VertexLess(const vector<Vector3d> &v) : v(v) {}
+  bool operator()(uint a, uint b) const {
+    for (uint i = 0; i < 3; i++)
+      if (v[a][i] != v[b][i]) return v[a][i] < v[b][i];
+    return false;
+  }
+};
+
+// indexed mesh: unique vertices, then normal and vertex indices of
+// the triangles
+static void putMesh(ProjectSection &s, const vector<Triangle> &triangles)
+{
+  vector<Vector3d> corners(3 * triangles.size());
+  for (uint t = 0; t < triangles.size(); t++)
+    for (uint c = 0; c < 3; c++)
+      corners[3*t+c] = triangles[t][c];
+  vector<uint> order(corners.size());
+  for (uint i = 0; i < order.size(); i++) order[i] = i;
+  std::sort(order.begin(), order.end(), VertexLess(corners));
+  vector<guint32> index(corners.size());
+  vector<Vector3d> vertices;
+  for (uint i = 0; i < order.size(); i++) {
+    if (i == 0 || corners[order[i]] != vertices.back())
+      vertices.push_back(corners[order[i]]);
+    index[order[i]] = vertices.size() - 1;
+  }
+  s.put<guint32>(vertices.size());
+  for (uint i = 0; i < vertices.size(); i++)
+    s.putVector3d(vertices[i]);
+  s.put<guint32>(triangles.size());
+  for (uint t = 0; t < triangles.size(); t++) {
+    s.putVector3d(triangles[t].Normal);
+    for (uint c = 0; c < 3; c++)
+      s.put<guint32>(index[3*t+c]);
+  }
+}
+
+static bool getMesh(ProjectSection &s, vector<Triangle> &triangles)
+{
+  const guint32 nvertices = s.get<guint32>();
+  if (!s.good() || nvertices > s.remaining() / (3*sizeof(double)))
+    return false;
+  vector<Vector3d> vertices(nvertices);
+  for (uint i = 0; i < nvertices; i++)
+    vertices[i] = s.getVector3d();
+  const guint32 ntriangles = s.get<guint32>();
+  if (!s.good() || ntriangles > s.remaining() / (3*sizeof(double)+3*sizeof(guint32)))
+    return false;
+  triangles.resize(ntriangles);
+  for (uint t = 0; t < ntriangles; t++) {
+    const Vector3d normal = s.getVector3d();
+    guint32 index[3];
+    for (uint c = 0; c < 3; c++) {
+      index[c] = s.get<guint32>();
+      if (index[c] >= nvertices) return false;
     }
+    triangles[t] = Triangle(normal, vertices[index[0]],
+			    vertices[index[1]], vertices[index[2]]);
   }
-  return shape;
+  return s.good();
 }
 
-void Model::SaveAMF(Glib::RefPtr<Gio::File> file)
+// the outlines of the layers as sliced, without shells and infill
+// without the raft layers, which are made from the hull of layer 0
+static void putLayers(ProjectSection &s, const vector<Layer*> &layers)
 {
-  vector<Shape*> shapes;
-  vector<Matrix4d> transforms;
-  objtree.get_all_shapes(shapes,transforms);
-  vector< vector<Triangle> > triangles;
-  vector<ustring> names;
-  for(uint s = 0; s < shapes.size(); s++) {
-    triangles.push_back(shapes[s]->getTriangles(transforms[s]));
-    names.push_back(shapes[s]->filename);
+  uint first = 0;
+  while (first < layers.size() && layers[first]->LayerNo < 0) first++;
+  s.put<guint32>(layers.size() - first);
+  for (uint l = first; l < layers.size(); l++) {
+    const Layer *layer = layers[l];
+    s.put<gint32>(layer->LayerNo);
+    s.put<double>(layer->getZ());
+    s.put<double>(layer->thickness);
+    s.put<guint32>(layer->getSkins());
+    const vector<Poly> polys = layer->GetPolygons();
+    s.put<guint32>(polys.size());
+    for (uint p = 0; p < polys.size(); p++) {
+      s.put<guint8>(polys[p].isClosed());
+      s.put<double>(polys[p].getExtrusionFactor());
+      s.put<guint32>(polys[p].vertices.size());
+      for (uint v = 0; v < polys[p].vertices.size(); v++) {
+	s.put<double>(polys[p].vertices[v].x());
+	s.put<double>(polys[p].vertices[v].y());
+      }
+    }
+  }
+}
+
+static bool getLayers(ProjectSection &s, vector<Layer*> &layers, Layer *&lastlayer)
+{
+  const guint32 nlayers = s.get<guint32>();
+  if (!s.good() || nlayers > s.remaining() / (2*sizeof(double)))
+    return false;
+  for (uint l = 0; l < nlayers; l++) {
+    const gint32 layerno = s.get<gint32>();
+    const double z = s.get<double>();
+    const double thickness = s.get<double>();
+    const guint32 skins = s.get<guint32>();
+    const guint32 npolys = s.get<guint32>();
+    if (!s.good() || npolys > s.remaining() / sizeof(double))
+      return false;
+    Layer *layer = new Layer(lastlayer, layerno, thickness, max(1u, skins));
+    layer->setZ(z);
+    layers.push_back(layer);
+    lastlayer = layer;
+    vector<Poly> polys(npolys);
+    for (uint p = 0; p < npolys; p++) {
+      const bool closed = s.get<guint8>();
+      polys[p] = Poly(z, s.get<double>());
+      polys[p].setClosed(closed);
+      const guint32 nvertices = s.get<guint32>();
+      if (!s.good() || nvertices > s.remaining() / (2*sizeof(double)))
+	return false;
+      polys[p].vertices.resize(nvertices);
+      for (uint v = 0; v < nvertices; v++) {
+	const double x = s.get<double>();
+	polys[p].vertices[v] = Vector2d(x, s.get<double>());
+      }
+    }
+    if (!s.good()) return false;
+    layer->SetPolygons(polys);
+    layer->setMinMax(polys);
+  }
+  return true;
+}
+
+static void putCommands(ProjectSection &s, const GCode &gcode)
+{
+  s.put<guint32>(gcode.commands.size());
+  for (uint i = 0; i < gcode.commands.size(); i++) {
+    const Command &c = gcode.commands[i];
+    s.put<gint32>(c.Code);
+    s.putVector3d(c.where);
+    s.putVector3d(c.arcIJK);
+    s.put<guint8>(c.is_value);
+    s.put<double>(c.value);
+    s.put<double>(c.f);
+    s.put<double>(c.e);
+    s.put<guint32>(c.extruder_no);
+    s.put<double>(c.abs_extr);
+    s.put<double>(c.travel_length);
+    s.put<guint8>(c.not_layerchange);
+    s.putString(c.explicit_arg);
+    s.putString(c.comment);
+  }
+  s.put<guint32>(gcode.layerchanges.size());
+  for (uint i = 0; i < gcode.layerchanges.size(); i++)
+    s.put<guint64>(gcode.layerchanges[i]);
+  s.putVector3d(gcode.Min);
+  s.putVector3d(gcode.Max);
+  s.putVector3d(gcode.Center);
+}
+
+static bool getCommands(ProjectSection &s, GCode &gcode)
+{
+  const guint32 ncommands = s.get<guint32>();
+  if (!s.good() || ncommands > s.remaining() / (6*sizeof(double)))
+    return false;
+  gcode.commands.resize(ncommands);
+  for (uint i = 0; i < ncommands; i++) {
+    Command &c = gcode.commands[i];
+    c.Code = (GCodes)s.get<gint32>();
+    c.where = s.getVector3d();
+    c.arcIJK = s.getVector3d();
+    c.is_value = s.get<guint8>();
+    c.value = s.get<double>();
+    c.f = s.get<double>();
+    c.e = s.get<double>();
+    c.extruder_no = s.get<guint32>();
+    c.abs_extr = s.get<double>();
+    c.travel_length = s.get<double>();
+    c.not_layerchange = s.get<guint8>();
+    c.explicit_arg = s.getString();
+    c.comment = s.getString();
+    if (!s.good()) return false;
+  }
+  const guint32 nchanges = s.get<guint32>();
+  if (!s.good() || nchanges > s.remaining() / sizeof(guint64))
+    return false;
+  gcode.layerchanges.resize(nchanges);
+  for (uint i = 0; i < nchanges; i++)
+    gcode.layerchanges[i] = s.get<guint64>();
+  gcode.Min = s.getVector3d();
+  gcode.Max = s.getVector3d();
+  gcode.Center = s.getVector3d();
+  return s.good();
+}
+
+void Model::SaveProject(Glib::RefPtr<Gio::File> file)
+{
+  if (is_calculating) return;
+  ProjectFile project;
+
+  ProjectSection &keys = project.add(ProjectFile::KEYS);
+  keys.putString(sliceKey());
+  keys.putString(settingsKey());
+
+  ProjectSection &objects = project.add(ProjectFile::OBJECTS, true);
+  putTransform(objects, objtree.transform3D);
+  objects.put<guint32>(objtree.Objects.size());
+  for (uint o = 0; o < objtree.Objects.size(); o++) {
+    const TreeObject *object = objtree.Objects[o];
+    vector<const Shape*> shapes;
+    for (uint s = 0; s < object->shapes.size(); s++)
+      if (object->shapes[s]->dimensions() == 3) // no flat shapes
+	shapes.push_back(object->shapes[s]);
+    objects.putString(object->name);
+    putTransform(objects, object->transform3D);
+    objects.put<guint32>(shapes.size());
+    for (uint s = 0; s < shapes.size(); s++) {
+      objects.putString(shapes[s]->filename);
+      putTransform(objects, shapes[s]->transform3D);
+      putMesh(objects, shapes[s]->getTriangles());
+    }
+  }
+
+  if (!layers.empty())
+    putLayers(project.add(ProjectFile::LAYERS, true), layers);
+  if (gcode.commands.size() > 0) {
+    putCommands(project.add(ProjectFile::COMMANDS, true), gcode);
+    project.add(ProjectFile::GCODETEXT, true).putString(gcode.get_text());
+  }
+
+  string err;
+  if (!project.save(file->get_path(), err))
+    error(_("Could not save project"), err.c_str());
+}
+
+void Model::ReadProject(Glib::RefPtr<Gio::File> file)
+{
+  if (is_calculating) return;
+  if (is_printing) return;
+  ProjectFile project;
+  string err;
+  if (!project.open(file->get_path(), err)) {
+    error(_("Could not read project"), err.c_str());
+    return;
+  }
+  ProjectSection *keys = project.section(ProjectFile::KEYS);
+  ProjectSection *objects = project.section(ProjectFile::OBJECTS);
+  if (!keys || !objects) {
+    error(_("Could not read project"), _("Project file is broken"));
+    return;
+  }
+  const string slicekey = keys->getString();
+  const string fullkey = keys->getString();
+
+  m_inhibit_modelchange = true;
+  ClearGCode();
+  ClearLayers();
+  objtree.clear();
+  getTransform(*objects, objtree.transform3D);
+  const guint32 nobjects = objects->get<guint32>();
+  for (uint o = 0; objects->good() && o < nobjects; o++) {
+    objtree.newObject();
+    TreeObject *object = objtree.Objects.back();
+    object->name = objects->getString();
+    getTransform(*objects, object->transform3D);
+    const guint32 nshapes = objects->get<guint32>();
+    for (uint s = 0; objects->good() && s < nshapes; s++) {
+      const string filename = objects->getString();
+      Transform3D transform;
+      getTransform(*objects, transform);
+      vector<Triangle> triangles;
+      if (!getMesh(*objects, triangles)) break;
+      Shape *shape = new Shape();
+      shape->setTriangles(triangles);
+      shape->transform3D = transform;
+      objtree.addShape(object, shape, filename);
+    }
+  }
+  m_inhibit_modelchange = false;
+  if (!objects->good())
+    error(_("Could not read project"), _("Project file is broken"));
+  CalcBoundingBoxAndCenter();
+
+  // reuse what was made with the current settings
+  ostringstream ostr;
+  ostr << _("Read project");
+  ProjectSection *section = project.section(ProjectFile::LAYERS);
+  if (section && slicekey == sliceKey() && !settings.Slicing.Support
+      && !settings.Slicing.SelectedOnly) {
+    if (getLayers(*section, layers, lastlayer)) {
+      cached_layers = true;
+      cached_slice_key = slicekey;
+      ostr << " - " << layers.size() << _(" sliced layers");
+    } else
+      ClearLayers();
   }
-  File::save_AMF(file->get_path(), triangles, names);
+  section = project.section(ProjectFile::COMMANDS);
+  ProjectSection *text = project.section(ProjectFile::GCODETEXT);
+  if (section && text && fullkey == settingsKey()) {
+    if (getCommands(*section, gcode)) {
+      gcode.SetText(text->getString());
+      ostr << " - " << gcode.commands.size() << _(" gcode commands");
+    } else
+      ClearGCode();
+  }
+  if (statusbar)
+    statusbar->push(ostr.str());
+
+  m_model_changed.emit();
+  m_signal_gcode_changed.emit();
+  m_signal_zoom.emit();
 }
 
+
 void Model::Read(Glib::RefPtr<Gio::File> file)
 {
   std::string basename = file->get_basename();
@@ -272,7 +639,8 @@ void Model::Read(Glib::RefPtr<Gio::File> file)
   cerr << "reading " << basename<< endl;
   string directory_path = file->get_parent()->get_path();
   if (pos != std::string::npos) {
-    std::string extn = basename.substr(pos);
+    // the file chooser also offers upper case names
+    std::string extn = Glib::ustring(basename.substr(pos)).lowercase();
     if (extn == ".conf")
       {
 	LoadConfig (file);
@@ -291,6 +659,12 @@ void Model::Read(Glib::RefPtr<Gio::File> file)
 	settings.STLPath = directory_path;
 	return;
       }
+    else if (extn == ".rsp")
+      {
+	ReadProject (file);
+	settings.STLPath = directory_path;
+	return;
+      }
     else if (extn == ".rfo")
       {
 	//      ReadRFO (file);
@@ -341,6 +715,12 @@ void Model::ModelChanged()
   if (m_inhibit_modelchange) return;
   if (objtree.empty()) return;
   //printer.update_temp_poll_interval(); // necessary?
+  if (is_calculating && sliced_gcode) {
+    // the worker reads the model, so stop it and clear when it is done
+    m_progress->stop_running();
+    changed_while_calculating = true;
+    return;
+  }
   if (!is_printing) {
     CalcBoundingBoxAndCenter();
     Infill::clearPatterns();
@@ -353,14 +733,91 @@ void Model::ModelChanged()
   }
 }
 
-static bool ClosestToOrigin (Vector3d a, Vector3d b)
+// The worker slices the shapes and fills the layers, so they can not
+// be changed or deleted before it is done.
+bool Model::CanEdit()
+{
+  if (!is_calculating) return true;
+  if (statusbar)
+    statusbar->push(_("The model can not be changed while slicing"));
+  else
+    cerr << _("The model can not be changed while slicing") << endl;
+  return false;
+}
+
+const double ARRANGE_SPACING = 5.0; // mm between parts
+
+// part of the bed parts can be placed on, from (0,0)
+static Vector2d arrangeArea(const Settings &settings)
+{
+  const Vector3d size = settings.getPrintVolume() - settings.getPrintMargin()*2.;
+  return Vector2d(size.x(), size.y());
+}
+
+// cells of about 0.5mm, at most 400 across the bed
+static double arrangeResolution(const Vector2d &area)
+{
+  return MAX(0.5, MAX(area.x(), area.y()) / 400);
+}
+
+// Triangles covering the shape on the bed.  Shapes without triangles,
+// like those from SVG, get their XY bounding box.
+static vector<Triangle> footprintTriangles(const Shape *shape,
+					   const Matrix4d &T)
+{
+  vector<Triangle> triangles = shape->getTriangles(T);
+  Vector2d min, max;
+  if (!triangles.empty() || !shape->getOutlineBounds(min, max))
+    return triangles;
+  const Matrix4d M = T * shape->transform3D.transform;
+  Vector2d bmin(INFTY,INFTY), bmax(-INFTY,-INFTY);
+  for (uint i = 0; i < 4; i++) {
+    const Vector3d corner = M * Vector3d(i&1 ? max.x() : min.x(),
+					 i&2 ? max.y() : min.y(), 0);
+    bmin.x() = MIN(bmin.x(), corner.x()); bmin.y() = MIN(bmin.y(), corner.y());
+    bmax.x() = MAX(bmax.x(), corner.x()); bmax.y() = MAX(bmax.y(), corner.y());
+  }
+  const Vector3d A(bmin.x(), bmin.y(), 0), B(bmax.x(), bmin.y(), 0),
+    C(bmax.x(), bmax.y(), 0), D(bmin.x(), bmax.y(), 0);
+  triangles.push_back(Triangle(A, B, C));
+  triangles.push_back(Triangle(A, C, D));
+  return triangles;
+}
+
+// bed with the footprints of the shapes where they are
+static void addToBed(BedRaster &bed, double resolution,
+		     const vector<Shape*> &shapes,
+		     const vector<Matrix4d> &transforms)
 {
-  return (a.squared_length()) < (b.squared_length());
+  for (uint s = 0; s < shapes.size(); s++) {
+    const Footprint fp(footprintTriangles(shapes[s], transforms[s]),
+		       resolution, ARRANGE_SPACING);
+    int cx, cy;
+    bed.cell(fp.min, cx, cy);
+    bed.add(fp, cx, cy);
+  }
+}
+
+// Best free place on the bed for the triangles' footprint.
+// Returns the footprint, its cell and the XY shift to get it there.
+static bool findBedPlace(const BedRaster &bed, double resolution,
+			 const vector<Triangle> &triangles,
+			 Footprint &fp, int &cx, int &cy,
+			 Vector3d &shift, double &score)
+{
+  fp = Footprint(triangles, resolution, ARRANGE_SPACING);
+  if (!bed.findPlace(fp, cx, cy, score)) return false;
+  const Vector2d move = bed.position(cx, cy) - fp.min;
+  shift = Vector3d(move.x(), move.y(), 0);
+  return true;
 }
 
-// rearrange unselected shapes in random sequence
+// Place the unselected shapes around the selected ones by their
+// footprints on the bed, largest first, turned by quarter turns
+// if Misc.ArrangeRotate and that fits better.
 bool Model::AutoArrange(vector<Gtk::TreeModel::Path> &path)
 {
+  if (!CanEdit()) return false;
   // all shapes
   vector<Shape*>   allshapes;
   vector<Matrix4d> transforms;
@@ -387,132 +844,81 @@ bool Model::AutoArrange(vector<Gtk::TreeModel::Path> &path)
     }
   }
 
-  // find place for unselected shapes
-  int num = unselshapes.size();
-  vector<int> rand_seq(num,1); // 1,1,1...
-  partial_sum(rand_seq.begin(), rand_seq.end(), rand_seq.begin()); // 1,2,3,...,N
-
-  Glib::TimeVal timeval;
-  timeval.assign_current_time();
-  srandom((unsigned long)(timeval.as_double()));
-  random_shuffle(rand_seq.begin(), rand_seq.end()); // shuffle
+  const Vector2d area = arrangeArea(settings);
+  const double resolution = arrangeResolution(area);
+  BedRaster bed(area, resolution, ARRANGE_SPACING);
+  addToBed(bed, resolution, selshapes, seltransforms);
 
+  // largest footprints first
+  const int num = unselshapes.size();
+  vector< pair<double, int> > order(num);
   for(int s=0; s < num; s++) {
-    int index = rand_seq[s]-1;
-    // use selshapes as vector to fill up
-    Vector3d trans = FindEmptyLocation(selshapes, seltransforms, unselshapes[index]);
-    selshapes.push_back(unselshapes[index]);
-    seltransforms.push_back(unseltransforms[index]); // basic transform, not shape
-    selshapes.back()->transform3D.move(trans);
-    CalcBoundingBoxAndCenter();
+    const Vector3d size = unselshapes[s]->Max - unselshapes[s]->Min;
+    order[s] = pair<double, int>(-size.x()*size.y(), s);
   }
-  ModelChanged();
-  return true;
-}
+  sort(order.begin(), order.end());
 
-Vector3d Model::FindEmptyLocation(const vector<Shape*> &shapes,
-				  const vector<Matrix4d> &transforms,
-				  const Shape *shape)
-{
-  // Get all object positions
-  std::vector<Vector3d> maxpos;
-  std::vector<Vector3d> minpos;
-  for(uint s=0; s<shapes.size(); s++) {
-    Vector3d p;
-    Matrix4d strans = transforms[s];
-    Vector3d min = strans * shapes[s]->Min;
-    Vector3d max = strans * shapes[s]->Max;
-    minpos.push_back(Vector3d(min.x(), min.y(), 0));
-    maxpos.push_back(Vector3d(max.x(), max.y(), 0));
-  }
-
-  double d = 5.0; // 5mm spacing between objects
-  Vector3d StlDelta = (shape->Max - shape->Min);
-  vector<Vector3d> candidates;
-
-  candidates.push_back(Vector3d(0.0, 0.0, 0.0));
-
-  for (uint j=0; j<maxpos.size(); j++)
-  {
-    candidates.push_back(Vector3d(maxpos[j].x() + d, minpos[j].y(), 0));
-    candidates.push_back(Vector3d(minpos[j].x(), maxpos[j].y() + d, 0));
-    candidates.push_back(maxpos[j] + Vector3d(d,d,0));
-  }
-
-  // Prefer positions closest to origin
-  sort(candidates.begin(), candidates.end(), ClosestToOrigin);
-
-
-  Vector3d result;
-  // Check all candidates for collisions with existing objects
-  for (uint c=0; c<candidates.size(); c++)
-  {
-    bool ok = true;
-
-    for (uint k=0; k<maxpos.size(); k++)
-    {
-      if (
-          // check x
-          ( ( ( minpos[k].x()     <= candidates[c].x() &&
-		candidates[c].x() <= maxpos[k].x() ) ||
-	      ( candidates[c].x() <= minpos[k].x() &&
-		maxpos[k].x() <= candidates[c].x()+StlDelta.x()+d ) ) ||
-	    ( ( minpos[k].x() <= candidates[c].x()+StlDelta.x()+d &&
-		candidates[c].x()+StlDelta.x()+d <= maxpos[k].x() ) ) )
-          &&
-          // check y
-          ( ( ( minpos[k].y() <= candidates[c].y() &&
-		candidates[c].y() <= maxpos[k].y() ) ||
-	      ( candidates[c].y() <= minpos[k].y() &&
-		maxpos[k].y() <= candidates[c].y()+StlDelta.y()+d ) ) ||
-	    ( ( minpos[k].y() <= candidates[c].y()+StlDelta.y()+d &&
-		candidates[c].y()+StlDelta.y()+d <= maxpos[k].y() ) ) )
-	  )
-	{
-	  ok = false;
-	  break;
-	}
-
-      // volume boundary
-      if (candidates[c].x()+StlDelta.x() >
-	  (settings.getPrintVolume().x() - 2*settings.getPrintMargin().x())
-	  || candidates[c].y()+StlDelta.y() >
-	  (settings.getPrintVolume().y() - 2*settings.getPrintMargin().y()))
-	{
-	  ok = false;
-	  break;
-	}
+  const int turns = settings.Misc.ArrangeRotate ? 4 : 1;
+  for(int s=0; s < num; s++) {
+    Shape *shape = unselshapes[order[s].second];
+    const Matrix4d &T = unseltransforms[order[s].second];
+    const Transform3D original = shape->transform3D;
+    Footprint bestfp;
+    int bestturn = -1, bestx = 0, besty = 0;
+    Vector3d bestshift;
+    double bestscore = INFTY;
+    for (int turn = 0; turn < turns; turn++) {
+      shape->transform3D = original;
+      if (turn > 0)
+	shape->Rotate(Vector3d(0,0,1), turn * M_PI/2);
+      Footprint fp;
+      int cx, cy;
+      Vector3d shift;
+      double score;
+      if (findBedPlace(bed, resolution, footprintTriangles(shape, T),
+		       fp, cx, cy, shift, score) && score < bestscore) {
+	bestscore = score; bestturn = turn;
+	bestfp = fp; bestx = cx; besty = cy; bestshift = shift;
+      }
     }
-    if (ok) {
-      result.x() = candidates[c].x();
-      result.y() = candidates[c].y();
-      result.z() = candidates[c].z();
-      // keep z
-      result.x() -= shape->Min.x();
-      result.y() -= shape->Min.y();
-      return result;
+    shape->transform3D = original;
+    if (bestturn < 0) {
+      cerr << _("No room on the bed for ") << shape->filename << endl;
+      continue;
     }
+    if (bestturn > 0)
+      shape->Rotate(Vector3d(0,0,1), bestturn * M_PI/2);
+    shape->transform3D.move(bestshift);
+    shape->CalcBBox();
+    bed.add(bestfp, bestx, besty);
   }
-
-  // no empty spots
-  return Vector3d(100,100,0);
+  CalcBoundingBoxAndCenter();
+  ModelChanged();
+  return true;
 }
 
 bool Model::FindEmptyLocation(Vector3d &result, const Shape *shape)
 {
-  // Get all object positions
-  std::vector<Vector3d> maxpos;
-  std::vector<Vector3d> minpos;
-
   vector<Shape*>   allshapes;
   vector<Matrix4d> transforms;
   objtree.get_all_shapes(allshapes, transforms);
-  result = FindEmptyLocation(allshapes, transforms, shape);
-  return true;
+
+  const Vector2d area = arrangeArea(settings);
+  const double resolution = arrangeResolution(area);
+  BedRaster bed(area, resolution, ARRANGE_SPACING);
+  addToBed(bed, resolution, allshapes, transforms);
+
+  Footprint fp;
+  int cx, cy;
+  double score;
+  return findBedPlace(bed, resolution,
+		      footprintTriangles(shape, Matrix4d::IDENTITY),
+		      fp, cx, cy, result, score);
 }
 
 int Model::AddShape(TreeObject *parent, Shape *shape, string filename, bool autoplace)
 {
+  if (!CanEdit()) return -1;
   //Shape *retshape;
   bool found_location=false;
 
@@ -553,6 +959,7 @@ int Model::AddShape(TreeObject *parent, Shape *shape, string filename, bool auto
 
 int Model::SplitShape(TreeObject *parent, Shape *shape, string filename)
 {
+  if (!CanEdit()) return 0;
   vector<Shape*> splitshapes;
   shape->splitshapes(splitshapes, m_progress);
   if (splitshapes.size()<2) return splitshapes.size();
@@ -566,6 +973,7 @@ int Model::SplitShape(TreeObject *parent, Shape *shape, string filename)
 
 int Model::MergeShapes(TreeObject *parent, const vector<Shape*> shapes)
 {
+  if (!CanEdit()) return 0;
   Shape * shape = new Shape();
   for (uint s = 0; s <  shapes.size(); s++) {
     vector<Triangle> str = shapes[s]->getTriangles();
@@ -577,6 +985,7 @@ int Model::MergeShapes(TreeObject *parent, const vector<Shape*> shapes)
 
 int Model::DivideShape(TreeObject *parent, Shape *shape, string filename)
 {
+  if (!CanEdit()) return 0;
   Shape *upper = new Shape();
   Shape *lower = new Shape();
   Matrix4d T = Matrix4d::IDENTITY;;//FIXME! objtree.GetSTLTransformationMatrix(parent);
@@ -591,12 +1000,14 @@ int Model::DivideShape(TreeObject *parent, Shape *shape, string filename)
 
 void Model::newObject()
 {
+  if (!CanEdit()) return;
   objtree.newObject();
 }
 
 /* Scales the object on changes of the scale slider */
 void Model::ScaleObject(Shape *shape, TreeObject *object, double scale)
 {
+  if (!CanEdit()) return;
   if (shape)
     shape->Scale(scale);
   else if(object)
@@ -609,6 +1020,7 @@ void Model::ScaleObject(Shape *shape, TreeObject *object, double scale)
 }
 void Model::ScaleObjectX(Shape *shape, TreeObject *object, double scale)
 {
+  if (!CanEdit()) return;
   if (shape)
     shape->ScaleX(scale);
   else if(object)
@@ -621,6 +1033,7 @@ void Model::ScaleObjectX(Shape *shape, TreeObject *object, double scale)
 }
 void Model::ScaleObjectY(Shape *shape, TreeObject *object, double scale)
 {
+  if (!CanEdit()) return;
   if (shape)
     shape->ScaleY(scale);
   else if(object)
@@ -633,6 +1046,7 @@ void Model::ScaleObjectY(Shape *shape, TreeObject *object, double scale)
 }
 void Model::ScaleObjectZ(Shape *shape, TreeObject *object, double scale)
 {
+  if (!CanEdit()) return;
   if (shape)
     shape->ScaleZ(scale);
   else if(object)
@@ -646,6 +1060,7 @@ void Model::ScaleObjectZ(Shape *shape, TreeObject *object, double scale)
 
 void Model::RotateObject(Shape* shape, TreeObject* object, Vector4d rotate)
 {
+  if (!CanEdit()) return;
   if (!shape)
     return;
   Vector3d rot(rotate.x(), rotate.y(), rotate.z());
@@ -655,6 +1070,7 @@ void Model::RotateObject(Shape* shape, TreeObject* object, Vector4d rotate)
 
 void Model::TwistObject(Shape *shape, TreeObject *object, double angle)
 {
+  if (!CanEdit()) return;
   if (!shape)
     return;
   shape->Twist(angle);
@@ -663,14 +1079,16 @@ void Model::TwistObject(Shape *shape, TreeObject *object, double angle)
 
 void Model::OptimizeRotation(Shape *shape, TreeObject *object)
 {
+  if (!CanEdit()) return;
   if (!shape)
     return; // FIXME: rotate entire Objects ...
-  shape->OptimizeRotation();
+  shape->OptimizeRotation(settings.Slicing.SupportAngle*M_PI/180.);
   ModelChanged();
 }
 
 void Model::InvertNormals(Shape *shape, TreeObject *object)
 {
+  if (!CanEdit()) return;
   if (shape)
     shape->invertNormals();
   else // if (object) object->invertNormals();
@@ -679,6 +1097,7 @@ void Model::InvertNormals(Shape *shape, TreeObject *object)
 }
 void Model::Mirror(Shape *shape, TreeObject *object)
 {
+  if (!CanEdit()) return;
   if (shape)
     shape->mirror();
   else // if (object) object->mirror();
@@ -688,6 +1107,7 @@ void Model::Mirror(Shape *shape, TreeObject *object)
 
 void Model::PlaceOnPlatform(Shape *shape, TreeObject *object)
 {
+  if (!CanEdit()) return;
   if (shape)
     shape->PlaceOnPlatform();
   else if(object) {
@@ -703,6 +1123,7 @@ void Model::PlaceOnPlatform(Shape *shape, TreeObject *object)
 
 void Model::DeleteObjTree(vector<Gtk::TreeModel::Path> &iter)
 {
+  if (!CanEdit()) return;
   objtree.DeleteSelected (iter);
   ClearGCode();
   ClearLayers();
@@ -777,14 +1198,12 @@ Vector3d Model::GetViewCenter()
 }
 
 // called from View::Draw
-int Model::draw (vector<Gtk::TreeModel::Path> &iter)
+int Model::draw (vector<Gtk::TreeModel::Path> &iter, bool interactive)
 {
   vector<Shape*> sel_shapes;
   vector<Matrix4d> transforms;
   objtree.get_selected_shapes(iter, sel_shapes, transforms);
 
-  gint index = 1; // pick/select index. matches computation in update_model()
-
   Vector3d printOffset = settings.getPrintMargin();
   if(settings.Raft.Enable)
     printOffset += Vector3d(settings.Raft.Size, settings.Raft.Size, 0);
@@ -818,14 +1237,11 @@ int Model::draw (vector<Gtk::TreeModel::Path> &iter)
 
   for (uint i = 0; i < objtree.Objects.size(); i++) {
     TreeObject *object = objtree.Objects[i];
-    index++;
 
     glPushMatrix();
     glMultMatrixd (&object->transform3D.transform.array[0]);
     for (uint j = 0; j < object->shapes.size(); j++) {
       Shape *shape = object->shapes[j];
-      glLoadName(index); // Load select/pick index
-      index++;
       glPushMatrix();
       glMultMatrixd (&shape->transform3D.transform.array[0]);
 
@@ -834,15 +1250,14 @@ int Model::draw (vector<Gtk::TreeModel::Path> &iter)
 	if (sel_shapes[s] == shape)
 	  is_selected = true;
 
-      // this is slow for big shapes
       if (is_selected) {
-	if (!shape->slow_drawing && shape->dimensions()>2) {
+	if (shape->dimensions()>2) {
 	  // Enable stencil buffer when we draw the selected object.
 	  glEnable(GL_STENCIL_TEST);
 	  glStencilFunc(GL_ALWAYS, 1, 1);
 	  glStencilOp(GL_KEEP, GL_REPLACE, GL_REPLACE);
 
-	  shape->draw (settings);
+	  shape->draw (settings, false, 0, interactive);
 
 	  if (!settings.Display.DisplayPolygons) {
 	    // If not drawing polygons, need to draw the geometry
@@ -854,7 +1269,7 @@ int Model::draw (vector<Gtk::TreeModel::Path> &iter)
 	    glDepthMask(GL_FALSE);
 	    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
 
-	    shape->draw_geometry();
+	    shape->draw_geometry(0, interactive);
 
 	    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 	    glDepthMask(GL_TRUE);
@@ -871,17 +1286,17 @@ int Model::draw (vector<Gtk::TreeModel::Path> &iter)
 	  glStencilFunc(GL_NOTEQUAL, 1, 1);
 	  glEnable(GL_DEPTH_TEST);
 
-	  shape->draw_geometry();
+	  shape->draw_geometry(0, interactive);
 
 	  glEnable (GL_CULL_FACE);
 	  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 	  glDisable(GL_STENCIL_TEST);
 	  glDisable(GL_POLYGON_OFFSET_LINE);
 	}
-	else shape->draw (settings, true);
+	else shape->draw (settings, true, 0, interactive);
       }
       else {
-	shape->draw (settings, false);
+	shape->draw (settings, false, 0, interactive);
       }
       // draw support triangles
       if (settings.Slicing.Support) {
@@ -953,7 +1368,7 @@ int Model::draw (vector<Gtk::TreeModel::Path> &iter)
   if(settings.Display.DisplayGCode && gcode.size() == 0) {
     // preview gcode if not calculated yet
     if ( m_previewGCode.size() != 0 ||
-	 ( layers.size() == 0 && gcode.commands.size() == 0 ) ) {
+	 ( !is_calculating && layers.size() == 0 && gcode.commands.size() == 0 ) ) {
       Vector3d start(0,0,0);
       const double thickness = settings.Slicing.LayerThickness;
       const double z = settings.Display.GCodeDrawStart + thickness/2;
@@ -981,6 +1396,52 @@ int Model::draw (vector<Gtk::TreeModel::Path> &iter)
   return drawnlayer;
 }
 
+// Pick index of the nearest shape hit by the ray origin + t*dir,
+// 0 if none.  The ray is in the coordinates draw() starts with.
+guint Model::find_shape_at(const Vector3d &origin, const Vector3d &dir,
+			   double &t) const
+{
+  gint index = 1; // pick/select index. matches computation in update_model()
+  guint found = 0;
+  t = INFTY;
+
+  Vector3d printOffset = settings.getPrintMargin();
+  if(settings.Raft.Enable)
+    printOffset += Vector3d(settings.Raft.Size, settings.Raft.Size, 0);
+  const Vector3d offset = printOffset + objtree.transform3D.getTranslation();
+  Matrix4d offsetT = Matrix4d::IDENTITY;
+  offsetT.set_translation(offset);
+  const Matrix4d treeT = offsetT * objtree.transform3D.transform;
+
+  for (uint i = 0; i < objtree.Objects.size(); i++) {
+    const TreeObject *object = objtree.Objects[i];
+    index++;
+    const Matrix4d objT = treeT * object->transform3D.transform;
+    Matrix4d invObjT;
+    objT.inverse(invObjT);
+    // shape bounding boxes are in object coordinates
+    const Vector3d o_origin = invObjT * origin;
+    const Vector3d o_dir    = invObjT * (origin + dir) - o_origin;
+    for (uint j = 0; j < object->shapes.size(); j++) {
+      const Shape *shape = object->shapes[j];
+      const guint shape_index = index++;
+      double tbox;
+      if (!intersectRayBox(o_origin, o_dir, shape->Min, shape->Max, tbox)
+	  || tbox > t)
+	continue;
+      const Matrix4d invShapeT = shape->transform3D.getInverse();
+      const Vector3d s_origin = invShapeT * o_origin;
+      const Vector3d s_dir    = invShapeT * (o_origin + o_dir) - s_origin;
+      double tshape; // same parameter in all coordinates
+      if (shape->intersectRay(s_origin, s_dir, tshape) && tshape < t) {
+	t = tshape;
+	found = shape_index;
+      }
+    }
+  }
+  return found;
+}
+
 // if single layer returns layerno of drawn layer
 // else returns -1
 int Model::drawLayers(double height, const Vector3d &offset, bool calconly)
@@ -32,6 +32,8 @@
 #include "gcode/gcode.h"
 /* #include "gcodestate.h" */
 #include "settings.h"
+#include "printer/thread.h"
+#include "profile.h"
 /* #include "progress.h" */
 /* #include "slicer/poly.h" */
 
@@ -66,12 +68,16 @@ public:
 	void SaveStl(Glib::RefPtr<Gio::File> file);
 	void SaveAMF(Glib::RefPtr<Gio::File> file);
 
+	// Project file (.rsp) with the meshes, the sliced layers and the
+	// gcode, which are reused on reading if the settings still match
+	void SaveProject(Glib::RefPtr<Gio::File> file);
+	void ReadProject(Glib::RefPtr<Gio::File> file);
+
 	int AddShape(TreeObject *parent, Shape * shape, string filename,
 		     bool autoplace = true);
 	int SplitShape(TreeObject *parent, Shape *shape, string filename);
 	int MergeShapes(TreeObject *parent, const vector<Shape*> shapes);
 	int DivideShape(TreeObject *parent, Shape *shape, string filename);
-	Shape GetCombinedShape() const;
 
 	sigc::signal< void, Gtk::TreePath & > m_signal_stl_added;
 
@@ -111,7 +117,16 @@ public:
 	void ReadGCode(Glib::RefPtr<Gio::File> file);
 	void translateGCode(Vector3d trans);
 
-	void ConvertToGCode();
+	void ConvertToGCode(); // blocking
+	// slice in a worker thread, polled from the main loop
+	bool StartConvertToGCode();
+	bool IsCalculating() const { return is_calculating; }
+	// the steps of a conversion, prepare and finish in the main thread
+	bool PrepareConvertToGCode();
+	bool SliceMain(); // false if cancelled
+	void FinishConvertToGCode();
+	// write the text made by SliceMain() and free it, from any thread
+	size_t WriteSlicedGCode(const string &path);
 
 	void MakeRaft(GCodeState &state, double &z);
 	void WriteGCode(Glib::RefPtr<Gio::File> file);
@@ -129,6 +144,7 @@ public:
 	void newObject();
 
 	Settings settings;
+	StageProfile profile; // of the last conversion to gcode
 
 	// Model derived: Bounding box info
 	Vector3d Center;
@@ -138,9 +154,6 @@ public:
 	void CalcBoundingBoxAndCenter(bool selected_only = false);
 	Vector3d GetViewCenter();
         bool AutoArrange(vector<Gtk::TreeModel::Path> &iter);
-	Vector3d FindEmptyLocation(const vector<Shape*> &shapes,
-				   const vector<Matrix4d> &transforms,
-				   const Shape *shape);
         bool FindEmptyLocation(Vector3d &result, const Shape *stl);
 
 	sigc::signal< void > m_model_changed;
@@ -150,7 +163,9 @@ public:
 	ObjectsTree objtree;
 	Glib::RefPtr<Gtk::TextBuffer> errlog, echolog;
 
-	int draw(vector<Gtk::TreeModel::Path> &selected);
+	int draw(vector<Gtk::TreeModel::Path> &selected, bool interactive = false);
+	guint find_shape_at(const Vector3d &origin, const Vector3d &dir,
+			    double &t) const;
 	int drawLayers(double height, const Vector3d &offset, bool calconly = false);
 	void setMeasuresPoint(const Vector3d &point);
 	Vector2d measuresPoint;
@@ -168,24 +183,48 @@ public:
 
 	void SetIsPrinting(bool printing) { is_printing = printing; };
 
-	string getSVG(int single_layer_no = -1) const;
 	void ReadSVG(Glib::RefPtr<Gio::File> file);
 
  private:
 	bool is_calculating;
 	bool is_printing;
+	// ModelChanged() while the worker ran, to be done when it ends
+	bool changed_while_calculating;
+	// false and tells so while the worker reads the shapes
+	bool CanEdit();
 	//GCodeIter *m_iter;
 	Layer * lastlayer;
+	// layers read from a project, sliced with settings of this key
+	bool cached_layers;
+	string cached_slice_key;
+	string sliceKey() const;
+	string settingsKey();
+
+	// GCode conversion in a worker thread
+	thread_t slicing_thread;
+	volatile gint slicing_done;
+	GCode *sliced_gcode;   // made by the worker, swapped into gcode
+	string sliced_text;
+	string sliced_start, sliced_layer, sliced_end; // gcode texts of the settings
+	Settings slicing_settings; // copy of settings for the worker
+	bool slicing_ok;
+	double sliced_timeused;
+	Glib::TimeVal slicing_start;
+	sigc::connection slicing_timeout;
+	static void *SliceMainStatic(void *arg);
+	bool PollSlicing();
 
         // Slicing/GCode conversion functions
+	bool getSliceShapes(vector<Shape*> &shapes, vector<Matrix4d> &transforms,
+			    double &minZ, double &maxZ, double &supportangle);
 	void Slice();
 
 	void CleanupLayers();
 	void CalcInfill();
 	void MakeShells();
 	void MakeUncoveredPolygons(bool make_decor, bool make_bridges=true);
-	vector<Poly> GetUncoveredPolygons(const Layer *subjlayer,
-					  const Layer *cliplayer);
+	Region GetUncoveredPolygons(const Layer *subjlayer,
+				    const Layer *cliplayer);
 	void MakeFullSkins();
 	void MultiplyUncoveredPolygons();
 	void MakeSupportPolygons(Layer * subjlayer, const Layer * cliplayer,
@@ -24,6 +24,7 @@
 #include <string>
 #include <cerrno>
 #include <functional>
+#include <algorithm>
 //#include <memory>
 
 // should move to platform.h with com port fun.
@@ -42,33 +43,34 @@
 #include "slicer/layer.h"
 #include "slicer/infill.h"
 #include "slicer/clipping.h"
+#include "slicer/slicewriter.h"
 
 
 void Model::MakeRaft(GCodeState &state, double &z)
 {
   if (layers.size() == 0) return;
   vector<Poly> raftpolys =
-    Clipping::getOffset(layers[0]->GetHullPolygon(), settings.Raft.Size, jround);
+    Clipping::getOffset(layers[0]->GetHullPolygon(), slicing_settings.Raft.Size, jround);
   for (uint i = 0; i< raftpolys.size(); i++)
-    raftpolys[i].cleanup(settings.Slicing.LayerThickness/4);
+    raftpolys[i].cleanup(slicing_settings.Slicing.LayerThickness/4);
 
   Settings::RaftSettings::PhasePropertiesType basesettings =
-    settings.Raft.Phase[0];
+    slicing_settings.Raft.Phase[0];
   Settings::RaftSettings::PhasePropertiesType interfacesettings =
-    settings.Raft.Phase[1];
+    slicing_settings.Raft.Phase[1];
 
   vector<Layer*> raft_layers;
 
   double rotation = basesettings.Rotation;
-  double basethickness = settings.Slicing.LayerThickness
+  double basethickness = slicing_settings.Slicing.LayerThickness
     * basesettings.Thickness;
-  double interthickness = settings.Slicing.LayerThickness
+  double interthickness = slicing_settings.Slicing.LayerThickness
     * interfacesettings.Thickness;
 
   double totalthickness = basesettings.LayerCount * basethickness
     + interfacesettings.LayerCount * interthickness;
 
-  double raft_z = -totalthickness + basethickness * settings.Slicing.FirstLayerHeight;
+  double raft_z = -totalthickness + basethickness * slicing_settings.Slicing.FirstLayerHeight;
 
   for (uint i = 0; i < basesettings.LayerCount; i++) {
     Layer * layer = new Layer(lastlayer,
@@ -105,9 +107,9 @@ void Model::MakeRaft(GCodeState &state, double &z)
 {
   vector<Intersection> HitsBuffer;
 
-  double raftSize = settings.Raft.Size;
-  Vector3d raftMin =  settings.Hardware.PrintMargin + Min;
-  Vector3d raftMax =  settings.Hardware.PrintMargin + Max + 2 * raftSize;
+  double raftSize = slicing_settings.Raft.Size;
+  Vector3d raftMin =  slicing_settings.Hardware.PrintMargin + Min;
+  Vector3d raftMax =  slicing_settings.Hardware.PrintMargin + Max + 2 * raftSize;
   Vector2d Center = Vector2d((raftMin.x + raftMax.x) / 2,
 			     (raftMin.y + raftMax.y) / 2);
 
@@ -117,20 +119,20 @@ void Model::MakeRaft(GCodeState &state, double &z)
 
   double rot;
   uint LayerNr = 0;
-  uint layerCount = settings.Raft.Phase[0].LayerCount +
-		    settings.Raft.Phase[1].LayerCount;
-  Settings::RaftSettings::PhasePropertiesType *props = &settings.Raft.Phase[0];
+  uint layerCount = slicing_settings.Raft.Phase[0].LayerCount +
+		    slicing_settings.Raft.Phase[1].LayerCount;
+  Settings::RaftSettings::PhasePropertiesType *props = &slicing_settings.Raft.Phase[0];
 
-  double thickness = props->Thickness * settings.Hardware.LayerThickness;
-  double extrusionfactor = settings.Hardware.GetExtrudeFactor(thickness)
+  double thickness = props->Thickness * slicing_settings.Hardware.LayerThickness;
+  double extrusionfactor = slicing_settings.Hardware.GetExtrudeFactor(thickness)
     * props->MaterialDistanceRatio;
 
 
   while(LayerNr < layerCount)
     {
       // If we finished phase 0, start phase 1 of the raft...
-      if (LayerNr >= settings.Raft.Phase[0].LayerCount)
-	props = &settings.Raft.Phase[1];
+      if (LayerNr >= slicing_settings.Raft.Phase[0].LayerCount)
+	props = &slicing_settings.Raft.Phase[1];
 
       rot = (props->Rotation+(double)LayerNr * props->RotationPrLayer)/180.0*M_PI;
       Vector2d InfillDirX(cosf(rot), sinf(rot));
@@ -197,17 +199,17 @@ void Model::MakeRaft(GCodeState &state, double &z)
 	  state.MakeGCodeLine (Vector3d(P1.x,P1.y,z),
 			       Vector3d(P2.x,P2.y,z),
 			       Vector3d(0,0,0), 0,
-			       settings.Hardware.MaxPrintSpeedXY * 60,
+			       slicing_settings.Hardware.MaxPrintSpeedXY * 60,
 			       extrusionfactor, 0,
 			       z,
-			       settings.Slicing, settings.Hardware);
+			       slicing_settings.Slicing, slicing_settings.Hardware);
 	  reverseLines = !reverseLines;
 	}
       // Set startspeed for Z-move
       Command g;
       g.Code = SETSPEED;
       g.where = Vector3d(P2.x, P2.y, z);
-      g.f=settings.Hardware.MinPrintSpeedZ * 60;
+      g.f=slicing_settings.Hardware.MinPrintSpeedZ * 60;
       g.comment = "Move Z";
       g.e = 0;
       gcode.commands.push_back(g);
@@ -216,7 +218,7 @@ void Model::MakeRaft(GCodeState &state, double &z)
       // Move Z
       g.Code = ZMOVE;
       g.where = Vector3d(P2.x, P2.y, z);
-      g.f = settings.Hardware.MinPrintSpeedZ * 60;
+      g.f = slicing_settings.Hardware.MinPrintSpeedZ * 60;
       g.comment = "Move Z";
       g.e = 0;
       gcode.commands.push_back(g);
@@ -273,51 +275,195 @@ bool layersort(const Layer * l1, const Layer * l2){
   return (l1->Z < l2->Z);
 }
 
-void Model::Slice()
+// Duplicated shapes share their mesh.  If such an instance is placed only
+// by a shift and a rotation about Z relative to an earlier shape with the
+// same mesh, its contours are those of that shape, moved, and it need not
+// be sliced itself.  For every shape to slice, instances[n] are the
+// placements of its instances; skip[n] is set for the instances.
+static void findInstances(const vector<Shape*> &shapes,
+			  const vector<Matrix4d> &transforms,
+			  vector< vector<Matrix4d> > &instances,
+			  vector<bool> &skip)
 {
-  vector<Shape*> shapes;
-  vector<Matrix4d> transforms;
+  const double eps = 1e-9, epsmm = 1e-6;
+  instances.assign(shapes.size(), vector<Matrix4d>());
+  skip.assign(shapes.size(), false);
+  for (uint n = 0; n < shapes.size(); n++) {
+    if (shapes[n]->dimensions() != 3) continue;
+    const Matrix4d Tn = transforms[n] * shapes[n]->transform3D.transform;
+    for (uint m = 0; m < n; m++) {
+      if (skip[m] || !shapes[n]->isInstanceOf(*shapes[m])) continue;
+      Matrix4d invTm;
+      if (!(transforms[m] * shapes[m]->transform3D.transform).inverse(invTm))
+	continue;
+      const Matrix4d D = Tn * invTm; // from shape m to shape n
+      if (fabs(D(2,0)) > eps || fabs(D(2,1)) > eps ||
+	  fabs(D(0,2)) > eps || fabs(D(1,2)) > eps ||
+	  fabs(D(2,2) - 1) > eps || fabs(D(2,3)) > epsmm ||
+	  fabs(D(3,0)) > eps || fabs(D(3,1)) > eps || fabs(D(3,2)) > eps)
+	continue; // tilted or moved in Z
+      // a rotation, not scaled or mirrored
+      if (fabs(D(0,0) - D(1,1)) > eps || fabs(D(0,1) + D(1,0)) > eps ||
+	  fabs(D(0,0)*D(0,0) + D(1,0)*D(1,0) - 1) > eps)
+	continue;
+      instances[m].push_back(D);
+      skip[n] = true;
+      break;
+    }
+  }
+}
 
-  if (settings.Slicing.SelectedOnly)
+// Adaptive layer heights.
+// A layer of height h on a facet with normal n leaves a stair step
+// ("cusp") of h*|n.z|, so at any Z the layer may be cusp/|n.z| high for
+// the flattest facet there.  One pass over all triangles records this in
+// a histogram over Z; where the surface is curved the facets in a bin
+// vary in slope and the flattest one limits the height.
+// The profile is smoothed so that heights change gradually, then the
+// layers are stacked from minZ up.  Returns the Z of each layer and
+// its thickness.
+const double ADAPTIVE_BINS_PER_LAYER = 4;  // histogram bins per min. height
+const double ADAPTIVE_MAX_GROWTH     = 0.5; // height change per mm of Z
+
+static void adaptiveLayers(const vector<Shape*> &shapes,
+			   const vector<Matrix4d> &transforms,
+			   double minZ, double maxZ,
+			   double minheight, double maxheight, double cusp,
+			   vector<double> &zs, vector<double> &heights)
+{
+  zs.clear(); heights.clear();
+  maxheight = max(maxheight, minheight);
+  if (maxZ <= minZ) return;
+
+  const double binh = minheight / ADAPTIVE_BINS_PER_LAYER;
+  const int nbins = (int)ceil((maxZ - minZ + maxheight) / binh) + 1;
+  vector<double> allowed(nbins, maxheight);
+
+  for (uint s = 0; s < shapes.size(); s++) {
+    const vector<Triangle> triangles = shapes[s]->getTriangles(transforms[s]);
+    for (uint t = 0; t < triangles.size(); t++) {
+      const Triangle &tr = triangles[t];
+      const double zmin = MIN(tr.A.z(), MIN(tr.B.z(), tr.C.z()));
+      const double zmax = MAX(tr.A.z(), MAX(tr.B.z(), tr.C.z()));
+      if (zmax - zmin < 1e-6) continue; // horizontal, no steps
+      if (zmax < minZ || zmin > maxZ + maxheight) continue;
+      const Vector3d n = (tr.B - tr.A).cross(tr.C - tr.A);
+      const double len = n.length();
+      if (len == 0) continue;
+      const double nz = fabs(n.z()) / len;
+      if (nz * maxheight <= cusp) continue; // steep enough for max. height
+      const double h = MAX(minheight, cusp / nz);
+      const int first = MAX(0, (int)floor((zmin - minZ) / binh));
+      const int last  = MIN(nbins - 1, (int)floor((zmax - minZ) / binh));
+      for (int b = first; b <= last; b++)
+	allowed[b] = MIN(allowed[b], h);
+    }
+  }
+
+  // limit the change between neighbouring bins in both directions
+  const double growth = ADAPTIVE_MAX_GROWTH * binh;
+  for (int b = 1; b < nbins; b++)
+    allowed[b] = MIN(allowed[b], allowed[b-1] + growth);
+  for (int b = nbins - 2; b >= 0; b--)
+    allowed[b] = MIN(allowed[b], allowed[b+1] + growth);
+
+  // first layer as in uniform slicing
+  double z = minZ;
+  zs.push_back(z);
+  heights.push_back(maxheight);
+  while (true) {
+    // the next layer covers [z, z+h], so h must be allowed on all of it
+    double h = maxheight;
+    while (h > minheight) {
+      const int first = MAX(0, (int)floor((z - minZ) / binh));
+      const int last  = MIN(nbins - 1, (int)floor((z + h - minZ) / binh));
+      double hmin = maxheight;
+      for (int b = first; b <= last; b++)
+	hmin = MIN(hmin, allowed[b]);
+      if (hmin >= h - 1e-9) break;
+      h = MAX(minheight, hmin);
+    }
+    z += h;
+    if (z >= maxZ) break;
+    zs.push_back(z);
+    heights.push_back(h);
+  }
+}
+
+// heights of the layers from minZ to maxZ, adaptive or uniform
+static void layerHeights(const Settings &settings,
+			 const vector<Shape*> &shapes,
+			 const vector<Matrix4d> &transforms,
+			 double minZ, double maxZ,
+			 vector<double> &zs, vector<double> &thicknesses)
+{
+  const double thickness = settings.Slicing.LayerThickness;
+  if (settings.Slicing.Varslicing) {
+    adaptiveLayers(shapes, transforms, minZ, maxZ,
+		   settings.Slicing.MinLayerThickness, thickness,
+		   settings.Slicing.CuspHeight, zs, thicknesses);
+  } else {
+    int num_uniform = (int)ceil((maxZ - minZ) / thickness);
+    for (int n = 0; n < num_uniform; n++) {
+      zs.push_back(minZ + thickness * n);
+      thicknesses.push_back(thickness);
+    }
+  }
+}
+
+// the shapes to slice with their transformations to the printer,
+// the z range of the layers and the support angle (-1: no support);
+// false if there is nothing to slice
+bool Model::getSliceShapes(vector<Shape*> &shapes, vector<Matrix4d> &transforms,
+			   double &minZ, double &maxZ, double &supportangle)
+{
+  shapes.clear();
+  transforms.clear();
+  if (slicing_settings.Slicing.SelectedOnly)
     objtree.get_selected_shapes(m_current_selectionpath, shapes, transforms);
   else
     objtree.get_all_shapes(shapes,transforms);
 
-  if (shapes.size() == 0) return;
+  if (shapes.size() == 0) return false;
 
   assert(shapes.size() == transforms.size());
 
-  CalcBoundingBoxAndCenter(settings.Slicing.SelectedOnly);
+  CalcBoundingBoxAndCenter(slicing_settings.Slicing.SelectedOnly);
 
   for (uint i = 0; i<transforms.size(); i++)
-    transforms[i] = settings.getBasicTransformation(transforms[i]);
+    transforms[i] = slicing_settings.getBasicTransformation(transforms[i]);
 
-  assert(shapes.size() == transforms.size());
+  // - Start at z~=0, cut off everything below
+  // - Offset it a bit in Z, z = 0 gives a empty slice because no triangle crosses this Z value
+  minZ = slicing_settings.Slicing.LayerThickness * slicing_settings.Slicing.FirstLayerHeight;// + Min.z;
+  Vector3d volume = slicing_settings.getPrintVolume();
+  maxZ = min(Max.z(), volume.z() - slicing_settings.getPrintMargin().z());
+
+  supportangle = slicing_settings.Slicing.SupportAngle*M_PI/180.;
+  if (!slicing_settings.Slicing.Support) supportangle = -1;
+  return true;
+}
+
+void Model::Slice()
+{
+  vector<Shape*> shapes;
+  vector<Matrix4d> transforms;
+  double minZ, maxZ, supportangle;
+  if (!getSliceShapes(shapes, transforms, minZ, maxZ, supportangle)) return;
 
   int LayerNr = 0;
-  bool varSlicing = settings.Slicing.Varslicing;
+  bool varSlicing = slicing_settings.Slicing.Varslicing;
 
-  uint max_skins = max(1, settings.Slicing.Skins);
-  double thickness = (double)settings.Slicing.LayerThickness;
+  uint max_skins = max(1, slicing_settings.Slicing.Skins);
+  double thickness = (double)slicing_settings.Slicing.LayerThickness;
   double skin_thickness = thickness / max_skins;
   uint skins = max_skins; // probably variable
 
-  // - Start at z~=0, cut off everything below
-  // - Offset it a bit in Z, z = 0 gives a empty slice because no triangle crosses this Z value
-  double minZ = thickness * settings.Slicing.FirstLayerHeight;// + Min.z;
-  Vector3d volume = settings.getPrintVolume();
-  double maxZ = min(Max.z(), volume.z() - settings.getPrintMargin().z());
-
   double max_gradient = 0;
-  double supportangle = settings.Slicing.SupportAngle*M_PI/180.;
-  if (!settings.Slicing.Support) supportangle = -1;
 
-  m_progress->set_terminal_output(settings.Display.TerminalProgress);
+  m_progress->set_terminal_output(slicing_settings.Display.TerminalProgress);
   m_progress->start (_("Slicing"), maxZ);
-  // for (vector<Layer *>::iterator pIt = layers.begin();
-  //      pIt != layers. end(); pIt++)
-  //   delete *pIt;
-  ClearLayers();
+  // the caller has cleared the layers in the main thread
 
   bool flatshapes = shapes.front()->dimensions() == 2;
   if (flatshapes) {
@@ -334,12 +480,11 @@ void Model::Slice()
   int progress_steps=(int)(maxZ/thickness/100);
   if (progress_steps==0) progress_steps=1;
 
-  if ((varSlicing && skins > 1) ||
-      (settings.Slicing.BuildSerial && shapes.size() > 1))
+  if (slicing_settings.Slicing.BuildSerial && shapes.size() > 1)
   {
-    // have skins and/or serial build, so can't parallelise
+    // serial build, so can't parallelise
     uint currentshape   = 0;
-    double serialheight = maxZ; // settings.Slicing.SerialBuildHeight;
+    double serialheight = maxZ; // slicing_settings.Slicing.SerialBuildHeight;
     double z            = minZ;
     double shape_z      = z;
     double max_shape_z  = z + serialheight;
@@ -406,9 +551,16 @@ void Model::Slice()
   }
 
   // simple case, can do multihreading
-  if (progress_steps==0) progress_steps=1;
 
-  int num_layers = (int)ceil((maxZ - minZ) / thickness);
+  vector<double> layer_z, layer_thickness;
+  layerHeights(slicing_settings, shapes, transforms, minZ, maxZ,
+	       layer_z, layer_thickness);
+  vector< vector<Matrix4d> > instances;
+  vector<bool> skip_instance;
+  findInstances(shapes, transforms, instances, skip_instance);
+
+  int num_layers = layer_z.size();
+  progress_steps = max(1, num_layers/100);
   layers.resize(num_layers);
   int nlayer;
   bool cont = true;
@@ -417,7 +569,7 @@ void Model::Slice()
   #pragma omp parallel for schedule(dynamic)
 #endif
   for (nlayer = 0; nlayer < num_layers; nlayer++) {
-    double z = minZ + thickness * nlayer;
+    double z = layer_z[nlayer];
     if (nlayer%progress_steps==0) {
 #ifdef _OPENMP
 	#pragma omp critical(updateProgress)
@@ -435,16 +587,25 @@ void Model::Slice()
 #else
     if (!cont) break;
 #endif
-    Layer * layer = new Layer(NULL, nlayer, thickness, nlayer>0?skins:1);
+    uint layer_skins = skins;
+    if (varSlicing) // thinner layers get fewer skin divisions, as above
+      layer_skins = max(1u, min(max_skins,
+	(uint)floor(layer_thickness[nlayer] / skin_thickness + 0.5)));
+    Layer * layer = new Layer(NULL, nlayer, layer_thickness[nlayer],
+			      nlayer>0?layer_skins:1);
     layer->setZ(z); // set to real z
     for (uint nshape= 0; nshape < shapes.size(); nshape++) {
+      if (skip_instance[nshape]) continue;
       layer->addShape(transforms[nshape], *shapes[nshape],
-				   z, max_gradient, supportangle);
+		      z, max_gradient, supportangle, instances[nshape]);
     }
     layers[nlayer] = layer;
   }
-  if (!cont)
-    ClearLayers();
+  if (!cont) { // made in this run and never drawn, so no GL to free
+    for (uint i = 0; i < layers.size(); i++)
+      delete layers[i];
+    layers.clear();
+  }
 
 #ifdef _OPENMP
     //std::sort(layers.begin(), layers.end(), layersort);
@@ -491,117 +652,178 @@ void Model::MakeFullSkins()
 }
 
 
+// Every layer only changes its own fill areas here and reads the inner
+// shells of its neighbours, which stay as they are.  So the layers can be
+// done in parallel, each first from above and then from below.
 void Model::MakeUncoveredPolygons(bool make_decor, bool make_bridges)
 {
   int count = (int)layers.size();
   if (count == 0 ) return;
-  if (!m_progress->restart (_("Find Uncovered"), 2*count+2)) return;
-  int progress_steps=(int)((2*count+2)/100);
+  if (!m_progress->restart (_("Find Uncovered"), count+2)) return;
+  int progress_steps=(int)((count+2)/100);
   if (progress_steps==0) progress_steps=1;
-  // bottom to top: uncovered from above -> top polys
-  for (int i = 0; i < count-1; i++)
-    {
-      if (i%progress_steps==0) if(!m_progress->update(i)) return ;
-      layers[i]->addFullPolygons(GetUncoveredPolygons(layers[i],layers[i+1]), make_decor);
-    }
-  // top to bottom: uncovered from below -> bridge polys
-  for (uint i = count-1; i > 0; i--)
+  bool cont = true;
+#ifdef _OPENMP
+  omp_lock_t progress_lock;
+  omp_init_lock(&progress_lock);
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int i = 0; i < count; i++)
     {
-      //cerr << "layer " << i << endl;
-      if (i%progress_steps==0) if(!m_progress->update(count + count - i)) return;
-      //make_bridges = false;
-      // no bridge on marked layers (serial build)
-      bool mbridge = make_bridges && (layers[i]->LayerNo != 0);
-      if (mbridge) {
-	vector<Poly> uncovered = GetUncoveredPolygons(layers[i],layers[i-1]);
-	layers[i]->addBridgePolygons(Clipping::getExPolys(uncovered));
-	layers[i]->calcBridgeAngles(layers[i-1]);
+      if (i%progress_steps==0) {
+#ifdef _OPENMP
+	omp_set_lock(&progress_lock);
+#endif
+	cont = (m_progress->update(i));
+#ifdef _OPENMP
+	omp_unset_lock(&progress_lock);
+#endif
       }
-      else {
-	const vector<Poly> &uncovered = GetUncoveredPolygons(layers[i],layers[i-1]);
-	layers[i]->addFullPolygons(uncovered,make_decor);
+      if (!cont) continue;
+      // uncovered from above -> top polys
+      if (i < count-1)
+	layers[i]->addFullPolygons(GetUncoveredPolygons(layers[i],layers[i+1]), make_decor);
+      // uncovered from below -> bridge polys
+      if (i > 0) {
+	//make_bridges = false;
+	// no bridge on marked layers (serial build)
+	bool mbridge = make_bridges && (layers[i]->LayerNo != 0);
+	const Region uncovered = GetUncoveredPolygons(layers[i],layers[i-1]);
+	if (mbridge) {
+	  layers[i]->addBridgePolygons(Clipping::getExPolys(uncovered));
+	  layers[i]->calcBridgeAngles(layers[i-1]);
+	}
+	else
+	  layers[i]->addFullPolygons(uncovered,make_decor);
       }
     }
-  m_progress->update(2*count+1);
-  layers.front()->addFullPolygons(layers.front()->GetFillPolygons(), make_decor);
-  m_progress->update(2*count+2);
-  layers.back()->addFullPolygons(layers.back()->GetFillPolygons(), make_decor);
+#ifdef _OPENMP
+  omp_destroy_lock(&progress_lock);
+#endif
+  if (!cont) return;
+  m_progress->update(count+1);
+  layers.front()->addFullPolygons(Region(layers.front()->GetFillRegion()), make_decor);
+  m_progress->update(count+2);
+  layers.back()->addFullPolygons(Region(layers.back()->GetFillRegion()), make_decor);
   //m_progress->stop (_("Done"));
 }
 
 // find polys in subjlayer that are not covered by shell of cliplayer
-vector<Poly> Model::GetUncoveredPolygons(const Layer * subjlayer,
-					 const Layer * cliplayer)
+Region Model::GetUncoveredPolygons(const Layer * subjlayer,
+				   const Layer * cliplayer)
 {
   Clipping clipp;
   clipp.clear();
-  clipp.addPolys(subjlayer->GetFillPolygons(),     subject);
-  clipp.addPolys(subjlayer->GetFullFillPolygons(), subject);
+  clipp.addPolys(subjlayer->GetFillRegion(),       subject);
+  clipp.addPolys(subjlayer->GetFullFillRegion(),   subject);
   clipp.addPolys(subjlayer->GetBridgePolygons(),   subject);
-  clipp.addPolys(subjlayer->GetDecorPolygons(),    subject);
+  clipp.addPolys(subjlayer->GetDecorRegion(),      subject);
   //clipp.addPolys(cliplayer->GetOuterShell(),       clip); // have some overlap
   clipp.addPolys(*(cliplayer->GetInnerShell()),       clip); // have some more overlap
-  vector<Poly> uncovered = clipp.subtractMerged();
-  return uncovered;
+  return clipp.reg_subtractMerged();
+}
+
+// Union of the solid areas of the layers 1..shells-1 steps in direction
+// dir from layer i.  Decor of the nearest numdecor layers stays decor.
+static void getSolidNeighbours(const vector<Layer*> &layers, int i, int dir,
+			       int shells, int numdecor, bool bridges,
+			       Region &full, Region &decor)
+{
+  Clipping fullclipp, decorclipp;
+  for (int s = 1; s < shells; s++) {
+    const int n = i + dir*s;
+    if (n < 0 || n >= (int)layers.size()) break;
+    fullclipp.addPolys(layers[n]->GetFullFillRegion(), subject);
+    if (bridges)
+      fullclipp.addPolys(layers[n]->GetBridgePolygons(), subject);
+    fullclipp.addPolys(layers[n]->GetSkinFullRegion(), subject);
+    if (s < numdecor)
+      decorclipp.addPolys(layers[n]->GetDecorRegion(), subject);
+    else
+      fullclipp.addPolys(layers[n]->GetDecorRegion(), subject);
+  }
+  fullclipp.setZ(layers[i]->getZ());
+  decorclipp.setZ(layers[i]->getZ());
+  // pieces of different layers overlap
+  full  = fullclipp.reg_unite (CL::pftNonZero, CL::pftNonZero);
+  decor = decorclipp.reg_unite(CL::pftNonZero, CL::pftNonZero);
 }
 
+// Copies the solid areas to the neighbour layers, first downwards,
+// then upwards including bridges.  Each direction first collects one union
+// per layer while no layer changes, then adds them, so both steps can run
+// in parallel.
 void Model::MultiplyUncoveredPolygons()
 {
-  if (!settings.Slicing.DoInfill && settings.Slicing.SolidThickness == 0.0) return;
-  if (settings.Slicing.NoTopAndBottom) return;
-  int shells = (int)ceil(settings.Slicing.SolidThickness/settings.Slicing.LayerThickness);
-  shells = max(shells, (int)settings.Slicing.ShellCount);
+  if (!slicing_settings.Slicing.DoInfill && slicing_settings.Slicing.SolidThickness == 0.0) return;
+  if (slicing_settings.Slicing.NoTopAndBottom) return;
+  int shells = (int)ceil(slicing_settings.Slicing.SolidThickness/slicing_settings.Slicing.LayerThickness);
+  shells = max(shells, (int)slicing_settings.Slicing.ShellCount);
   if (shells<1) return;
   int count = (int)layers.size();
 
   int numdecor = 0;
   // add another full layer if making decor
-  if (settings.Slicing.MakeDecor)
-    numdecor = settings.Slicing.DecorLayers;
+  if (slicing_settings.Slicing.MakeDecor)
+    numdecor = slicing_settings.Slicing.DecorLayers;
   shells += numdecor;
 
   if (!m_progress->restart (_("Uncovered Shells"), count*3)) return;
   int progress_steps=(int)(count*3/100);
   if (progress_steps==0) progress_steps=1;
-  // bottom-up: mulitply downwards
-  int i,s;
-  for (i=0; i < count; i++)
-    {
-      if (i%progress_steps==0) if(!m_progress->update(i)) return;
-      // (brigdepolys are not multiplied downwards)
-      const vector<Poly> &fullpolys     = layers[i]->GetFullFillPolygons();
-      const vector<Poly> &skinfullpolys = layers[i]->GetSkinFullPolygons();
-      const vector<Poly> &decorpolys    = layers[i]->GetDecorPolygons();
-      for (s=1; s < shells; s++)
-	if (i-s > 1) {
-	  layers[i-s]->addFullPolygons (fullpolys,     false);
-	  layers[i-s]->addFullPolygons (skinfullpolys, false);
-	  layers[i-s]->addFullPolygons (decorpolys,    s < numdecor);
-	}
-    }
-  // top-down: mulitply upwards
-  for (int i=count-1; i>=0; i--)
-    {
-      if (i%progress_steps==0) if (!m_progress->update(count + count -i)) return;
-      const vector<Poly>   &fullpolys     = layers[i]->GetFullFillPolygons();
-      const vector<ExPoly> &bridgepolys   = layers[i]->GetBridgePolygons();
-      const vector<Poly>   &skinfullpolys = layers[i]->GetSkinFullPolygons();
-      const vector<Poly>   &decorpolys    = layers[i]->GetDecorPolygons();
-      for (int s=1; s < shells; s++)
-	if (i+s < count){
-	  layers[i+s]->addFullPolygons (fullpolys,     false);
-	  layers[i+s]->addFullPolygons (bridgepolys,   false);
-	  layers[i+s]->addFullPolygons (skinfullpolys, false);
-	  layers[i+s]->addFullPolygons (decorpolys,    s < numdecor);
+  int i;
+  bool cont = true;
+  vector<Region> full(count), decor(count);
+#ifdef _OPENMP
+  omp_lock_t progress_lock;
+  omp_init_lock(&progress_lock);
+#endif
+  for (int pass = 0; pass < 2; pass++) {
+    // downwards: from the layers above (brigdepolys are not multiplied
+    // downwards, and the lowest two layers get nothing),
+    // upwards: from the layers below
+    const int dir = (pass == 0) ? 1 : -1;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (i=0; i < count; i++)
+      {
+	if (i%progress_steps==0) {
+#ifdef _OPENMP
+	  omp_set_lock(&progress_lock);
+#endif
+	  cont = (m_progress->update(pass*count + i));
+#ifdef _OPENMP
+	  omp_unset_lock(&progress_lock);
+#endif
 	}
-    }
+	if (!cont) continue;
+	if (pass == 0 && i <= 1) continue;
+	getSolidNeighbours(layers, i, dir, shells, numdecor, pass == 1,
+			   full[i], decor[i]);
+      }
+    if (!cont) break;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (i=0; i < count; i++)
+      {
+	layers[i]->addFullPolygons(full[i],  false);
+	layers[i]->addFullPolygons(decor[i], true);
+	full[i].clear();
+	decor[i].clear();
+      }
+  }
+  if (!cont) {
+#ifdef _OPENMP
+    omp_destroy_lock(&progress_lock);
+#endif
+    return;
+  }
 
   m_progress->set_label(_("Merging Full Polygons"));
   // merge results
-  bool cont = true;
 #ifdef _OPENMP
-  omp_lock_t progress_lock;
-  omp_init_lock(&progress_lock);
 #pragma omp parallel for schedule(dynamic)
 #endif
   for (i=0; i < count; i++)
@@ -629,7 +851,7 @@ void Model::MakeSupportPolygons(Layer * layer, // lower -> will change
 				double widen)
 {
   const double distance =
-    settings.Extruder.GetExtrudedMaterialWidth(layer->thickness);
+    slicing_settings.Extruder.GetExtrudedMaterialWidth(layer->thickness);
   // vector<Poly> tosupport = Clipping::getOffset(layerabove->GetToSupportPolygons(),
   //  					       distance/2.);
   //vector<Poly> tosupport = Clipping::getMerged(layerabove->GetToSupportPolygons(),
@@ -637,17 +859,17 @@ void Model::MakeSupportPolygons(Layer * layer, // lower -> will change
   vector<Poly> tosupport = layerabove->GetToSupportPolygons();
 
   Clipping clipp;
-  clipp.addPolys(layerabove->GetSupportPolygons(),  subject);
+  clipp.addPolys(layerabove->GetSupportRegion(),    subject);
   clipp.addPolys(tosupport,                         subject);
   clipp.addPolys(layer->GetPolygons(),              clip);
   clipp.setZ(layer->getZ());
 
-  vector<Poly> spolys = clipp.subtract(CL::pftNonZero,CL::pftEvenOdd);
+  Region spolys = clipp.reg_subtract(CL::pftNonZero,CL::pftEvenOdd);
 
   if (widen != 0) // widen from layer to layer
-    spolys = clipp.getOffset(spolys, widen * layer->thickness);
+    spolys = Clipping::getOffset(spolys, widen * layer->thickness);
 
-  spolys = clipp.getMerged(spolys,distance);
+  spolys = Clipping::getMerged(spolys,distance);
 
   layer->setSupportPolygons(spolys);
 }
@@ -671,7 +893,7 @@ void Model::MakeSupportPolygons(double widen)
   // for (int i=0; i<count; i++)
   //   {
   //     const double distance =
-  // 	settings.Hardware.GetExtrudedMaterialWidth(layers[i]->thickness);
+  // 	slicing_settings.Hardware.GetExtrudedMaterialWidth(layers[i]->thickness);
   //     if (i%progress_steps==0) if(!m_progress->update(i+count)) return;
   //     vector<Poly> offset =
   // 	Clipping::getOffset(layers[i]->GetSupportPolygons(), -distance);
@@ -684,8 +906,8 @@ void Model::MakeSupportPolygons(double widen)
 void Model::MakeSkirt()
 {
 
-  if (!settings.Slicing.Skirt) return;
-  double skirtdistance  = settings.Slicing.SkirtDistance;
+  if (!slicing_settings.Slicing.Skirt) return;
+  double skirtdistance  = slicing_settings.Slicing.SkirtDistance;
 
   Clipping clipp;
   guint count = layers.size();
@@ -694,10 +916,10 @@ void Model::MakeSkirt()
   clipp.clear();
   for (guint i=0; i < count; i++)
     {
-      if (layers[i]->getZ() > settings.Slicing.SkirtHeight)
+      if (layers[i]->getZ() > slicing_settings.Slicing.SkirtHeight)
 	break;
       layers[i]->MakeSkirt(skirtdistance,
-			   settings.Slicing.SingleSkirt && !settings.Slicing.Support);
+			   slicing_settings.Slicing.SingleSkirt && !slicing_settings.Slicing.Support);
       vector<Poly> sp = layers[i]->GetSkirtPolygons();
       clipp.addPolys(sp,subject);
       endindex = i;
@@ -735,7 +957,7 @@ void Model::MakeShells()
 #endif
       }
       if (!cont) continue;
-      layers[i]->MakeShells(settings);
+      layers[i]->MakeShells(slicing_settings);
     }
 #ifdef _OPENMP
   omp_destroy_lock(&progress_lock);
@@ -747,10 +969,10 @@ void Model::MakeShells()
 
 void Model::CalcInfill()
 {
-  if (!settings.Slicing.DoInfill && settings.Slicing.SolidThickness == 0.0) return;
+  if (!slicing_settings.Slicing.DoInfill && slicing_settings.Slicing.SolidThickness == 0.0) return;
 
   int count = (int)layers.size();
-  m_progress->start (_("Infill"), count);
+  if (!m_progress->restart (_("Infill"), count)) return;
   int progress_steps=(count/100);
   if (progress_steps==0) progress_steps=1;
   bool cont = true;
@@ -773,7 +995,7 @@ void Model::CalcInfill()
 #endif
       }
       if (!cont) continue;
-      layers[i]->CalcInfill(settings);
+      layers[i]->CalcInfill(slicing_settings);
     }
 #ifdef _OPENMP
   omp_destroy_lock(&progress_lock);
@@ -782,79 +1004,129 @@ void Model::CalcInfill()
 }
 
 
-void Model::ConvertToGCode()
+// GCode conversion runs in a worker thread that never touches GTK or GL:
+// StartConvertToGCode() prepares in the main thread and starts
+// SliceMain(), which builds the layers and the commands of sliced_gcode.
+// While is_calculating, the layers belong to the worker and are not drawn.
+// The main loop polls the progress and, when the worker is done, takes
+// the result over in FinishConvertToGCode().
+
+bool Model::PrepareConvertToGCode()
 {
   if (is_calculating) {
-    return;
+    return false;
   }
   is_calculating=true;
 
   // default:
   settings.SelectExtruder(0);
+  // the worker slices with a copy, the gui may change the settings meanwhile
+  slicing_settings = settings;
 
-  Glib::TimeVal start_time;
-  start_time.assign_current_time();
+  slicing_start.assign_current_time();
 
   gcode.clear();
+  // layers read from a project can be used if sliced the same way
+  if (!cached_layers || cached_slice_key != sliceKey()
+      || settings.Slicing.Support || settings.Slicing.SelectedOnly) {
+    ClearLayers(); // also the infill patterns
+  } else {
+    Infill::clearPatterns();
+    ClearPreview();
+  }
+
+  // has a text buffer, so is made here
+  sliced_gcode = new GCode();
+  sliced_text.clear();
+  // the settings' gcode texts are text buffers too
+  sliced_start = settings.GCode.getStartText();
+  sliced_layer = settings.GCode.getLayerText();
+  sliced_end   = settings.GCode.getEndText();
+  return true;
+}
 
-  GCodeState state(gcode);
+void *Model::SliceMainStatic(void *arg)
+{
+  Model *model = (Model *) arg;
+  model->SliceMain();
+  g_atomic_int_set(&model->slicing_done, 1);
+  return NULL;
+}
 
-  Infill::clearPatterns();
+bool Model::SliceMain()
+{
+  GCodeState state(*sliced_gcode);
 
-  Vector3d printOffset  = settings.getPrintMargin();
+  Vector3d printOffset  = slicing_settings.getPrintMargin();
   double   printOffsetZ = printOffset.z();
 
-  // Make Layers
-  lastlayer = NULL;
+  profile.start();
 
+  // a trace of this conversion, unless one runs already (--trace)
+  const bool tracing = slicing_settings.Misc.TraceFile != "" && !Trace::enabled();
+  if (tracing) {
+    Trace::clear();
+    Trace::enable(true);
+  }
 
-  Slice();
+  // Make Layers
+  if (cached_layers) {
+    CalcBoundingBoxAndCenter(slicing_settings.Slicing.SelectedOnly);
+    cached_layers = false; // get shells and infill from now on
+  } else
+    Slice();
+  profile.stage("Slice");
 
   //CleanupLayers();
 
   MakeShells();
+  profile.stage("MakeShells");
 
-  if (settings.Slicing.DoInfill &&  !settings.Slicing.NoTopAndBottom &&
-      (settings.Slicing.SolidThickness > 0 || settings.Slicing.ShellCount > 0))
+  if (slicing_settings.Slicing.DoInfill &&  !slicing_settings.Slicing.NoTopAndBottom &&
+      (slicing_settings.Slicing.SolidThickness > 0 || slicing_settings.Slicing.ShellCount > 0))
     // not bridging when support
-    MakeUncoveredPolygons(settings.Slicing.MakeDecor,
-			  !settings.Slicing.NoBridges && !settings.Slicing.Support);
+    MakeUncoveredPolygons(slicing_settings.Slicing.MakeDecor,
+			  !slicing_settings.Slicing.NoBridges && !slicing_settings.Slicing.Support);
+  profile.stage("Uncovered");
 
-  if (settings.Slicing.Support)
+  if (slicing_settings.Slicing.Support)
     // easier before having multiplied uncovered bottoms
-    MakeSupportPolygons(settings.Slicing.SupportWiden);
+    MakeSupportPolygons(slicing_settings.Slicing.SupportWiden);
+  profile.stage("Support");
 
   MakeFullSkins(); // must before multiplied uncovered bottoms
 
   MultiplyUncoveredPolygons();
+  profile.stage("Skins");
 
-  if (settings.Slicing.Skirt)
+  if (slicing_settings.Slicing.Skirt)
     MakeSkirt();
 
   CalcInfill();
+  profile.stage("Infill");
 
-  if (settings.Raft.Enable)
+  if (slicing_settings.Raft.Enable)
     {
-      printOffset += Vector3d (settings.Raft.Size, settings.Raft.Size, 0);
+      printOffset += Vector3d (slicing_settings.Raft.Size, slicing_settings.Raft.Size, 0);
       MakeRaft (state, printOffsetZ); // printOffsetZ will have height of raft added
     }
+  profile.stage("Raft");
 
   state.ResetLastWhere(Vector3d(0,0,0));
   uint count =  layers.size();
 
-  m_progress->start (_("Making Lines"), count+1);
+  bool cont = m_progress->restart (_("Making Lines"), count+1);
 
   state.AppendCommand(MILLIMETERSASUNITS,  false, _("Millimeters"));
   state.AppendCommand(ABSOLUTEPOSITIONING, false, _("Absolute Pos"));
-  if (settings.Slicing.RelativeEcode)
+  if (slicing_settings.Slicing.RelativeEcode)
     state.AppendCommand(RELATIVE_ECODE, false, _("Relative E Code"));
   else
     state.AppendCommand(ABSOLUTE_ECODE, false, _("Absolute E Code"));
 
-  bool cont = true;
   vector<PLine3> plines;
   Vector3d start = state.LastPosition();
-  for (uint p=0; p<count; p++) {
+  for (uint p=0; cont && p<count; p++) {
     cont = (m_progress->update(p)) ;
     if (!cont) break;
     // cerr << "GCode layer " << (p+1) << " of " << count
@@ -865,7 +1137,7 @@ void Model::ConvertToGCode()
     layers[p]->MakePrintlines(start,
 			      plines,
 			      printOffsetZ,
-			      settings);
+			      slicing_settings);
     // } catch (Glib::Error e) {
     //   error("GCode Error:", (e.what()).c_str());
     // }
@@ -873,18 +1145,83 @@ void Model::ConvertToGCode()
     //   cerr << p << ": " <<layers[p]->LayerNo << " prev: "
     // 	   << layers[p]->getPrevious()->LayerNo << endl;
   }
-  // do antiooze retract for all lines:
-  Printlines::makeAntioozeRetract(plines, settings, m_progress);
-  vector<Command> commands;
-  //Printlines::getCommands(plines, settings, commands, m_progress);
-  Printlines::getCommands(plines, settings, state, m_progress);
-
-  //state.AppendCommands(commands, settings.Slicing.RelativeEcode);
-
-  string GcodeTxt;
-  if (cont)
-    gcode.MakeText (GcodeTxt, settings, m_progress);
-  else {
+  profile.stage("MakePrintlines");
+  if (cont) {
+    // do antiooze retract for all lines:
+    Printlines::makeAntioozeRetract(plines, slicing_settings, m_progress);
+    profile.stage("Antiooze");
+    //Printlines::getCommands(plines, slicing_settings, commands, m_progress);
+    Printlines::getCommands(plines, slicing_settings, state, m_progress);
+    profile.stage("getCommands");
+    //state.AppendCommands(commands, slicing_settings.Slicing.RelativeEcode);
+    sliced_gcode->MakeCommandText (sliced_text, slicing_settings, sliced_start,
+				   sliced_layer, sliced_end, m_progress);
+    profile.stage("MakeText");
+  }
+  sliced_timeused = state.timeused;
+  slicing_ok = cont && m_progress->do_continue();
+  if (tracing) {
+    Trace::enable(false);
+    string error;
+    if (!Trace::save(slicing_settings.Misc.TraceFile, error))
+      cerr << error << endl;
+  }
+  return slicing_ok;
+}
+
+size_t Model::WriteSlicedGCode(const string &path)
+{
+  const size_t bytes = sliced_text.size();
+  Glib::file_set_contents (path, sliced_text);
+  string().swap(sliced_text);
+  return bytes;
+}
+
+bool Model::StartConvertToGCode()
+{
+  if (!PrepareConvertToGCode()) return false;
+  slicing_done = 0;
+  if (thread_create(&slicing_thread, SliceMainStatic, this) != 0) {
+    cerr << _("Could not start the slicing thread") << endl;
+    SliceMain();
+    FinishConvertToGCode();
+    return true;
+  }
+  slicing_timeout = Glib::signal_timeout().connect
+    (sigc::mem_fun(*this, &Model::PollSlicing), 100);
+  return true;
+}
+
+bool Model::PollSlicing()
+{
+  m_progress->display();
+  if (!g_atomic_int_get(&slicing_done)) return true;
+  thread_join(slicing_thread);
+  FinishConvertToGCode();
+  return false;
+}
+
+void Model::ConvertToGCode()
+{
+  if (!PrepareConvertToGCode()) return;
+  SliceMain();
+  FinishConvertToGCode();
+}
+
+void Model::FinishConvertToGCode()
+{
+  // the result is of the model before it changed
+  const bool changed = changed_while_calculating;
+  changed_while_calculating = false;
+  if (changed) slicing_ok = false;
+  if (slicing_ok && !is_printing) { // the printer keeps the old gcode
+    gcode.swapCommands(*sliced_gcode);
+    gcode.SetText(sliced_text);
+  }
+  delete sliced_gcode;
+  sliced_gcode = NULL;
+  is_calculating=false;
+  if (!slicing_ok) {
     ClearLayers();
     ClearGCode();
     ClearPreview();
@@ -896,23 +1233,28 @@ void Model::ConvertToGCode()
 
   m_progress->stop (_("Done"));
 
-  int h = (int)state.timeused/3600;
-  int m = ((int)state.timeused%3600)/60;
-  int s = ((int)state.timeused-3600*h-60*m);
+  vector<double> layertimes;
+  const double gctime = gcode.GetTimeEstimation(settings, &layertimes);
+  int h = (int)gctime/3600;
+  int m = ((int)gctime%3600)/60;
+  int s = ((int)gctime-3600*h-60*m);
   std::ostringstream ostr;
   ostr << _("Time Estimation: ") ;
   if (h>0) ostr << h <<_("h") ;
   ostr <<m <<_("m") <<s <<_("s") ;
 
-  double gctime = gcode.GetTimeEstimation();
-  if (abs(state.timeused - gctime) > 10) {
-    h = (int)(gctime/3600);
-    m = ((int)gctime)%3600/60;
-    s = (int)(gctime)-3600*h-60*m;
-    ostr << _(" / GCode Estimation: ");
+  // without acceleration
+  if (abs(sliced_timeused - gctime) > 10) {
+    h = (int)(sliced_timeused/3600);
+    m = ((int)sliced_timeused)%3600/60;
+    s = (int)(sliced_timeused)-3600*h-60*m;
+    ostr << _(" / Lines: ");
     if (h>0) ostr << h <<_("h");
     ostr<< m <<_("m") << s <<_("s") ;
   }
+  if (layertimes.size() > 0)
+    ostr << _(" - shortest layer: ")
+	 << (int)*std::min_element(layertimes.begin(), layertimes.end()) << _("s");
 
   double totlength = gcode.GetTotalExtruded(settings.Slicing.RelativeEcode);
   ostr << _(" - total extruded: ") << totlength << "mm";
@@ -928,75 +1270,101 @@ void Model::ConvertToGCode()
   {
     Glib::TimeVal now;
     now.assign_current_time();
-    const int time_used = (int) round((now - start_time).as_double()); // seconds
-    cerr << "GCode generated in " << time_used << " seconds. " << GcodeTxt.size() << " bytes" << endl;
+    const int time_used = (int) round((now - slicing_start).as_double()); // seconds
+    cerr << "GCode generated in " << time_used << " seconds. " << sliced_text.size() << " bytes" << endl;
   }
+  sliced_text.clear();
 
-  is_calculating=false;
   m_signal_gcode_changed.emit();
+  if (changed) ModelChanged();
 }
 
-string Model::getSVG(int single_layer_no) const
-{
-  Vector3d printOffset  = settings.getPrintMargin();
-
-  ostringstream ostr;
-  ostr << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>" <<endl
-       << "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.0//EN\" \"http://www.w3.org/TR/2001/REC-SVG-20010904/DTD/svg10.dtd\">" << endl
-       << "<!-- Created by Repsnapper -->" << endl
-       << "<svg " << endl
-       << "\txmlns:svg=\"http://www.w3.org/2000/svg\""<< endl
-       << "\txmlns=\"http://www.w3.org/2000/svg\"" << endl
-    //<< "\tversion=\"1.1\"" << endl
-       << "\twidth=\"" << Max.x()-Min.x()+printOffset.x()
-       << "\" height=\""<< Max.y()-Min.y()+printOffset.y() << "\"" << endl
-       << ">" << endl;
-  if (single_layer_no<0) {
-    ostr << "<g id=\"" << layers.size() << "_Layers\">" << endl;
-    for (uint i = 0; i < layers.size(); i++) {
-      ostr << "\t\t" << layers[i]->SVGpath() << endl;
-    }
-  } else {
-    ostr << "<g id=\"" << "Layer_" << single_layer_no
-	 << "_of_" <<layers.size() << "\">" << endl;
-    ostr << "\t\t" << layers[single_layer_no]->SVGpath() << endl;
-  }
-  ostr << "</g>" << endl;
-  ostr << "</svg>" << endl;
-  return ostr.str();
-}
-
+// Slices are written while they are made, a few per thread at a time,
+// and deleted after writing, so the model keeps no layers.
+// The file type is chosen by the extension, see SliceWriter::create().
 void Model::SliceToSVG(Glib::RefPtr<Gio::File> file, bool single_layer)
 {
   if (is_calculating) return;
   is_calculating=true;
+  slicing_settings = settings;
 
-  lastlayer = NULL;
-  Slice();
-  m_progress->stop (_("Done"));
-  if (!single_layer) {
-    Glib::file_set_contents (file->get_path(), getSVG());
+  ClearLayers();
+
+  vector<Shape*> shapes;
+  vector<Matrix4d> transforms;
+  double minZ, maxZ, supportangle;
+  if (!getSliceShapes(shapes, transforms, minZ, maxZ, supportangle)) {
+    is_calculating = false;
+    return;
   }
-  else {
-    uint n_layers = layers.size();
-    m_progress->start (_("Saving Files"),n_layers);
-    uint digits = log10(n_layers)+1;
-    string base = file->get_path();
-    ostringstream ostr;
-    for (uint i = 0; i < n_layers; i++) {
-      ostr.str("");
-      ostr << base;
-      uint nzero = (uint)(digits - log10(i+1));
-      if (i==0) nzero = digits-1;
-      for (uint d = 0; d < nzero; d++)
-	ostr << "0";
-      ostr << i
-	   << ".svg";
-      if (!m_progress->update(i)) break;
-      Glib::file_set_contents (ostr.str(), getSVG(i));
+
+  const Vector3d printOffset = slicing_settings.getPrintMargin();
+  const Vector3d volume = slicing_settings.getPrintVolume();
+  SliceWriter *writer =
+    SliceWriter::create(file->get_path(), single_layer,
+			Vector2d(Max.x()-Min.x()+printOffset.x(),
+				 Max.y()-Min.y()+printOffset.y()),
+			Vector2d(volume.x(), volume.y()),
+			slicing_settings.Misc.ExportDPI);
+
+  bool ok = true;
+  if (shapes.front()->dimensions() == 2 ||
+      (slicing_settings.Slicing.BuildSerial && shapes.size() > 1)) {
+    // layers depend on each other, slice all first
+    Slice();
+    const int num_layers = layers.size();
+    vector<string> rendered(num_layers);
+    ok = writer->begin(num_layers);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int n = 0; n < num_layers; n++)
+      if (ok) rendered[n] = writer->render(*layers[n], n);
+    for (int n = 0; ok && n < num_layers; n++)
+      ok = writer->write(rendered[n], n);
+    ClearLayers();
+  } else {
+    vector<double> layer_z, layer_thickness;
+    layerHeights(slicing_settings, shapes, transforms, minZ, maxZ,
+		 layer_z, layer_thickness);
+    vector< vector<Matrix4d> > instances;
+    vector<bool> skip_instance;
+    findInstances(shapes, transforms, instances, skip_instance);
+
+    const int num_layers = layer_z.size();
+    int chunk = 16;
+#ifdef _OPENMP
+    chunk = 4 * omp_get_max_threads();
+#endif
+    vector<string> rendered(chunk);
+    m_progress->start (_("Exporting Slices"), num_layers);
+    ok = writer->begin(num_layers);
+    for (int first = 0; ok && first < num_layers; first += chunk) {
+      const int last = min(num_layers, first + chunk);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+      for (int n = first; n < last; n++) {
+	double max_gradient = 0;
+	Layer layer(NULL, n, layer_thickness[n], 1);
+	layer.setZ(layer_z[n]);
+	for (uint nshape= 0; nshape < shapes.size(); nshape++) {
+	  if (skip_instance[nshape]) continue;
+	  layer.addShape(transforms[nshape], *shapes[nshape],
+			 layer_z[n], max_gradient, supportangle, instances[nshape]);
+	}
+	rendered[n - first] = writer->render(layer, n);
+      }
+      for (int n = first; ok && n < last; n++)
+	ok = writer->write(rendered[n - first], n);
+      if (!m_progress->update(last)) break;
     }
-    m_progress->stop (_("Done"));
   }
+  ok = writer->end() && ok;
+  delete writer;
+  m_progress->stop (_("Done"));
+  if (!ok)
+    error (_("Could not write all slices"), file->get_path().c_str());
   string directory_path = file->get_parent()->get_path();
   settings.STLPath = directory_path;
   is_calculating = false;
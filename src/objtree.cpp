@@ -272,7 +272,8 @@ void ObjectsTree::get_all_shapes(vector<Shape*>   &allshapes,
   for (uint o = 0; o < Objects.size(); o++) {
     Matrix4d otrans =
       transform3D.transform * Objects[o]->transform3D.transform;
-    allshapes.insert(allshapes.begin(),
+    // in the order of the transforms
+    allshapes.insert(allshapes.end(),
 		     Objects[o]->shapes.begin(), Objects[o]->shapes.end());
     for (uint s = 0; s < Objects[o]->shapes.size(); s++) {
       transforms.push_back(otrans);
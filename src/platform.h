@@ -34,6 +34,9 @@
 	#include <OpenGL/glu.h>
 //	#include <GLUT/glut.h>
 #else
+#ifndef GL_GLEXT_PROTOTYPES
+	#define GL_GLEXT_PROTOTYPES 1	// GL 1.5 buffer objects, see vertexbuffer.cpp
+#endif
 	#include <GL/gl.h>		// Header File For The OpenGL32 Library
 	#include <GL/glu.h>		// Header File For The GLu32 Library
 //#ifndef WIN32
@@ -0,0 +1,228 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2011-12 martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Benchmarks ThreadedPrinterSerial against a fake firmware on a pty.
+// The firmware answers every line with "ok" after a delay drawn from an
+// ok-latency profile, and optionally requests resends.
+//
+// Usage: fake_firmware_test [profile [lines [resend_rate [gcode_file]]]]
+//   profile: fast, marlin, slow (default marlin)
+//   lines: number of generated G1 lines if no gcode_file (default 2000)
+//   resend_rate: fraction of lines answered with "rs" (default 0)
+//
+// Built by "make check", which runs it with the defaults (posix only).
+// Fails if not all lines were sent.
+
+#include "threaded_printer_serial.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+using namespace std;
+
+struct LatencyProfile {
+  const char *name;
+  // Latency in ms is uniform in [min, max] for each class.
+  // Classes are chosen with the given probabilities, last takes the rest.
+  double fast_min, fast_max;
+  double stall_prob, stall_min, stall_max;
+  double long_prob, long_min, long_max;
+};
+
+// fast: firmware with free planner slots, ok comes right after parsing
+// marlin: planner mostly full, many oks wait for a short move to finish
+// slow: every line waits for a move, e.g. tiny segments on an 8 bit board
+static const LatencyProfile profiles[] = {
+  { "fast",   0.3,  1.5, 0.00,  0,   0,   0.000,   0,   0 },
+  { "marlin", 1.0,  4.0, 0.10, 10,  60,   0.005, 150, 400 },
+  { "slow",  15.0, 40.0, 0.05, 60, 120,   0.000,   0,   0 },
+};
+
+struct FakeFirmware {
+  int fd;
+  const LatencyProfile *profile;
+  double resend_rate;
+  unsigned long lines;
+};
+
+static double FakeLatency( const LatencyProfile *p ) {
+  double r = drand48();
+  double min = p->fast_min, max = p->fast_max;
+  if ( r < p->long_prob ) {
+    min = p->long_min;
+    max = p->long_max;
+  } else if ( r < p->long_prob + p->stall_prob ) {
+    min = p->stall_min;
+    max = p->stall_max;
+  }
+  return ( min + ( max - min ) * drand48() ) / 1000.0;
+}
+
+static void FakeReply( int fd, const char *reply ) {
+  size_t len = strlen( reply );
+  while ( len > 0 ) {
+    ssize_t num = write( fd, reply, len );
+    if ( num <= 0 )
+      return;
+    reply += num;
+    len -= num;
+  }
+}
+
+void *FirmwareMain( void *arg ) {
+  FakeFirmware *fw = ( FakeFirmware * ) arg;
+  char buf[ 4096 ];
+  string line;
+
+  FakeReply( fw->fd, "start\n" );
+
+  while ( true ) {
+    ssize_t num = read( fw->fd, buf, sizeof( buf ) );
+    if ( num <= 0 )
+      break;
+
+    for ( ssize_t i = 0; i < num; i++ ) {
+      if ( buf[i] != '\n' ) {
+	line += buf[i];
+	continue;
+      }
+
+      // Line numbers are "N<num> ...", ask for the same line again
+      if ( fw->resend_rate > 0 && drand48() < fw->resend_rate ) {
+	ostringstream os;
+	os << "rs " << strtoul( line.c_str() + 1, NULL, 10 ) << "\n";
+	FakeReply( fw->fd, os.str().c_str() );
+	line.clear();
+	continue;
+      }
+
+      double latency = FakeLatency( fw->profile );
+      ntime_t nts = { ( time_t ) latency,
+		      ( long ) ( ( latency - ( time_t ) latency ) * 1e9 ) };
+      nsleep( &nts );
+
+      if ( line.find( "M115" ) != string::npos )
+	FakeReply( fw->fd, "ok FIRMWARE_NAME:FakeFirmware\n" );
+      else
+	FakeReply( fw->fd, "ok\n" );
+      fw->lines++;
+      line.clear();
+    }
+  }
+
+  return NULL;
+}
+
+int main( int argc, char *argv[] ) {
+  const LatencyProfile *profile = &profiles[1];
+  unsigned long num_lines = 2000;
+  double resend_rate = 0;
+  string gcode;
+
+  if ( argc >= 2 ) {
+    profile = NULL;
+    for ( unsigned int i = 0; i < sizeof( profiles ) / sizeof( profiles[0] ); i++ )
+      if ( strcmp( argv[1], profiles[i].name ) == 0 )
+	profile = &profiles[i];
+    if ( profile == NULL ) {
+      cerr << "Unknown profile " << argv[1] << endl;
+      return 1;
+    }
+  }
+  if ( argc >= 3 )
+    num_lines = strtoul( argv[2], NULL, 10 );
+  if ( argc >= 4 )
+    resend_rate = strtod( argv[3], NULL );
+
+  if ( argc >= 5 ) {
+    ifstream file( argv[4], ifstream::in );
+    char block[ 1024 ];
+    while ( file.good() ) {
+      file.read( block, 1024 );
+      gcode.append( block, file.gcount() );
+    }
+  } else {
+    ostringstream os;
+    os.precision( 3 );
+    os << fixed;
+    for ( unsigned long i = 0; i < num_lines; i++ )
+      os << "G1 X" << 100 + 50 * sin( i * 0.01 ) << " Y" << 100 + 50 * cos( i * 0.01 )
+	 << " E" << i * 0.01 << "\n";
+    gcode = os.str();
+  }
+
+  int master = posix_openpt( O_RDWR | O_NOCTTY );
+  if ( master < 0 || grantpt( master ) != 0 || unlockpt( master ) != 0 ) {
+    cerr << "Cannot open pty: " << strerror( errno ) << endl;
+    return 1;
+  }
+  string slave = ptsname( master );
+
+  srand48( 1 );
+
+  ThreadedPrinterSerial tps;
+  if ( ! tps.Connect( slave, 115200 ) ) {
+    cerr << tps.ReadErrorLog();
+    return 1;
+  }
+
+  FakeFirmware fw;
+  fw.fd = master;
+  fw.profile = profile;
+  fw.resend_rate = resend_rate;
+  fw.lines = 0;
+
+  thread_t firmware;
+  thread_create( &firmware, FirmwareMain, &fw );
+
+  // Wait for the start line and M115 to pass
+  tps.SendAndWaitResponse( "M110" );
+
+  cout << "Profile " << profile->name << ", streaming to " << slave << endl;
+  tps.StartPrinting( gcode );
+
+  const ntime_t poll = { 1, 0 };
+  while ( tps.IsPrinting() ) {
+    nsleep( &poll );
+    tps.ReadLog();
+    cout << tps.GetPrintingProgress() << "/" << tps.GetTotalPrintingLines()
+	 << ": " << tps.GetStats().ToString() << endl;
+  }
+
+  SerialStatsSnapshot stats = tps.GetStats();
+  const bool complete = tps.GetPrintingProgress() >= tps.GetTotalPrintingLines();
+  tps.Disconnect();
+  close( master );
+  thread_join( firmware );
+
+  cout << stats.ToReport();
+
+  if ( ! complete ) {
+    cerr << "Printing stopped before the end" << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -380,6 +380,8 @@ bool PrinterSerial::RawConnect( string device, int baudrate ) {
   // Reset line number
   prev_cmd_line_number = 0;
   
+  stats.Reset();
+  
   return true;
 }
 
@@ -479,6 +481,14 @@ char *PrinterSerial::Send( const char *command ) {
   return SendCommand();
 }
 
+SerialStatsSnapshot PrinterSerial::GetStats( void ) {
+  return stats.GetSnapshot();
+}
+
+void PrinterSerial::ResetStats( void ) {
+  stats.Reset();
+}
+
 // Sends gcode command.  Performs formating and waits for reply.  The line starts at command_scratch + max_command_prefix.  If buffer_response, the reply is entered into the response_buffer.
 char *PrinterSerial::SendCommand( void ) {
   char *formated;
@@ -497,6 +507,9 @@ char *PrinterSerial::SendCommand( void ) {
     return recv_buffer;
   }
   
+  // Latency is measured from the first send, so it includes resends
+  double send_time = nseconds();
+  
   while ( true ) {
     if ( send_text ) {
       if ( ! SendText( formated ) )
@@ -506,12 +519,18 @@ char *PrinterSerial::SendCommand( void ) {
     if ( ( recvd = RecvLine() ) == NULL )
       return NULL;
     
-    if ( strncasecmp( recvd, "ok", 2 ) == 0 || strncasecmp( recvd, "!!", 2 ) == 0 ) {
+    if ( strncasecmp( recvd, "ok", 2 ) == 0 ) {
+      stats.AddLineOk( nseconds() - send_time );
+      return recvd;
+    }
+    
+    if ( strncasecmp( recvd, "!!", 2 ) == 0 ) {
       return recvd;
     }
     
     if ( strncasecmp( recvd, "rs", 2 ) == 0 || strncasecmp( recvd, "resend:", 7 ) == 0 ) {
       // Checksum error, resend the line
+      stats.AddResend();
       send_text = true;
     } else {
       send_text = false;
@@ -584,6 +603,7 @@ bool PrinterSerial::SendText( char *text ) {
   LogLine( text - 4 );
   
   size_t len = strlen( text );
+  size_t total_len = len;
   
 #ifdef WIN32
   DWORD num;
@@ -616,6 +636,8 @@ bool PrinterSerial::SendText( char *text ) {
   }
 #endif
 
+  stats.AddBytesSent( total_len );
+  
   return true;
 }
 
@@ -22,6 +22,8 @@
 #include <iostream>
 #include <vector>
 
+#include "serial_stats.h"
+
 #ifdef WIN32
 #include <windows.h>
 #endif
@@ -44,6 +46,8 @@ protected:
   
   unsigned long prev_cmd_line_number;
   
+  SerialStats stats;
+  
   char *full_command_scratch;
   char *command_scratch;
   char *full_recv_buffer;
@@ -93,4 +97,8 @@ public:
   virtual bool Reset( void );
   
   virtual char *Send( const char *command );
+  
+  // Link throughput and latency since the last Connect or ResetStats
+  SerialStatsSnapshot GetStats( void );
+  void ResetStats( void );
 };
@@ -0,0 +1,187 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2011-12 martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "stdafx.h"
+#else
+#define _( t ) t
+#endif
+
+#include <sstream>
+#include <math.h>
+#include <string.h>
+
+#include "serial_stats.h"
+
+const double SerialStats::min_latency = 10e-6;
+
+SerialStats::SerialStats() {
+  mutex_init( &mutex );
+  Reset();
+}
+
+SerialStats::~SerialStats() {
+  mutex_destroy( &mutex );
+}
+
+void SerialStats::Reset( void ) {
+  mutex_lock( &mutex );
+
+  start_time = nseconds();
+  bytes_sent = 0;
+  lines_sent = 0;
+  resends = 0;
+  memset( latency_hist, 0, sizeof( latency_hist ) );
+  latency_count = 0;
+  latency_max = 0;
+  helper_blocked = 0;
+  helper_idle = 0;
+
+  mutex_unlock( &mutex );
+}
+
+void SerialStats::AddBytesSent( unsigned long bytes ) {
+  mutex_lock( &mutex );
+  bytes_sent += bytes;
+  mutex_unlock( &mutex );
+}
+
+void SerialStats::AddResend( void ) {
+  mutex_lock( &mutex );
+  resends++;
+  mutex_unlock( &mutex );
+}
+
+void SerialStats::AddLineOk( double latency ) {
+  unsigned int bucket = LatencyBucket( latency );
+
+  mutex_lock( &mutex );
+  lines_sent++;
+  latency_hist[ bucket ]++;
+  latency_count++;
+  if ( latency > latency_max )
+    latency_max = latency;
+  mutex_unlock( &mutex );
+}
+
+void SerialStats::AddHelperBlocked( double seconds ) {
+  mutex_lock( &mutex );
+  helper_blocked += seconds;
+  mutex_unlock( &mutex );
+}
+
+void SerialStats::AddHelperIdle( double seconds ) {
+  mutex_lock( &mutex );
+  helper_idle += seconds;
+  mutex_unlock( &mutex );
+}
+
+unsigned int SerialStats::LatencyBucket( double latency ) {
+  if ( latency <= min_latency )
+    return 0;
+
+  double bucket = floor( log2( latency / min_latency ) * bucket_steps );
+  if ( bucket >= latency_buckets - 1 )
+    return latency_buckets - 1;
+
+  return ( unsigned int ) bucket;
+}
+
+// Returns the geometric center of the bucket holding the requested fraction
+// of samples.  Accurate to about 10% with 4 buckets per doubling.
+double SerialStats::LatencyPercentile( double fraction ) const {
+  if ( latency_count == 0 )
+    return 0;
+
+  unsigned long rank = ( unsigned long ) ceil( fraction * latency_count );
+  if ( rank == 0 )
+    rank = 1;
+
+  unsigned long count = 0;
+  unsigned int bucket;
+  for ( bucket = 0; bucket < latency_buckets - 1; bucket++ ) {
+    count += latency_hist[ bucket ];
+    if ( count >= rank )
+      break;
+  }
+
+  double center = min_latency * pow( 2.0, ( bucket + 0.5 ) / bucket_steps );
+  return center < latency_max ? center : latency_max;
+}
+
+SerialStatsSnapshot SerialStats::GetSnapshot( void ) {
+  SerialStatsSnapshot snap;
+
+  mutex_lock( &mutex );
+
+  snap.elapsed = nseconds() - start_time;
+  snap.bytes_sent = bytes_sent;
+  snap.lines_sent = lines_sent;
+  snap.resends = resends;
+  snap.ok_latency_p50 = LatencyPercentile( 0.50 );
+  snap.ok_latency_p99 = LatencyPercentile( 0.99 );
+  snap.ok_latency_max = latency_max;
+  snap.helper_blocked = helper_blocked;
+  snap.helper_idle = helper_idle;
+
+  mutex_unlock( &mutex );
+
+  if ( snap.elapsed > 0 ) {
+    snap.bytes_per_second = snap.bytes_sent / snap.elapsed;
+    snap.lines_per_second = snap.lines_sent / snap.elapsed;
+  } else {
+    snap.bytes_per_second = 0;
+    snap.lines_per_second = 0;
+  }
+
+  return snap;
+}
+
+string SerialStatsSnapshot::ToString( void ) const {
+  ostringstream os;
+  os.precision( 1 );
+  os << fixed;
+  os << lines_per_second << _(" lines/s, ");
+  os << bytes_per_second << _(" bytes/s, ");
+  os << _("ok p50 ") << ok_latency_p50 * 1000 << _(" ms, ");
+  os << _("p99 ") << ok_latency_p99 * 1000 << _(" ms, ");
+  os << resends << _(" resends");
+
+  double busy = helper_blocked + helper_idle;
+  if ( busy > 0 )
+    os << ", " << 100 * helper_blocked / busy << _("% waiting for printer");
+
+  return os.str();
+}
+
+string SerialStatsSnapshot::ToReport( void ) const {
+  ostringstream os;
+  os.precision( 3 );
+  os << fixed;
+  os << _("Elapsed:          ") << elapsed << " s" << endl;
+  os << _("Bytes sent:       ") << bytes_sent << " (" << bytes_per_second << " /s)" << endl;
+  os << _("Lines ok'd:       ") << lines_sent << " (" << lines_per_second << " /s)" << endl;
+  os << _("Resends:          ") << resends << endl;
+  os << _("ok latency p50:   ") << ok_latency_p50 * 1000 << " ms" << endl;
+  os << _("ok latency p99:   ") << ok_latency_p99 * 1000 << " ms" << endl;
+  os << _("ok latency max:   ") << ok_latency_max * 1000 << " ms" << endl;
+  os << _("Helper blocked:   ") << helper_blocked << " s" << endl;
+  os << _("Helper idle:      ") << helper_idle << " s" << endl;
+  return os.str();
+}
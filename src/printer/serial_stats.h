@@ -0,0 +1,83 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2011-12 martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <string>
+
+#include "thread.h"
+
+using namespace std;
+
+// Copy of the serial link counters at one point in time.
+// All times are in seconds.
+struct SerialStatsSnapshot {
+  double elapsed; // time since the counters were last reset
+  unsigned long bytes_sent;
+  unsigned long lines_sent; // lines acknowledged by the printer with "ok"
+  unsigned long resends; // "rs" / "Resend:" requests from the printer
+  double bytes_per_second;
+  double lines_per_second;
+  double ok_latency_p50; // time from first sending a line until its "ok"
+  double ok_latency_p99;
+  double ok_latency_max;
+  double helper_blocked; // helper thread waiting for the printer to reply
+  double helper_idle; // helper thread sleeping with nothing to send
+
+  string ToString( void ) const; // One line summary for status bars
+  string ToReport( void ) const; // Multi line report for terminal output
+};
+
+// Thread-safe counters and ok-latency histogram for a printer link.
+// Written by the thread talking to the printer, read by any thread.
+class SerialStats {
+  // Latency histogram with logarithmic buckets, bucket_steps per doubling
+  // starting at min_latency.  The last bucket collects everything above.
+  static const unsigned int latency_buckets = 100;
+  static const unsigned int bucket_steps = 4;
+  static const double min_latency;
+
+  mutex_t mutex;
+  double start_time;
+  unsigned long bytes_sent;
+  unsigned long lines_sent;
+  unsigned long resends;
+  unsigned long latency_hist[ latency_buckets ];
+  unsigned long latency_count;
+  double latency_max;
+  double helper_blocked;
+  double helper_idle;
+
+  static unsigned int LatencyBucket( double latency );
+  double LatencyPercentile( double fraction ) const; // mutex required
+
+ public:
+  SerialStats();
+  ~SerialStats();
+
+  void Reset( void );
+
+  void AddBytesSent( unsigned long bytes );
+  void AddResend( void );
+  void AddLineOk( double latency );
+  void AddHelperBlocked( double seconds );
+  void AddHelperIdle( double seconds );
+
+  SerialStatsSnapshot GetSnapshot( void );
+};
@@ -102,8 +102,23 @@ inline int nsleep( const ntime_t *req ) {
   Sleep( req->tv_sec * 1000 + ( req->tv_nsec + 999999 ) / 1000000 );
   return 0;
 };
+
+// Monotonic clock in seconds, only useful for measuring intervals
+inline double nseconds( void ) {
+  LARGE_INTEGER count, freq;
+  QueryPerformanceCounter( &count );
+  QueryPerformanceFrequency( &freq );
+  return ( double ) count.QuadPart / ( double ) freq.QuadPart;
+};
 #else
 #include <time.h>
 typedef struct timespec ntime_t;
 inline int nsleep( const ntime_t *req ) { return nanosleep( req, NULL ); };
+
+// Monotonic clock in seconds, only useful for measuring intervals
+inline double nseconds( void ) {
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+};
 #endif
@@ -265,6 +265,8 @@ bool ThreadedPrinterSerial::StartPrinting( string commands, unsigned long start_
   pc_bytes_printed = bytes_printed;
   pc_stop_line = stop_line;
 
+  PrinterSerial::ResetStats();
+
   // Request printing
   request_print = true;
 
@@ -465,6 +467,14 @@ string ThreadedPrinterSerial::ReadErrorLog( bool wait ) {
   return error_buffer.Read( wait );
 }
 
+SerialStatsSnapshot ThreadedPrinterSerial::GetStats( void ) {
+  return PrinterSerial::GetStats();
+}
+
+void ThreadedPrinterSerial::ResetStats( void ) {
+  PrinterSerial::ResetStats();
+}
+
 ////////////////////////////////////////////////////////////////////////////
 //  Helper Thread Funcitons
 ////////////////////////////////////////////////////////////////////////////
@@ -496,12 +506,17 @@ void *ThreadedPrinterSerial::HelperMain( void ) {
 
     CheckPrintingState();
 
+    // Time spent sending is mostly waiting for the printer's reply
+    double start = nseconds();
     if ( command_buffer.Read( command_scratch, max_command_size, false, &return_data ) > 0 ) {
       SendCommand( true );
+      stats.AddHelperBlocked( nseconds() - start );
     } else if ( IsPrinting() ) {
       SendNextPrinterCommand();
+      stats.AddHelperBlocked( nseconds() - start );
     } else {
       nsleep( &helper_thread_sleep );
+      stats.AddHelperIdle( nseconds() - start );
     }
   }
 
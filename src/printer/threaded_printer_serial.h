@@ -145,4 +145,10 @@ class ThreadedPrinterSerial : protected PrinterSerial
 
   string ReadErrorLog( bool wait = false );
   // returns "" if wait is false and no log entries are ready
+
+  SerialStatsSnapshot GetStats( void );
+  // Link throughput, ok latency and helper thread load since the
+  // connection was made or the current print was started
+
+  void ResetStats( void );
 };
@@ -0,0 +1,230 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <fstream>
+#include <sstream>
+#include <ctime>
+#include <iomanip>
+
+#ifndef WIN32
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+#include "profile.h"
+
+void StageProfile::start()
+{
+  m_stages.clear();
+  if (measure_memory) resetPeakRSS();
+  last_wall = wallTime();
+  last_cpu  = cpuTime();
+}
+
+void StageProfile::stage(const string &name)
+{
+  Stage stage;
+  stage.name = name;
+  const double wall = wallTime(), cpu = cpuTime();
+  stage.wall = wall - last_wall;
+  stage.cpu  = cpu - last_cpu;
+  stage.peak_rss = 0;
+  if (measure_memory) {
+    stage.peak_rss = peakRSS();
+    resetPeakRSS();
+  }
+  m_stages.push_back(stage);
+  last_wall = wallTime();
+  last_cpu  = cpuTime();
+}
+
+string StageProfile::json(const Stage &stage)
+{
+  ostringstream ostr;
+  ostr.imbue(std::locale::classic());
+  ostr << "{\"name\": \"" << stage.name << "\", "
+       << "\"wall\": " << stage.wall << ", "
+       << "\"cpu\": " << stage.cpu << ", "
+       << "\"peak_rss_kb\": " << stage.peak_rss << "}";
+  return ostr.str();
+}
+
+double StageProfile::wallTime()
+{
+  Glib::TimeVal now;
+  now.assign_current_time();
+  return now.as_double();
+}
+
+double StageProfile::cpuTime()
+{
+#ifndef WIN32
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+      + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#endif
+  return (double) clock() / CLOCKS_PER_SEC;
+}
+
+long StageProfile::peakRSS()
+{
+  // Linux: the high water mark, which can be reset
+  ifstream status("/proc/self/status");
+  string line;
+  while (getline(status, line))
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      istringstream istr(line.substr(6));
+      long kb = 0;
+      if (istr >> kb) return kb;
+    }
+#ifndef WIN32
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    return usage.ru_maxrss; // peak of the process
+#endif
+  return 0;
+}
+
+void StageProfile::resetPeakRSS()
+{
+  ofstream clear_refs("/proc/self/clear_refs");
+  if (clear_refs.good())
+    clear_refs << "5" << endl;
+}
+
+
+struct TraceEvent {
+  const char *name;
+  char phase;   // 'X' a call, 'C' a counter
+  double time;  // microseconds
+  double value; // duration or count
+};
+
+struct TraceBuffer {
+  uint tid;
+  vector<TraceEvent> events;
+  size_t dropped;
+};
+
+// events per thread, further ones are dropped
+static const size_t TRACE_BUFFER_MAX = 1 << 22;
+
+volatile bool Trace::on = false;
+static double trace_epoch = 0;
+// of all threads that recorded, never freed
+static vector<TraceBuffer*> trace_buffers;
+G_LOCK_DEFINE_STATIC(trace_buffers);
+
+#if GLIB_CHECK_VERSION( 2, 32, 0 )
+static GPrivate trace_buffer = G_PRIVATE_INIT(NULL);
+#define trace_buffer_key (&trace_buffer)
+#else
+static GPrivate *trace_buffer = NULL; // made by enable()
+#define trace_buffer_key trace_buffer
+#endif
+
+static TraceBuffer *threadBuffer()
+{
+  TraceBuffer *buffer = (TraceBuffer *) g_private_get(trace_buffer_key);
+  if (!buffer) { // first event of this thread
+    buffer = new TraceBuffer();
+    buffer->dropped = 0;
+    buffer->events.reserve(4096);
+    G_LOCK(trace_buffers);
+    buffer->tid = trace_buffers.size() + 1;
+    trace_buffers.push_back(buffer);
+    G_UNLOCK(trace_buffers);
+    g_private_set(trace_buffer_key, buffer);
+  }
+  return buffer;
+}
+
+void Trace::enable(bool enable)
+{
+#if !GLIB_CHECK_VERSION( 2, 32, 0 )
+  if (enable && !trace_buffer)
+    trace_buffer = g_private_new(NULL);
+#endif
+  if (enable && trace_epoch == 0)
+    trace_epoch = StageProfile::wallTime();
+  on = enable;
+}
+
+void Trace::clear()
+{
+  G_LOCK(trace_buffers);
+  for (uint i = 0; i < trace_buffers.size(); i++) {
+    trace_buffers[i]->events.clear();
+    trace_buffers[i]->dropped = 0;
+  }
+  G_UNLOCK(trace_buffers);
+  trace_epoch = StageProfile::wallTime();
+}
+
+double Trace::now()
+{
+  return (StageProfile::wallTime() - trace_epoch) * 1e6;
+}
+
+void Trace::record(const char *name, char phase, double time, double value)
+{
+  TraceBuffer *buffer = threadBuffer();
+  if (buffer->events.size() >= TRACE_BUFFER_MAX) {
+    buffer->dropped++;
+    return;
+  }
+  TraceEvent event = { name, phase, time, value };
+  buffer->events.push_back(event);
+}
+
+bool Trace::save(const string &path, string &error)
+{
+  ofstream file(path.c_str(), ios::out | ios::trunc);
+  file.imbue(std::locale::classic());
+  file << fixed << setprecision(3) << "{\"traceEvents\": [";
+  size_t dropped = 0;
+  G_LOCK(trace_buffers);
+  for (uint i = 0; i < trace_buffers.size(); i++) {
+    const TraceBuffer *buffer = trace_buffers[i];
+    file << (i > 0 ? "," : "")
+	 << "\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+	 << buffer->tid << ", \"args\": {\"name\": \"thread " << buffer->tid << "\"}}";
+    for (uint e = 0; e < buffer->events.size(); e++) {
+      const TraceEvent &event = buffer->events[e];
+      file << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"" << event.phase
+	   << "\", \"pid\": 1, \"tid\": " << buffer->tid
+	   << ", \"ts\": " << event.time;
+      if (event.phase == 'X')
+	file << ", \"dur\": " << event.value << "}";
+      else
+	file << ", \"args\": {\"value\": " << event.value << "}}";
+    }
+    dropped += buffer->dropped;
+  }
+  G_UNLOCK(trace_buffers);
+  file << "\n],\n\"displayTimeUnit\": \"ms\",\n"
+       << "\"otherData\": {\"dropped_events\": " << dropped << "}}\n";
+  file.close();
+  if (file.fail()) {
+    error = _("Could not write ") + path;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,103 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include "stdafx.h"
+
+// Wall time, cpu time of all threads and peak resident memory of the
+// consecutive stages of a computation.  Call start() before the first
+// stage and stage() at the end of each.  The memory is only measured
+// if asked for: it resets the peak of the whole process.
+class StageProfile
+{
+ public:
+  struct Stage {
+    string name;
+    double wall, cpu; // seconds
+    long peak_rss;    // kB, during the stage where the system tells
+  };
+
+  StageProfile() : last_wall(0), last_cpu(0), measure_memory(false) {}
+
+  // peak_rss of the stages, 0 if not
+  void setMeasureMemory(bool measure) { measure_memory = measure; }
+
+  void start();
+  void stage(const string &name);
+  const vector<Stage> &stages() const { return m_stages; }
+
+  // {"name": .., "wall": .., "cpu": .., "peak_rss_kb": ..}
+  static string json(const Stage &stage);
+
+  static double wallTime(); // seconds, from any start
+  static double cpuTime();  // seconds used by the process
+  static long peakRSS();    // kB
+  // make peakRSS() the peak from now on, if possible
+  static void resetPeakRSS();
+
+ private:
+  vector<Stage> m_stages;
+  double last_wall, last_cpu;
+  bool measure_memory;
+};
+
+
+// A trace of the calls of the hot functions and of counters, to see
+// which of them take the time, in Chrome's trace event format
+// (chrome://tracing, Perfetto).  Off by default: then a TRACE_SCOPE
+// costs one test of a flag.  When on, every thread records into its
+// own buffer without locking; clear() and save() may only be called
+// while no traced code runs.
+class Trace
+{
+ public:
+  static bool enabled() { return on; }
+  static void enable(bool enable);
+  static void clear();
+  // all events recorded since clear()
+  static bool save(const string &path, string &error);
+
+  // name must be a string constant
+  static void counter(const char *name, double value)
+  { if (on) record(name, 'C', now(), value); }
+
+ private:
+  friend class TraceScope;
+  static volatile bool on;
+  static double now(); // microseconds since clear()
+  static void record(const char *name, char phase, double time, double value);
+};
+
+// Records the time from its construction to the end of the scope:
+//   TRACE_SCOPE("Clipping::getOffset");
+class TraceScope
+{
+ public:
+  TraceScope(const char *name) : name(name), begin(Trace::on ? Trace::now() : -1) {}
+  ~TraceScope() {
+    if (begin >= 0 && Trace::on)
+      Trace::record(name, 'X', begin, Trace::now() - begin);
+  }
+ private:
+  const char *name;
+  double begin;
+};
+
+#define TRACE_SCOPE(name) TraceScope trace_scope(name)
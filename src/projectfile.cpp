@@ -0,0 +1,229 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include <cstring>
+#include <fstream>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "projectfile.h"
+
+static const char MAGIC[8] = { 'R','S','P','R','O','J',0,0 };
+static const guint32 BYTE_ORDER_MARK = 0x01020304;
+
+static inline guint64 aligned(guint64 n) { return (n + 7) & ~(guint64)7; }
+
+
+void ProjectSection::putString(const string &s)
+{
+  put<guint32>(s.size());
+  buf.append(s);
+}
+
+void ProjectSection::putVector3d(const Vector3d &v)
+{
+  for (uint i = 0; i < 3; i++) put<double>(v[i]);
+}
+
+void ProjectSection::putMatrix(const Matrix4d &m)
+{
+  for (uint i = 0; i < 4; i++)
+    for (uint j = 0; j < 4; j++)
+      put<double>(m(i,j));
+}
+
+string ProjectSection::getString()
+{
+  const guint32 length = get<guint32>();
+  if (!ok || pos + length > size) {
+    ok = false;
+    return "";
+  }
+  string s(data + pos, length);
+  pos += length;
+  return s;
+}
+
+Vector3d ProjectSection::getVector3d()
+{
+  Vector3d v;
+  for (uint i = 0; i < 3; i++) v[i] = get<double>();
+  return v;
+}
+
+Matrix4d ProjectSection::getMatrix()
+{
+  Matrix4d m;
+  for (uint i = 0; i < 4; i++)
+    for (uint j = 0; j < 4; j++)
+      m(i,j) = get<double>();
+  return m;
+}
+
+
+ProjectFile::ProjectFile()
+  : mapped(NULL)
+{
+}
+
+ProjectFile::~ProjectFile()
+{
+  if (mapped) g_mapped_file_unref(mapped);
+}
+
+ProjectSection &ProjectFile::add(Tag tag, bool compressed)
+{
+  compress[tag] = compressed;
+  return sections[tag];
+}
+
+bool ProjectFile::save(const string &path, string &error) const
+{
+  // the stored data of all sections, compressed if asked and possible
+  vector<Entry> table;
+  vector<string> stored;
+  guint64 offset = aligned(sizeof(MAGIC) + 3*sizeof(guint32)
+			   + sections.size() * sizeof(Entry));
+  for (map<guint32, ProjectSection>::const_iterator s = sections.begin();
+       s != sections.end(); s++) {
+    Entry entry;
+    entry.tag = s->first;
+    entry.compressed = 0;
+    entry.size = s->second.buf.size();
+    stored.push_back(string());
+#ifdef HAVE_ZLIB
+    if (compress.find(s->first)->second && entry.size > 0) {
+      uLongf length = compressBound(entry.size);
+      stored.back().resize(length);
+      if (compress2((Bytef *)&stored.back()[0], &length,
+		    (const Bytef *)s->second.buf.data(), entry.size,
+		    Z_BEST_SPEED) == Z_OK && length < entry.size) {
+	stored.back().resize(length);
+	entry.compressed = 1;
+      } else
+	stored.back().clear();
+    }
+#endif
+    if (!entry.compressed)
+      stored.back() = s->second.buf;
+    entry.offset = offset;
+    entry.stored = stored.back().size();
+    offset = aligned(offset + entry.stored);
+    table.push_back(entry);
+  }
+
+  ofstream file(path.c_str(), ios::out | ios::trunc | ios::binary);
+  const guint32 header[3] = { VERSION, BYTE_ORDER_MARK, (guint32)table.size() };
+  file.write(MAGIC, sizeof(MAGIC));
+  file.write((const char *)header, sizeof(header));
+  if (!table.empty())
+    file.write((const char *)&table[0], table.size() * sizeof(Entry));
+  const char zeros[8] = { 0,0,0,0,0,0,0,0 };
+  guint64 written = sizeof(MAGIC) + sizeof(header) + table.size() * sizeof(Entry);
+  for (uint i = 0; i < table.size(); i++) {
+    file.write(zeros, table[i].offset - written);
+    file.write(stored[i].data(), stored[i].size());
+    written = table[i].offset + stored[i].size();
+  }
+  file.close();
+  if (file.fail()) {
+    error = _("Could not write ") + path;
+    return false;
+  }
+  return true;
+}
+
+bool ProjectFile::open(const string &path, string &error)
+{
+  GError *gerror = NULL;
+  mapped = g_mapped_file_new(path.c_str(), FALSE, &gerror);
+  if (!mapped) {
+    error = gerror->message;
+    g_error_free(gerror);
+    return false;
+  }
+  const char *contents = g_mapped_file_get_contents(mapped);
+  const guint64 length = g_mapped_file_get_length(mapped);
+  guint32 header[3];
+  const guint64 headersize = sizeof(MAGIC) + sizeof(header);
+  if (length < headersize || memcmp(contents, MAGIC, sizeof(MAGIC)) != 0) {
+    error = _("Not a RepSnapper project file");
+    return false;
+  }
+  memcpy(header, contents + sizeof(MAGIC), sizeof(header));
+  if (header[1] != BYTE_ORDER_MARK) {
+    error = _("Project file from a machine with another byte order");
+    return false;
+  }
+  if (header[0] > VERSION) {
+    error = _("Project file from a newer version of RepSnapper");
+    return false;
+  }
+  if (length < headersize + header[2] * sizeof(Entry)) {
+    error = _("Project file is truncated");
+    return false;
+  }
+  for (uint i = 0; i < header[2]; i++) {
+    Entry entry;
+    memcpy(&entry, contents + headersize + i * sizeof(Entry), sizeof(Entry));
+    if (entry.offset > length || entry.stored > length - entry.offset)
+      continue; // truncated
+    entries[entry.tag] = entry;
+  }
+  return true;
+}
+
+bool ProjectFile::has(Tag tag) const
+{
+  return entries.find(tag) != entries.end();
+}
+
+ProjectSection *ProjectFile::section(Tag tag)
+{
+  map<guint32, Entry>::const_iterator e = entries.find(tag);
+  if (e == entries.end() || !mapped) return NULL;
+  const Entry &entry = e->second;
+  ProjectSection &section = sections[tag];
+  const char *stored = g_mapped_file_get_contents(mapped) + entry.offset;
+  if (!entry.compressed) {
+    if (entry.stored != entry.size) return NULL;
+    section.data = stored; // in place
+  } else {
+#ifdef HAVE_ZLIB
+    section.inflated.resize(entry.size);
+    uLongf length = entry.size;
+    if (uncompress((Bytef *)&section.inflated[0], &length,
+		   (const Bytef *)stored, entry.stored) != Z_OK
+	|| length != entry.size)
+      return NULL;
+    section.data = &section.inflated[0];
+#else
+    cerr << _("Compressed project section, but no zlib") << endl;
+    return NULL;
+#endif
+  }
+  section.size = entry.size;
+  section.pos = 0;
+  section.ok = true;
+  return &section;
+}
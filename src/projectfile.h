@@ -0,0 +1,102 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <cstring>
+#include <map>
+
+#include "stdafx.h"
+
+// Binary project file (.rsp): a header, a table of sections and the
+// sections, each 8 byte aligned so they can be read in place from the
+// mapped file, or zlib compressed when that is available.
+// Numbers are stored in the byte order of the machine, a marker in the
+// header rejects files from the other order.
+//
+//   header:  "RSPROJ\0\0", guint32 version, byte order marker,
+//            guint32 number of sections
+//   table:   per section guint32 tag, guint32 compressed,
+//            guint64 offset, stored size, size
+
+// a section while writing or reading
+class ProjectSection
+{
+ public:
+  ProjectSection() : data(NULL), size(0), pos(0), ok(true) {}
+
+  template <class T> void put(const T &value)
+  { buf.append((const char *)&value, sizeof(T)); }
+  void putString(const string &s);
+  void putVector3d(const Vector3d &v);
+  void putMatrix(const Matrix4d &m);
+
+  // false (and zeros) if reading past the end
+  template <class T> T get()
+  {
+    T value = T();
+    if (pos + sizeof(T) > size) { ok = false; return value; }
+    memcpy(&value, data + pos, sizeof(T));
+    pos += sizeof(T);
+    return value;
+  }
+  string getString();
+  Vector3d getVector3d();
+  Matrix4d getMatrix();
+  bool good() const { return ok; }
+  size_t remaining() const { return size - pos; }
+
+ private:
+  friend class ProjectFile;
+  string buf;             // written
+  vector<char> inflated;  // read and uncompressed
+  const char *data;       // read
+  size_t size, pos;
+  bool ok;
+};
+
+class ProjectFile
+{
+ public:
+  enum Tag { KEYS = 1, OBJECTS, LAYERS, COMMANDS, GCODETEXT };
+  static const guint32 VERSION = 1;
+
+  ProjectFile();
+  ~ProjectFile();
+
+  // writing
+  ProjectSection &add(Tag tag, bool compress = false);
+  bool save(const string &path, string &error) const;
+
+  // reading
+  bool open(const string &path, string &error);
+  bool has(Tag tag) const;
+  // NULL if missing or broken
+  ProjectSection *section(Tag tag);
+
+ private:
+  struct Entry {
+    guint32 tag, compressed;
+    guint64 offset, stored, size;
+  };
+  map<guint32, ProjectSection> sections;
+  map<guint32, bool> compress;
+  map<guint32, Entry> entries;
+  GMappedFile *mapped;
+};
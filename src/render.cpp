@@ -42,7 +42,8 @@ inline GtkWidget *Render::get_widget()
 inline Model *Render::get_model() const { return m_view->get_model(); }
 
 Render::Render (View *view, Glib::RefPtr<Gtk::TreeSelection> selection) :
-  m_arcBall(new ArcBall()), m_view (view), m_selection(selection)
+  m_arcBall(new ArcBall()), m_rotating(false),
+  m_view (view), m_selection(selection)
 {
 
   set_events (Gdk::POINTER_MOTION_MASK |
@@ -274,7 +275,7 @@ bool Render::on_expose_event(GdkEventExpose* event)
 
   vector<Gtk::TreeModel::Path> selpath = m_selection->get_selected_rows();
 
-  m_view->Draw (selpath);
+  m_view->Draw (selpath, false, m_rotating);
 
   glPopMatrix();
 
@@ -368,6 +369,10 @@ bool Render::on_button_press_event(GdkEventButton* event)
 bool Render::on_button_release_event(GdkEventButton* event)
 {
   //dragging = false;
+  if (m_rotating) { // redraw in full detail
+    m_rotating = false;
+    queue_draw();
+  }
   if (event->state & GDK_SHIFT_MASK || event->state & GDK_CONTROL_MASK)  {
     // move/rotate object
     get_model()->ModelChanged();
@@ -473,6 +478,7 @@ bool Render::on_motion_notify_event(GdkEventMotion* event)
       //Vector3d axis(delta.y(), delta.x(), 0);
       //rotArcballTrans(m_transform, axis, -delta.length()/100.);
       m_arcBall->dragAccumulate(event->x, event->y, &m_transform);
+      m_rotating = true;
     }
     if (redraw) queue_draw();
     return true;
@@ -535,86 +541,33 @@ void Render::CenterView()
 }
 
 
+// Pick by casting the mouse ray against the shapes on the CPU,
+// see Model::find_shape_at()
 guint Render::find_object_at(gdouble x, gdouble y)
 {
-  // Render everything in selection mode
   Glib::RefPtr<Gdk::GL::Drawable> gldrawable = get_gl_drawable();
   if (!gldrawable->gl_begin(get_gl_context()))
-    return false;
-
-  const GLsizei BUFSIZE = 256;
-  GLuint select_buffer[BUFSIZE];
-
-  glSelectBuffer(BUFSIZE, select_buffer);
-  (void)glRenderMode(GL_SELECT);
-
-  GLint viewport[4];
+    return 0;
 
-  glMatrixMode (GL_PROJECTION);
-  glPushMatrix();
-  glLoadIdentity ();
-  glGetIntegerv(GL_VIEWPORT,viewport);
-  gluPickMatrix(x,viewport[3]-y,2,2,viewport); // 2x2 pixels around the cursor
-  gluPerspective (45.0f, (float)get_width()/(float)get_height(),1.0f, 1000000.0f);
+  // same view as in on_expose_event
   glMatrixMode (GL_MODELVIEW);
-  glInitNames();
-  glPushName(0);
   glLoadIdentity ();
-
   glTranslatef (0.0, 0.0, -2.0 * m_zoom);
   glMultMatrixf (m_transform.M);
   CenterView();
-  glPushMatrix();
-  glColor3f(0.75f,0.75f,1.0f);
-
-  glLightModeli(GL_LIGHT_MODEL_LOCAL_VIEWER, 1);
-
-  vector<Gtk::TreeModel::Path> no_object;
-  m_view->Draw (no_object, true);
 
-  // restor projection and model matrices
-  glMatrixMode(GL_PROJECTION);
-  glPopMatrix();
-  glMatrixMode(GL_MODELVIEW);
-  glPopMatrix();
-  // restore rendering mode
-  GLint hits = glRenderMode(GL_RENDER);
-
-  if (gldrawable->is_double_buffered())
-    gldrawable->swap_buffers();
-  else
-    glFlush();
+  Vector3d origin, dir;
+  mouse_ray(x, y, origin, dir);
   gldrawable->gl_end();
 
-  // Process the selection hits
-  GLuint *ptr = select_buffer;
-  GLuint name = 0;
-  GLuint minZ = G_MAXUINT;
-
-  for (GLint i = 0; i < hits; i++) { /*  for each hit  */
-     GLuint n = *ptr++; // number of hits in this record
-     GLuint z1 = *ptr++; // Minimum Z in the hit record
-     ptr++; // Skip Maximum Z coord
-     if (n > 0 && z1 < minZ) {
-       // Found an object further forward.
-       name = *ptr;
-       minZ = z1;
-     }
-     ptr += n; // Skip n name records;
-  }
-
-  return name;
+  double t;
+  return get_model()->find_shape_at(origin, dir, t);
 }
 
-
-// http://www.3dkingdoms.com/selection.html
-Vector3d Render::mouse_on_plane(double x, double y, double plane_z) const
+// Ray from the near to the far plane through window point (x,y),
+// in the coordinates of the current modelview matrix
+void Render::mouse_ray(double x, double y, Vector3d &origin, Vector3d &dir) const
 {
-  Vector3d margin;
-  Model *m = get_model();
-  if (m!=NULL) margin = m->settings.getPrintMargin();
-
- // This function will find 2 points in world space that are on the line into the screen defined by screen-space( ie. window-space ) point (x,y)
   double mvmatrix[16];
   double projmatrix[16];
   int viewport[4];
@@ -626,9 +579,22 @@ Vector3d Render::mouse_on_plane(double x, double y, double plane_z) const
   dClickY = double ((double)get_height() - y); // OpenGL renders with (0,0) on bottom, mouse reports with (0,0) on top
 
   gluUnProject ((double) x, dClickY, 0.0, mvmatrix, projmatrix, viewport, &dX, &dY, &dZ);
-  Vector3d rayP1( dX, dY, dZ );
+  origin = Vector3d( dX, dY, dZ );
   gluUnProject ((double) x, dClickY, 1.0, mvmatrix, projmatrix, viewport, &dX, &dY, &dZ);
-  Vector3d rayP2( dX, dY, dZ );
+  dir = Vector3d( dX, dY, dZ ) - origin;
+}
+
+// http://www.3dkingdoms.com/selection.html
+Vector3d Render::mouse_on_plane(double x, double y, double plane_z) const
+{
+  Vector3d margin;
+  Model *m = get_model();
+  if (m!=NULL) margin = m->settings.getPrintMargin();
+
+ // This function will find 2 points in world space that are on the line into the screen defined by screen-space( ie. window-space ) point (x,y)
+  Vector3d rayP1, raydir;
+  mouse_ray(x, y, rayP1, raydir);
+  Vector3d rayP2 = rayP1 + raydir;
 
   // intersect with z=plane_z;
   if (rayP2.z() != rayP1.z()) {
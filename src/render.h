@@ -30,6 +30,7 @@ class Settings;
 class Render : public Gtk::GL::DrawingArea
 {
   ArcBall  *m_arcBall;
+  bool      m_rotating; // arcball drag in progress
   Matrix4fT m_transform;
   Vector2f  m_downPoint;
   Vector2f  m_dragStart;
@@ -48,6 +49,7 @@ class Render : public Gtk::GL::DrawingArea
   void CenterView();
   void selection_changed();
   guint find_object_at(gdouble x, gdouble y);
+  void mouse_ray(double x, double y, Vector3d &origin, Vector3d &dir) const;
   Vector3d mouse_on_plane(double x, double y, double plane_z=0) const;
 
  public:
@@ -29,6 +29,7 @@
 #include "ui/progress.h"
 #include "gcode/gcode.h"
 #include "model.h"
+#include "batchserver.h"
 
 using namespace std;
 
@@ -45,12 +46,18 @@ public:
 	string printerdevice_path;
   string svg_output_path;
   bool svg_single_output;
+  bool serial_stats;
+  string spool_dir;
+  uint jobs;
+  string trace_path;
 	std::vector<std::string> files;
 private:
 	void init ()
 	{
 		// specify defaults here or in the block below
 		use_gui = true;
+		serial_stats = false;
+		jobs = 0;
 	}
 	void version ()
 	{
@@ -69,9 +76,20 @@ private:
 			     "  -o, --output [file]    if not head-less (-t),\n"
 			     "                         enter non-printing GUI mode\n"
 			     "                         only able to output gcode to [file]\n"
-			     "  --svg [file]           slice to SVG file\n"
+			     "  --svg [file]           slice to SVG file, or to images\n"
+			     "                         [file]NNNN.png or .pbm if named so\n"
 			     "  --ssvg [file]          slice to single layer SVG files [file]NNNN.svg\n"
 			     "  -s, --settings [file]  read render settings [file]\n"
+			     "  -p, --printnow [dev]   print input Model on printer [dev]\n"
+			     "  --stats                with -t and -p, wait for the print and\n"
+			     "                         dump serial link statistics\n"
+			     "  --spool [dir]          head-less, slice the jobs put in [dir]\n"
+			     "                         until a file named quit appears there\n"
+			     "  -j, --jobs [n]         with --spool, slice [n] jobs at once\n"
+			     "                         (default: one per processor)\n"
+			     "  --trace [file]         write a trace of the slicing functions\n"
+			     "                         to [file] (chrome://tracing) at exit,\n"
+			     "                         with --spool of all jobs together\n"
 			     "  -h, --help             show this help\n"
 			     "\n"
 			     "Report bugs to #repsnapper, irc.freenode.net\n\n"));
@@ -117,6 +135,17 @@ public:
 				svg_output_path = argv[++i];
 				svg_single_output = true;
 			}
+			else if (!strcmp (arg, "--stats"))
+				serial_stats = true;
+			else if (param && !strcmp (arg, "--spool")) {
+				spool_dir = argv[++i];
+				use_gui = false;
+			}
+			else if (param && (!strcmp (arg, "-j") ||
+					   !strcmp (arg, "--jobs")))
+				jobs = atoi (argv[++i]);
+			else if (param && !strcmp (arg, "--trace"))
+				trace_path = argv[++i];
 			else if (!strcmp (arg, "--version") || !strcmp (arg, "-v"))
 				version();
 			else
@@ -126,6 +155,24 @@ public:
 	// add more options above
 };
 
+// --trace: records from start to exit of main
+struct TraceToFile
+{
+  string path;
+  TraceToFile(const string &path) : path(path)
+  {
+    if (path.size() > 0) Trace::enable(true);
+  }
+  ~TraceToFile()
+  {
+    if (path.size() == 0) return;
+    Trace::enable(false);
+    string error;
+    if (!Trace::save(path, error))
+      cerr << error << endl;
+  }
+};
+
 Glib::RefPtr<Gio::File> find_global_config(const std::string filename) {
   std::vector<std::string> dirs = Platform::getConfigPaths();
   Glib::RefPtr<Gio::File> f;
@@ -140,15 +187,45 @@ Glib::RefPtr<Gio::File> find_global_config(const std::string filename) {
   return Glib::RefPtr<Gio::File>();
 }
 
+// --spool runs on machines without a display, so it is looked
+// for before gtk is started
+static bool spool_mode(int argc, char **argv)
+{
+  for (int i = 1; i < argc; i++)
+    if (!strcmp (argv[i], "--spool")) return true;
+  return false;
+}
+
+// a message box, or stderr without a display
+static void show_error(bool gui, const string &title, const string &text,
+		       Gtk::MessageType type = Gtk::MESSAGE_ERROR)
+{
+  if (!gui) {
+    cerr << title << ": " << text << endl;
+    return;
+  }
+  Gtk::MessageDialog dialog (title, false, type, Gtk::BUTTONS_CLOSE);
+  dialog.set_secondary_text(text);
+  dialog.run();
+}
+
 int main(int argc, char **argv)
 {
   Glib::thread_init();
 
-  // gdk_threads_init();
-
-  // gdk_threads_enter();
-  Gtk::Main tk(argc, argv);
-  // gdk_threads_leave();
+  const bool headless = spool_mode(argc, argv);
+  Gtk::Main *tk = NULL;
+  if (headless) {
+    // the batch models have text buffers, but no widgets
+    gtk_init_check(&argc, &argv);
+    Gtk::Main::init_gtkmm_internals();
+  } else {
+    // gdk_threads_init();
+
+    // gdk_threads_enter();
+    tk = new Gtk::Main(argc, argv);
+    // gdk_threads_leave();
+  }
 
   gchar *locale_dir;
 
@@ -170,6 +247,7 @@ int main(int argc, char **argv)
   save_locales();
 
   CommandLineOptions opts (argc, argv);
+  TraceToFile trace (opts.trace_path);
 
   Platform::setBinaryPath (argv[0]);
 
@@ -183,10 +261,8 @@ int main(int argc, char **argv)
       break;
 
     default:
-      Gtk::MessageDialog dialog (_("Couldn't create user config directory!"),
-				 false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_CLOSE);
-      dialog.set_secondary_text(e.what());
-      dialog.run();
+      show_error(!headless, _("Couldn't create user config directory!"),
+		 e.what());
       return 1;
     }
   }
@@ -204,10 +280,8 @@ int main(int argc, char **argv)
     if(!global) {
       // Don't leave an empty config file behind
       conf->remove();
-      Gtk::MessageDialog dialog (_("Couldn't find global configuration!"),
-				 false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_CLOSE);
-      dialog.set_secondary_text (_("It is likely that repsnapper is not correctly installed."));
-      dialog.run();
+      show_error(!headless, _("Couldn't find global configuration!"),
+		 _("It is likely that repsnapper is not correctly installed."));
       return 1;
     }
 
@@ -221,16 +295,13 @@ int main(int argc, char **argv)
     case Gio::Error::PERMISSION_DENIED:
     {
       // Fall back to global config
-      Gtk::MessageDialog dialog (_("Unable to create user config"), false,
-                                Gtk::MESSAGE_WARNING, Gtk::BUTTONS_CLOSE);
-      dialog.set_secondary_text(e.what() + _("\nFalling back to global config. Settings will not be saved."));
-      dialog.run();
+      show_error(!headless, _("Unable to create user config"),
+		 e.what() + _("\nFalling back to global config. Settings will not be saved."),
+		 Gtk::MESSAGE_WARNING);
       conf = find_global_config("repsnapper.conf");
       if(!conf) {
-        Gtk::MessageDialog dialog (_("Couldn't find global configuration!"), false,
-                                  Gtk::MESSAGE_ERROR, Gtk::BUTTONS_CLOSE);
-        dialog.set_secondary_text (_("It is likely that repsnapper is not correctly installed."));
-        dialog.run();
+        show_error(!headless, _("Couldn't find global configuration!"),
+		   _("It is likely that repsnapper is not correctly installed."));
         return 1;
       }
       break;
@@ -238,20 +309,23 @@ int main(int argc, char **argv)
 
     default:
     {
-      Gtk::MessageDialog dialog (_("Failed to locate config"), false,
-				 Gtk::MESSAGE_ERROR, Gtk::BUTTONS_CLOSE);
-      dialog.set_secondary_text(e.what());
-      dialog.run();
+      show_error(!headless, _("Failed to locate config"), e.what());
       return 1;
     }
     }
   }
 
-  Model *model = new Model();
-
   if (opts.settings_path.size() > 0)
     conf = Gio::File::create_for_path(opts.settings_path);
 
+  if (opts.spool_dir.size() > 0) {
+    BatchServer server(opts.spool_dir, opts.jobs,
+		       conf->query_exists() ? conf->get_path() : "");
+    return server.run();
+  }
+
+  Model *model = new Model();
+
   if (conf->query_exists())
     model->LoadConfig(conf);
 
@@ -283,6 +357,15 @@ int main(int argc, char **argv)
 	printer.setModel(model);
 	printer.Connect();
 	printer.StartPrinting();
+	if (opts.serial_stats) {
+	  while (printer.IsPrinting()) {
+	    Glib::usleep(5 * G_USEC_PER_SEC);
+	    cerr << printer.GetPrintingProgress() << "/"
+		 << printer.GetTotalPrintingLines() << ": "
+		 << printer.GetStats().ToString() << endl;
+	  }
+	  cerr << printer.GetStats().ToReport();
+	}
 	printer.Disconnect();
 	return 0;
       }
@@ -322,10 +405,11 @@ int main(int argc, char **argv)
 
   model->ModelChanged();
 
-  tk.run();
+  tk->run();
 
   delete mainwin;
   delete model;
+  delete tk;
 
   return 0;
 }
@@ -116,6 +116,8 @@ static struct {
   FLOAT_MEMBER (Hardware.MaxMoveSpeedXY, 180, true),
   FLOAT_MEMBER (Hardware.MinMoveSpeedZ,  1, true),
   FLOAT_MEMBER (Hardware.MaxMoveSpeedZ,  3, true),
+  FLOAT_MEMBER (Hardware.Acceleration, 1000, false),
+  FLOAT_MEMBER (Hardware.JunctionDeviation, 0.05, false),
 
   // FLOAT_MEMBER (Hardware.DistanceToReachFullSpeed, "DistanceToReachFullSpeed", 1.5, false),
   // Volume.
@@ -207,6 +209,8 @@ static struct {
   BOOL_MEMBER   (Slicing.FillSkirt, false, true),
   INT_MEMBER    (Slicing.Skins, 1, true),
   BOOL_MEMBER   (Slicing.Varslicing, false, true),
+  FLOAT_MEMBER  (Slicing.MinLayerThickness,  0.1, true),
+  FLOAT_MEMBER  (Slicing.CuspHeight,  0.05, true),
   BOOL_MEMBER   (Slicing.DoInfill, true, true),
   INT_MEMBER    (Slicing.ShellCount, 1, true),
   // BOOL_MEMBER   (Slicing.EnableAcceleration, true, false),
@@ -225,7 +229,7 @@ static struct {
   FLOAT_MEMBER  (Slicing.FirstLayersSpeed, 0.5, true),
   FLOAT_MEMBER  (Slicing.FirstLayersInfillDist, 0.8, true),
   FLOAT_MEMBER  (Slicing.FirstLayerHeight,  0.7, true),
-  BOOL_MEMBER   (Slicing.UseArcs, false, true),
+  BOOL_MEMBER   (Slicing.UseArcs, true, true),
   FLOAT_MEMBER  (Slicing.ArcsMaxAngle,  20, true),
   FLOAT_MEMBER  (Slicing.MinArcLength,  1, true),
   BOOL_MEMBER   (Slicing.RoundCorners, true, true),
@@ -242,9 +246,12 @@ static struct {
   // Misc.
   BOOL_MEMBER (Misc.SpeedsAreMMperSec,  false, false),
   BOOL_MEMBER (Misc.ShapeAutoplace,     true,  false),
+  BOOL_MEMBER (Misc.ArrangeRotate,      true,  false),
   //BOOL_MEMBER (Misc.FileLoggingEnabled,  true, false),
   BOOL_MEMBER (Misc.TempReadingEnabled, true,  false),
   BOOL_MEMBER (Misc.SaveSingleShapeSTL, false, false),
+  FLOAT_MEMBER (Misc.ExportDPI,         254,   false),
+  STRING_MEMBER (Misc.TraceFile,        "",    false),
 
   // GCode - handled by GCodeImpl
   BOOL_MEMBER (Display.DisplayGCode, true, true),
@@ -325,6 +332,8 @@ static struct {
 
   // Slicing
   { "Slicing.LayerThickness", 0.01, 3.0, 0.01, 0.2 },
+  { "Slicing.MinLayerThickness", 0.01, 3.0, 0.01, 0.1 },
+  { "Slicing.CuspHeight", 0.001, 1.0, 0.005, 0.05 },
   { "Slicing.ShellCount", 0, 100, 1, 5 },
   // { "Slicing.SolidLayers", 0, 100, 1, 5 },
   { "Slicing.SolidThickness", 0, 10, 0.01, 0.1 },
@@ -366,6 +375,9 @@ static struct {
   // Milling
   { "Milling.ToolDiameter", 0, 5, 0.01, 0.1 },
 
+  // Misc
+  { "Misc.ExportDPI", 10, 5000, 1, 50 },
+
   // Hardware
   { "Hardware.Volume.X", 0.0, 1000.0, 5.0, 25.0 },
   { "Hardware.Volume.Y", 0.0, 1000.0, 5.0, 25.0 },
@@ -377,6 +389,8 @@ static struct {
   { "Hardware.MaxMoveSpeedXY", 0.1, 2000.0, 1.0, 10.0 },
   { "Hardware.MinMoveSpeedZ", 0.1, 250.0, 1.0, 10.0 },
   { "Hardware.MaxMoveSpeedZ", 0.1, 250.0, 1.0, 10.0 },
+  { "Hardware.Acceleration", 0.0, 50000.0, 100.0, 1000.0 },
+  { "Hardware.JunctionDeviation", 0.0, 1.0, 0.001, 0.01 },
   { "Hardware.KeepLines", 100.0, 100000.0, 1.0, 500.0 },
   // { "Hardware.DistanceToReachFullSpeed", 0.0, 10.0, 0.1, 1.0 },
 
@@ -474,6 +488,11 @@ public:
     for (guint i = 0; i < GCODE_TEXT_TYPE_COUNT; i++)
       cfg.set_string ("GCode", GCodeNames[i], m_GCode[i]->get_text());
   }
+  void copyFrom(const GCodeImpl &other)
+  {
+    for (guint i = 0; i < GCODE_TEXT_TYPE_COUNT; i++)
+      m_GCode[i]->set_text(other.m_GCode[i]->get_text());
+  }
   void connectToUI(Builder &builder)
   {
     static const char *ui_names[] =
@@ -504,6 +523,29 @@ public:
   }
 };
 
+Settings::GCodeType::GCodeType()
+  : m_impl(new GCodeImpl())
+{
+}
+
+Settings::GCodeType::GCodeType(const GCodeType &other)
+  : m_impl(new GCodeImpl())
+{
+  m_impl->copyFrom(*other.m_impl);
+}
+
+Settings::GCodeType &Settings::GCodeType::operator=(const GCodeType &other)
+{
+  if (this != &other)
+    m_impl->copyFrom(*other.m_impl);
+  return *this;
+}
+
+Settings::GCodeType::~GCodeType()
+{
+  delete m_impl;
+}
+
 std::string Settings::GCodeType::getText(GCodeTextType t) const
 {
   return m_impl->m_GCode[t]->get_text();
@@ -538,7 +580,6 @@ double Settings::GetInfillDistance(double layerthickness, float percent) const
 
 Settings::Settings ()
 {
-  GCode.m_impl = new GCodeImpl();
   set_defaults();
   m_user_changed = false;
   inhibit_callback = false;
@@ -546,7 +587,6 @@ Settings::Settings ()
 
 Settings::~Settings()
 {
-  delete GCode.m_impl;
 }
 
 void
@@ -76,6 +76,9 @@ class Settings {
     float MinMoveSpeedZ;
     float MaxMoveSpeedZ;
 
+    float Acceleration;      // mm/sec^2, for time estimation
+    float JunctionDeviation; // mm
+
     float DistanceToReachFullSpeed;
 
     vmml::vec3d Volume;      // Print volume
@@ -171,6 +174,8 @@ class Settings {
     bool FillSkirt;
     int Skins;
     bool Varslicing;
+    float MinLayerThickness;
+    float CuspHeight;
     int NormalFilltype;
     float NormalFillExtrusion;
     int FullFilltype;
@@ -222,6 +227,7 @@ class Settings {
   struct MiscSettings {
     bool SpeedsAreMMperSec;
     bool ShapeAutoplace;
+    bool ArrangeRotate;
     bool FileLoggingEnabled;
     bool TempReadingEnabled;
     bool ClearLogfilesWhenPrintStarts;
@@ -233,6 +239,8 @@ class Settings {
     bool ExpandModelDisplay;
     bool ExpandPAxisDisplay;
     bool SaveSingleShapeSTL;
+    float ExportDPI; // of exported PNG/PBM slices
+    std::string TraceFile; // Chrome trace of each conversion to gcode
   };
   MiscSettings Misc;
 
@@ -245,6 +253,11 @@ class Settings {
   };
   struct GCodeType {
     GCodeImpl *m_impl;
+    // copies have their own text buffers
+    GCodeType();
+    GCodeType(const GCodeType &other);
+    GCodeType &operator=(const GCodeType &other);
+    ~GCodeType();
     std::string getText(GCodeTextType t) const ;
     std::string getStartText() const { return getText (GCODE_TEXT_START); }
     std::string getLayerText() const { return getText (GCODE_TEXT_LAYER); }
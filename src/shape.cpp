@@ -18,20 +18,82 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+#include <map>
+
 #include "shape.h"
 #include "files.h"
 #include "ui/progress.h"
 #include "settings.h"
 #include "clipping.h"
 #include "render.h"
+#include "profile.h"
 
 #ifdef _OPENMP
 #include <omp.h>
 #endif
 
+SharedTriangles::SharedTriangles()
+  : data(new Data())
+{
+  data->refs = 1;
+}
+
+SharedTriangles::SharedTriangles(const SharedTriangles &other)
+  : data(other.data)
+{
+  data->refs++;
+}
+
+SharedTriangles::~SharedTriangles()
+{
+  release();
+}
+
+void SharedTriangles::release()
+{
+  if (--data->refs == 0)
+    delete data;
+}
+
+SharedTriangles &SharedTriangles::operator=(const SharedTriangles &other)
+{
+  other.data->refs++;
+  release();
+  data = other.data;
+  return *this;
+}
+
+SharedTriangles &SharedTriangles::operator=(const vector<Triangle> &triangles)
+{
+  if (data->refs > 1) {
+    release();
+    data = new Data();
+    data->refs = 1;
+  }
+  data->triangles = triangles;
+  return *this;
+}
+
+void SharedTriangles::clear()
+{
+  *this = vector<Triangle>();
+}
+
+vector<Triangle> &SharedTriangles::edit()
+{
+  if (data->refs > 1) {
+    Data *copy = new Data();
+    copy->triangles = data->triangles;
+    copy->refs = 1;
+    release();
+    data = copy;
+  }
+  return data->triangles;
+}
+
+
 // Constructor
 Shape::Shape()
-  : slow_drawing(false), gl_List(-1)
 {
   Min.set(0,0,0);
   Max.set(200,200,200);
@@ -40,14 +102,20 @@ Shape::Shape()
 
 void Shape::clear() {
   triangles.clear();
-  if (gl_List>=0)
-    glDeleteLists(gl_List,1);
-  gl_List = -1;
+  clearCaches();
 };
 
+// call when the triangles change
+void Shape::clearCaches()
+{
+  lod.clear();
+  bvh.clear();
+}
+
 void Shape::setTriangles(const vector<Triangle> &triangles_)
 {
   triangles = triangles_;
+  clearCaches();
 
   CalcBBox();
   double vol = volume();
@@ -62,14 +130,6 @@ void Shape::setTriangles(const vector<Triangle> &triangles_)
 }
 
 
-int Shape::saveBinarySTL(Glib::ustring filename) const
-{
-  if (!File::saveBinarySTL(filename, triangles, transform3D.transform))
-    return -1;
-  return 0;
-
-}
-
 bool Shape::hasAdjacentTriangleTo(const Triangle &triangle, double sqdistance) const
 {
   bool haveadj = false;
@@ -161,9 +221,10 @@ void Shape::splitshapes(vector<Shape*> &shapes, ViewProgress *progress)
       addtoshape(i, adj, current, done);
       Shape *shape = new Shape();
       shapes.push_back(shape);
-      shapes.back()->triangles.resize(current.size());
+      vector<Triangle> &shapetriangles = shapes.back()->triangles.edit();
+      shapetriangles.resize(current.size());
       for (uint i = 0; i < current.size(); i++)
-	shapes.back()->triangles[i] = triangles[current[i]];
+	shapetriangles[i] = triangles[current[i]];
       shapes.back()->CalcBBox();
     }
     if (!cont) i=n_tr;
@@ -206,19 +267,24 @@ void Shape::makeHollow(double wallthickness)
   const Vector3d wall(wallthickness,wallthickness,wallthickness);
   Matrix4d invT = transform3D.getInverse();
   vector<Triangle> cubet = cube(invT*Min-wall, invT*Max+wall);
-  triangles.insert(triangles.end(),cubet.begin(),cubet.end());
+  vector<Triangle> &tr = triangles.edit();
+  tr.insert(tr.end(),cubet.begin(),cubet.end());
+  clearCaches();
   CalcBBox();
 }
 
 void Shape::invertNormals()
 {
-  for (uint i = 0; i < triangles.size(); i++)
-    triangles[i].invertNormal();
+  vector<Triangle> &tr = triangles.edit();
+  for (uint i = 0; i < tr.size(); i++)
+    tr[i].invertNormal();
+  clearCaches();
 }
 
 // doesn't work
 void Shape::repairNormals(double sqdistance)
 {
+  vector<Triangle> &triangles = this->triangles.edit();
   for (uint i = 0; i < triangles.size(); i++) {
     vector<uint> adjacent;
     uint numadj=0, numwrong=0;
@@ -236,24 +302,43 @@ void Shape::repairNormals(double sqdistance)
     //cerr << i<< ": " << numadj << " - " << numwrong  << endl;
     //if (numwrong > numadj/2) triangles[i].invertNormal();
   }
+  clearCaches();
 }
 
 void Shape::mirror()
 {
   const Vector3d mCenter = transform3D.getInverse() * Center;
-  for (uint i = 0; i < triangles.size(); i++)
-    triangles[i].mirrorX(mCenter);
+  vector<Triangle> &tr = triangles.edit();
+  for (uint i = 0; i < tr.size(); i++)
+    tr[i].mirrorX(mCenter);
+  clearCaches();
   CalcBBox();
 }
 
 double Shape::volume() const
 {
   double vol=0;
-  for (uint i = 0; i < triangles.size(); i++)
+  const int count = triangles.size();
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+:vol)
+#endif
+  for (int i = 0; i < count; i++)
     vol+=triangles[i].projectedvolume(transform3D.transform);
   return vol;
 }
 
+double Shape::area() const
+{
+  double area=0;
+  const int count = triangles.size();
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+:area)
+#endif
+  for (int i = 0; i < count; i++)
+    area+=triangles[i].transformed(transform3D.transform).area();
+  return area;
+}
+
 string Shape::getSTLsolid() const
 {
   stringstream sstr;
@@ -266,7 +351,9 @@ string Shape::getSTLsolid() const
 
 void Shape::addTriangles(const vector<Triangle> &tr)
 {
+  vector<Triangle> &triangles = this->triangles.edit();
   triangles.insert(triangles.end(), tr.begin(), tr.end());
+  clearCaches();
   CalcBBox();
 }
 
@@ -340,9 +427,6 @@ void Shape::CalcBBox()
     triangles[i].AccumulateMinMax (Min, Max, transform3D.transform);
   }
   Center = (Max + Min) / 2;
-  if (gl_List>=0)
-    glDeleteLists(gl_List,1);
-  gl_List = -1;
 }
 
 Vector3d Shape::scaledCenter() const
@@ -351,73 +435,172 @@ Vector3d Shape::scaledCenter() const
 }
 
 struct SNorm {
-  Vector3d normal;
+  Vector3d normal; // sum of area weighted normals
   double area;
+  SNorm() : normal(0,0,0), area(0) {}
   bool operator<(const SNorm &other) const {return (area<other.area);};
 } ;
 
-vector<Vector3d> Shape::getMostUsedNormals() const
+// normal components are quantised to this many steps per unit
+const double NORMAL_BINS = 1000.;
+
+static guint64 normalBin(const Vector3d &n)
 {
-  vector<struct SNorm> normals;
-  // vector<Vector3d> normals;
-  // vector<double> area;
-  uint ntr = triangles.size();
-  vector<bool> done(ntr);
-  for(size_t i=0;i<ntr;i++) done[ntr] = false;
-  for(size_t i=0;i<ntr;i++)
-    {
-      bool havenormal = false;
-      int numnorm = normals.size();
+  guint64 key = 0;
+  for (uint i = 0; i < 3; i++)
+    key = (key << 21) | (guint64)(floor(n[i] * NORMAL_BINS + 0.5) + NORMAL_BINS);
+  return key;
+}
+
+// The normals of the triangles transformed by T with their summed area,
+// largest area first.  Normals are put into bins on the unit sphere, the
+// normal of a bin is the area weighted mean of its triangles.
+void Shape::getNormalHistogram(const Matrix4d &T, vector<Vector3d> &normals,
+			       vector<double> &areas) const
+{
+  map<guint64, SNorm> bins;
+  const int ntr = triangles.size();
 #ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic)
+#pragma omp parallel
 #endif
-      for (int n = 0; n < numnorm; n++) {
-	if ( (normals[n].normal -
-	      triangles[i].transformed(transform3D.transform).Normal)
-	     .squared_length() < 0.000001) {
-	  havenormal = true;
-	  normals[n].area += triangles[i].area();
-	  done[i] = true;
-	}
-      }
-      if (!havenormal){
-	SNorm n;
-	n.normal = triangles[i].transformed(transform3D.transform).Normal;
-	n.area = triangles[i].area();
-	normals.push_back(n);
-	done[i] = true;
-      }
+  {
+    map<guint64, SNorm> threadbins;
+#ifdef _OPENMP
+#pragma omp for schedule(static) nowait
+#endif
+    for (int i = 0; i < ntr; i++) {
+      const Triangle tr = triangles[i].transformed(T);
+      const double area = tr.area();
+      if (!(area > 0)) continue; // degenerate, no normal
+      SNorm &bin = threadbins[normalBin(tr.Normal)];
+      bin.normal += tr.Normal * area;
+      bin.area += area;
     }
-  std::sort(normals.rbegin(),normals.rend());
-  //cerr << normals.size() << endl;
-  vector<Vector3d> nv(normals.size());
-  for (uint n=0; n < normals.size(); n++) nv[n] = normals[n].normal;
-  return nv;
+#ifdef _OPENMP
+#pragma omp critical(normalhistogram)
+#endif
+    for (map<guint64, SNorm>::const_iterator b = threadbins.begin();
+	 b != threadbins.end(); b++) {
+      SNorm &bin = bins[b->first];
+      bin.normal += b->second.normal;
+      bin.area += b->second.area;
+    }
+  }
+  vector<SNorm> sorted;
+  sorted.reserve(bins.size());
+  for (map<guint64, SNorm>::const_iterator b = bins.begin(); b != bins.end(); b++)
+    sorted.push_back(b->second);
+  std::sort(sorted.rbegin(), sorted.rend());
+  normals.resize(sorted.size());
+  areas.resize(sorted.size());
+  for (uint n = 0; n < sorted.size(); n++) {
+    normals[n] = sorted[n].normal;
+    normals[n].normalize();
+    areas[n] = sorted[n].area;
+  }
+}
+
+vector<Vector3d> Shape::getMostUsedNormals() const
+{
+  vector<Vector3d> normals;
+  vector<double> areas;
+  getNormalHistogram(transform3D.transform, normals, areas);
+  return normals;
 }
 
+// rotation that turns direction N down, as done by Rotate()
+static void rotationDown(const Vector3d &N, Vector3d &axis, double &angle)
+{
+  const Vector3d Z(0,0,-1);
+  angle = acos(CLAMP(N.dot(Z), -1., 1.));
+  axis = N.cross(Z);
+  if (axis.squared_length() < 1e-12) // N is vertical
+    axis = Vector3d(1,0,0);
+  axis.normalize();
+}
 
-void Shape::OptimizeRotation()
+// Overhang area, support volume below it and height of the triangles
+// rotated by R.  Faces pointing down steeper than supportangle (from
+// the horizontal) need support unless they are on the platform.
+static void scoreOrientation(const vector<Triangle> &triangles,
+			     const Matrix4d &R, double supportangle,
+			     double &overhang, double &support, double &height)
 {
-  // CenterAroundXY();
-  vector<Vector3d> normals = getMostUsedNormals();
-  // cycle through most-used normals?
-
-  Vector3d N;
-  Vector3d Z(0,0,-1);
-  double angle=0;
-  int count = (int)normals.size();
-  for (int n=0; n < count; n++) {
-    //cerr << n << normals[n] << endl;
-    N = normals[n];
-    angle = acos(N.dot(Z));
-    if (angle>0) {
-      Vector3d axis = N.cross(Z);
-      if (axis.squared_length()>0.1) {
-	Rotate(axis,angle);
-	break;
-      }
+  double minz = INFTY, maxz = -INFTY;
+  vector<Triangle> rotated(triangles.size());
+  for (uint i = 0; i < triangles.size(); i++) {
+    rotated[i] = triangles[i].transformed(R);
+    for (uint c = 0; c < 3; c++) {
+      minz = MIN(minz, rotated[i][c].z());
+      maxz = MAX(maxz, rotated[i][c].z());
     }
   }
+  const double minslope = sin(supportangle);
+  overhang = support = 0;
+  height = maxz - minz;
+  for (uint i = 0; i < rotated.size(); i++) {
+    const Triangle &tr = rotated[i];
+    if (-tr.Normal.z() < minslope) continue;
+    const double z = (tr.A.z() + tr.B.z() + tr.C.z()) / 3. - minz;
+    if (z < 0.1) continue; // on the platform
+    const double area = tr.area();
+    overhang += area;
+    support  += area * -tr.Normal.z() * z; // projected area * height
+  }
+}
+
+// weights of the orientation score, which is the support volume (mm^3)
+// plus these per mm^2 of overhang and per mm of height
+const double OVERHANG_WEIGHT = 2.;
+const double HEIGHT_WEIGHT = 5.;
+const uint   MAX_ORIENTATIONS = 32; // largest normals tried
+
+// Rotate to the orientation of least support, overhang and height,
+// trying the directions of the largest faces down and the axes.
+void Shape::OptimizeRotation(double supportangle)
+{
+  const Matrix4d &T = transform3D.transform;
+  vector<Vector3d> candidates;
+  vector<double> areas;
+  getNormalHistogram(T, candidates, areas);
+  if (candidates.size() > MAX_ORIENTATIONS)
+    candidates.resize(MAX_ORIENTATIONS);
+  candidates.insert(candidates.begin(), Vector3d(0,0,-1)); // as it is
+  for (uint i = 0; i < 3; i++) {
+    Vector3d axis(0,0,0);
+    axis[i] = 1;
+    candidates.push_back(axis);
+    candidates.push_back(-axis);
+  }
+
+  const vector<Triangle> transformed = getTriangles(T);
+  const int count = candidates.size();
+  vector<double> scores(count);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int n = 0; n < count; n++) {
+    Vector3d axis;
+    double angle;
+    rotationDown(candidates[n], axis, angle);
+    Matrix4d R;
+    R.rotate(angle, axis);
+    double overhang, support, height;
+    scoreOrientation(transformed, R, supportangle, overhang, support, height);
+    scores[n] = support + OVERHANG_WEIGHT * overhang + HEIGHT_WEIGHT * height;
+  }
+
+  // first best, so the current one or the largest face down on a tie
+  int best = 0;
+  for (int n = 1; n < count; n++)
+    if (scores[n] < scores[best] - 1e-6) best = n;
+  if (best > 0) {
+    Vector3d axis;
+    double angle;
+    rotationDown(candidates[best], axis, angle);
+    if (angle > 0)
+      Rotate(axis, angle);
+  }
   CalcBBox();
   PlaceOnPlatform();
 }
@@ -436,16 +619,18 @@ int Shape::divideAtZ(double z, Shape *upper, Shape *lower, const Matrix4d &T) co
   for (uint i=0; i<surfs.size(); i++)
     surf.insert(surf.end(), surfs[i].begin(), surfs[i].end());
 
-  lower->triangles.insert(lower->triangles.end(),surf.begin(),surf.end());
+  vector<Triangle> &lowertr = lower->triangles.edit();
+  vector<Triangle> &uppertr = upper->triangles.edit();
+  lowertr.insert(lowertr.end(),surf.begin(),surf.end());
   for (guint i=0; i<surf.size(); i++) surf[i].invertNormal();
-  upper->triangles.insert(upper->triangles.end(),surf.begin(),surf.end());
+  uppertr.insert(uppertr.end(),surf.begin(),surf.end());
   vector<Triangle> toboth;
   for (guint i=0; i< triangles.size(); i++) {
     Triangle tt = triangles[i].transformed(T*transform3D.transform);
     if (tt.A.z() < z && tt.B.z() < z && tt.C.z() < z )
-      lower->triangles.push_back(tt);
+      lowertr.push_back(tt);
     else if (tt.A.z() > z && tt.B.z() > z && tt.C.z() > z )
-      upper->triangles.push_back(tt);
+      uppertr.push_back(tt);
     else
       toboth.push_back(tt);
   }
@@ -453,10 +638,10 @@ int Shape::divideAtZ(double z, Shape *upper, Shape *lower, const Matrix4d &T) co
   for (guint i=0; i< toboth.size(); i++) {
     toboth[i].SplitAtPlane(z, uppersplit, lowersplit);
   }
-  upper->triangles.insert(upper->triangles.end(),
-			 uppersplit.begin(),uppersplit.end());
-  lower->triangles.insert(lower->triangles.end(),
-			 lowersplit.begin(),lowersplit.end());
+  uppertr.insert(uppertr.end(), uppersplit.begin(),uppersplit.end());
+  lowertr.insert(lowertr.end(), lowersplit.begin(),lowersplit.end());
+  upper->clearCaches();
+  lower->clearCaches();
   upper->CalcBBox();
   lower->CalcBBox();
   lower->Rotate(Vector3d(0,1,0),M_PI);
@@ -497,6 +682,7 @@ void Shape::Twist(double angle)
   double h = Max.z()-Min.z();
   double hangle=0;
   Vector3d axis(0,0,1);
+  vector<Triangle> &triangles = this->triangles.edit();
   int count = (int)triangles.size();
 #ifdef _OPENMP
 #pragma omp parallel for schedule(dynamic)
@@ -509,6 +695,7 @@ void Shape::Twist(double angle)
       }
     triangles[i].calcNormal();
   }
+  clearCaches();
   CalcBBox();
 }
 
@@ -716,6 +903,7 @@ vector<Segment> Shape::getCutlines(const Matrix4d &T, double z,
 				   double supportangle,
 				   double thickness) const
 {
+  TRACE_SCOPE("Shape::getCutlines");
   Vector2d lineStart;
   Vector2d lineEnd;
   vector<Segment> lines;
@@ -783,12 +971,14 @@ vector<Segment> Shape::getCutlines(const Matrix4d &T, double z,
 	  lines.push_back(line);
 	}
     }
+  Trace::counter("cutlines", lines.size());
   return lines;
 }
 
 
 // called from Model::draw
-void Shape::draw(const Settings &settings, bool highlight, uint max_triangles)
+void Shape::draw(const Settings &settings, bool highlight, uint max_triangles,
+		 bool interactive)
 {
   //cerr << "Shape::draw" <<  endl;
 	// polygons
@@ -840,7 +1030,7 @@ void Shape::draw(const Settings &settings, bool highlight, uint max_triangles)
 		glEnable(GL_BLEND);
 //		glDepthMask(GL_TRUE);
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);  //define blending factors
-                draw_geometry(max_triangles);
+                draw_geometry(max_triangles, interactive);
 	}
 
 	glDisable (GL_POLYGON_OFFSET_FILL);
@@ -857,16 +1047,13 @@ void Shape::draw(const Settings &settings, bool highlight, uint max_triangles)
 		glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
 
 		glColor4fv(settings.Display.WireframeColour);
-		for(size_t i=0;i<triangles.size();i++)
-		{
-			glBegin(GL_LINE_LOOP);
-			glLineWidth(1);
-			glNormal3dv((GLdouble*)&(triangles[i].Normal));
-			glVertex3dv((GLdouble*)&(triangles[i].A));
-			glVertex3dv((GLdouble*)&(triangles[i].B));
-			glVertex3dv((GLdouble*)&(triangles[i].C));
-			glEnd();
-		}
+		glLineWidth(1);
+		const GLboolean cull = glIsEnabled(GL_CULL_FACE);
+		glDisable(GL_CULL_FACE);
+		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		Shape::draw_geometry(max_triangles, interactive);
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		if (cull) glEnable(GL_CULL_FACE);
 	}
 
 	glDisable(GL_LIGHTING);
@@ -964,54 +1151,27 @@ void Shape::drawBBox() const
 }
 
 
-void Shape::draw_geometry(uint max_triangles)
+// Nearest hit of the ray origin + t*dir with the triangles,
+// in shape coordinates (without transform3D)
+bool Shape::intersectRay(const Vector3d &origin, const Vector3d &dir,
+			 double &t) const
 {
+  if (triangles.empty()) return false;
+  if (bvh.empty())
+    bvh.build(triangles);
+  uint triangle;
+  return bvh.intersect(triangles, origin, dir, t, triangle);
+}
 
-  bool listDraw = (max_triangles == 0); // not in preview mode
-  bool haveList = gl_List >= 0;
-
-  if (!listDraw && haveList) {
-    if (gl_List>=0)
-      glDeleteLists(gl_List,1);
-    gl_List = -1;
-    haveList = false;
-  }
-  if (listDraw && !haveList) {
-    gl_List = glGenLists(1);
-    glNewList(gl_List, GL_COMPILE);
-  }
-  if (!listDraw || !haveList) {
-	uint step = 1;
-	if (max_triangles>0) step = floor(triangles.size()/max_triangles);
-	step = max((uint)1,step);
-
-	glBegin(GL_TRIANGLES);
-	for(size_t i=0;i<triangles.size();i+=step)
-	{
-		glNormal3dv(triangles[i].Normal);
-		glVertex3dv(triangles[i].A);
-		glVertex3dv(triangles[i].B);
-		glVertex3dv(triangles[i].C);
-	}
-	glEnd();
-  }
-  if (listDraw && !haveList) {
-    glEndList();
-  }
-
-  if (listDraw && gl_List >= 0) { // have stored list
-    Glib::TimeVal starttime, endtime;
-    if (!slow_drawing) {
-      starttime.assign_current_time();
-    }
-    glCallList(gl_List);
-    if (!slow_drawing) {
-      endtime.assign_current_time();
-      Glib::TimeVal usedtime = endtime-starttime;
-      if (usedtime.as_double() > 0.2) slow_drawing = true;
-    }
-    return;
-  }
+// Draws a simplified mesh if the shape has more triangles than
+// can be seen at its size on screen, or while rotating the view.
+void Shape::draw_geometry(uint max_triangles, bool interactive)
+{
+  uint screen_triangles = lod.screenTriangles(interactive);
+  if (screen_triangles > 0 &&
+      (max_triangles == 0 || screen_triangles < max_triangles))
+    max_triangles = screen_triangles;
+  lod.draw(triangles, max_triangles);
 }
 
 /*
@@ -1127,6 +1287,7 @@ bool CleanupSharedSegments(vector<Segment> &lines)
  */
 bool CleanupConnectSegments(const vector<Vector2d> &vertices, vector<Segment> &lines, bool connect_all)
 {
+	TRACE_SCOPE("CleanupConnectSegments");
 	vector<int> vertex_types;
 	vertex_types.resize (vertices.size());
 	// vector<int> vertex_counts;
@@ -34,6 +34,8 @@
 #include "triangle.h"
 #include "slicer/geometry.h"
 #include "poly.h"
+#include "meshlod.h"
+#include "trianglebvh.h"
 
 //#define ABS(a)	   (((a) < 0) ? -(a) : (a))
 
@@ -54,6 +56,39 @@ struct Segment {
 #define sqr(x) ((x)*(x))
 
 
+// Triangles of a shape, shared by its duplicates (instances) until one of
+// them changes its mesh (copy on write).  Reading works like a const
+// vector, changes go through edit().  Copies are made in the GUI thread
+// only, so the reference count needs no lock.
+class SharedTriangles
+{
+public:
+  SharedTriangles();
+  SharedTriangles(const SharedTriangles &other);
+  ~SharedTriangles();
+  SharedTriangles &operator=(const SharedTriangles &other);
+  SharedTriangles &operator=(const vector<Triangle> &triangles);
+
+  operator const vector<Triangle>&() const { return data->triangles; }
+  const Triangle &operator[](uint i) const { return data->triangles[i]; }
+  uint size()  const { return data->triangles.size(); }
+  bool empty() const { return data->triangles.empty(); }
+  void clear();
+
+  vector<Triangle> &edit(); // unshare first
+  bool isSharedWith(const SharedTriangles &other) const
+  { return data == other.data; }
+
+private:
+  struct Data {
+    vector<Triangle> triangles;
+    uint refs;
+  };
+  Data *data;
+  void release();
+};
+
+
 class Shape
 {
 public:
@@ -72,9 +107,11 @@ public:
 	virtual void clear();
 	/* void displayInfillOld(const Settings &settings, CuttingPlane &plane,  */
 	/* 		      guint LayerNr, vector<int>& altInfillLayers); */
+	// interactive: the view is being rotated, draw less detail
 	void draw (const Settings &settings,
-		   bool highlight=false, uint max_triangles=0);
-	virtual void draw_geometry (uint max_triangles=0);
+		   bool highlight=false, uint max_triangles=0,
+		   bool interactive=false);
+	virtual void draw_geometry (uint max_triangles=0, bool interactive=false);
 	void drawBBox() const;
 	virtual bool getPolygonsAtZ(const Matrix4d &T, double z,
 				    vector<Poly> &polys,
@@ -85,9 +122,11 @@ public:
 	// Extract a 2D polygonset from a 3D model:
 	// void CalcLayer(const Matrix4d &T, CuttingPlane *plane) const;
 
+    void getNormalHistogram(const Matrix4d &T, vector<Vector3d> &normals,
+			    vector<double> &areas) const;
     virtual vector<Vector3d> getMostUsedNormals() const;
-	// Auto-Rotate object to have the largest area surface down for printing:
-    virtual void OptimizeRotation();
+	// Auto-Rotate object for least support, overhang and height:
+    virtual void OptimizeRotation(double supportangle = M_PI/4);
     virtual void CalcBBox();
 	// Rotation for manual rotate and used by OptimizeRotation:
     virtual void Rotate(const Vector3d & axis, const double &angle);
@@ -123,6 +162,7 @@ public:
 
     string getSTLsolid() const;
     double volume() const;
+    double area() const;
 
     void invertNormals();
     void repairNormals(double sqdistance);
@@ -132,26 +172,34 @@ public:
     int divideAtZ(double z, Shape *upper, Shape *lower, const Matrix4d &T) const;
 
 
-    int saveBinarySTL(Glib::ustring filename) const;
-
-
-    bool slow_drawing;
     virtual string info() const;
 
     vector<Triangle> getTriangles(const Matrix4d &T=Matrix4d::IDENTITY) const;
+    // without the transform, not copied
+    const vector<Triangle> &getUntransformedTriangles() const { return triangles; }
     void addTriangles(const vector<Triangle> &tr);
 
     void setTriangles(const vector<Triangle> &triangles_);
 
     uint size() const {return triangles.size();}
 
-protected:
+    virtual bool intersectRay(const Vector3d &origin, const Vector3d &dir,
+			      double &t) const;
+    // XY bounding box, without the transform, of shapes made of
+    // outlines instead of triangles
+    virtual bool getOutlineBounds(Vector2d &min, Vector2d &max) const
+    { return false; }
 
-    int gl_List;
+    // same mesh as other, possibly with another transform
+    bool isInstanceOf(const Shape &other) const
+    { return triangles.isSharedWith(other.triangles); }
 
 private:
 
-    vector<Triangle> triangles;
+    SharedTriangles triangles;
+    MeshLOD lod; // display buffers
+    mutable TriangleBVH bvh; // for picking, built when needed
+    void clearCaches(); // call when triangles change
     //vector<Polygon2d>  polygons;  // surface polygons instead of triangles
     void calcPolygons();
 
@@ -19,6 +19,10 @@
 */
 
 #include "clipping.h"
+#include "region.h"
+#include "profile.h"
+
+#include <algorithm>
 
 //////////////////////////////////////////////////////////////////////////////////////////
 //
@@ -200,6 +204,20 @@ void Clipping::addPolygons(const CL::Polygons &cp, PolyType type)
 {
   clpr.AddPolygons(cp, CLType(type));
 }
+void Clipping::addPolys(const Region &region, PolyType type)
+{
+  if (debug) {
+    if (type==clip)
+      clippolygons.push_back(region.paths());
+    else  if (type==subject)
+      subjpolygons.push_back(region.paths());
+  }
+  clpr.AddPolygons(region.paths(), CLType(type));
+  if (region.size()>0) {
+    lastZ = region.getZ();
+    lastExtrF = region.getExtrusionFactor();
+  }
+}
 
 
 // // return intersection polys
@@ -299,6 +317,42 @@ vector<Poly> Clipping::subtractMerged(double dist,
   return getPolys(getMerged(diff, dist), lastZ, lastExtrF);
 }
 
+Region Clipping::reg_intersect(CL::PolyFillType sft,
+			       CL::PolyFillType cft)
+{
+  Region result(lastZ, lastExtrF);
+  CL::Polygons inter;
+  clpr.Execute(CL::ctIntersection, inter, sft, cft);
+  result.swapPaths(inter);
+  return result;
+}
+Region Clipping::reg_unite(CL::PolyFillType sft,
+			   CL::PolyFillType cft)
+{
+  Region result(lastZ, lastExtrF);
+  CL::Polygons united;
+  clpr.Execute(CL::ctUnion, united, sft, cft);
+  result.swapPaths(united);
+  return result;
+}
+Region Clipping::reg_subtract(CL::PolyFillType sft,
+			      CL::PolyFillType cft)
+{
+  Region result(lastZ, lastExtrF);
+  CL::Polygons diff;
+  clpr.Execute(CL::ctDifference, diff, sft, cft);
+  result.swapPaths(diff);
+  return result;
+}
+Region Clipping::reg_subtractMerged(double dist,
+				    CL::PolyFillType sft,
+				    CL::PolyFillType cft)
+{
+  CL::Polygons diff;
+  clpr.Execute(CL::ctDifference, diff, sft, cft);
+  return Region(getMerged(diff, dist), lastZ, lastExtrF);
+}
+
 vector<Poly> Clipping::Xor(CL::PolyFillType sft,
 			   CL::PolyFillType cft)
 {
@@ -311,14 +365,14 @@ vector<Poly> Clipping::getOffset(const Poly &poly, double distance,
 				 JoinType jtype, double miterdist)
 {
   CL::Polygons cpolys(1); cpolys[0]=getClipperPolygon(poly);
-  CL::Polygons offset = CLOffset(cpolys, CL_FACTOR*distance, CLType(jtype), miterdist);
+  CL::Polygons offset = getOffset(cpolys, distance, jtype, miterdist);
   return getPolys(offset, poly.getZ(), poly.getExtrusionFactor());
 }
 vector<Poly> Clipping::getOffset(const vector<Poly> &polys, double distance,
 				 JoinType jtype, double miterdist)
 {
   CL::Polygons cpolys = getClipperPolygons(polys);
-  CL::Polygons offset = CLOffset(cpolys, CL_FACTOR*distance, CLType(jtype), miterdist);
+  CL::Polygons offset = getOffset(cpolys, distance, jtype, miterdist);
   double z=0, extrf=1.;;
   if (polys.size()>0) {
     z = polys.back().getZ();
@@ -365,6 +419,173 @@ vector<Poly> Clipping::getOffset(const vector<ExPoly> &expolys, double distance,
 //   return getExPolys(offset,z,extrf);
 // }
 
+CL::Polygons Clipping::getOffset(const CL::Polygons &cpolys, double distance,
+				 JoinType jtype, double miterdist)
+{
+  TRACE_SCOPE("Clipping::getOffset");
+  if (cpolys.size() == 1 && distance < 0) {
+    CL::Polygons shrinked(1);
+    if (getConvexShrinked(cpolys[0], CL_FACTOR*distance, shrinked[0])) {
+      if (shrinked[0].size() == 0) shrinked.clear();
+      return shrinked;
+    }
+  }
+  return CLOffset(cpolys, CL_FACTOR*distance, CLType(jtype), miterdist);
+}
+
+Region Clipping::getOffset(const Region &region, double distance,
+			   JoinType jtype, double miterdist)
+{
+  return Region(getOffset(region.paths(), distance, jtype, miterdist),
+		region.getZ(), region.getExtrusionFactor());
+}
+
+// Shrinking a convex polygon only moves its edges inwards, all join
+// types give the intersection of the moved edges' half planes.
+// As long as no edge turns around the new vertices are the miter points,
+// which needs no clipping.  False if the polygon is not (nearly) convex,
+// has negative orientation or an edge would vanish.
+bool Clipping::getConvexShrinked(const CL::Polygon &cpoly, double cldist,
+				 CL::Polygon &result)
+{
+  const double delta = cldist;
+  uint n = cpoly.size();
+  if (n < 3) return false;
+  // coordinates relative to the first point, without duplicates
+  vector<double> x, y;
+  x.reserve(n); y.reserve(n);
+  for (uint i = 0; i < n; i++) {
+    const double px = double(cpoly[i].X - cpoly[0].X),
+      py = double(cpoly[i].Y - cpoly[0].Y);
+    if (i > 0 && px == x.back() && py == y.back()) continue;
+    x.push_back(px); y.push_back(py);
+  }
+  if (x.size() > 1 && x.back() == 0 && y.back() == 0) {
+    x.pop_back(); y.pop_back();
+  }
+  n = x.size();
+  if (n < 3) return false;
+
+  // a negative (hole) contour grows when offset inwards, leave it to Clipper
+  double area = 0;
+  for (uint i = 0; i < n; i++) {
+    const uint j = (i+1 == n) ? 0 : i+1;
+    area += x[i] * y[j] - x[j] * y[i];
+  }
+  area /= 2;
+  if (area <= 0) return false;
+  vector<double> ex(n), ey(n);
+  for (uint i = 0; i < n; i++) {
+    const uint j = (i+1 == n) ? 0 : i+1;
+    ex[i] = x[j] - x[i];
+    ey[i] = y[j] - y[i];
+  }
+  // Clipper drops polygons this small
+  if (area < delta*delta*M_PI) {
+    result.clear();
+    return true;
+  }
+
+  // convex: no right turns beyond rounding, and edge directions
+  // change x and y sign at most twice
+  vector<double> len(n);
+  for (uint i = 0; i < n; i++)
+    len[i] = sqrt(ex[i]*ex[i] + ey[i]*ey[i]);
+  uint xchanges = 0, ychanges = 0;
+  int xsign = 0, ysign = 0;
+  for (uint i = 0; i < n; i++) {
+    const uint k = (i == 0) ? n-1 : i-1;
+    const double cross = ex[k]*ey[i] - ey[k]*ex[i];
+    if (cross < -1e-3 * len[k] * len[i]) return false;
+    const int sx = (ex[i] > 0) - (ex[i] < 0);
+    const int sy = (ey[i] > 0) - (ey[i] < 0);
+    if (sx != 0) { if (xsign != 0 && sx != xsign) xchanges++; xsign = sx; }
+    if (sy != 0) { if (ysign != 0 && sy != ysign) ychanges++; ysign = sy; }
+  }
+  if (xchanges > 2 || ychanges > 2) return false;
+
+  // outward unit normals as in Clipper, and the miter points
+  vector<double> nx(n), ny(n);
+  for (uint i = 0; i < n; i++) {
+    nx[i] =  ey[i] / len[i];
+    ny[i] = -ex[i] / len[i];
+  }
+  vector<double> qx(n), qy(n);
+  for (uint i = 0; i < n; i++) {
+    const uint k = (i == 0) ? n-1 : i-1;
+    const double r = 1 + nx[k]*nx[i] + ny[k]*ny[i];
+    if (r < 1e-6) return false; // turning back
+    const double q = delta / r;
+    qx[i] = x[i] + (nx[k] + nx[i]) * q;
+    qy[i] = y[i] + (ny[k] + ny[i]) * q;
+  }
+  // every edge has to keep its direction
+  for (uint i = 0; i < n; i++) {
+    const uint j = (i+1 == n) ? 0 : i+1;
+    if ((qx[j]-qx[i])*ex[i] + (qy[j]-qy[i])*ey[i] <= 0) return false;
+  }
+  result.resize(n);
+  for (uint i = 0; i < n; i++)
+    result[i] = CL::IntPoint(cpoly[0].X + CL::long64(floor(qx[i] + 0.5)),
+			     cpoly[0].Y + CL::long64(floor(qy[i] + 0.5)));
+  return true;
+}
+
+// Douglas-Peucker like simplified() in geometry.cpp, marks points to keep
+static void simplifyRange(const CL::Polygon &cpoly, uint from, uint to,
+			  double epsilon, vector<bool> &keep)
+{
+  if (to < from + 2) return;
+  const double dx = double(cpoly[to].X - cpoly[from].X),
+    dy = double(cpoly[to].Y - cpoly[from].Y);
+  const double length = sqrt(dx*dx + dy*dy);
+  if (length == 0) { // keep all, as simplified() does
+    for (uint i = from+1; i < to; i++) keep[i] = true;
+    return;
+  }
+  double dmax = 0;
+  uint index = 0;
+  for (uint i = from+1; i < to; i++) {
+    const double dist =
+      abs((double(cpoly[i].X - cpoly[from].X) * dy -
+	   double(cpoly[i].Y - cpoly[from].Y) * dx) / length);
+    if (dist >= epsilon && dist > dmax) {
+      index = i;
+      dmax = dist;
+    }
+  }
+  if (index == 0) return;
+  keep[index] = true;
+  simplifyRange(cpoly, from, index, epsilon, keep);
+  simplifyRange(cpoly, index, to, epsilon, keep);
+}
+
+static void simplify(CL::Polygon &cpoly, double epsilon)
+{
+  const uint n = cpoly.size();
+  if (n < 3) return;
+  vector<bool> keep(n, false);
+  keep[0] = keep[n-1] = true;
+  simplifyRange(cpoly, 0, n-1, epsilon, keep);
+  uint k = 0;
+  for (uint i = 0; i < n; i++)
+    if (keep[i]) cpoly[k++] = cpoly[i];
+  cpoly.resize(k);
+}
+
+void Clipping::cleanup(CL::Polygons &cpolys, double epsilon)
+{
+  if (epsilon == 0) return;
+  const double cleps = CL_FACTOR * epsilon;
+  for (uint p = 0; p < cpolys.size(); p++) {
+    CL::Polygon &cpoly = cpolys[p];
+    simplify(cpoly, cleps);
+    // again starting in the middle, like Poly::cleanup
+    std::rotate(cpoly.begin(), cpoly.begin() + cpoly.size()/2, cpoly.end());
+    simplify(cpoly, cleps);
+  }
+}
+
 // first goes in then out to get capped corners
 vector<Poly> Clipping::getShrinkedCapped(const vector<Poly> &polys, double distance,
 					 JoinType jtype, double miterdist)
@@ -405,6 +626,11 @@ vector<Poly> Clipping::getMerged(const vector<Poly> &polys, double overlap)
   }
   return getPolys(merged, z, extrf);
 }
+Region Clipping::getMerged(const Region &region, double overlap)
+{
+  return Region(getMerged(region.paths(), CL_FACTOR*overlap),
+		region.getZ(), region.getExtrusionFactor());
+}
 // overlap a bit and unite to merge adjacent polys
 CL::Polygons Clipping::getMerged(const CL::Polygons &cpolys, int overlap)
 {
@@ -453,7 +679,7 @@ vector<ExPoly> Clipping::getExPolys(const CL::PolyTree &ctree, double z,
   PolyTreeToExPolygons(&ctree, cexpolys);
   vector<ExPoly> expolys(cexpolys.size());
   for (uint j = 0 ; j < cexpolys.size(); j++) {
-    expolys[j].outer = getPoly(cexpolys[0].outer, z, extrusionfactor);
+    expolys[j].outer = getPoly(cexpolys[j].outer, z, extrusionfactor);
     for (uint i = 0 ; i < cexpolys[j].holes.size(); i++)
       expolys[j].holes.push_back(getPoly(cexpolys[j].holes[i], z, extrusionfactor));
   }
@@ -477,29 +703,117 @@ vector<Poly> Clipping::getPolys(const vector<ExPoly> &expolys)
   return polys;
 }
 
+// events of the sweep in getExPolys(), at equal x outers start
+// before and end after the hole points
+struct NestEvent {
+  double x;
+  int type; // 0: outer starts, 1: hole point, 2: outer ends
+  uint index;
+  bool operator<(const NestEvent &other) const {
+    if (x != other.x) return x < other.x;
+    return type < other.type;
+  }
+};
+
+static double polyArea(const Poly &poly)
+{
+  double a = 0;
+  const uint n = poly.size();
+  for (uint i = 0; i < n; i++) {
+    const Vector2d &p1 = poly.vertices[i], &p2 = poly.vertices[(i+1)%n];
+    a += p1.x()*p2.y() - p2.x()*p1.y();
+  }
+  return abs(a/2);
+}
+
+// Every hole goes to the smallest outer poly around its first vertex.
+// A sweep along x with the bounding boxes of the outers collects the
+// candidates for each hole, these are tested in parallel.
 vector<ExPoly> Clipping::getExPolys(const vector<Poly> &polys)
 {
   /*
   CL::PolyTree tree = getClipperTree(polys);
   return getExPolys(tree, polys.back().getZ(), polys.back().getExtrusionFactor());
   */
-  vector<ExPoly> expolys;
-  vector<Poly> holes;
+  vector<uint> outers, holes;
   for (uint i = 0; i<polys.size(); i++) {
     if (polys[i].isHole()) {
-      holes.push_back(polys[i]);
+      if (polys[i].size()>0)
+	holes.push_back(i);
+    } else
+      outers.push_back(i);
+  }
+  vector<ExPoly> expolys(outers.size());
+  for (uint o = 0; o<outers.size(); o++)
+    expolys[o].outer = polys[outers[o]];
+  if (holes.size()==0 || outers.size()==0) return expolys;
+
+  vector<Vector2d> omin(outers.size()), omax(outers.size());
+  vector<NestEvent> events;
+  events.reserve(2*outers.size() + holes.size());
+  for (uint o = 0; o<outers.size(); o++) {
+    const vector<Vector2d> minmax = polys[outers[o]].getMinMax();
+    omin[o] = minmax[0]; omax[o] = minmax[1];
+    NestEvent start = { omin[o].x(), 0, o };
+    NestEvent end   = { omax[o].x(), 2, o };
+    events.push_back(start);
+    events.push_back(end);
+  }
+  for (uint h = 0; h<holes.size(); h++) {
+    NestEvent point = { polys[holes[h]].vertices[0].x(), 1, h };
+    events.push_back(point);
+  }
+  std::sort(events.begin(), events.end());
+
+  // outers whose x range contains the sweep position
+  vector<uint> active;
+  vector<uint> activepos(outers.size());
+  vector< vector<uint> > candidates(holes.size());
+  for (uint e = 0; e<events.size(); e++) {
+    const NestEvent &ev = events[e];
+    if (ev.type == 0) {
+      activepos[ev.index] = active.size();
+      active.push_back(ev.index);
+    } else if (ev.type == 2) {
+      const uint pos = activepos[ev.index];
+      active[pos] = active.back();
+      activepos[active[pos]] = pos;
+      active.pop_back();
     } else {
-      ExPoly expoly;
-      expoly.outer = polys[i];
-      expolys.push_back(expoly);
+      const double y = polys[holes[ev.index]].vertices[0].y();
+      for (uint a = 0; a<active.size(); a++)
+	if (y >= omin[active[a]].y() && y <= omax[active[a]].y())
+	  candidates[ev.index].push_back(active[a]);
     }
   }
-  for (uint i = 0; i<holes.size(); i++)
-    for (uint j = 0; j<expolys.size(); j++)
-      if (holes[i].size()>0)
-	if (expolys[j].outer.vertexInside(holes[i].vertices[0])) // just test one point
-	  //if (holes[i].isInside(expolys[j].outer)) // test all
-	  expolys[j].holes.push_back(holes[i]);
+
+  vector<double> area(outers.size(), -1);
+  for (uint h = 0; h<holes.size(); h++)
+    for (uint c = 0; c<candidates[h].size(); c++) {
+      const uint o = candidates[h][c];
+      if (area[o] < 0) {
+	area[o] = polyArea(polys[outers[o]]);
+	polys[outers[o]].calcSlabs();
+      }
+    }
+
+  vector<int> owner(holes.size(), -1);
+  const int numholes = holes.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int h = 0; h<numholes; h++) {
+    const Vector2d &point = polys[holes[h]].vertices[0];
+    for (uint c = 0; c<candidates[h].size(); c++) {
+      const uint o = candidates[h][c];
+      if (owner[h] >= 0 && area[o] >= area[owner[h]]) continue;
+      if (polys[outers[o]].vertexInside(point)) // just test one point
+	owner[h] = o;
+    }
+  }
+  for (uint h = 0; h<holes.size(); h++)
+    if (owner[h] >= 0)
+      expolys[owner[h]].holes.push_back(polys[holes[h]]);
   return expolys;
 }
 
@@ -514,6 +828,15 @@ vector<ExPoly> Clipping::getExPolys(const vector<Poly> &polys,
   return getExPolys(ppolys);
 }
 
+vector<ExPoly> Clipping::getExPolys(const Region &region)
+{
+  CL::Clipper clpr;
+  clpr.AddPolygons(region.paths(), CL::ptSubject);
+  CL::PolyTree ctree;
+  clpr.Execute(CL::ctUnion, ctree, CL::pftEvenOdd, CL::pftEvenOdd);
+  return getExPolys(ctree, region.getZ(), region.getExtrusionFactor());
+}
+
 CL::PolyTree Clipping::getClipperTree(const vector<Poly> &polys)
 {
   CL::Polygons cpolys = getClipperPolygons(polys);
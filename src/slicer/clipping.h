@@ -45,6 +45,7 @@ enum JoinType{jsquare,jmiter,jround};
 class Clipping
 {
   friend class Poly;
+  friend class Region;
 
   CL::Clipper clpr;
 
@@ -60,6 +61,8 @@ class Clipping
   static CL::Polygons CLOffset(const CL::Polygons &cpolys, int cldist,
 			       CL::JoinType cljtype, double miter_limit=1,
 			       bool reverse=false);
+  static bool getConvexShrinked(const CL::Polygon &cpoly, double cldist,
+				CL::Polygon &result);
 
   bool debug;
   vector<CL::Polygons> subjpolygons; // for debugging
@@ -76,6 +79,7 @@ public:
   void addPolys   (const vector<ExPoly> &expolys, PolyType type);
   void addPolys   (const ExPoly &poly, PolyType type);
   void addPolygons(const CL::Polygons &cp, PolyType type);
+  void addPolys   (const Region &region, PolyType type);
 
   // do after addPoly... and before clipping/results
   void setZ(double z) {lastZ = z;};
@@ -99,9 +103,20 @@ public:
 				 CL::PolyFillType cft=CL::pftEvenOdd);
   vector<ExPoly> ext_subtract   (CL::PolyFillType sft=CL::pftEvenOdd,
 				 CL::PolyFillType cft=CL::pftEvenOdd);
+  // results staying in Clipper space
+  Region reg_intersect     (CL::PolyFillType sft=CL::pftEvenOdd,
+			    CL::PolyFillType cft=CL::pftEvenOdd);
+  Region reg_unite         (CL::PolyFillType sft=CL::pftEvenOdd,
+			    CL::PolyFillType cft=CL::pftEvenOdd);
+  Region reg_subtract      (CL::PolyFillType sft=CL::pftEvenOdd,
+			    CL::PolyFillType cft=CL::pftEvenOdd);
+  Region reg_subtractMerged(double overlap=0.001,
+			    CL::PolyFillType sft=CL::pftEvenOdd,
+			    CL::PolyFillType cft=CL::pftEvenOdd);
 
   static vector<Poly> getMerged(const vector<Poly> &polys, double overlap=0.001);
   static CL::Polygons getMerged(const CL::Polygons &cpolys, int overlap=3);
+  static Region getMerged(const Region &region, double overlap=0.001);
 
   static vector<Poly> getOffset(const Poly &poly, double distance,
 				JoinType jtype=jmiter, double miterdist=1);
@@ -112,6 +127,14 @@ public:
   static vector<Poly> getOffset(const vector<ExPoly> &expolys, double distance,
 				JoinType jtype=jmiter, double miterdist=1);
 
+  // the same in Clipper space, to chain offsets without converting
+  static CL::Polygons getOffset(const CL::Polygons &cpolys, double distance,
+				JoinType jtype=jmiter, double miterdist=1);
+  static Region getOffset(const Region &region, double distance,
+			  JoinType jtype=jmiter, double miterdist=1);
+  // like Poly::cleanup()
+  static void cleanup(CL::Polygons &cpolys, double epsilon);
+
   static vector<Poly> getShrinkedCapped(const vector<Poly> &polys, double distance,
 					JoinType jtype=jmiter,double miterdist=1);
 
@@ -127,6 +150,8 @@ public:
   static vector<ExPoly> getExPolys(const vector<Poly> &polys,
 				   double z, double extrusionfactor);
   static vector<ExPoly> getExPolys(const vector<Poly> &polys);
+  // from Clipper's nesting, no containment tests
+  static vector<ExPoly> getExPolys(const Region &region);
   static CL::PolyTree   getClipperTree(const vector<Poly> &polys);
 
   static CL::Polygon    getClipperPolygon (const Poly &poly);
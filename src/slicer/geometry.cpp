@@ -24,9 +24,6 @@
 #include "clipping.h"
 #include "triangle.h"
 
-// limfit library for arc fitting
-#include <lmmin.h>
-
 
 // #ifdef WIN32
 // #  include <GL/glut.h>	// Header GLUT Library
@@ -64,99 +61,69 @@ void drawString(const Vector3d &pos, void* font, const string &text)
 
 //////////////////////////// ARC FITTING //////////////////////////
 
+// Kasa fit: minimize sum of (x^2+y^2 + D*x + E*y + F)^2,
+// coordinates relative to the first point for precision
 
-/* function evaluation, determination of residues */
-// residue is difference between radius parameter and distance of point to center
-void evaluate_arcfit( const double *par, int m_dat, const void *data,
-		      double *fvec, int *info )
+void CircleFit::clear()
 {
-  /* for readability, perform explicit type conversion */
-  arc_data_struct *arcdata;
-  arcdata = (arc_data_struct*)data;
-  const Vector2d center(par[0], par[1]);
-  //const double radius_sq = par[2];
-  int i;
-  for ( i = 0; i < m_dat; i++ ) {
-    const Vector2d arcpoint(arcdata->px[i], arcdata->py[i]);
-    const double distance_sq = center.squared_distance(arcpoint);
-    fvec[i] = abs(par[2] - distance_sq); // sq.radius difference = residue
-  }
+  n = 0;
+  Sx = Sy = Sxx = Syy = Sxy = Sxz = Syz = Szz = 0;
 }
 
-bool fit_arc(const int m_dat, const arc_data_struct data,
-	     const int n_par, double *par, double sq_error,
-	     Vector2d &result_center, double &result_radiussq)
+void CircleFit::add(const Vector2d &point)
 {
-  lm_status_struct status;
-  lm_control_struct control = lm_control_double;
-  control.printflags = 0; // 3 = monitor status (+1) and parameters (+2)
-  control.maxcall = 200;
-  control.ftol = sq_error; // max square error sum
-
-  // printf( "Fitting:\n" );
-  lmmin( n_par, par, m_dat, (const void*) &data,
-	 evaluate_arcfit, &control, &status, lm_printout_std );
-
-  result_center.x() = par[0];
-  result_center.y() = par[1];
-  result_radiussq   = par[2];
-
-
-  double fvec[m_dat];
-  int info;
-  evaluate_arcfit(par, m_dat, (const void*) &data, fvec, &info);
-  double totres = 0;
-  for (int i=0; i<m_dat; ++i ) totres+=fvec[i];
-
-  return  (totres < sq_error);
-
-#if 0
-  printf( "\nResults:\n" );
-  printf( "status after %d function evaluations:\n  %s\n",
-	  status.nfev, lm_infmsg[status.info] );
-
-  printf("obtained parameters:\n");
-  int i;
-  for ( i=0; i<n_par; ++i )
-    printf("  par[%i] = %12g\n", i, par[i]);
-  printf("obtained norm:\n  %12g\n", status.fnorm );
-#endif
-
-  // printf("fitting data as follows:\n");
-  // double ff;
-  // for ( i=0; i<m_dat; ++i ){
-  //     ff = f(tx[i], tz[i], par);
-  //     printf( "  t[%2d]=%12g,%12g y=%12g fit=%12g residue=%12g\n",
-  //             i, tx[i], tz[i], y[i], ff, y[i] - ff );
-  // }
-  // free(data.px);
-  // free(data.py);
+  if (n == 0) origin = point;
+  const double x = point.x() - origin.x();
+  const double y = point.y() - origin.y();
+  const double z = x*x + y*y;
+  n++;
+  Sx  += x;   Sy  += y;
+  Sxx += x*x; Syy += y*y; Sxy += x*y;
+  Sxz += x*z; Syz += y*z; Szz += z*z;
 }
 
-// find center for best fit of arcpoints
-bool fit_arc(const vector<Vector2d> &points, double sq_error,
-	     Vector2d &result_center, double &result_radiussq)
+bool CircleFit::fit(Vector2d &center, double &radius) const
 {
-  if (points.size() < 3) return false;
-  const int n_par = 3; // center x,y and arc radius_sq
-  // start values:
-  const Vector2d P = points[0];
-  const Vector2d Q = points.back();
-  const Vector2d startxy = (P+Q)/2.;
-  double par[3] = { startxy.x(), startxy.y(), P.squared_distance(Q) };
-
-  int m_dat = points.size();
-  arc_data_struct data;
-  data.px = new double[m_dat];
-  data.py = new double[m_dat];
-  for (int i = 0; i < m_dat; i++) {
-    data.px[i] = points[i].x();
-    data.py[i] = points[i].y();
-  }
-  return fit_arc(m_dat, data, n_par, par, sq_error,
-		 result_center, result_radiussq);
+  if (n < 3) return false;
+  const double Sz = Sxx + Syy;
+  // normal equations M * (D,E,F) = -(Sxz,Syz,Sz), by Cramer's rule
+  const double det =
+      Sxx * (Syy*n  - Sy*Sy)
+    - Sxy * (Sxy*n  - Sy*Sx)
+    + Sx  * (Sxy*Sy - Syy*Sx);
+  const double scale = Sxx * Syy * n;
+  if (abs(det) <= 1e-12 * abs(scale)) return false; // collinear
+  const double bx = -Sxz, by = -Syz, bz = -Sz;
+  const double D = ( bx  * (Syy*n  - Sy*Sy)
+		   - Sxy * (by*n   - Sy*bz)
+		   + Sx  * (by*Sy  - Syy*bz) ) / det;
+  const double E = ( Sxx * (by*n   - Sy*bz)
+		   - bx  * (Sxy*n  - Sy*Sx)
+		   + Sx  * (Sxy*bz - by*Sx) ) / det;
+  const double F = ( Sxx * (Syy*bz - by*Sy)
+		   - Sxy * (Sxy*bz - by*Sx)
+		   + bx  * (Sxy*Sy - Syy*Sx) ) / det;
+  const double rsq = (D*D + E*E) / 4 - F;
+  if (rsq <= 0) return false;
+  center = origin + Vector2d(-D/2, -E/2);
+  radius = sqrt(rsq);
+  return true;
 }
 
+// root mean square of the distances of the points from the circle,
+// from the algebraic residual (z + D*x + E*y + F = (d^2-r^2) ~ 2*r*(d-r))
+double CircleFit::rmsError(const Vector2d &center, double radius) const
+{
+  if (n == 0 || radius <= 0) return 0;
+  const double D = -2 * (center.x() - origin.x());
+  const double E = -2 * (center.y() - origin.y());
+  const double F = (D*D + E*E) / 4 - radius*radius;
+  const double Sz = Sxx + Syy;
+  const double res = Szz + D*D*Sxx + E*E*Syy + F*F*n
+    + 2*D*Sxz + 2*E*Syz + 2*F*Sz
+    + 2*D*E*Sxy + 2*D*F*Sx + 2*E*F*Sy;
+  return sqrt(MAX(res, 0.) / n) / (2*radius);
+}
 
 /////////////////////////////////////////////////////////////////////////////
 
@@ -1362,11 +1329,10 @@ void glDrawPolySurfaceRastered(const vector<Poly> &polys,
 }
 
 
-void glDrawCairoSurface(const Cairo::RefPtr<Cairo::ImageSurface> surface,
-			const Vector2d &min, const Vector2d &max,
-			const double z)
+// mipmapped alpha texture of the surface, 0 if none
+GLuint glMakeCairoTexture(const Cairo::RefPtr<Cairo::ImageSurface> surface)
 {
-  if (surface==0) return;
+  if (surface==0) return 0;
   int w = surface->get_width();
   int h = surface->get_height();
   unsigned char * data = surface->get_data();
@@ -1386,7 +1352,15 @@ void glDrawCairoSurface(const Cairo::RefPtr<Cairo::ImageSurface> surface,
   // build our texture mipmaps
   gluBuild2DMipmaps( GL_TEXTURE_2D, GL_ALPHA, w, h,
 		     GL_ALPHA, GL_UNSIGNED_BYTE, data );
+  return texture;
+}
 
+// draw texture on the rectangle min-max at height z
+void glDrawTexture(GLuint texture,
+		   const Vector2d &min, const Vector2d &max,
+		   const double z)
+{
+  glBindTexture( GL_TEXTURE_2D, texture );
   glEnable(GL_TEXTURE_2D);
   glBegin(GL_QUADS);
   glTexCoord2d(0.0,0.0); glVertex3d(min.x(),min.y(),z);
@@ -1395,6 +1369,15 @@ void glDrawCairoSurface(const Cairo::RefPtr<Cairo::ImageSurface> surface,
   glTexCoord2d(0.0,1.0); glVertex3d(min.x(),max.y(),z);
   glEnd();
   glDisable(GL_TEXTURE_2D);
+}
+
+void glDrawCairoSurface(const Cairo::RefPtr<Cairo::ImageSurface> surface,
+			const Vector2d &min, const Vector2d &max,
+			const double z)
+{
+  GLuint texture = glMakeCairoTexture(surface);
+  if (texture == 0) return;
+  glDrawTexture(texture, min, max, z);
   glDeleteTextures( 1, &texture );
 }
 
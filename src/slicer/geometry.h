@@ -114,17 +114,24 @@ vector<Poly> dir_thick_line(const Vector2d &from, const Vector2d &to,
 			    double fr_width, double to_width);
 
 
-bool fit_arc(const vector<Vector2d> &points, double sq_error,
-	     Vector2d &result_center, double &result_radius);
-
-typedef struct {
-  double *px, *py; // arc points
-} arc_data_struct;
-
-bool fit_arc(const int m_dat, const arc_data_struct data,
-	     const int n_par, double *par, double sq_error,
-	     Vector2d &result_center, double &result_radiussq);
-
+// Algebraic (Kasa) circle fit with running sums,
+// points can be added one by one and fitted at any time
+class CircleFit
+{
+ public:
+  CircleFit() { clear(); }
+  void clear();
+  void add(const Vector2d &point);
+  uint size() const { return n; }
+  // false if less than 3 points or all on a line
+  bool fit(Vector2d &center, double &radius) const;
+  // approximate rms distance of the points from the given circle
+  double rmsError(const Vector2d &center, double radius) const;
+ private:
+  uint n;
+  Vector2d origin;
+  double Sx, Sy, Sxx, Syy, Sxy, Sxz, Syz, Szz; // z = x^2+y^2
+};
 
 
 bool rasterpolys(const vector<Poly> &polys,
@@ -141,6 +148,12 @@ void glDrawCairoSurface(const Cairo::RefPtr<Cairo::ImageSurface> surface,
 			const Vector2d &min, const Vector2d &max,
 			const double z);
 
+GLuint glMakeCairoTexture(const Cairo::RefPtr<Cairo::ImageSurface> surface);
+
+void glDrawTexture(GLuint texture,
+		   const Vector2d &min, const Vector2d &max,
+		   const double z);
+
 int getCairoSurfaceDatapoint(const Cairo::RefPtr<Cairo::ImageSurface> surface,
 			     const Vector2d &min, const Vector2d &max,
 			     const Vector2d &p);
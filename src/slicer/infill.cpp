@@ -20,11 +20,13 @@
 #include "infill.h"
 #include "poly.h"
 #include "layer.h"
+#include "profile.h"
 
 
 vector<struct Infill::pattern> Infill::savedPatterns;
 #ifdef _OPENMP
 omp_lock_t Infill::save_lock;
+bool Infill::save_lock_ready = (omp_init_lock(&Infill::save_lock), true);
 #endif
 
 void hilbert(int level,int direction, double infillDistance, vector<Vector2d> &v);
@@ -58,7 +60,11 @@ void Infill::clear()
   m_tofillpolys.clear();
 }
 
+// the patterns are shared by all models, so clear under the lock
 void Infill::clearPatterns() {
+#ifdef _OPENMP
+  omp_set_lock(&save_lock);
+#endif
   for (uint i=0; i<savedPatterns.size(); i++) {
     savedPatterns[i].type = INVALIDINFILL;
     savedPatterns[i].cpolys.clear();
@@ -66,8 +72,7 @@ void Infill::clearPatterns() {
   savedPatterns.clear();
   //cerr << "clearpatterns " << savedPatterns.size() << endl;
 #ifdef _OPENMP
-  omp_destroy_lock(&save_lock);
-  omp_init_lock(&save_lock);
+  omp_unset_lock(&save_lock);
 #endif
 }
 
@@ -96,6 +101,23 @@ void Infill::addPolys(double z, const vector<Poly> &polys, InfillType type,
   addPolys(z, polys, patterncpolys, offsetDistance);
 }
 
+// the pattern needs the Poly view, clipping uses the paths
+void Infill::addPolys(double z, const Region &region, InfillType type,
+		      double infillDistance, double offsetDistance, double rotation)
+{
+  this->infillDistance = infillDistance;
+
+#ifdef _OPENMP
+  omp_set_lock(&save_lock);
+#endif
+  ClipperLib::Polygons patterncpolys =
+    makeInfillPattern(type, region.polys(), infillDistance, offsetDistance, rotation);
+#ifdef _OPENMP
+  omp_unset_lock(&save_lock);
+#endif
+  addPolys(z, region, patterncpolys, offsetDistance);
+}
+
 void Infill::addPoly(double z, const ExPoly &expoly, InfillType type,
 		     double infillDistance, double offsetDistance, double rotation)
 {
@@ -150,6 +172,22 @@ void Infill::addPolys(double z, const vector<Poly> &polys,
   addInfillPolys(result);
 }
 
+void Infill::addPolys(double z, const Region &region,
+		      const ClipperLib::Polygons &patterncpolys,
+		      double offsetDistance)
+{
+  Clipping clipp;
+  clipp.addPolys   (region,        subject);
+  clipp.addPolygons(patterncpolys, clip);
+  clipp.setExtrusionFactor(extrusionfactor); // set my extfactor
+  clipp.setZ(z);
+  vector<Poly> result = clipp.intersect();
+  if (m_type==PolyInfill)  // reversal from evenodd clipping
+    for (uint i = 0; i<result.size(); i+=2)
+      result[i].reverse();
+  addInfillPolys(result);
+}
+
 // generate infill pattern as a vector of polygons
 ClipperLib::Polygons Infill::makeInfillPattern(InfillType type,
 					       const vector<Poly> &tofillpolys,
@@ -157,6 +195,7 @@ ClipperLib::Polygons Infill::makeInfillPattern(InfillType type,
 					       double offsetDistance,
 					       double rotation)
 {
+  TRACE_SCOPE("Infill::makeInfillPattern");
   ClipperLib::Polygons cpolys;
   m_tofillpolys = tofillpolys;
   m_type = type;
@@ -435,128 +474,307 @@ ClipperLib::Polygons Infill::makeInfillPattern(InfillType type,
 }
 
 
-int smallest(const vector<double> &nums, double &minimum)
+// Uniform grid over the area of the infill lines, for finding nearby
+// line endpoints without looking at all of them
+class InfillGrid
 {
-  minimum = INFTY;
-  int minind = -1;
-  for (uint i = 0; i < nums.size(); i++ ) {
-    if (nums[i] < minimum) {
-      minimum = nums[i];
-      minind = i;
+public:
+  InfillGrid(const Vector2d &min, const Vector2d &max, uint numpoints)
+    : Min(min)
+  {
+    const Vector2d size = max - min;
+    cellsize = sqrt(size.x() * size.y() / MAX(numpoints, 1u));
+    cellsize = MAX(cellsize, (size.x() + size.y()) / MAX(numpoints, 1u));
+    cellsize = MAX(cellsize, 0.001);
+    nx = (uint)(size.x() / cellsize) + 1;
+    ny = (uint)(size.y() / cellsize) + 1;
+    cells.resize(nx * ny);
+  }
+  int cellX(double x) const {
+    return CLAMP((int)floor((x - Min.x()) / cellsize), 0, (int)nx - 1);
+  }
+  int cellY(double y) const {
+    return CLAMP((int)floor((y - Min.y()) / cellsize), 0, (int)ny - 1);
+  }
+  uint cellOf(const Vector2d &p) const { return cellY(p.y()) * nx + cellX(p.x()); }
+
+  Vector2d Min;
+  double cellsize;
+  uint nx, ny;
+  vector< vector<uint> > cells;
+};
+
+// Segments to test a line for crossings, sorted into bands along the
+// direction of the infill lines.  A segment is in the bands its span
+// across that direction touches: an infill line in one band, an outline
+// edge in as many as it is wide across the lines.  So there are about
+// as many entries as segments plus bands, where a grid would put a long
+// line into every cell it crosses.
+class SegmentBands
+{
+public:
+  // bands from vmin to vmax as given by across()
+  SegmentBands(const Vector2d &direction, double vmin, double vmax,
+	       double bandwidth, uint maxbands)
+    : dir(direction), vmin(vmin), querycount(0), sorted(true)
+  {
+    width = MAX(bandwidth, (vmax - vmin) / MAX(maxbands, 1u));
+    width = MAX(width, 0.001);
+    bands.resize((uint)((vmax - vmin) / width) + 1);
+  }
+
+  static double along (const Vector2d &dir, const Vector2d &p)
+  { return p.x()*dir.x() + p.y()*dir.y(); }
+  static double across(const Vector2d &dir, const Vector2d &p)
+  { return p.y()*dir.x() - p.x()*dir.y(); }
+
+  void add(const Vector2d &from, const Vector2d &to)
+  {
+    const uint id = umin.size();
+    segments.push_back(from);
+    segments.push_back(to);
+    const double u1 = along(dir, from), u2 = along(dir, to);
+    umin.push_back(MIN(u1, u2));
+    umax.push_back(MAX(u1, u2));
+    stamp.push_back(0);
+    const double v1 = across(dir, from), v2 = across(dir, to);
+    const int b1 = band(MAX(v1, v2));
+    for (int b = band(MIN(v1, v2)); b <= b1; b++)
+      bands[b].push_back(id);
+    sorted = false;
+  }
+
+  // does P1--P2 cross any segment between 0.1 and 0.9 of its length
+  // (with ends = true: anywhere)
+  bool crosses(const Vector2d &P1, const Vector2d &P2, bool ends)
+  {
+    if (!sorted) sortBands();
+    querycount++;
+    const double pad = 0.01 * width;
+    const double u1 = along(dir, P1), u2 = along(dir, P2);
+    const double qumin = MIN(u1, u2) - pad, qumax = MAX(u1, u2) + pad;
+    const double v1 = across(dir, P1), v2 = across(dir, P2);
+    const int b1 = band(MAX(v1, v2) + pad);
+    const Vector2d d = P2 - P1;
+    const bool use_x = abs(d.x()) >= abs(d.y());
+    Intersection inter;
+    for (int b = band(MIN(v1, v2) - pad); b <= b1; b++) {
+      const vector<uint> &segs = bands[b];
+      for (uint i = 0; i < segs.size(); i++) {
+	const uint s = segs[i];
+	if (umin[s] > qumax) break; // sorted by umin
+	if (umax[s] < qumin || stamp[s] == querycount) continue;
+	stamp[s] = querycount;
+	if (!IntersectXY(P1, P2, segments[2*s], segments[2*s+1], inter))
+	  continue;
+	if (ends) return true;
+	double t = use_x ? d.x() : d.y();
+	if (t != 0)
+	  t = (use_x ? inter.p.x() - P1.x() : inter.p.y() - P1.y()) / t;
+	// don't catch endpoint intersections (continuations)
+	if (t > 0.1 && t < 0.9) return true;
+      }
     }
+    return false;
   }
-  return minind;
-}
 
-bool intersectsPolys(const Vector2d &P1, const Vector2d &P2,
-		     const vector<Poly> &polys, double err=0.01)
+private:
+  Vector2d dir;
+  double vmin, width;
+  vector< vector<uint> > bands;
+  vector<Vector2d> segments;
+  vector<double> umin, umax; // span along dir
+  vector<uint> stamp; // last query that tested the segment
+  uint querycount;
+  bool sorted;
+
+  int band(double v) const {
+    return CLAMP((int)floor((v - vmin) / width), 0, (int)bands.size() - 1);
+  }
+
+  struct ByUmin {
+    const vector<double> &umin;
+    ByUmin(const vector<double> &umin) : umin(umin) {}
+    bool operator()(uint a, uint b) const { return umin[a] < umin[b]; }
+  };
+  void sortBands()
+  {
+    for (uint b = 0; b < bands.size(); b++)
+      std::sort(bands[b].begin(), bands[b].end(), ByUmin(umin));
+    sorted = true;
+  }
+};
+
+// line endpoints not used yet, id = 2*line + (0 for from, 1 for to)
+class EndpointGrid : public InfillGrid
 {
-  Intersection inter;
-  for (size_t ci = 0; ci < polys.size(); ci++) {
-    // bool in1 = polys[ci].vertexInside(P1);
-    // bool in2 = polys[ci].vertexInside(P2);
-    // if (in1 != in2) return true;
-    vector<Intersection> inter = polys[ci].lineIntersections(P1, P2, err);
-    if (inter.size() > 0) {
-      return true;
+public:
+  EndpointGrid(const vector<Infill::infillline> &lines,
+	       const Vector2d &min, const Vector2d &max)
+    : InfillGrid(min, max, 2 * lines.size()), lines(lines)
+  {
+    for (uint i = 0; i < lines.size(); i++) {
+      cells[cellOf(lines[i].from)].push_back(2*i);
+      cells[cellOf(lines[i].to)  ].push_back(2*i+1);
     }
+    remaining = lines.size();
   }
-  return false;
-}
+
+  void remove(uint line)
+  {
+    removeId(cellOf(lines[line].from), 2*line);
+    removeId(cellOf(lines[line].to),   2*line+1);
+    remaining--;
+  }
+
+  // nearest endpoint, searching rings of cells around p
+  // until no closer one can come; false if none left
+  bool nearest(const Vector2d &p, uint &id, double &distsq) const
+  {
+    distsq = INFTY;
+    if (remaining == 0) return false;
+    const int px = cellX(p.x()), py = cellY(p.y());
+    const int maxring = MAX(nx, ny);
+    for (int r = 0; r <= maxring; r++) {
+      for (int cy = py - r; cy <= py + r; cy++) {
+	if (cy < 0 || cy >= (int)ny) continue;
+	// full rows at top and bottom, only the sides in between
+	const int step = (cy == py - r || cy == py + r) ? 1 : MAX(2*r, 1);
+	for (int cx = px - r; cx <= px + r; cx += step) {
+	  if (cx < 0 || cx >= (int)nx) continue;
+	  const vector<uint> &cell = cells[cy * nx + cx];
+	  for (uint i = 0; i < cell.size(); i++) {
+	    const uint e = cell[i];
+	    const Vector2d &v = (e % 2 == 0) ? lines[e/2].from : lines[e/2].to;
+	    const double d = (v - p).squared_length();
+	    if (d < distsq) { distsq = d; id = e; }
+	  }
+	}
+      }
+      // all cells in the next ring are at least r cells away
+      const double ringdist = r * cellsize;
+      if (distsq <= ringdist * ringdist) break;
+    }
+    return distsq < INFTY;
+  }
+
+private:
+  const vector<Infill::infillline> &lines;
+  uint remaining;
+
+  void removeId(uint c, uint id)
+  {
+    vector<uint> &cell = cells[c];
+    for (uint i = 0; i < cell.size(); i++)
+      if (cell[i] == id) {
+	cell[i] = cell.back();
+	cell.pop_back();
+	return;
+      }
+  }
+};
 
 // sort (parallel) lines into polys so that each poly can be an extrusion path
 // polys will later be connected by moves (as printlines)
 // that is: connect nearest lines, but when connection intersects anything,
 //          start a new path (poly)
+// Nearest line ends are found in a grid, crossings are tested only with
+// the lines and outline edges in the bands the connection touches.
 vector<Poly> Infill::sortedpolysfromlines(const vector<infillline> &lines, double z)
 {
   vector<Poly> polys;
-  uint count = lines.size();
+  const uint count = lines.size();
   if (count == 0) return polys;
-  vector<Poly> clippolys = Clipping::getOffset(m_tofillpolys,0.1);
+  const vector<Poly> clippolys = Clipping::getOffset(m_tofillpolys,0.1);
+
+  Vector2d min(INFTY,INFTY), max(-INFTY,-INFTY);
+  for (uint i = 0; i < count; i++) {
+    min[0] = MIN(min[0], MIN(lines[i].from.x(), lines[i].to.x()));
+    min[1] = MIN(min[1], MIN(lines[i].from.y(), lines[i].to.y()));
+    max[0] = MAX(max[0], MAX(lines[i].from.x(), lines[i].to.x()));
+    max[1] = MAX(max[1], MAX(lines[i].from.y(), lines[i].to.y()));
+  }
 
-  vector<bool> done(count);
-  for (uint i = 0; i < count; i++ ) done[i]==false;
-  Poly p(z, extrusionfactor);
-  p.setClosed(false);
-  p.addVertex(lines[0].from);
-  p.addVertex(lines[0].to);
-  uint donelines = 1;
-  while(donelines < count)
+  EndpointGrid endpoints(lines, min, max);
+
+  // bands along the (nearly parallel) lines, about one per line
+  Vector2d direction(1,0);
+  for (uint i = 0; i < count; i++) {
+    const Vector2d d = lines[i].to - lines[i].from;
+    if (d.length() > 0) { direction = d / d.length(); break; }
+  }
+  double vmin = INFTY, vmax = -INFTY;
+  for (uint i = 0; i < count; i++) {
+    const double v1 = SegmentBands::across(direction, lines[i].from);
+    const double v2 = SegmentBands::across(direction, lines[i].to);
+    vmin = MIN(vmin, MIN(v1, v2));
+    vmax = MAX(vmax, MAX(v1, v2));
+  }
+  const uint maxbands = 4 * count + 16;
+  SegmentBands linebands(direction, vmin, vmax, infillDistance, maxbands);
+  for (uint i = 0; i < count; i++)
+    linebands.add(lines[i].from, lines[i].to);
+  // outline edges outside the lines' area end up in the border bands
+  SegmentBands edgebands(direction, vmin, vmax, infillDistance, maxbands);
+  for (uint ci = 0; ci < clippolys.size(); ci++)
+    for (uint i = 0; i < clippolys[ci].size(); i++)
+      edgebands.add(clippolys[ci].getVertexCircular(i),
+		    clippolys[ci].getVertexCircular(i+1));
+
+  // current path, grows at both ends
+  deque<Vector2d> path;
+  path.push_back(lines[0].from);
+  path.push_back(lines[0].to);
+  endpoints.remove(0);
+  for (uint donelines = 1; donelines < count; donelines++)
     {
-      vector<double> dist(4);
-      Vector2d l1,l2;
-      double mindistline = INFTY;
-      uint minindline = 0;
-      uint minind = 0;
-      double mindist = INFTY;
-      // find nearest line for current p endpoints:
-      for (uint j = 1; j < count; j++)
-	if (!done[j]) {
-	  dist[0] = (p.front()-lines[j].from).squared_length();
-	  dist[1] = (p.front()-lines[j].to  ).squared_length();
-	  dist[2] = (p.back() -lines[j].from).squared_length();
-	  dist[3] = (p.back() -lines[j].to  ).squared_length();
-	  uint mind = smallest(dist, mindist);
-	  if (mindist < mindistline) {
-	    minindline = j;
-	    mindistline = mindist;
-	    minind = mind;
-	  }
-	}
-      uint i = minindline;
+      // find nearest line end for current path endpoints:
+      uint frontid = 0, backid = 0;
+      double frontdist, backdist;
+      endpoints.nearest(path.front(), frontid, frontdist);
+      endpoints.nearest(path.back(),  backid,  backdist);
+      const bool atfront = frontdist <= backdist;
+      const uint id = atfront ? frontid : backid;
+      const uint i = id / 2;
       // make new line l1--l2:
-      if (minind % 2 == 0) { l1 = lines[i].from; l2 = lines[i].to; }
-      else                 { l1 = lines[i].to; l2 = lines[i].from; }
+      Vector2d l1,l2;
+      if (id % 2 == 0) { l1 = lines[i].from; l2 = lines[i].to; }
+      else             { l1 = lines[i].to; l2 = lines[i].from; }
 
       // connection to last/first
-      Vector2d conn1, conn2 = l1;
-      if (minind < 2) conn1 = p.front();
-      else            conn1 = p.back();
-
-      // try polygons intersect
-      bool intersects = intersectsPolys(conn1, conn2, clippolys);
-
-      if (!intersects) {
-        // detect crossings: try intersect with any line
-      	Intersection inter;
-      	for (uint li = 0; li<lines.size(); li++) {
-      	  if (IntersectXY(conn1, conn2, lines[li].from, lines[li].to, inter,
-			  infillDistance/2.))  {
-            double t = conn2.x() - conn1.x();
-            if (t != 0)
-              t = (inter.p.x() - conn1.x()) / t;
-
-	    // don't catch endpoint intersections (continuations)
-	    if (t > 0.1 && t < 0.9) {
-		intersects = true;
-		break;
-      	    }
-          }
-      	}
-      }
+      const Vector2d conn1 = atfront ? path.front() : path.back();
+      const Vector2d conn2 = l1;
+
+      // try polygons intersect, then crossings with any line
+      const bool intersects = edgebands.crosses(conn1, conn2, true)
+	|| linebands.crosses(conn1, conn2, false);
 
       if (intersects) { // start new poly
-	if (p.size() > 0) {
-	  p.cleanup(infillDistance/2.);
-	  polys.push_back(p);
-	}
-	p = Poly(z, extrusionfactor);
-	p.setClosed(false);
+	addPath(path, z, polys);
+	path.clear();
       }
-      // add new line to current p
-      if (minind < 2) { p.push_front(l1); p.push_front(l2); }
-      else            { p.push_back(l1);  p.push_back(l2);  }
-      done[i] = true;
-      donelines++;
+      // add new line to current path
+      if (atfront) { path.push_front(l1); path.push_front(l2); }
+      else         { path.push_back(l1);  path.push_back(l2);  }
+      endpoints.remove(i);
     }
-  if (p.size() > 0) {
-    p.cleanup(infillDistance/2.);
-    polys.push_back(p);
-  }
+  addPath(path, z, polys);
   return polys;
 }
 
+void Infill::addPath(const deque<Vector2d> &path, double z,
+		     vector<Poly> &polys) const
+{
+  if (path.size() == 0) return;
+  Poly p(z, extrusionfactor);
+  p.setClosed(false);
+  for (deque<Vector2d>::const_iterator v = path.begin(); v != path.end(); ++v)
+    p.addVertex(*v);
+  p.cleanup(infillDistance/2.);
+  polys.push_back(p);
+}
+
+
 bool sameAngle(double angle1, double angle2, double err)
 {
   while (angle1 < 0) angle1+=2.*M_PI;
@@ -24,8 +24,11 @@
 #include <omp.h>
 #endif
 
+#include <deque>
+
 #include "stdafx.h"
 #include "clipping.h"
+#include "region.h"
 
 
 // user selectable have to be first
@@ -53,6 +56,7 @@ class Infill
   static vector<struct pattern> savedPatterns;
 #ifdef _OPENMP
   static omp_lock_t save_lock;
+  static bool save_lock_ready;
 #endif
 
   ClipperLib::Polygons makeInfillPattern(InfillType type,
@@ -96,6 +100,10 @@ class Infill
 		double offsetDistance);
   void addPolys(double z, const vector<Poly> &polys, const ClipperLib::Polygons &ifcpolys,
 		double offsetDistance);
+  void addPolys(double z, const Region &region, InfillType type,
+		double infillDistance, double offsetDistance, double rotation);
+  void addPolys(double z, const Region &region, const ClipperLib::Polygons &ifcpolys,
+		double offsetDistance);
 
   void addPoly (double z, const ExPoly &expoly, InfillType type, double infillDistance,
 	       double offsetDistance, double rotation);
@@ -106,6 +114,7 @@ class Infill
 
   typedef struct { Vector2d from; Vector2d to; } infillline;
   vector<Poly> sortedpolysfromlines(const vector<infillline> &lines, double z);
+  void addPath(const deque<Vector2d> &path, double z, vector<Poly> &polys) const;
 
   void clear();
   uint size() const {return infillpolys.size();};
@@ -57,20 +57,21 @@ void Layer::Clear()
   skinFullInfills.clear();
   clearpolys(polygons);
   clearpolys(shellPolygons);
-  clearpolys(fillPolygons);
+  fillPolygons.clear();
   clearpolys(thinPolygons);
-  clearpolys(fullFillPolygons);
+  fullFillPolygons.clear();
   clearpolys(bridgePolygons);
   clearpolys(bridgePillars);
   bridge_angles.clear();
   bridgeInfills.clear();
-  clearpolys(decorPolygons);
-  clearpolys(supportPolygons);
+  decorPolygons.clear();
+  supportPolygons.clear();
   clearpolys(toSupportPolygons);
   clearpolys(skinPolygons);
-  clearpolys(skinFullFillPolygons);
+  skinFullFillPolygons.clear();
   hullPolygon.clear();
   clearpolys(skirtPolygons);
+  display.clear();
 }
 
 // void Layer::setBBox(Vector2d min, Vector2d max)
@@ -127,22 +128,43 @@ bool Layer::pointInPolygons(const Vector2d &p) const
 
 int Layer::addShape(const Matrix4d &T, const Shape &shape, double z,
 		    double &max_gradient, double max_supportangle)
+{
+  return addShape(T, shape, z, max_gradient, max_supportangle,
+		  vector<Matrix4d>());
+}
+
+int Layer::addShape(const Matrix4d &T, const Shape &shape, double z,
+		    double &max_gradient, double max_supportangle,
+		    const vector<Matrix4d> &instances)
 {
   double hackedZ = z;
   bool polys_ok = false;
-  vector<Poly> polys;
+  vector<Poly> polys, supportpolys;
   int num_polys=-1;
   // try to slice until polygons can be made, otherwise hack z
   while (!polys_ok && hackedZ < z+thickness) {
     polys.clear();
+    supportpolys.clear();
     polys_ok = shape.getPolygonsAtZ(T, hackedZ,  // slice shape at hackedZ
 				    polys, max_gradient,
-				    toSupportPolygons, max_supportangle,
+				    supportpolys, max_supportangle,
 				    thickness);
     hackedZ += thickness/10;
     if (polys_ok) {
       num_polys = polys.size();
+      for (uint i = 0; i < instances.size(); i++) {
+	vector<Poly> placed = polys;
+	for (uint p = 0; p < placed.size(); p++)
+	  placed[p].transform(instances[i]);
+	addPolygons(placed);
+	for (uint p = 0; p < supportpolys.size(); p++) {
+	  toSupportPolygons.push_back(supportpolys[p]);
+	  toSupportPolygons.back().transform(instances[i]);
+	}
+      }
       addPolygons(polys);
+      toSupportPolygons.insert(toSupportPolygons.end(),
+			       supportpolys.begin(), supportpolys.end());
     } else {
       num_polys=-1;
       cerr << "hacked Z " << z << " -> " << hackedZ << endl;
@@ -373,7 +395,7 @@ void Layer::addBridgePolygons(const vector<ExPoly> &newexpolys)
   clipp.clear();
   clipp.addPolys(fillPolygons,subject);
   clipp.addPolys(newexpolys, clip);
-  setNormalFillPolygons(clipp.subtract());
+  setNormalFillPolygons(clipp.reg_subtract());
 }
 
 void Layer::addFullPolygons(const vector<ExPoly> &newpolys, bool decor)
@@ -381,10 +403,16 @@ void Layer::addFullPolygons(const vector<ExPoly> &newpolys, bool decor)
   addFullPolygons(Clipping::getPolys(newpolys),decor);
 }
 
-// add full fill and subtract them from normal fill polys
 void Layer::addFullPolygons(const vector<Poly> &newpolys, bool decor)
 {
   if (newpolys.size()==0) return;
+  addFullPolygons(Region(newpolys), decor);
+}
+
+// add full fill and subtract them from normal fill polys
+void Layer::addFullPolygons(const Region &newpolys, bool decor)
+{
+  if (newpolys.empty()) return;
   Clipping clipp;
   clipp.clear();
   // full fill only where already normal fill
@@ -392,30 +420,24 @@ void Layer::addFullPolygons(const vector<Poly> &newpolys, bool decor)
   if (decor) clipp.addPolys(fullFillPolygons,subject);
   clipp.addPolys(newpolys,clip);
   clipp.setZ(Z);
-  vector<Poly> inter = clipp.intersect();
-  vector<Poly> normals = clipp.subtractMerged(thickness/2.);
+  Region inter = clipp.reg_intersect();
+  Region normals = clipp.reg_subtractMerged(thickness/2.);
   if (decor) {//  && LayerNo != 0) // no decor on base layers
-    decorPolygons.insert(decorPolygons.end(), inter.begin(), inter.end());
+    decorPolygons.add(inter);
     Clipping clipp;
     clipp.addPolys(fullFillPolygons,subject);
     clipp.addPolys(inter,clip);
     clipp.setZ(Z);
-    setFullFillPolygons(clipp.subtract());
+    setFullFillPolygons(clipp.reg_subtract());
   }
   else {
-    fullFillPolygons.insert(fullFillPolygons.end(),inter.begin(),inter.end());
+    fullFillPolygons.add(inter);
   }
 
   setNormalFillPolygons(normals);
   //  mergeFullPolygons(false); // done separately
 }
 
-void cleanup(vector<Poly> &polys, double error)
-{
-  for (uint i = 0; i<polys.size(); i++)
-    polys[i].cleanup(error);
-}
-
 void Layer::mergeFullPolygons(bool bridge)
 {
   // if (bridge) {
@@ -429,20 +451,20 @@ void Layer::mergeFullPolygons(bool bridge)
   // setFullFillPolygons(clipp.subtract());
 
   setFullFillPolygons(Clipping::getMerged(fullFillPolygons, thickness));
-  cleanup(fullFillPolygons, thickness/CLEANFACTOR);
+  fullFillPolygons.cleanup(thickness/CLEANFACTOR);
   //subtract from normal fills
   clipp.clear();
-  cleanup(fillPolygons, thickness/CLEANFACTOR);
+  fillPolygons.cleanup(thickness/CLEANFACTOR);
   clipp.addPolys(fillPolygons,subject);
   clipp.addPolys(fullFillPolygons,clip);
   clipp.addPolys(decorPolygons,clip);
-  vector<Poly> normals = clipp.subtractMerged();
+  Region normals = clipp.reg_subtractMerged();
   setNormalFillPolygons(normals);
   // }
 }
 void Layer::mergeSupportPolygons()
 {
-  setSupportPolygons(Clipping::getMerged(GetSupportPolygons()));
+  setSupportPolygons(Clipping::getMerged(supportPolygons));
 }
 
 const vector<Poly> * Layer::GetInnerShell() const
@@ -461,7 +483,7 @@ const vector<Poly> * Layer::GetOuterShell() const
   // no skins
   if (shellPolygons.size()>0) return &(shellPolygons.front());
   // no shells:
-  if (fillPolygons.size()>0) return &fillPolygons;
+  if (fillPolygons.size()>0) return &fillPolygons.polys();
   // no offset
   return &polygons;
 }
@@ -478,20 +500,16 @@ vector<Poly> Layer::GetShellPolygonsCirc(int number) const
   return shellPolygons[number];
 }
 
-void Layer::setNormalFillPolygons(const vector<Poly> &polys)
+void Layer::setNormalFillPolygons(const Region &region)
 {
-  clearpolys(fillPolygons);
-  fillPolygons = polys;
-  for (uint i=0; i<fillPolygons.size();i++)
-    fillPolygons[i].setZ(Z);
+  fillPolygons = region;
+  fillPolygons.setZ(Z);
 }
 
-void Layer::setFullFillPolygons(const vector<Poly> &polys)
+void Layer::setFullFillPolygons(const Region &region)
 {
-  clearpolys(fullFillPolygons);
-  fullFillPolygons = polys;
-  for (uint i=0; i<fullFillPolygons.size();i++)
-    fullFillPolygons[i].setZ(Z);
+  fullFillPolygons = region;
+  fullFillPolygons.setZ(Z);
 }
 void Layer::setBridgePolygons(const vector<ExPoly> &expolys)
 {
@@ -525,22 +543,18 @@ void Layer::setBridgeAngles(const vector<double> &angles)
   bridge_angles=angles; // .insert(bridge_angles.begin(),angles.begin(),angles.end());
 }
 
-void Layer::setSupportPolygons(const vector<Poly> &polys)
+void Layer::setSupportPolygons(const Region &region)
 {
-  clearpolys(supportPolygons);
-  supportPolygons = polys;
-  const double minarea = 10*thickness*thickness;
-  for (int i = supportPolygons.size()-1; i >= 0; i--) {
-    supportPolygons[i].cleanup(thickness/CLEANFACTOR);
-    if (abs(Clipping::Area(supportPolygons[i])) < minarea) {
-      supportPolygons.erase(supportPolygons.begin() + i);
-      continue;
-    }
-    vector<Vector2d> minmax = supportPolygons[i].getMinMax();
-    Min.x() = min(minmax[0].x(),Min.x());
-    Min.y() = min(minmax[0].y(),Min.y());
-    Max.x() = max(minmax[1].x(),Max.x());
-    Max.y() = max(minmax[1].y(),Max.y());
+  supportPolygons = region;
+  supportPolygons.setZ(Z);
+  supportPolygons.cleanup(thickness/CLEANFACTOR);
+  supportPolygons.removeSmall(10*thickness*thickness);
+  Vector2d smin, smax;
+  if (supportPolygons.getMinMax(smin, smax)) {
+    Min.x() = min(smin.x(),Min.x());
+    Min.y() = min(smin.y(),Min.y());
+    Max.x() = max(smax.x(),Max.x());
+    Max.y() = max(smax.y(),Max.y());
   }
 }
 
@@ -555,31 +569,37 @@ void Layer::setSkirtPolygons(const vector<Poly> &poly)
 }
 
 
-void Layer::FindThinpolys(const vector<Poly> &polys, double extrwidth,
-			  vector<Poly> &thickpolys, vector<Poly> &thinpolys)
+// all in Clipper space, see MakeShells
+void Layer::FindThinpolys(const CL::Polygons &cpolys, double extrwidth,
+			  CL::Polygons &thickpolys, CL::Polygons &thinpolys)
 {
 #define THINPOLYS 1
 #if THINPOLYS
   // go in
-  thickpolys = Clipping::getOffset(polys, -0.5*extrwidth);
+  thickpolys = Clipping::getOffset(cpolys, -0.5*extrwidth);
   // go out again, now thin polys are gone
   thickpolys = Clipping::getOffset(thickpolys, 0.55*extrwidth);
   // (need overlap to really clip)
 
   // use bigger (longer) polys for clip to avoid overlap of thin and thick extrusion lines
-  vector <Poly> bigthick = Clipping::getOffset(thickpolys, extrwidth);
+  CL::Polygons bigthick = Clipping::getOffset(thickpolys, extrwidth);
   // difference to original are thin polys
-  Clipping clipp;
-  clipp.addPolys(polys, subject);
-  clipp.addPolys(bigthick, clip);
-  thinpolys = clipp.subtract();
+  CL::Clipper clpr;
+  clpr.AddPolygons(cpolys, CL::ptSubject);
+  clpr.AddPolygons(bigthick, CL::ptClip);
+  thinpolys.clear();
+  clpr.Execute(CL::ctDifference, thinpolys, CL::pftEvenOdd, CL::pftEvenOdd);
   // remove overlap
   thickpolys = Clipping::getOffset(thickpolys, -0.05*extrwidth);
 #else
-  thickpolys = polys;
+  thickpolys = cpolys;
+  thinpolys.clear();
 #endif
 }
 
+// The shells are offsets of offsets, so they stay in Clipper coordinates
+// from the layer polygons to the fill polygons and only the results are
+// converted back.
 void Layer::MakeShells(const Settings &settings)
 {
   double extrudedWidth        = settings.Extruder.GetExtrudedMaterialWidth(thickness);
@@ -591,55 +611,55 @@ void Layer::MakeShells(const Settings &settings)
   uint   shellcount     = settings.Slicing.ShellCount;
   double infilloverlap  = settings.Slicing.InfillOverlap;
 
+  double extrf = 1.;
+  if (polygons.size() > 0)
+    extrf = polygons.back().getExtrusionFactor();
+
   // first shrink with global offset
-  vector<Poly> shrinked = Clipping::getOffset(polygons, -2.0/M_PI*extrudedWidth-shelloffset);
+  CL::Polygons shrinked =
+    Clipping::getOffset(Clipping::getClipperPolygons(polygons),
+			-2.0/M_PI*extrudedWidth-shelloffset);
 
-  vector<Poly> thickPolygons;
-  FindThinpolys(shrinked, extrudedWidth, thickPolygons, thinPolygons);
-  shrinked = thickPolygons;
+  CL::Polygons thickPolygons, thinpolys;
+  FindThinpolys(shrinked, extrudedWidth, thickPolygons, thinpolys);
+  shrinked.swap(thickPolygons);
 
-  for (uint i = 0; i<thinPolygons.size(); i++)
-    thinPolygons[i].cleanup(cleandist);
+  Clipping::cleanup(thinpolys, cleandist);
+  thinPolygons = Clipping::getPolys(thinpolys, Z, extrf);
 
   // // expand shrinked to get to the outer shell again
   // shrinked = Clipping::getOffset(shrinked, 2*distance);
-  for (uint i = 0; i<shrinked.size(); i++)
-    shrinked[i].cleanup(cleandist);
+  Clipping::cleanup(shrinked, cleandist);
 
   //vector<Poly> shrinked = Clipping::getShrinkedCapped(polygons,distance);
   // outmost shells
   if (shellcount > 0) {
     if (skins>1) { // either skins
-      for (uint i = 0; i<shrinked.size(); i++)  {
-	shrinked[i].setExtrusionFactor(1./skins*roundline_extrfactor);
-      }
-      skinPolygons = shrinked;
+      extrf = 1./skins*roundline_extrfactor;
+      skinPolygons = Clipping::getPolys(shrinked, Z, extrf);
     } else {  // or normal shell
       clearpolys(shellPolygons);
-      for (uint i = 0; i<shrinked.size(); i++)  {
-	shrinked[i].setExtrusionFactor(roundline_extrfactor);
-      }
-      shellPolygons.push_back(shrinked);
+      extrf = roundline_extrfactor;
+      shellPolygons.push_back(Clipping::getPolys(shrinked, Z, extrf));
     }
     // inner shells
     for (uint i = 1; i<shellcount; i++) // shrink from shell to shell
       {
 	shrinked = Clipping::getOffset(shrinked,-extrudedWidth);
-	vector<Poly> thinpolys;
 	FindThinpolys(shrinked, extrudedWidth, thickPolygons, thinpolys);
-	shrinked = thickPolygons;
-	thinPolygons.insert(thinPolygons.end(), thinpolys.begin(),thinpolys.end());
-	for (uint j = 0; j<shrinked.size(); j++)
-	  shrinked[j].cleanup(cleandist);
+	shrinked.swap(thickPolygons);
+	vector<Poly> thin = Clipping::getPolys(thinpolys, Z, extrf);
+	thinPolygons.insert(thinPolygons.end(), thin.begin(), thin.end());
+	Clipping::cleanup(shrinked, cleandist);
 	//shrinked = Clipping::getShrinkedCapped(shrinked,extrudedWidth);
-	shellPolygons.push_back(shrinked);
+	shellPolygons.push_back(Clipping::getPolys(shrinked, Z, extrf));
       }
   }
   // the filling polygon
   if (settings.Slicing.DoInfill) {
-    fillPolygons = Clipping::getOffset(shrinked,-(1.-infilloverlap)*extrudedWidth);
-    for (uint i = 0; i<fillPolygons.size(); i++)
-      fillPolygons[i].cleanup(cleandist);
+    CL::Polygons fill = Clipping::getOffset(shrinked,-(1.-infilloverlap)*extrudedWidth);
+    Clipping::cleanup(fill, cleandist);
+    fillPolygons = Region(fill, Z, extrf);
     //fillPolygons = Clipping::getShrinkedCapped(shrinked,extrudedWidth);
     //cerr << LayerNo << " > " << fillPolygons.size()<< endl;
   }
@@ -661,7 +681,7 @@ void Layer::MakeSkirt(double distance, bool single)
   vector<Poly> all;
   if (single) { // single skirt
     all.push_back(hullPolygon);
-    all.insert(all.end(),supportPolygons.begin(),supportPolygons.end());
+    all.insert(all.end(),supportPolygons.polys().begin(),supportPolygons.polys().end());
     Poly hull = convexHull2D(all);
     vector<Poly> skp = Clipping::getOffset(hull, distance, jround);
     if (skp.size()>0){
@@ -846,6 +866,7 @@ void Layer::MakePrintlines(Vector3d &lastPos, //GCodeState &state,
 		      settings.Slicing.MinLayertime, cornerradius, lines);
   if ((guint)LayerNo < settings.Slicing.FirstLayersNum)
     printlines.setSpeedFactor(settings.Slicing.FirstLayersSpeed, lines);
+  // slowdown for MinLayertime comes from the planned times with acceleration
   double slowdownfactor = printlines.getSlowdownFactor() * polyspeedfactor;
 
   if (settings.Slicing.FanControl) {
@@ -929,122 +950,199 @@ string Layer::SVGpath(const Vector2d &trans) const
 }
 
 
-void Layer::Draw(const Settings &settings)
+static void polys_fingerprint(ostringstream &o, const vector<Poly> &polys)
 {
+  uint vertices = 0;
+  double sum = 0;
+  for (uint i = 0; i < polys.size(); i++) {
+    vertices += polys[i].size();
+    if (polys[i].size() > 0)
+      sum += polys[i][0].x() + polys[i][0].y();
+  }
+  o << " " << polys.size() << "," << vertices << "," << sum;
+}
 
-#if 0
-  // test single area expolys
-  vector<ExPoly> expolys = Clipping::getExPolys(polygons);
-  draw_polys(expolys, GL_LINE_LOOP, 1, 3, RED, 1);
-  cerr << expolys.size() << endl;
-
-  Infill exinf(this, 1.);
-  exinf.setName("infill");
-  double infilldistance = settings.GetInfillDistance(thickness,
-						     settings.Slicing.InfillPercent);
+static void infill_fingerprint(ostringstream &o, const Infill *infill)
+{
+  if (infill) {
+    polys_fingerprint(o, infill->infillpolys);
+    o << infill->cached;
+  } else
+    o << " -";
+}
 
-  exinf.addPolys(Z, expolys, HexInfill,
-		 infilldistance, infilldistance, 0.4);
-  draw_polys(exinf.infillpolys, GL_LINE_LOOP, 1, 3,
-	     (exinf.cached?BLUEGREEN:GREEN), 1);
-  return;
-#endif
+// Key of everything recorded in the display cache: the display settings
+// and a cheap fingerprint of the polygons (counts and first vertices)
+string Layer::getDisplayKey(const Settings &settings) const
+{
+  ostringstream o;
+  o.precision(17);
+  o << settings.Display.RandomizedLines
+    << settings.Display.DisplayFilledAreas
+    << settings.Display.DisplayinFill
+    << settings.Display.DisplayDebuginFill
+    << " " << Z << " " << thickness << " " << skins
+    << " " << Min << Max;
+  polys_fingerprint(o, polygons);
+  for (uint i = 0; i < shellPolygons.size(); i++)
+    polys_fingerprint(o, shellPolygons[i]);
+  polys_fingerprint(o, thinPolygons);
+  polys_fingerprint(o, fillPolygons.polys());
+  polys_fingerprint(o, fullFillPolygons.polys());
+  for (uint i = 0; i < bridgePolygons.size(); i++) {
+    o << " " << bridgePolygons[i].outer.size();
+    polys_fingerprint(o, bridgePolygons[i].holes);
+  }
+  polys_fingerprint(o, supportPolygons.polys());
+  polys_fingerprint(o, skinPolygons);
+  polys_fingerprint(o, skinFullFillPolygons.polys());
+  o << " " << hullPolygon.size();
+  polys_fingerprint(o, skirtPolygons);
+  polys_fingerprint(o, decorPolygons.polys());
+  infill_fingerprint(o, normalInfill);
+  infill_fingerprint(o, thinInfill);
+  infill_fingerprint(o, fullInfill);
+  infill_fingerprint(o, skirtInfill);
+  infill_fingerprint(o, decorInfill);
+  infill_fingerprint(o, supportInfill);
+  for (uint i = 0; i < bridgeInfills.size(); i++)
+    infill_fingerprint(o, bridgeInfills[i]);
+  for (uint i = 0; i < skinFullInfills.size(); i++)
+    infill_fingerprint(o, skinFullInfills[i]);
+  return o.str();
+}
 
+// the polygons and filled areas of Draw() that can be cached
+void Layer::recordDisplay(const Settings &settings)
+{
   bool randomized = settings.Display.RandomizedLines;
   bool filledpolygons = settings.Display.DisplayFilledAreas;
-  // glEnable(GL_LINE_SMOOTH);
-  // glHint(GL_LINE_SMOOTH_HINT,  GL_NICEST);
-  draw_polys(polygons, GL_LINE_LOOP, 1, 3, RED, 1, randomized);
-  draw_polys(polygons, GL_POINTS,    1, 3, RED, 1, randomized);
-
-  if(settings.Display.DrawCPOutlineNumbers)
-    for(size_t p=0; p<polygons.size();p++)
-      {
-	ostringstream oss;
-	oss << p;
-	Vector2d center = polygons[p].getCenter();
-	Render::draw_string(Vector3d(center.x(), center.y(), Z), oss.str());
-      }
+  display.addPolys(polygons, GL_LINE_LOOP, 1, 3, RED, 1, randomized);
+  display.addPolys(polygons, GL_POINTS,    1, 3, RED, 1, randomized);
 
-  draw_poly(hullPolygon,    GL_LINE_LOOP, 3, 3, ORANGE,  0.5, randomized);
-  draw_polys(skirtPolygons, GL_LINE_LOOP, 3, 3, YELLOW,  1, randomized);
-  draw_polys(shellPolygons, GL_LINE_LOOP, 1, 3, YELLOW2, 1, randomized);
-  draw_polys(thinPolygons,  GL_LINE_LOOP, 2, 3, YELLOW,  1, randomized);
+  display.addPoly(hullPolygon, hullPolygon.getZ(),
+		  GL_LINE_LOOP, 3, 3, ORANGE,  0.5, randomized);
+  display.addPolys(skirtPolygons, GL_LINE_LOOP, 3, 3, YELLOW,  1, randomized);
+  display.addPolys(shellPolygons, GL_LINE_LOOP, 1, 3, YELLOW2, 1, randomized);
+  display.addPolys(thinPolygons,  GL_LINE_LOOP, 2, 3, YELLOW,  1, randomized);
 
-  glColor4f(0.5,0.9,1,1);
-  glLineWidth(1);
+  const float SKIN[3] = {0.5,0.9,1};
   double zs = Z;
   for(size_t s=0;s<skins;s++) {
     for(size_t p=0; p < skinPolygons.size();p++) {
-      //cerr << s << ": " << p << " _ " << zs << endl;
-      skinPolygons[p].draw(GL_LINE_LOOP, zs, randomized);
+      display.addPoly(skinPolygons[p], zs, GL_LINE_LOOP, 1, 1, SKIN, 1, randomized);
     }
     zs-=thickness/skins;
   }
-  draw_polys(fillPolygons,         GL_LINE_LOOP, 1, 3, WHITE, 0.6, randomized);
+  display.addPolys(fillPolygons.polys(),         GL_LINE_LOOP, 1, 3, WHITE, 0.6, randomized);
   if (supportPolygons.size()>0) {
     if (filledpolygons)
-      draw_polys_surface(supportPolygons,  Min, Max, Z, thickness/2., BLUE2, 0.4);
-    draw_polys(supportPolygons,      GL_LINE_LOOP, 3, 3, BLUE2, 1,   randomized);
-    if(settings.Display.DrawVertexNumbers)
-      for(size_t p=0; p<supportPolygons.size();p++)
-	supportPolygons[p].drawVertexNumbers();
+      display.addSurface(supportPolygons.polys(),  Min, Max, Z, thickness/2., BLUE2, 0.4);
+    display.addPolys(supportPolygons.polys(),      GL_LINE_LOOP, 3, 3, BLUE2, 1,   randomized);
   } // else
     // draw_polys(toSupportPolygons,    GL_LINE_LOOP, 1, 1, BLUE2, 1,   randomized);
-  draw_polys(bridgePolygons,       GL_LINE_LOOP, 3, 3, RED2,  0.7, randomized);
-  draw_polys(fullFillPolygons,     GL_LINE_LOOP, 1, 1, GREY,  0.6, randomized);
-  draw_polys(decorPolygons,        GL_LINE_LOOP, 1, 3, WHITE, 1,   randomized);
-  draw_polys(skinFullFillPolygons, GL_LINE_LOOP, 1, 3, GREY,  0.6, randomized);
+  display.addPolys(bridgePolygons,       GL_LINE_LOOP, 3, 3, RED2,  0.7, randomized);
+  display.addPolys(fullFillPolygons.polys(),     GL_LINE_LOOP, 1, 1, GREY,  0.6, randomized);
+  display.addPolys(decorPolygons.polys(),        GL_LINE_LOOP, 1, 3, WHITE, 1,   randomized);
+  display.addPolys(skinFullFillPolygons.polys(), GL_LINE_LOOP, 1, 3, GREY,  0.6, randomized);
   if (filledpolygons) {
-    draw_polys_surface(fullFillPolygons,  Min, Max, Z, thickness/2., GREEN, 0.5);
-    draw_polys_surface(decorPolygons,  Min, Max, Z, thickness/2., GREY, 0.2);
+    display.addSurface(fullFillPolygons.polys(),  Min, Max, Z, thickness/2., GREEN, 0.5);
+    display.addSurface(decorPolygons.polys(),  Min, Max, Z, thickness/2., GREY, 0.2);
   }
   if(settings.Display.DisplayinFill)
     {
       if (filledpolygons)
-	draw_polys_surface(fillPolygons,  Min, Max, Z, thickness/2., GREEN2, 0.25);
+	display.addSurface(fillPolygons.polys(),  Min, Max, Z, thickness/2., GREEN2, 0.25);
       bool DebugInfill = settings.Display.DisplayDebuginFill;
       if (normalInfill)
-	draw_polys(normalInfill->infillpolys, GL_LINE_LOOP, 1, 3,
-		   (normalInfill->cached?BLUEGREEN:GREEN), 1, randomized);
+	display.addPolys(normalInfill->infillpolys, GL_LINE_LOOP, 1, 3,
+			 (normalInfill->cached?BLUEGREEN:GREEN), 1, randomized);
       if(DebugInfill && normalInfill->cached)
-	draw_polys(normalInfill->getCachedPattern(Z), GL_LINE_LOOP, 1, 3,
-		   ORANGE, 0.5, randomized);
+	display.addPolys(normalInfill->getCachedPattern(Z), GL_LINE_LOOP, 1, 3,
+			 ORANGE, 0.5, randomized);
       if (thinInfill)
-	draw_polys(thinInfill->infillpolys, GL_LINE_LOOP, 1, 3,
-		   GREEN, 1, randomized);
+	display.addPolys(thinInfill->infillpolys, GL_LINE_LOOP, 1, 3,
+			 GREEN, 1, randomized);
       if (fullInfill)
-	draw_polys(fullInfill->infillpolys, GL_LINE_LOOP, 1, 3,
-		   (fullInfill->cached?BLUEGREEN:GREEN), 0.8, randomized);
+	display.addPolys(fullInfill->infillpolys, GL_LINE_LOOP, 1, 3,
+			 (fullInfill->cached?BLUEGREEN:GREEN), 0.8, randomized);
       if (skirtInfill)
-	draw_polys(skirtInfill->infillpolys, GL_LINE_LOOP, 1, 3,
-		   YELLOW, 0.6, randomized);
+	display.addPolys(skirtInfill->infillpolys, GL_LINE_LOOP, 1, 3,
+			 YELLOW, 0.6, randomized);
       if(DebugInfill && fullInfill->cached)
-	draw_polys(fullInfill->getCachedPattern(Z), GL_LINE_LOOP, 1, 3,
-		   ORANGE, 0.5, randomized);
+	display.addPolys(fullInfill->getCachedPattern(Z), GL_LINE_LOOP, 1, 3,
+			 ORANGE, 0.5, randomized);
       if (decorInfill)
-	draw_polys(decorInfill->infillpolys, GL_LINE_LOOP, 1, 3,
-		   (decorInfill->cached?BLUEGREEN:GREEN), 0.8, randomized);
+	display.addPolys(decorInfill->infillpolys, GL_LINE_LOOP, 1, 3,
+			 (decorInfill->cached?BLUEGREEN:GREEN), 0.8, randomized);
       if(DebugInfill && decorInfill->cached)
-	draw_polys(decorInfill->getCachedPattern(Z), GL_LINE_LOOP, 1, 3,
-		   ORANGE, 0.5, randomized);
+	display.addPolys(decorInfill->getCachedPattern(Z), GL_LINE_LOOP, 1, 3,
+			 ORANGE, 0.5, randomized);
       uint bridgecount = bridgeInfills.size();
       if (bridgecount>0)
 	for (uint i = 0; i<bridgecount; i++)
-	  draw_polys(bridgeInfills[i]->infillpolys, GL_LINE_LOOP, 2, 3,
-		     RED3,0.9, randomized);
+	  display.addPolys(bridgeInfills[i]->infillpolys, GL_LINE_LOOP, 2, 3,
+			   RED3,0.9, randomized);
       if (supportInfill)
-	draw_polys(supportInfill->infillpolys, GL_LINE_LOOP, 1, 3,
-		   (supportInfill->cached?BLUEGREEN:GREEN), 0.8, randomized);
+	display.addPolys(supportInfill->infillpolys, GL_LINE_LOOP, 1, 3,
+			 (supportInfill->cached?BLUEGREEN:GREEN), 0.8, randomized);
       if(DebugInfill && supportInfill->cached)
-	draw_polys(supportInfill->getCachedPattern(Z), GL_LINE_LOOP, 1, 3,
-		   ORANGE, 0.5, randomized);
+	display.addPolys(supportInfill->getCachedPattern(Z), GL_LINE_LOOP, 1, 3,
+			 ORANGE, 0.5, randomized);
       for(size_t s=0;s<skinFullInfills.size();s++)
-	draw_polys(skinFullInfills[s]->infillpolys, GL_LINE_LOOP, 1, 3,
-		   (skinFullInfills[s]->cached?BLUEGREEN:GREEN), 0.6, randomized);
+	display.addPolys(skinFullInfills[s]->infillpolys, GL_LINE_LOOP, 1, 3,
+			 (skinFullInfills[s]->cached?BLUEGREEN:GREEN), 0.6, randomized);
     }
   //draw_polys(GetInnerShell(), GL_LINE_LOOP, 2, 3, WHITE,  1);
+}
+
+void Layer::Draw(const Settings &settings)
+{
+
+#if 0
+  // test single area expolys
+  vector<ExPoly> expolys = Clipping::getExPolys(polygons);
+  draw_polys(expolys, GL_LINE_LOOP, 1, 3, RED, 1);
+  cerr << expolys.size() << endl;
+
+  Infill exinf(this, 1.);
+  exinf.setName("infill");
+  double infilldistance = settings.GetInfillDistance(thickness,
+						     settings.Slicing.InfillPercent);
+
+  exinf.addPolys(Z, expolys, HexInfill,
+		 infilldistance, infilldistance, 0.4);
+  draw_polys(exinf.infillpolys, GL_LINE_LOOP, 1, 3,
+	     (exinf.cached?BLUEGREEN:GREEN), 1);
+  return;
+#endif
+
+  const string key = getDisplayKey(settings);
+  if (!display.isRecorded() || key != display_key) {
+    display.clear();
+    recordDisplay(settings);
+    display.finish();
+    display_key = key;
+  }
+  display.draw();
   glLineWidth(1);
+
+  bool randomized = settings.Display.RandomizedLines;
+
+  if(settings.Display.DrawCPOutlineNumbers)
+    for(size_t p=0; p<polygons.size();p++)
+      {
+	ostringstream oss;
+	oss << p;
+	Vector2d center = polygons[p].getCenter();
+	Render::draw_string(Vector3d(center.x(), center.y(), Z), oss.str());
+      }
+
+  if (supportPolygons.size()>0)
+    if(settings.Display.DrawVertexNumbers)
+      for(size_t p=0; p<supportPolygons.size();p++)
+	supportPolygons.polys()[p].drawVertexNumbers();
+
   if(settings.Display.DrawCPVertexNumbers) // poly vertex numbers
     for(size_t p=0; p<polygons.size();p++)
       polygons[p].drawVertexNumbers();
@@ -1056,11 +1154,11 @@ void Layer::Draw(const Settings &settings)
 
   if(settings.Display.DrawVertexNumbers) { // infill vertex numbers
     for(size_t p=0; p<fillPolygons.size();p++)
-      fillPolygons[p].drawVertexNumbers();
+      fillPolygons.polys()[p].drawVertexNumbers();
     for(size_t p=0; p<fullFillPolygons.size();p++)
-      fullFillPolygons[p].drawVertexNumbers();
+      fullFillPolygons.polys()[p].drawVertexNumbers();
     for(size_t p=0; p<decorPolygons.size();p++)
-      decorPolygons[p].drawVertexNumbers();
+      decorPolygons.polys()[p].drawVertexNumbers();
     for(size_t p=0; p<shellPolygons.size();p++)
       for(size_t q=0; q<shellPolygons[p].size();q++)
 	shellPolygons[p][q].drawVertexNumbers();
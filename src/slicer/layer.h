@@ -26,8 +26,11 @@
 #include <iostream>
 
 #include "poly.h"
+#include "clipping.h"
+#include "region.h"
 #include "gcode/gcodestate.h"
 #include "printlines.h"
+#include "polydisplay.h"
 
 #include <cairomm/cairomm.h>
 
@@ -49,6 +52,7 @@ public:
   double getZ() const {return Z;}
   void setZ(double z){Z=z;}
   void setSkins(uint skins_){skins = skins_;}
+  uint getSkins() const {return skins;}
 
   Layer * getPrevious() const {return previous;};
   void setPrevious(Layer * prevlayer){previous = prevlayer;};
@@ -80,8 +84,8 @@ public:
   vector<double> getBridgeRotations(const vector<Poly> &poly) const;
   void calcBridgeAngles(const Layer *layerbelow);
 
-  static void FindThinpolys(const vector<Poly> &polys, double extrwidth,
-			    vector<Poly> &thickpolys, vector<Poly> &thinpolys);
+  static void FindThinpolys(const CL::Polygons &cpolys, double extrwidth,
+			    CL::Polygons &thickpolys, CL::Polygons &thinpolys);
 
   void MakeShells(const Settings &settings);
   // uint shellcount, double extrudedWidth, double shelloffset,
@@ -96,13 +100,19 @@ public:
   vector<ExPoly>  GetExPolygons() const;
   void SetPolygons(vector<Poly> &polys) ;
   /* void SetPolygons(const Matrix4d &T, const Shape &shape, double z); */
-  vector<Poly> GetFillPolygons() const { return fillPolygons; }
-  vector<Poly> GetFullFillPolygons() const { return fullFillPolygons; }
+  const vector<Poly> &GetFillPolygons() const { return fillPolygons.polys(); }
+  const vector<Poly> &GetFullFillPolygons() const { return fullFillPolygons.polys(); }
   vector<ExPoly> GetBridgePolygons() const { return bridgePolygons; }
-  vector<Poly> GetSkinFullPolygons() const { return skinFullFillPolygons; }
-  vector<Poly> GetSupportPolygons() const { return supportPolygons; }
+  const vector<Poly> &GetSkinFullPolygons() const { return skinFullFillPolygons.polys(); }
+  const vector<Poly> &GetSupportPolygons() const { return supportPolygons.polys(); }
   vector<Poly> GetToSupportPolygons() const { return toSupportPolygons; }
-  vector<Poly> GetDecorPolygons() const { return decorPolygons; }
+  const vector<Poly> &GetDecorPolygons() const { return decorPolygons.polys(); }
+  // the same in Clipper space, for clipping without conversion
+  const Region &GetFillRegion() const { return fillPolygons; }
+  const Region &GetFullFillRegion() const { return fullFillPolygons; }
+  const Region &GetSkinFullRegion() const { return skinFullFillPolygons; }
+  const Region &GetSupportRegion() const { return supportPolygons; }
+  const Region &GetDecorRegion() const { return decorPolygons; }
   vector< vector<Poly> >  GetShellPolygons() const {return shellPolygons; }
   vector<Poly>  GetShellPolygonsCirc(int number) const;
   vector<Poly>  GetSkirtPolygons() const {return skirtPolygons; };
@@ -113,16 +123,17 @@ public:
   vector<Poly> getOverhangs() const;
 
 
-  void setFullFillPolygons(const vector<Poly> &polys);
+  void setFullFillPolygons(const Region &region);
   void addFullFillPolygons(const vector<Poly> &polys);
+  void addFullPolygons(const Region &fullpolys, bool decor=false);
   void addFullPolygons(const vector<Poly> &fullpolys, bool decor=false);
   void addFullPolygons(const vector<ExPoly> &expolys, bool decor=false);
   void setBridgePolygons(const vector<ExPoly> &polys);
   void addBridgePolygons(const vector<ExPoly> &polys);
   void setBridgeAngles(const vector<double> &angles);
   void makeSkinPolygons();
-  void setNormalFillPolygons(const vector<Poly> &polys);
-  void setSupportPolygons(const vector<Poly> &polys);
+  void setNormalFillPolygons(const Region &region);
+  void setSupportPolygons(const Region &region);
   void setSkirtPolygons(const vector<Poly> &poly);
   void setDecorPolygons(const vector<Poly> &polys);
 
@@ -154,6 +165,10 @@ public:
   void cleanupPolygons();
   int addShape(const Matrix4d &T, const Shape &shape, double z,
 	       double &max_gradient, double max_supportangle);
+  // also add the contours moved by each of the instance placements
+  int addShape(const Matrix4d &T, const Shape &shape, double z,
+	       double &max_gradient, double max_supportangle,
+	       const vector<Matrix4d> &instances);
 
   double area() const;
 
@@ -177,19 +192,24 @@ public:
   vector<Poly> polygons;		// original polygons directly from model
   vector< vector<Poly> > shellPolygons; // all shells except innermost
   vector<Poly> thinPolygons;            // areas thinner than 2 extrusion lines
-  vector<Poly> fillPolygons;	        // innermost shell
-  vector<Poly> fullFillPolygons;        // fully filled polygons (uncovered)
+  Region fillPolygons;	                // innermost shell
+  Region fullFillPolygons;              // fully filled polygons (uncovered)
   vector<ExPoly> bridgePolygons;        // fully filled ex-polygons with holes for bridges
   vector<double> bridge_angles;         // angles of each bridge ex-polygon
   vector< vector<Poly> > bridgePillars; // bridge pillars for debugging
-  vector<Poly> supportPolygons;	        // polygons to be filled with support pattern
+  Region supportPolygons;	        // polygons to be filled with support pattern
   vector<Poly> toSupportPolygons;       // triangles that should be supported
   uint skins;                           // number of skin divisions
   vector<Poly> skinPolygons;            // outer skin polygons
-  vector<Poly> skinFullFillPolygons;    // skin polygons of fully filled areas
+  Region skinFullFillPolygons;          // skin polygons of fully filled areas
   Poly hullPolygon;                     // convex hull around everything
   vector<Poly> skirtPolygons;           // skirt polygon
-  vector<Poly> decorPolygons;           // decoration polygons
+  Region decorPolygons;                 // decoration polygons
+
+  PolyDisplay display;  // cached drawing of the polygons
+  string display_key;   // settings and polygons the display was made with
+  string getDisplayKey(const Settings &settings) const;
+  void recordDisplay(const Settings &settings);
 
   // uses too much memory
   /* Cairo::RefPtr<Cairo::ImageSurface> raster_surface; */
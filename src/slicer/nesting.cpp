@@ -0,0 +1,202 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "nesting.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+static inline double cross2(const Vector2d &o, const Vector2d &a,
+			    const Vector2d &b)
+{
+  return (a.x()-o.x())*(b.y()-o.y()) - (a.y()-o.y())*(b.x()-o.x());
+}
+
+Footprint::Footprint(const vector<Triangle> &triangles, double resolution,
+		     double spacing)
+  : width(0), height(0), border(0), cells(0)
+{
+  if (triangles.empty()) return;
+  Vector2d pmin(INFTY,INFTY), pmax(-INFTY,-INFTY);
+  for (uint t = 0; t < triangles.size(); t++)
+    for (uint j = 0; j < 3; j++) {
+      const Vector3d &v = triangles[t][j];
+      pmin.x() = MIN(pmin.x(), v.x()); pmin.y() = MIN(pmin.y(), v.y());
+      pmax.x() = MAX(pmax.x(), v.x()); pmax.y() = MAX(pmax.y(), v.y());
+    }
+  border = (int)ceil(spacing / 2 / resolution);
+  min = pmin - Vector2d(border, border) * resolution;
+  width  = (int)floor((pmax.x() - pmin.x()) / resolution) + 1 + 2*border;
+  height = (int)floor((pmax.y() - pmin.y()) / resolution) + 1 + 2*border;
+
+  // the shadow of all triangles: cells with the center inside a
+  // triangle, and all cells on the edges for triangles seen edge-on
+  vector<char> grid(width * height, 0);
+  for (uint t = 0; t < triangles.size(); t++) {
+    Vector2d p[3];
+    for (uint j = 0; j < 3; j++)
+      p[j] = (Vector2d(triangles[t][j].x(), triangles[t][j].y()) - min)
+	/ resolution;
+    for (uint j = 0; j < 3; j++) {
+      const Vector2d &a = p[j], &b = p[(j+1)%3];
+      const int steps = (int)ceil(2 * (b - a).length()) + 1;
+      for (int s = 0; s <= steps; s++) {
+	const Vector2d e = a + (b - a) * ((double)s / steps);
+	grid[(int)e.y() * width + (int)e.x()] = 1;
+      }
+    }
+    const double area = cross2(p[0], p[1], p[2]);
+    if (fabs(area) < 1e-9) continue;
+    const int x0 = (int)MIN(p[0].x(), MIN(p[1].x(), p[2].x()));
+    const int x1 = (int)MAX(p[0].x(), MAX(p[1].x(), p[2].x()));
+    const int y0 = (int)MIN(p[0].y(), MIN(p[1].y(), p[2].y()));
+    const int y1 = (int)MAX(p[0].y(), MAX(p[1].y(), p[2].y()));
+    const double sign = area > 0 ? 1 : -1;
+    for (int y = y0; y <= y1; y++)
+      for (int x = x0; x <= x1; x++) {
+	const Vector2d c(x + 0.5, y + 0.5);
+	if (sign * cross2(p[0], p[1], c) >= 0 &&
+	    sign * cross2(p[1], p[2], c) >= 0 &&
+	    sign * cross2(p[2], p[0], c) >= 0)
+	  grid[y * width + x] = 1;
+      }
+  }
+
+  // grow by the border, rows then columns
+  if (border > 0) {
+    vector<char> grown(width * height, 0);
+    for (int y = 0; y < height; y++)
+      for (int x = 0; x < width; x++)
+	if (grid[y * width + x])
+	  for (int gx = MAX(0, x - border); gx <= MIN(width-1, x + border); gx++)
+	    grown[y * width + gx] = 1;
+    grid.assign(width * height, 0);
+    for (int y = 0; y < height; y++)
+      for (int x = 0; x < width; x++)
+	if (grown[y * width + x])
+	  for (int gy = MAX(0, y - border); gy <= MIN(height-1, y + border); gy++)
+	    grid[gy * width + x] = 1;
+  }
+
+  rows.resize(height);
+  for (int y = 0; y < height; y++) {
+    int x = 0;
+    while (x < width) {
+      while (x < width && !grid[y * width + x]) x++;
+      if (x == width) break;
+      Run run;
+      run.start = x;
+      while (x < width && grid[y * width + x]) x++;
+      run.end = x;
+      rows[y].push_back(run);
+      cells += run.end - run.start;
+    }
+  }
+}
+
+
+BedRaster::BedRaster(const Vector2d &size, double resolution, double spacing)
+  : resolution(resolution)
+{
+  border = (int)ceil(spacing / 2 / resolution);
+  width  = MAX(0, (int)floor(size.x() / resolution)) + 2*border;
+  height = MAX(0, (int)floor(size.y() / resolution)) + 2*border;
+  occupied.assign(width * height, 0);
+  prefix.assign((width + 1) * height, 0);
+}
+
+Vector2d BedRaster::position(int cx, int cy) const
+{
+  return Vector2d(cx - border, cy - border) * resolution;
+}
+
+void BedRaster::cell(const Vector2d &pos, int &cx, int &cy) const
+{
+  cx = (int)floor(pos.x() / resolution) + border;
+  cy = (int)floor(pos.y() / resolution) + border;
+}
+
+void BedRaster::calcPrefix(int y)
+{
+  int *row = &prefix[y * (width + 1)];
+  row[0] = 0;
+  for (int x = 0; x < width; x++)
+    row[x + 1] = row[x] + occupied[y * width + x];
+}
+
+// parts already on the bed may stick out of it
+void BedRaster::add(const Footprint &footprint, int cx, int cy)
+{
+  for (int fy = 0; fy < footprint.height; fy++) {
+    const int y = cy + fy;
+    if (y < 0 || y >= height) continue;
+    const vector<Footprint::Run> &runs = footprint.rows[fy];
+    for (uint r = 0; r < runs.size(); r++)
+      for (int x = MAX(0, cx + runs[r].start);
+	   x < MIN(width, cx + runs[r].end); x++)
+	occupied[y * width + x] = 1;
+    calcPrefix(y);
+  }
+}
+
+bool BedRaster::fits(const Footprint &footprint, int cx, int cy) const
+{
+  for (int fy = 0; fy < footprint.height; fy++) {
+    const int *row = &prefix[(cy + fy) * (width + 1) + cx];
+    const vector<Footprint::Run> &runs = footprint.rows[fy];
+    for (uint r = 0; r < runs.size(); r++)
+      if (row[runs[r].end] != row[runs[r].start]) return false;
+  }
+  return true;
+}
+
+bool BedRaster::findPlace(const Footprint &footprint, int &cx, int &cy,
+			  double &score) const
+{
+  if (footprint.empty()) return false;
+  const int maxx = width  - footprint.width;
+  const int maxy = height - footprint.height;
+  if (maxx < 0 || maxy < 0) return false;
+  // grow the used square first, then stay near the origin.
+  // The score rises along a row, so the first fit is the best of the row.
+  const double weight = width + height + 1;
+  vector<int> rowx(maxy + 1, -1);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int y = 0; y <= maxy; y++)
+    for (int x = 0; x <= maxx; x++)
+      if (fits(footprint, x, y)) {
+	rowx[y] = x;
+	break;
+      }
+  bool found = false;
+  score = INFTY;
+  for (int y = 0; y <= maxy; y++) {
+    if (rowx[y] < 0) continue;
+    const double s = MAX(rowx[y] + footprint.width, y + footprint.height)
+      * weight + rowx[y] + y;
+    if (s < score) {
+      score = s; cx = rowx[y]; cy = y;
+      found = true;
+    }
+  }
+  return found;
+}
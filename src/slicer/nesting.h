@@ -0,0 +1,77 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "stdafx.h"
+#include "triangle.h"
+
+// The shadow of a part on the bed, rasterised from its triangles and
+// grown by half the spacing between parts, so two footprints that don't
+// overlap keep the spacing.  Concave parts keep their concave shape.
+// Every row is stored as runs of covered cells.
+class Footprint
+{
+ public:
+  Footprint() : width(0), height(0), border(0), cells(0) {}
+  // triangles in bed coordinates
+  Footprint(const vector<Triangle> &triangles, double resolution,
+	    double spacing);
+
+  bool empty() const { return cells == 0; }
+  Vector2d min;       // where cell (0,0) is now
+  int width, height;  // in cells
+  int border;         // cells grown on each side
+  uint cells;         // number of covered cells
+
+  struct Run { int start, end; }; // cells [start, end) of a row
+  vector< vector<Run> > rows;
+};
+
+// Occupied cells of the print bed, for placing footprints.
+// Placement tests use prefix sums per row, so testing a position
+// costs one lookup per run of the footprint.
+class BedRaster
+{
+ public:
+  // bed from (0,0) to size, with room for the grown borders of footprints
+  BedRaster(const Vector2d &size, double resolution, double spacing);
+
+  void add(const Footprint &footprint, int cx, int cy);
+  // best cell for the footprint's cell (0,0), the one keeping the used
+  // part of the bed small, near the origin.  All positions are tested
+  // in parallel.
+  bool findPlace(const Footprint &footprint, int &cx, int &cy,
+		 double &score) const;
+  // bed position of cell (cx,cy)
+  Vector2d position(int cx, int cy) const;
+  // cell of a bed position, rounded down
+  void cell(const Vector2d &pos, int &cx, int &cy) const;
+
+ private:
+  double resolution;
+  int border;        // cells outside the bed on each side
+  int width, height;
+  vector<char> occupied;
+  vector<int> prefix; // per row: occupied cells left of x, width+1 per row
+  void calcPrefix(int y);
+  bool fits(const Footprint &footprint, int cx, int cy) const;
+};
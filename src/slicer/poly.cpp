@@ -25,6 +25,10 @@
 #include "clipping.h"
 #include "render.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 
 #include <poly2tri/poly2tri/poly2tri/poly2tri.h>
 
@@ -57,6 +61,7 @@ Poly::Poly(const Poly &p, double z_)
   //uint count = p.vertices.size();
   // vertices.resize(count);
   this->vertices = p.vertices;
+  slabs = p.slabs;
   holecalculated = p.holecalculated;
   if (holecalculated) {
     hole = p.hole;
@@ -71,6 +76,7 @@ Poly::~Poly()
 
 void Poly::cleanup(double epsilon)
 {
+  slabs.reset();
   vertices = simplified(vertices, epsilon);
   if (!closed) return;
   uint n_vert = vertices.size();
@@ -142,6 +148,7 @@ void Poly::rotate(const Vector2d &rotcenter, double angle)
   for (uint i = 0; i < vertices.size();  i++) {
     ::rotate(vertices[i], rotcenter, angle);
   }
+  slabs.reset();
 }
 
 void Poly::move(const Vector2d &delta)
@@ -150,6 +157,7 @@ void Poly::move(const Vector2d &delta)
     vertices[i] += delta;
   }
   center+=delta;
+  slabs.reset();
 }
 
 void Poly::transform(const Matrix4d &T) {
@@ -159,6 +167,7 @@ void Poly::transform(const Matrix4d &T) {
   }
   setZ((T * Vector3d(0,0,z)).z());
   calcHole();
+  slabs.reset();
 }
 
 void Poly::transform(const Matrix3d &T) {
@@ -166,6 +175,7 @@ void Poly::transform(const Matrix3d &T) {
     vertices[i] = T * vertices[i];
   }
   calcHole();
+  slabs.reset();
 }
 
 void Poly::mirrorX(const Vector3d &center)
@@ -292,6 +302,54 @@ bool Poly::vertexInside2(const Vector2d &point, double maxoffset) const
   return (intersectcount%2==0);
 }
 
+// vertexInside() uses slabs from this number of vertices on
+const uint SLABS_MIN_VERTICES = 16;
+
+// about sqrt(N) slabs, every edge that is not horizontal is in all
+// slabs its y range touches
+void Poly::calcSlabs() const
+{
+  const uint N = size();
+  if (N < SLABS_MIN_VERTICES || slabs) return;
+  PolySlabs *sl = new PolySlabs();
+  sl->bmin = Vector2d( INFTY, INFTY);
+  sl->bmax = Vector2d(-INFTY,-INFTY);
+  for (uint i = 0; i < N; i++) {
+    sl->bmin.x() = min(sl->bmin.x(), vertices[i].x());
+    sl->bmin.y() = min(sl->bmin.y(), vertices[i].y());
+    sl->bmax.x() = max(sl->bmax.x(), vertices[i].x());
+    sl->bmax.y() = max(sl->bmax.y(), vertices[i].y());
+  }
+  const uint nslabs = max(1u, (uint)sqrt((double)N));
+  sl->height = (sl->bmax.y() - sl->bmin.y()) / nslabs;
+  if (sl->height <= 0) sl->height = 1;
+  vector<uint> from(N), to(N);
+  sl->start.assign(nslabs+1, 0);
+  for (uint i = 0; i < N; i++) {
+    const Vector2d &p1 = vertices[i==0 ? N-1 : i-1], &p2 = vertices[i];
+    if (p1.y() == p2.y()) { from[i] = 1; to[i] = 0; continue; }
+    from[i] = min(nslabs-1, (uint)((min(p1.y(),p2.y()) - sl->bmin.y()) / sl->height));
+    to[i]   = min(nslabs-1, (uint)((max(p1.y(),p2.y()) - sl->bmin.y()) / sl->height));
+    for (uint s = from[i]; s <= to[i]; s++)
+      sl->start[s+1]++;
+  }
+  for (uint s = 0; s < nslabs; s++)
+    sl->start[s+1] += sl->start[s];
+  const uint nedges = sl->start[nslabs];
+  sl->x1.resize(nedges); sl->y1.resize(nedges);
+  sl->x2.resize(nedges); sl->y2.resize(nedges);
+  vector<uint> pos(sl->start.begin(), sl->start.end()-1);
+  for (uint i = 0; i < N; i++) {
+    const Vector2d &p1 = vertices[i==0 ? N-1 : i-1], &p2 = vertices[i];
+    for (uint s = from[i]; s <= to[i]; s++) {
+      const uint e = pos[s]++;
+      sl->x1[e] = p1.x(); sl->y1[e] = p1.y();
+      sl->x2[e] = p2.x(); sl->y2[e] = p2.y();
+    }
+  }
+  slabs = Glib::RefPtr<const PolySlabs>(sl);
+}
+
 // http://paulbourke.net/geometry/insidepoly/
 bool Poly::vertexInside(const Vector2d &p, double maxoffset) const
 {
@@ -300,6 +358,31 @@ bool Poly::vertexInside(const Vector2d &p, double maxoffset) const
   // this one works
   uint N = size();
   if (N < 2) return false;
+  // parallel loops have to call calcSlabs() before
+#ifdef _OPENMP
+  if (!omp_in_parallel())
+#endif
+    calcSlabs();
+  if (slabs) {
+    // the same test, only for the edges in the point's slab,
+    // without branches for the compiler to vectorise
+    const double px = p.x(), py = p.y();
+    if (px < slabs->bmin.x() || px > slabs->bmax.x() ||
+	py <= slabs->bmin.y() || py > slabs->bmax.y()) return false;
+    const uint s = min((uint)slabs->start.size()-2,
+		       (uint)((py - slabs->bmin.y()) / slabs->height));
+    const double *x1 = &slabs->x1[0], *y1 = &slabs->y1[0],
+      *x2 = &slabs->x2[0], *y2 = &slabs->y2[0];
+    const uint estart = slabs->start[s], eend = slabs->start[s+1];
+    uint counter = 0;
+    for (uint e = estart; e < eend; e++) {
+      const double xinters = (py-y1[e])*(x2[e]-x1[e])/(y2[e]-y1[e])+x1[e];
+      counter += (py > min(y1[e], y2[e])) & (py <= max(y1[e], y2[e]))
+	& (px <= max(x1[e], x2[e]))
+	& ((x1[e] == x2[e]) | (px <= xinters));
+    }
+    return (counter % 2 != 0);
+  }
   uint counter = 0;
   uint i;
   double xinters;
@@ -343,12 +426,10 @@ bool Poly::vertexInside(const Vector2d &p, double maxoffset) const
 // this polys completely contained in other
 bool Poly::isInside(const Poly &poly, double maxoffset) const
 {
-  uint i, count=0;
-  for (i = 0; i < vertices.size();  i++) {
-    if (poly.vertexInside(vertices[i],maxoffset))
-      count++;
-  }
-  return count == vertices.size();
+  for (uint i = 0; i < vertices.size();  i++)
+    if (!poly.vertexInside(vertices[i],maxoffset))
+      return false;
+  return true;
 }
 
 
@@ -359,6 +440,7 @@ void Poly::addVertex(const Vector2d &v, bool front)
   else
     vertices.push_back(v);
   holecalculated=false;
+  slabs.reset();
 }
 void Poly::addVertexUnique(const Vector2d &v, bool front)
 {
@@ -825,8 +907,11 @@ void ExPoly::draw(int gl_type, bool randomized) const
 void ExPoly::cleanup(double epsilon)
 {
   outer.vertices = simplified(outer.vertices, epsilon);
-  for (uint i=0; i < holes.size(); i++)
+  outer.clearSlabs();
+  for (uint i=0; i < holes.size(); i++) {
     holes[i].vertices = simplified(holes[i].vertices, epsilon);
+    holes[i].clearSlabs();
+  }
 }
 
 void ExPoly::drawVertexNumbers() const
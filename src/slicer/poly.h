@@ -22,6 +22,23 @@
 #include "stdafx.h"
 #include "geometry.h"
 
+// The bounding box of a polygon and the edges crossing each of some
+// horizontal slabs.  Never changed once made.
+class PolySlabs
+{
+  mutable volatile gint refcount;
+ public:
+  PolySlabs() : refcount(1) {};
+  void reference() const { g_atomic_int_inc(&refcount); };
+  void unreference() const {
+    if (g_atomic_int_dec_and_test(&refcount)) delete this; };
+
+  Vector2d bmin, bmax;
+  double height;
+  vector<uint> start;  // first edge of each slab, and the end
+  vector<double> x1, y1, x2, y2; // edges by slab
+};
+
 class Poly
 {
   double z;
@@ -32,6 +49,10 @@ class Poly
   mutable bool hole; // this polygon is a hole
   bool closed;
 
+  // for vertexInside(), made when first needed and shared by copies;
+  // the mutating methods drop it
+  mutable Glib::RefPtr<const PolySlabs> slabs;
+
 public:
         Poly();
 	Poly(double z, double extrusionfactor=1.);
@@ -57,9 +78,10 @@ public:
 	// simplify douglas-peucker
 	void cleanup(double maxerror);
 
-	void reverse() {std::reverse(vertices.begin(),vertices.end());holecalculated = false;};
+	void reverse() {std::reverse(vertices.begin(),vertices.end());
+	  holecalculated = false; slabs.reset();};
 
-	void clear(){vertices.clear(); holecalculated = false;};
+	void clear(){vertices.clear(); holecalculated = false; slabs.reset();};
 
 	void transform(const Matrix4d &T);
 	void transform(const Matrix3d &T);
@@ -68,6 +90,10 @@ public:
 	//vector< vector<Vector2d> > intersect(Poly &poly1, Poly &poly2) const;
 
 	bool vertexInside(const Vector2d &point, double maxoffset=0.0001) const;
+	// make vertexInside()'s lookup now, before using it from several threads
+	void calcSlabs() const;
+	// call after changing the vertices directly
+	void clearSlabs() { slabs.reset(); };
 	bool vertexInside2(const Vector2d &point, double maxoffset=0.0001) const;
 	bool isInside(const Poly &poly, double maxoffset=0.0001) const;
 	uint nearestDistanceSqTo(const Vector2d &p, double &mindist) const;
@@ -132,9 +158,10 @@ public:
 	Vector2d front() {return vertices.front(); };
 	Vector2d back()  {return vertices.back(); };
 	void push_back (Vector2d v) {
-	  vertices.push_back(v); holecalculated = false;};
+	  vertices.push_back(v); holecalculated = false; slabs.reset();};
 	void push_front(Vector2d v) {
-	  vertices.insert(vertices.begin(),v); holecalculated = false;};
+	  vertices.insert(vertices.begin(),v);
+	  holecalculated = false; slabs.reset();};
 
 	string info() const;
 
@@ -0,0 +1,185 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "polydisplay.h"
+
+size_t PolyDisplay::cache_limit = 256 * 1024 * 1024;
+list<PolyDisplay*> PolyDisplay::lru;
+size_t PolyDisplay::cached_bytes = 0;
+
+PolyDisplay::PolyDisplay()
+  : buffer(VertexBuffer::POSITION_COLOR), texture_bytes(0),
+    recorded(false), in_lru(false)
+{
+}
+
+PolyDisplay::~PolyDisplay()
+{
+  clear();
+}
+
+void PolyDisplay::clear()
+{
+  if (in_lru) {
+    lru.erase(lru_pos);
+    cached_bytes -= bytes();
+    in_lru = false;
+  }
+  for (uint i = 0; i < items.size(); i++)
+    if (items[i].texture != 0)
+      glDeleteTextures(1, &items[i].texture);
+  items.clear();
+  buffer.clear();
+  texture_bytes = 0;
+  recorded = false;
+}
+
+// start a new item unless the last one has the same state
+void PolyDisplay::addItem(GLenum mode, float size)
+{
+  if (!items.empty()) {
+    const Item &last = items.back();
+    if (last.mode == mode && last.size == size)
+      return;
+  }
+  Item item;
+  item.mode = mode;
+  item.size = size;
+  item.first = buffer.size();
+  item.count = 0;
+  item.texture = 0;
+  item.z = 0;
+  items.push_back(item);
+}
+
+void PolyDisplay::addPoly(const Poly &poly, double z, int gl_type,
+			  int linewidth, int pointsize, const float *rgb, float a,
+			  bool randomized)
+{
+  uint count = poly.size();
+  if (count == 0) return;
+  const Vector4f colour(rgb[0], rgb[1], rgb[2], a);
+  if (gl_type == GL_POINTS) {
+    addItem(GL_POINTS, pointsize);
+    for (uint i = 0; i < count; i++) {
+      Vector2d v = poly.getVertexCircular(i);
+      if (randomized) v = random_displaced(v);
+      buffer.add(Vector3d(v.x(), v.y(), z), colour);
+    }
+  } else { // loops as single lines, as in Poly::draw
+    if (!poly.isClosed()) count--;
+    addItem(GL_LINES, linewidth);
+    for (uint i = 0; i < count; i++) {
+      Vector2d v  = poly.getVertexCircular(i);
+      Vector2d vn = poly.getVertexCircular(i+1);
+      if (randomized) {
+	v  = random_displaced(v);
+	vn = random_displaced(vn);
+      }
+      buffer.add(Vector3d(v.x(),  v.y(),  z), colour);
+      buffer.add(Vector3d(vn.x(), vn.y(), z), colour);
+    }
+  }
+  items.back().count = buffer.size() - items.back().first;
+}
+
+void PolyDisplay::addPolys(const vector<Poly> &polys, int gl_type,
+			   int linewidth, int pointsize, const float *rgb, float a,
+			   bool randomized)
+{
+  for (uint p = 0; p < polys.size(); p++)
+    addPoly(polys[p], polys[p].getZ(), gl_type, linewidth, pointsize,
+	    rgb, a, randomized);
+}
+
+void PolyDisplay::addPolys(const vector< vector<Poly> > &polys, int gl_type,
+			   int linewidth, int pointsize, const float *rgb, float a,
+			   bool randomized)
+{
+  for (uint p = 0; p < polys.size(); p++)
+    addPolys(polys[p], gl_type, linewidth, pointsize, rgb, a, randomized);
+}
+
+void PolyDisplay::addPolys(const vector<ExPoly> &expolys, int gl_type,
+			   int linewidth, int pointsize, const float *rgb, float a,
+			   bool randomized)
+{
+  for (uint p = 0; p < expolys.size(); p++) {
+    addPoly(expolys[p].outer, expolys[p].getZ(), gl_type, linewidth, pointsize,
+	    rgb, a, randomized);
+    addPolys(expolys[p].holes, gl_type, linewidth, pointsize,
+	     rgb, a, randomized);
+  }
+}
+
+void PolyDisplay::addSurface(const vector<Poly> &polys,
+			     const Vector2d &min, const Vector2d &max,
+			     double z, double resolution, const float *rgb, float a)
+{
+  Cairo::RefPtr<Cairo::ImageSurface> surface;
+  Cairo::RefPtr<Cairo::Context> context;
+  if (!rasterpolys(polys, min, max, resolution, surface, context)) return;
+  Item item;
+  item.mode = GL_QUADS;
+  item.size = 0;
+  item.first = item.count = 0;
+  item.texture = glMakeCairoTexture(surface);
+  if (item.texture == 0) return;
+  item.min = min;
+  item.max = max;
+  item.z = z;
+  item.colour = Vector4f(rgb[0], rgb[1], rgb[2], a);
+  items.push_back(item);
+  // with mipmaps
+  texture_bytes += surface->get_width() * surface->get_height() * 4 / 3;
+}
+
+// done adding, make room in the cache
+void PolyDisplay::finish()
+{
+  recorded = true;
+  lru.push_front(this);
+  lru_pos = lru.begin();
+  in_lru = true;
+  cached_bytes += bytes();
+  while (cached_bytes > cache_limit && lru.back() != this)
+    lru.back()->clear();
+}
+
+void PolyDisplay::draw()
+{
+  if (in_lru && lru_pos != lru.begin())
+    lru.splice(lru.begin(), lru, lru_pos);
+  for (uint i = 0; i < items.size(); i++) {
+    const Item &item = items[i];
+    switch (item.mode) {
+    case GL_QUADS:
+      glColor4fv(&item.colour[0]);
+      glDrawTexture(item.texture, item.min, item.max, item.z);
+      break;
+    case GL_POINTS:
+      glPointSize(item.size);
+      buffer.draw(GL_POINTS, item.first, item.count);
+      break;
+    default:
+      glLineWidth(item.size);
+      buffer.draw(item.mode, item.first, item.count);
+    }
+  }
+}
@@ -0,0 +1,92 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+#include <list>
+
+#include "stdafx.h"
+#include "poly.h"
+#include "vertexbuffer.h"
+
+// Recorded drawing of polygons, replayed with draw().
+// Lines and points go to one vertex buffer, filled areas are
+// rasterised once into textures.  Usage: clear(), add...(), finish(),
+// then draw() as long as the polygons don't change.
+// All displays together keep at most cache_limit bytes of GL memory,
+// the least recently drawn are cleared when more is needed.
+class PolyDisplay
+{
+ public:
+  PolyDisplay();
+  ~PolyDisplay();
+
+  void clear();
+  bool isRecorded() const { return recorded; }
+
+  // like draw_poly() etc. in poly.h
+  void addPoly(const Poly &poly, double z, int gl_type,
+	       int linewidth, int pointsize, const float *rgb, float a,
+	       bool randomized);
+  void addPolys(const vector<Poly> &polys, int gl_type,
+		int linewidth, int pointsize, const float *rgb, float a,
+		bool randomized);
+  void addPolys(const vector< vector<Poly> > &polys, int gl_type,
+		int linewidth, int pointsize, const float *rgb, float a,
+		bool randomized);
+  void addPolys(const vector<ExPoly> &expolys, int gl_type,
+		int linewidth, int pointsize, const float *rgb, float a,
+		bool randomized);
+  // like draw_polys_surface()
+  void addSurface(const vector<Poly> &polys,
+		  const Vector2d &min, const Vector2d &max,
+		  double z, double resolution, const float *rgb, float a);
+  void finish();
+
+  void draw();
+
+  static size_t cache_limit;
+
+ private:
+  PolyDisplay(const PolyDisplay &);
+  PolyDisplay &operator=(const PolyDisplay &);
+
+  struct Item {
+    GLenum mode;    // GL_LINES, GL_POINTS or GL_QUADS for a texture
+    float size;     // line width or point size
+    uint first, count; // vertices of lines and points
+    GLuint texture;
+    Vector2d min, max;
+    double z;
+    Vector4f colour; // of the texture
+  };
+  vector<Item> items;
+  VertexBuffer buffer;
+  size_t texture_bytes;
+  bool recorded;
+
+  void addItem(GLenum mode, float size);
+  size_t bytes() const { return buffer.bytes() + texture_bytes; }
+
+  static list<PolyDisplay*> lru; // most recently drawn first
+  static size_t cached_bytes;
+  list<PolyDisplay*>::iterator lru_pos;
+  bool in_lru;
+};
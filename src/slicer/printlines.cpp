@@ -21,7 +21,9 @@
 #include "poly.h"
 #include "layer.h"
 #include "gcode/gcodestate.h"
+#include "gcode/motionplanner.h"
 #include "ui/progress.h"
+#include "profile.h"
 
 
 
@@ -702,6 +704,7 @@ void Printlines::addPolys(PLineArea area,
 double Printlines::makeLines(Vector2d &startPoint,
 			     vector<PLine2> &lines)
 {
+  TRACE_SCOPE("Printlines::makeLines");
   const uint count = printpolys.size();
   if (count == 0) return 1;
 
@@ -770,6 +773,7 @@ double Printlines::makeLines(Vector2d &startPoint,
     totalspeedfactor /= totallength;
   else
     totalspeedfactor = 1.;
+  Trace::counter("printlines", lines.size());
   return totalspeedfactor;
 }
 
@@ -866,176 +870,129 @@ void Printlines::optimize(double linewidth,
 }
 
 
-#define FITARC_FIND 0
-#if FITARC_FIND
-
-// find center for best fit of arclines
-bool fit_arc(const vector<PLine2> &lines, uint fromind, uint toind,
-	     double sq_error,
-	     Vector2d &result_center, double &result_radiussq)
-{
-  if (toind-fromind < 2) return false;
-  if (toind > lines.size()) return false;
-  const int n_par = 3; // center x,y and arc radius_sq
-  // start values:
-  const Vector2d &P = lines[fromind].getFrom();
-  const Vector2d &Q = lines[toind].getTo();
-  const Vector2d startxy = (P+Q)/2.;
-  double par[3] = { startxy.x(), startxy.y(), P.squared_distance(Q) };
-
-  int m_dat = toind-fromind+1;
-  arc_data_struct data;
-  data.px = new double[m_dat];
-  data.py = new double[m_dat];
-  data.px[0] = P.x();
-  data.py[0] = P.y();
-  for (int i = 0; i < m_dat; i++) {
-    data.px[i] = lines[fromind+i].getTo().x();
-    data.py[i] = lines[fromind+i].getTo().y();
-  }
-  return fit_arc(m_dat, data, n_par, par, sq_error,
-		 result_center, result_radiussq);
-}
-
+// how far points and chords may be off an arc, as part of linewidth
+const double ARC_TOLERANCE = 0.1;
 
-// max offset of the arc from the line
-double arc_offset(const Vector2d &center, const PLine2 &line)
+// does l2 continue the run of lines ending with l1 on an arc?
+// turn is the total turning angle of the run so far
+bool Printlines::continuesArc(const PLine2 &l1, const PLine2 &l2,
+			      double maxAngle, double turn)
 {
-  const double r = center.distance(line.getFrom());
-  const double angle = abs(angleBetween(line.getFrom()-center, line.getTo()-center));
-  const double off =  r - r*sin(angle/2);
-  //cerr << "offset " << off << endl;
-  return off;
+  if (l1.arc != 0 || l2.arc != 0) return false;
+  if (l2.from.squared_distance(l1.to) > 0.001) return false; // not adjacent
+  if (abs(l2.feedratio - l1.feedratio) > 0.1) return false; // different feedrate
+  if (l2.extruder_no != l1.extruder_no) return false;
+  const double dangle = l2.angle_to(l1);
+  if (abs(dangle) < 0.0001 || abs(dangle) > maxAngle) return false;
+  if (turn * dangle < 0) return false; // turning the other way
+  return (abs(turn + dangle) < 2*M_PI - 0.01); // not more than a circle
 }
 
-bool continues_arc(const Vector2d &center,
-		   uint index, double maxAngle,
-		   const vector<PLine2> &lines)
+// distance of the line's end point from the circle and
+// height of the arc over the line must be within tolerance
+inline bool fits_arc(const PLine2 &line, const Vector2d &center,
+		     double radius, double tolerance)
 {
-  if (index < 2 || index >= lines.size()) return false;
-  const PLine2 &l1 = lines[index-2];
-  const PLine2 &l2 = lines[index-1];
-  const PLine2 &l3 = lines[index];
-  const double angle1 = l1.angle_to(l2);
-  const double angle2 = l2.angle_to(l3);
-  if (abs(angle1) < 0.001) return false;
-  if (abs(angle2) < 0.001) return false;
-  const double len2 = l2.length();
-  const double len3 = l3.length();
-  if (abs(len2) < 0.001) return false;
-  if (abs(len3) < 0.001) return false;
-  return ( angle1 < maxAngle && angle2 < maxAngle
-	   && abs(angle1/angle2-1) < 0.3
-	   && abs(len2/len3-1) < 0.3 );
+  if (abs(line.to.distance(center) - radius) > tolerance) return false;
+  const double halfchord_sq = line.lengthSq() / 4;
+  if (halfchord_sq > radius*radius) return false;
+  return (radius - sqrt(radius*radius - halfchord_sq) <= tolerance);
 }
 
-
+// Runs of lines turning the same way get a circle fit (Kasa)
+// with running sums while they grow, so all lines are looked at
+// only twice: when added and when the run is made into an arc.
+// Arcs are written to a new vector in one pass, lines between them copied.
 uint Printlines::makeArcs(double linewidth,
 			  vector<PLine2> &lines) const
 {
-  if (!slicing.UseArcs) return 0;
+  if (!settings->Slicing.UseArcs) return 0;
   if (lines.size() < 3) return 0;
   const double maxAngle = settings->Slicing.ArcsMaxAngle * M_PI/180;
-  const double linewidth_sq = linewidth*linewidth;
   if (maxAngle <= 0) return 0;
-  double arcRadiusSq = 0;
-  Vector2d arccenter(1000000,1000000);
+  const double tolerance = linewidth * ARC_TOLERANCE;
+  vector<PLine2> result;
+  guint copied = 0; // lines before this are in result
+  uint numarcs = 0;
   guint arcstart = 0;
-  Vector2d newcenter;
-  double newradiusSq = 0;
-  uint i = arcstart;
-  uint arcend = i;
-  while (arcstart < lines.size()-4) {
-    i = arcstart+2;
-    arcend = arcstart;
-    while ( continues_arc(arccenter, i, maxAngle, lines) ) {
-      if ( fit_arc (lines, arcstart, i, linewidth_sq, newcenter, newradiusSq)
-	   //&&  arc_offset(newcenter, lines[i]) < 5*linewidth
-	   ) {
-	arccenter = newcenter;
-	arcend = i;
+  double turn = 0;
+  CircleFit circle;
+  circle.add(lines[0].from);
+  circle.add(lines[0].to);
+  for (uint i = 1; i <= lines.size(); i++) {
+    if (i < lines.size()
+	&& continuesArc(lines[i-1], lines[i], maxAngle, turn)) {
+      CircleFit grown = circle;
+      grown.add(lines[i].to);
+      Vector2d center;
+      double radius;
+      bool fits = true;
+      if (grown.size() > 3) // 3 points always fit
+	fits = grown.fit(center, radius)
+	  && fits_arc(lines[i], center, radius, tolerance)
+	  && grown.rmsError(center, radius) <= tolerance / 2;
+      if (fits) {
+	circle = grown;
+	turn += lines[i].angle_to(lines[i-1]);
+	continue;
       }
-      i++;
-    }
-    if (arcend > arcstart + 2) {
-      cerr << "found arc from " << arcstart << " to " << arcend << endl;
-      i -= makeIntoArc(arccenter, arcstart, arcend, lines);
     }
-    arcstart = i+1;
-  }
-}
-
-#else
-
-// gets center of common arc of 2 lines if radii match inside maxSqerr range
-Vector2d Printlines::arcCenter(const PLine2 &l1, const PLine2 &l2,
-			       double maxSqerr) const
-{
-  Vector2d l1p1,l1p2;
-  center_perpendicular(l1.from, l1.to, l1p1, l1p2);
-  Vector2d l2p1,l2p2;
-  center_perpendicular(l2.from, l2.to, l2p1, l2p2);
-  Vector2d center, ip;
-  int is = intersect2D_Segments(l1p1, l1p2, l2p1, l2p2,
- 				center, ip);
-  if (is > 0) {
-    // radii match?
-    if (abs(l1p1.squared_distance(center) -
-	    l2p1.squared_distance(center)) < maxSqerr)
-      return center;
+    // run ends with line i-1
+    if (arcstart+2 <= i-1) // at least three lines to make an arc
+      if (appendArc(circle, arcstart, i-1, tolerance, lines, copied, result))
+	numarcs++;
+    // start next run
+    if (i == lines.size()) break;
+    arcstart = i;
+    turn = 0;
+    circle.clear();
+    circle.add(lines[i].from);
+    circle.add(lines[i].to);
   }
-  return Vector2d(10000000,10000000);
-}
-
-uint Printlines::makeArcs(double linewidth,
-			  vector<PLine2> &lines) const
-{
-  if (!settings->Slicing.UseArcs) return 0;
-  if (lines.size() < 2) return 0;
-  double maxAngle = settings->Slicing.ArcsMaxAngle * M_PI/180;
-  if (maxAngle < 0) return 0;
-  double arcRadiusSq = 0;
-  Vector2d arccenter(1000000,1000000);
-  guint arcstart = 0;
-  for (uint i=1; i < lines.size(); i++) {
-    const PLine2 &l1 = lines[i-1];
-    const PLine2 &l2 = lines[i];
-    if (l1.arc) { arcstart = i+1; cerr << "1 arc" << endl;continue; }
-    if (l2.arc) { i++; arcstart = i+1;cerr << "2 arc" << endl; continue; }
-    double dangle         = l2.angle_to(l1);
-    double feedratechange = l2.feedratio - l1.feedratio;
-    Vector2d nextcenter   = arcCenter(l2, l1, 0.05*arcRadiusSq);
-    double radiusSq       = nextcenter.squared_distance(l2.from);
-    // test if NOT continue arc:
-    if (l2.from.squared_distance(l1.to) > 0.001 // not adjacent
-	|| abs(feedratechange) > 0.1            // different feedrate
-	|| abs(dangle) < 0.0001                 // straight continuation
-	|| abs(dangle) > maxAngle               // too big angle
-	|| ( i>1 && arccenter.squared_distance(nextcenter) > 0.05*radiusSq ) // center displacement
-	)
-      {
-	arccenter   = nextcenter;
-	arcRadiusSq = radiusSq;
-	// this one doesn't fit, so i-1 is last line of the arc
-	if (arcstart+2 < i-1) // at least three lines to make an arc
-	  i -= makeIntoArc(arcstart, i-1, lines);
-	// set start for potential next arc
-	arcstart = i;
-      }
+  if (numarcs == 0) return 0;
+  result.insert(result.end(), lines.begin()+copied, lines.end());
+  lines.swap(result);
+  return numarcs;
+}
+
+// if the lines fromind..toind fit on the circle through their ends,
+// copy lines up to fromind to result, then the arc replacing them
+bool Printlines::appendArc(const CircleFit &circle,
+			   guint fromind, guint toind, double tolerance,
+			   const vector<PLine2> &lines,
+			   guint &copied, vector<PLine2> &result) const
+{
+  Vector2d center;
+  double radius;
+  if (!circle.fit(center, radius)) return false;
+  // move center to the bisector of the ends, the arc must meet both
+  const Vector2d &P = lines[fromind].from;
+  const Vector2d &Q = lines[toind].to;
+  if (P.squared_distance(Q) > 0.000001) {
+    const Vector2d M = (P + Q) / 2.;
+    Vector2d normal(P.y() - Q.y(), Q.x() - P.x());
+    normal.normalize();
+    center = M + normal * (center - M).dot(normal);
+    radius = center.distance(P);
   }
-  // remaining
-  if (arcstart+2 < lines.size()-1)
-    makeIntoArc(arcstart, lines.size()-1, lines);
-  return 0;
+  for (guint i = fromind; i <= toind; i++)
+    if (!fits_arc(lines[i], center, radius, tolerance)) return false;
+  PLine2 arc;
+  if (!makeIntoArc(center, fromind, toind, lines, arc)) return false;
+  if (result.empty()) result.reserve(lines.size());
+  result.insert(result.end(), lines.begin()+copied, lines.begin()+fromind);
+  result.push_back(arc);
+  copied = toind+1;
+  return true;
 }
-#endif
 
 
-uint Printlines::makeIntoArc(const Vector2d &center,
+// the arc around center replacing lines fromind..toind
+bool Printlines::makeIntoArc(const Vector2d &center,
 			     guint fromind, guint toind,
-			     vector<PLine2> &lines) const
+			     const vector<PLine2> &lines, PLine2 &arc) const
 {
-  if (toind < fromind+1 || toind+1 > lines.size()) return 0;
+  if (toind < fromind+1 || toind+1 > lines.size()) return false;
   const Vector2d &P = lines[fromind].from;
   const Vector2d &Q = lines[toind].to;
   bool fullcircle = (P==Q);
@@ -1046,97 +1003,65 @@ uint Printlines::makeIntoArc(const Vector2d &center,
   if (!ccw) angle = -angle;
   if (angle<=0) angle+=2*M_PI;
   short arctype = ccw ? -1 : 1;
-  PLine2 newline(lines[fromind].area, lines[fromind].extruder_no, P, Q,
-		lines[fromind].speed, lines[fromind].feedratio,
-		arctype, center, angle, lines[fromind].lifted);
-  lines[fromind] = newline;
-  lines.erase(lines.begin()+fromind+1, lines.begin()+toind+1);
-  return toind-fromind;
-}
-
-// return how many lines are removed
-uint Printlines::makeIntoArc(guint fromind, guint toind,
-			     vector<PLine2> &lines) const
-{
-  if (toind < fromind+1 || toind+1 > lines.size()) return 0;
-  //cerr<< "arcstart = " << fromind << endl;
-  const Vector2d &P = lines[fromind].from;
-
-#define FITARC 0
-#if FITARC
-
-  Vector2d center; double fitradius_sq;
-  vector<Vector2d> arcpoints;
-  arcpoints.push_back(P);
-  for (uint i = fromind; i <= toind; i++)
-    arcpoints.push_back(lines[i].to);
-
-  if (  fit_arc(arcpoints, 0.1, center, fitradius_sq) ) {
-    cerr << " found center " << center << " radius="<< sqrt(fitradius_sq) << endl;
-#else
-  const Vector2d &Q = lines[toind].to;
-
-  //bool fullcircle = (P==Q);
-  // get center: intersection of center perpendiculars of 2 chords
-  // center perp of start -- endpoint:
-  guint end1ind = toind;
-  //if (fullcircle) { // take one-third for first center_perp
-    end1ind = fromind + (toind-fromind)/2;
-    //}
-  Vector2d chord1p1, chord1p2;
-  center_perpendicular(P, lines[end1ind].to, chord1p1, chord1p2);
-  // center perp of midpoint -- endpoint:
-  guint start2ind =  fromind + (toind-fromind)/2;
-  Vector2d chord2p1, chord2p2;
-  center_perpendicular(lines[start2ind].from, Q, chord2p1, chord2p2);
-  // intersection = center
-  Vector2d center, ip;
-  int is = intersect2D_Segments(chord1p1, chord1p2, chord2p1, chord2p2,
-   				center, ip);
-  if (is > 0) {
-#endif
-    return makeIntoArc(center, fromind, toind, lines);
-  } // else cerr << "arc not possible" << endl;
-  return 0;
+  arc = PLine2(lines[fromind].area, lines[fromind].extruder_no, P, Q,
+	       lines[fromind].speed, lines[fromind].feedratio,
+	       arctype, center, angle, lines[fromind].lifted);
+  return true;
 }
 
+// in one pass to a new vector, the last line of a rounded corner
+// is kept as first line of the next corner
 uint Printlines::roundCorners(double maxdistance, double minarclength,
 			      vector<PLine2> &lines) const
 {
   if (lines.size() < 2) return 0;
   uint num = 0;
-  for (uint i=0; i < lines.size()-1; i++) {
-    uint n = makeCornerArc(maxdistance, minarclength, i, lines);
-    i+=n;
-    if (n>0) i--;
-    num+=n;
+  vector<PLine2> result;
+  result.reserve(lines.size() + lines.size()/2);
+  vector<PLine2> newlines;
+  newlines.reserve(5);
+  PLine2 current = lines[0];
+  for (uint i=1; i < lines.size(); i++) {
+    const uint numnew = makeCornerArc(maxdistance, minarclength,
+				      current, lines[i], newlines);
+    if (numnew < 2) {
+      result.push_back(numnew == 1 ? newlines[0] : current);
+      current = lines[i];
+      continue;
+    }
+    result.insert(result.end(), newlines.begin(), newlines.end()-1);
+    current = newlines.back();
+    num += numnew - 2;
   }
+  result.push_back(current);
+  lines.swap(result);
   return num;
 }
 
-// make corner of lines[ind], lines[ind+1] into arc
-// or rounded sequence of lines
+// make corner of line1, line2 into arc
+// or rounded sequence of lines, written to newlines
 // maxdistance is distance of arc begin from corner
+// returns number of newlines (0: corner stays)
 uint Printlines::makeCornerArc(double maxdistance, double minarclength,
-			       uint ind,
-			       vector<PLine2> &lines) const
+			       const PLine2 &line1, const PLine2 &line2,
+			       vector<PLine2> &newlines) const
 {
-  if (ind > lines.size()-2) return 0;
-  if (lines[ind].arc != 0 || lines[ind+1].arc != 0) return 0;
+  newlines.clear();
+  if (line1.arc != 0 || line2.arc != 0) return 0;
   // movement in between?
-  if ((lines[ind].to - lines[ind+1].from).squared_length() > 0.01) return 0;
-  // if ((lines[ind].from - lines[ind+1].to).squared_length()
+  if ((line1.to - line2.from).squared_length() > 0.01) return 0;
+  // if ((line1.from - line2.to).squared_length()
   //     < maxdistance*maxdistance) return 0;
-  const double len1 = lines[ind].length();
-  const double len2 = lines[ind+1].length();
+  const double len1 = line1.length();
+  const double len2 = line2.length();
   maxdistance   = min(maxdistance, len1); // ok to eat up line 1
   maxdistance   = min(maxdistance, len2 / 2.1); // only eat up less than half of second line
-  const Vector2d dir1 = lines[ind].to   - lines[ind].from;
-  const Vector2d dir2 = lines[ind+1].to - lines[ind+1].from;
+  const Vector2d dir1 = line1.to   - line1.from;
+  const Vector2d dir2 = line2.to - line2.from;
   double angle  = angleBetween(dir1, dir2);
   // arc start and end point:
-  const Vector2d p1   = lines[ind].to     - normalized(dir1)*maxdistance;
-  const Vector2d p2   = lines[ind+1].from + normalized(dir2)*maxdistance;
+  const Vector2d p1   = line1.to     - normalized(dir1)*maxdistance;
+  const Vector2d p2   = line2.from + normalized(dir2)*maxdistance;
   // intersect perpendiculars at arc start/end
   Vector2d center, I1;
   int is = intersect2D_Segments(p1, p1 + Vector2d(-dir1.y(),dir1.x()),
@@ -1151,8 +1076,8 @@ uint Printlines::makeCornerArc(double maxdistance, double minarclength,
   const short arctype = ccw ? -1 : 1;
   // need 2 half arcs?
   const bool split =
-    (lines[ind].feedratio != lines[ind+1].feedratio)
-    || (lines[ind].extruder_no != lines[ind+1].extruder_no);
+    (line1.feedratio != line2.feedratio)
+    || (line1.extruder_no != line2.extruder_no);
   const double arc_len = radius * angle;
   // too small for arc, replace by 2 straight lines
   const bool not_arc =
@@ -1163,52 +1088,44 @@ uint Printlines::makeCornerArc(double maxdistance, double minarclength,
     (arc_len < (split?(minarclength/2):minarclength));
   // if (toosmallfortwo) return 0;
 
-  vector<PLine2> newlines;
-  if (p1 != lines[ind].from) { // straight line 1
-    newlines.push_back(lines[ind]);
-    newlines.back().move_to(lines[ind].from, p1);
+  if (p1 != line1.from) { // straight line 1
+    newlines.push_back(line1);
+    newlines.back().move_to(line1.from, p1);
   }
   if (p2 != p1)  {
     if (toosmallfortwo) { // 1 line
-      const double feedr = ( lines[ind].feedratio + lines[ind+1].feedratio ) / 2;
-      newlines.push_back(PLine2(lines[ind].area, lines[ind].extruder_no,
-				p1, p2, lines[ind].speed, feedr,
-				(feedr!=0)?lines[ind].lifted:0));
+      const double feedr = ( line1.feedratio + line2.feedratio ) / 2;
+      newlines.push_back(PLine2(line1.area, line1.extruder_no,
+				p1, p2, line1.speed, feedr,
+				(feedr!=0)?line1.lifted:0));
     }
     else if (split || not_arc) { // calc arc midpoint
       const Vector2d splitp = rotated(p1, center, angle/2, ccw);
       if (not_arc) { // 2 straight lines
-	newlines.push_back(lines[ind]);
+	newlines.push_back(line1);
 	newlines.back().move_to(p1, splitp);
-	newlines.push_back(lines[ind+1]);
+	newlines.push_back(line2);
 	newlines.back().move_to(splitp, p2);
       }
       else if (split) { // 2 arcs
-	newlines.push_back(PLine2(lines[ind].area, lines[ind].extruder_no,  p1, splitp,
-				 lines[ind].speed, lines[ind].feedratio,
-				 arctype, center, angle/2, lines[ind].lifted));
-	newlines.push_back(PLine2(lines[ind+1].area, lines[ind+1].extruder_no, splitp, p2,
-				 lines[ind+1].speed, lines[ind+1].feedratio,
-				 arctype, center, angle/2, lines[ind+1].lifted));
+	newlines.push_back(PLine2(line1.area, line1.extruder_no,  p1, splitp,
+				 line1.speed, line1.feedratio,
+				 arctype, center, angle/2, line1.lifted));
+	newlines.push_back(PLine2(line2.area, line2.extruder_no, splitp, p2,
+				 line2.speed, line2.feedratio,
+				 arctype, center, angle/2, line2.lifted));
       }
     } else { // 1 arc
-      newlines.push_back(PLine2(lines[ind].area, lines[ind].extruder_no, p1, p2,
-			       lines[ind].speed, lines[ind].feedratio,
-			       arctype, center, angle, lines[ind].lifted));
+      newlines.push_back(PLine2(line1.area, line1.extruder_no, p1, p2,
+			       line1.speed, line1.feedratio,
+			       arctype, center, angle, line1.lifted));
     }
   }
-  if (p2 != lines[ind+1].to) { // straight line 2
-    newlines.push_back(lines[ind+1]);
-    newlines.back().move_to(p2, lines[ind+1].to);
+  if (p2 != line2.to) { // straight line 2
+    newlines.push_back(line2);
+    newlines.back().move_to(p2, line2.to);
   }
-  const uint numnew = newlines.size();
-  if (numnew>0)
-    lines[ind] = newlines[0];
-  if (numnew>1)
-    lines[ind+1] = newlines[1];
-  if (numnew>2)
-    lines.insert(lines.begin()+ind+2, newlines.begin()+2, newlines.end());
-  return max(0, (int)numnew - 2);
+  return newlines.size();
 }
 
 
@@ -1290,90 +1207,79 @@ uint Printlines::divideline(uint lineindex,
 #define NEWCLIP 1
 #if NEWCLIP
 // polys are clippolys (shells)
+// moves are divided into a new vector in one pass
 void Printlines::clipMovements(const vector<Poly> &polys, vector<PLine2> &lines,
 			       bool findnearest, double maxerr) const
 {
+  TRACE_SCOPE("Printlines::clipMovements");
   if (polys.size()==0 || lines.size()==0) return;
   vector<PLine2> newlines;
+  newlines.reserve(lines.size());
+  vector<PLine2> divided; // current move's parts
   for (guint i=0; i < lines.size(); i++) {
-    if (lines[i].is_move()) {
-      // // don't clip a lifted line
-      // if (lines[i].lifted > 0) continue;
-      int frompoly=-1, topoly=-1;
-      // get start and end poly of move
-      for (uint p = 0; p < polys.size(); p++) {
-	if ((frompoly==-1) && polys[p].vertexInside(lines[i].from, maxerr))
-	  frompoly=(int)p;
-	if ((topoly==-1)   && polys[p].vertexInside(lines[i].to,   maxerr))
-	  topoly=(int)p;
-      }
-      int div = 0;
-      //cerr << frompoly << " --> "<< topoly << endl;
-      if (frompoly >=0 && topoly >=0) {
-	if (findnearest && frompoly != topoly) {
-	  int fromind, toind;
-	  polys[frompoly].nearestIndices(polys[topoly], fromind, toind);
-	  vector<Vector2d> path(2);
-	  path[0] = polys[frompoly].vertices[fromind];
-	  path[1] = polys[topoly].  vertices[toind];
-	  // for (uint pi=0; pi < path.size(); pi++)
-	  //   cerr << path[pi] << endl;
-	  div += divideline(i, path, lines);
-	  // cerr << i << " _ "<<  frompoly<<":"<<fromind << " ==> "<< topoly<<":"<<toind
-	  //      << " - " << div<< endl;
-	  //i++;
-	  // continue;
-	}
+    if (!lines[i].is_move()) {
+      newlines.push_back(lines[i]);
+      continue;
+    }
+    // // don't clip a lifted line
+    // if (lines[i].lifted > 0) continue;
+    divided.assign(1, lines[i]);
+    int frompoly=-1, topoly=-1;
+    // get start and end poly of move
+    for (uint p = 0; p < polys.size(); p++) {
+      if ((frompoly==-1) && polys[p].vertexInside(lines[i].from, maxerr))
+	frompoly=(int)p;
+      if ((topoly==-1)   && polys[p].vertexInside(lines[i].to,   maxerr))
+	topoly=(int)p;
+    }
+    //cerr << frompoly << " --> "<< topoly << endl;
+    if (frompoly >=0 && topoly >=0) {
+      if (findnearest && frompoly != topoly) {
+	int fromind, toind;
+	polys[frompoly].nearestIndices(polys[topoly], fromind, toind);
+	vector<Vector2d> path(2);
+	path[0] = polys[frompoly].vertices[fromind];
+	path[1] = polys[topoly].  vertices[toind];
+	// for (uint pi=0; pi < path.size(); pi++)
+	//   cerr << path[pi] << endl;
+	divideline(0, path, divided);
       }
-      //continue;
+    }
 #define FASTPATH 0
 #if FASTPATH // find shortest path through polygon
-      // faster to print but slow to calculate
-      if (frompoly >=0 && topoly >=0) {
-	// vector<Poly> allpolys;
-	// allpolys.push_back(polys[frompoly]);
-	// // add holes
-	// for (int p = 0; p < polys.size(); p++) {
-	//   if (p != frompoly && polys[p].isInside(polys[frompoly]))
-	//     allpolys.push_back(polys[p]);
-	// }
-	// cerr << allpolys.size() << " holes" << endl;
-	vector<Vector2d> path;
-	bool ispath = shortestPath(lines[i].from, lines[i].to,
-				   polys, frompoly, path, maxerr);
-	//cerr << path.size() << " path points" << endl;
-
-	if (ispath) {
-	  div += (divideline(i,path,lines));
-	  if (divisions>0)
-	    cerr << divisions << " div in poly " << topoly << " - " << ispath << " path " << path.size()<<endl;
-	}
-      }
+    // faster to print but slow to calculate
+    if (frompoly >=0 && topoly >=0) {
+      vector<Vector2d> path;
+      bool ispath = shortestPath(divided[0].from, divided[0].to,
+				 polys, frompoly, path, maxerr);
+      //cerr << path.size() << " path points" << endl;
+      if (ispath)
+	divideline(0, path, divided);
+    }
 #else // walk along perimeters
-      // intersections with all polys
-      for (uint p = 0; p < polys.size(); p++) {
-	vector<Intersection> pinter =
-	  polys[p].lineIntersections(lines[i].from,lines[i].to, maxerr);
-	if (pinter.size() > 0) {
-	  // if (pinter.size()%2 == 0) {
-	    vector<Vector2d> path =
-	      polys[p].getPathAround(lines[i].from, lines[i].to);
-	    // after divide, skip number of added lines -> test remaining line later
-	    div += (divideline(i, path, lines));
-	    //continue;
-	  // }
-	}
+    // intersections with all polys, of the first part,
+    // the remaining parts are not tested again
+    for (uint p = 0; p < polys.size(); p++) {
+      vector<Intersection> pinter =
+	polys[p].lineIntersections(divided[0].from, divided[0].to, maxerr);
+      if (pinter.size() > 0) {
+	// if (pinter.size()%2 == 0) {
+	vector<Vector2d> path =
+	  polys[p].getPathAround(divided[0].from, divided[0].to);
+	divideline(0, path, divided);
+	// }
       }
-
-#endif
-      i += div;
     }
+#endif
+    newlines.insert(newlines.end(), divided.begin(), divided.end());
   }
+  lines.swap(newlines);
 }
 #else  // old clip
 void Printlines::clipMovements(const vector<Poly> &polys, vector<PLine2> &lines,
 			       double maxerr) const
 {
+  TRACE_SCOPE("Printlines::clipMovements");
   if (polys.size()==0 || lines.size()==0) return;
   vector<PLine2> newlines;
   for (guint i=0; i < lines.size(); i++) {
@@ -1472,14 +1378,19 @@ void Printlines::setSpeedFactor(double speedfactor, vector<PLine2> &lines) const
       lines[i].speed *= speedfactor;
   }
 }
+// the planned times don't scale with the speed because of acceleration,
+// so slow down again until the time is reached
 double Printlines::slowdownTo(double totalseconds, vector<PLine2> &lines)
 {
-  double totalnow = totalSecondsExtruding(lines);
+  double totalnow;
+  plannedSeconds(lines, totalnow);
   if (totalseconds == 0 || totalnow == 0) return 1;
-  double speedfactor = totalnow / totalseconds;
-  if (speedfactor < 1.){
+  for (uint i = 0; i < 4 && totalnow > 0; i++) {
+    const double speedfactor = totalnow / totalseconds;
+    if (speedfactor >= 0.99) break;
     setSpeedFactor(speedfactor,lines);
     slowdownfactor *= speedfactor;
+    plannedSeconds(lines, totalnow);
   }
   return slowdownfactor;
 }
@@ -1667,6 +1578,42 @@ double Printlines::totalSecondsExtruding(const vector<PLine2> &lines) const
   return t * 60;
 }
 
+double Printlines::plannedSeconds(const vector<PLine2> &lines,
+				  double &extrudingseconds) const
+{
+  extrudingseconds = 0;
+  if (lines.size() == 0) return 0;
+  enum { MOVING, EXTRUDING };
+  MotionPlanner planner(settings->Hardware);
+  planner.setPosition(Vector3d(lines[0].from.x(), lines[0].from.y(), 0));
+  for (lineCIt lIt = lines.begin(); lIt!=lines.end();++lIt){
+    if (lIt->is_command()) continue;
+    const uint tag = (!lIt->is_move() || lIt->absolute_extrusion!=0)
+      ? EXTRUDING : MOVING;
+    const Vector3d from(lIt->from.x(), lIt->from.y(), 0);
+    const Vector3d to  (lIt->to.x(),   lIt->to.y(),   0);
+    if (from != planner.getPosition()) {
+      planner.flush();
+      planner.setPosition(from);
+    }
+    if (lIt->arc == 0)
+      planner.move(to, lIt->speed, tag);
+    else {
+      // tangents at start and end, ccw for arc -1
+      const Vector2d r1 = lIt->from - lIt->arccenter;
+      const Vector2d r2 = lIt->to   - lIt->arccenter;
+      const double sign = (lIt->arc < 0) ? 1. : -1.;
+      Vector3d startdir(-r1.y()*sign, r1.x()*sign, 0);
+      Vector3d enddir  (-r2.y()*sign, r2.x()*sign, 0);
+      startdir.normalize(); enddir.normalize();
+      planner.move(lIt->length(), startdir, enddir, lIt->speed, tag);
+      planner.setPosition(to);
+    }
+  }
+  extrudingseconds = planner.tagTime(EXTRUDING);
+  return planner.totalTime();
+}
+
 
 void Printlines::getCommands(const vector<PLine3> &plines,
 			     const Settings & settings,
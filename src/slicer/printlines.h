@@ -28,6 +28,7 @@
 
 class PLine2; // see below
 class ViewProgress;
+class CircleFit;
 
 enum PLineArea { UNDEF, SHELL, SKIN, INFILL, SUPPORT, SKIRT, BRIDGE, COMMAND };
 const string AreaNames[] = { _(""), _("Shell"), _("Skin"), _("Infill"),
@@ -258,13 +259,19 @@ class Printlines
 
   uint makeArcs(double linewidth,
 		vector<PLine2> &lines) const;
-  uint makeIntoArc(guint fromind, guint toind, vector<PLine2> &lines) const;
-  uint makeIntoArc(const Vector2d &center, guint fromind, guint toind,
-		   vector<PLine2> &lines) const;
+  static bool continuesArc(const PLine2 &l1, const PLine2 &l2,
+			   double maxAngle, double turn);
+  bool appendArc(const CircleFit &circle,
+		 guint fromind, guint toind, double tolerance,
+		 const vector<PLine2> &lines,
+		 guint &copied, vector<PLine2> &result) const;
+  bool makeIntoArc(const Vector2d &center, guint fromind, guint toind,
+		   const vector<PLine2> &lines, PLine2 &arc) const;
 
   uint roundCorners(double maxdistance, double minarclength, vector<PLine2> &lines) const;
   uint makeCornerArc(double maxdistance, double minarclength,
-		     uint ind, vector<PLine2> &lines) const;
+		     const PLine2 &line1, const PLine2 &line2,
+		     vector<PLine2> &newlines) const;
 
   static bool find_nextmoves(double minlength, uint startindex,
 			     AORange &range,
@@ -309,6 +316,9 @@ class Printlines
   double totalLength(const vector<PLine2> &lines) const;
   double totalSeconds(const vector<PLine2> &lines) const;
   double totalSecondsExtruding(const vector<PLine2> &lines) const;
+  // with acceleration as the printer does it, see MotionPlanner
+  double plannedSeconds(const vector<PLine2> &lines,
+			double &extrudingseconds) const;
 
   static double total_Extrusion(const vector< PLine3 > &lines);
   static double total_rel_Extrusion(const vector< PLine3 > &lines);
@@ -377,9 +387,6 @@ class Printlines
 				       vector< PLine3 > &lines,
 				       double &havedistributed);
 
-  Vector2d arcCenter(const PLine2 &l1, const PLine2 &l2,
-		     double maxerr) const;
-
   double slowdownfactor; // result of slowdown/setspeedfactor. not used here.
 
   /* string GCode(PLine2 l, Vector3d &lastpos, double &E, double feedrate,  */
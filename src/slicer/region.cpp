@@ -0,0 +1,130 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "region.h"
+
+Region::Region(double z, double extrusionfactor)
+  : z(z), extrusionfactor(extrusionfactor), viewcalculated(false)
+{
+}
+
+Region::Region(const CL::Polygons &cpolys, double z, double extrusionfactor)
+  : cpolys(cpolys), z(z), extrusionfactor(extrusionfactor),
+    viewcalculated(false)
+{
+}
+
+Region::Region(const vector<Poly> &polys)
+  : cpolys(Clipping::getClipperPolygons(polys)), z(0), extrusionfactor(1.),
+    viewcalculated(false)
+{
+  if (polys.size() > 0) {
+    z = polys.back().getZ();
+    extrusionfactor = polys.back().getExtrusionFactor();
+  }
+}
+
+void Region::clear()
+{
+  cpolys.clear();
+  changed();
+}
+
+void Region::setPaths(const CL::Polygons &paths)
+{
+  cpolys = paths;
+  changed();
+}
+
+void Region::swapPaths(CL::Polygons &paths)
+{
+  cpolys.swap(paths);
+  changed();
+}
+
+void Region::add(const Region &other)
+{
+  cpolys.insert(cpolys.end(), other.cpolys.begin(), other.cpolys.end());
+  changed();
+}
+
+void Region::setZ(double z_)
+{
+  if (z_ == z) return;
+  z = z_;
+  changed();
+}
+
+void Region::setExtrusionFactor(double e)
+{
+  if (e == extrusionfactor) return;
+  extrusionfactor = e;
+  changed();
+}
+
+const vector<Poly> &Region::polys() const
+{
+  if (!viewcalculated) {
+    view = Clipping::getPolys(cpolys, z, extrusionfactor);
+    viewcalculated = true;
+  }
+  return view;
+}
+
+void Region::cleanup(double epsilon)
+{
+  Clipping::cleanup(cpolys, epsilon);
+  changed();
+}
+
+void Region::removeSmall(double minarea)
+{
+  const double clarea = minarea * CL_FACTOR * CL_FACTOR;
+  uint k = 0;
+  for (uint i = 0; i < cpolys.size(); i++)
+    if (abs(CL::Area(cpolys[i])) >= clarea) {
+      if (k != i) cpolys[k].swap(cpolys[i]);
+      k++;
+    }
+  if (k == cpolys.size()) return;
+  cpolys.resize(k);
+  changed();
+}
+
+bool Region::getMinMax(Vector2d &min, Vector2d &max) const
+{
+  CL::long64 minx = 0, miny = 0, maxx = 0, maxy = 0;
+  bool found = false;
+  for (uint i = 0; i < cpolys.size(); i++)
+    for (uint j = 0; j < cpolys[i].size(); j++) {
+      const CL::IntPoint &p = cpolys[i][j];
+      if (!found) {
+	minx = maxx = p.X;
+	miny = maxy = p.Y;
+	found = true;
+	continue;
+      }
+      minx = MIN(minx, p.X); maxx = MAX(maxx, p.X);
+      miny = MIN(miny, p.Y); maxy = MAX(maxy, p.Y);
+    }
+  if (!found) return false;
+  min = Clipping::getPoint(CL::IntPoint(minx, miny));
+  max = Clipping::getPoint(CL::IntPoint(maxx, maxy));
+  return true;
+}
@@ -0,0 +1,69 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "stdafx.h"
+#include "clipping.h"
+
+// Polygons of one kind in a layer, kept as Clipper paths because
+// all boolean operations and offsets work on those.  The Poly view for
+// infill, drawing and gcode is converted only when first asked for,
+// any change of the paths drops it.
+class Region
+{
+ public:
+  Region(double z = 0, double extrusionfactor = 1.);
+  Region(const CL::Polygons &cpolys, double z, double extrusionfactor = 1.);
+  // z and extrusion factor of the last poly, like Clipping::addPolys
+  explicit Region(const vector<Poly> &polys);
+
+  void clear();
+  bool empty() const { return cpolys.empty(); }
+  uint size() const { return cpolys.size(); }
+
+  const CL::Polygons &paths() const { return cpolys; }
+  void setPaths(const CL::Polygons &paths);
+  void swapPaths(CL::Polygons &paths);
+  void add(const Region &other);
+
+  double getZ() const { return z; }
+  void setZ(double z);
+  double getExtrusionFactor() const { return extrusionfactor; }
+  void setExtrusionFactor(double e);
+
+  // not thread safe the first time
+  const vector<Poly> &polys() const;
+
+  void cleanup(double epsilon);
+  // remove paths of less area than minarea mm^2
+  void removeSmall(double minarea);
+  bool getMinMax(Vector2d &min, Vector2d &max) const;
+
+ private:
+  CL::Polygons cpolys;
+  double z;
+  double extrusionfactor;
+
+  mutable vector<Poly> view;
+  mutable bool viewcalculated;
+  void changed() { view.clear(); viewcalculated = false; }
+};
@@ -0,0 +1,197 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <cstring>
+
+#include "slicewriter.h"
+#include "layer.h"
+#include "geometry.h"
+
+static string lowercase_extension(const string &path)
+{
+  const size_t dot = path.find_last_of('.');
+  if (dot == string::npos || path.find_first_of("/\\", dot) != string::npos)
+    return "";
+  string ext = path.substr(dot);
+  for (uint i = 0; i < ext.size(); i++)
+    ext[i] = tolower(ext[i]);
+  return ext;
+}
+
+SliceWriter *SliceWriter::create(const string &path, bool single_layer,
+				 const Vector2d &svgsize,
+				 const Vector2d &bedsize, double dpi)
+{
+  const string ext = lowercase_extension(path);
+  if (ext == ".png")
+    return new RasterSliceWriter(path, RasterSliceWriter::PNG, bedsize, dpi);
+  if (ext == ".pbm")
+    return new RasterSliceWriter(path, RasterSliceWriter::PBM, bedsize, dpi);
+  return new SVGSliceWriter(path, single_layer, svgsize);
+}
+
+string SliceWriter::layerFilename(uint layerno, const string &extension) const
+{
+  uint digits = 1;
+  for (uint n = layercount; n >= 10; n /= 10) digits++;
+  ostringstream ostr;
+  ostr << base;
+  ostr.width(digits);
+  ostr.fill('0');
+  ostr << layerno << extension;
+  return ostr.str();
+}
+
+
+SVGSliceWriter::SVGSliceWriter(const string &path, bool single_layer,
+			       const Vector2d &size)
+  : path(path), single_layer(single_layer), size(size)
+{
+  base = path;
+  if (lowercase_extension(path) == ".svg")
+    base = path.substr(0, path.size() - 4);
+}
+
+string SVGSliceWriter::header(const Vector2d &size)
+{
+  ostringstream ostr;
+  ostr << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>" <<endl
+       << "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.0//EN\" \"http://www.w3.org/TR/2001/REC-SVG-20010904/DTD/svg10.dtd\">" << endl
+       << "<!-- Created by Repsnapper -->" << endl
+       << "<svg " << endl
+       << "\txmlns:svg=\"http://www.w3.org/2000/svg\""<< endl
+       << "\txmlns=\"http://www.w3.org/2000/svg\"" << endl
+    //<< "\tversion=\"1.1\"" << endl
+       << "\twidth=\"" << size.x()
+       << "\" height=\""<< size.y() << "\"" << endl
+       << ">" << endl;
+  return ostr.str();
+}
+
+string SVGSliceWriter::footer()
+{
+  return "</g>\n</svg>\n";
+}
+
+bool SVGSliceWriter::begin(uint count)
+{
+  SliceWriter::begin(count);
+  if (single_layer) return true;
+  file.open(path.c_str(), ios::out | ios::trunc);
+  file << header(size)
+       << "<g id=\"" << layercount << "_Layers\">" << endl;
+  return file.good();
+}
+
+// single layers are written here, in parallel
+string SVGSliceWriter::render(const Layer &layer, uint layerno)
+{
+  if (!single_layer)
+    return "\t\t" + layer.SVGpath() + "\n";
+  ofstream single(layerFilename(layerno, ".svg").c_str(), ios::out | ios::trunc);
+  single << header(size)
+	 << "<g id=\"" << "Layer_" << layerno
+	 << "_of_" << layercount << "\">" << endl
+	 << "\t\t" << layer.SVGpath() << endl
+	 << footer();
+  if (!single.good()) failed = true;
+  return "";
+}
+
+bool SVGSliceWriter::write(const string &rendered, uint /*layerno*/)
+{
+  if (single_layer) return !failed;
+  file << rendered;
+  return file.good();
+}
+
+bool SVGSliceWriter::end()
+{
+  if (single_layer) return !failed;
+  file << footer();
+  file.close();
+  return !file.fail();
+}
+
+
+RasterSliceWriter::RasterSliceWriter(const string &path, Format format,
+				     const Vector2d &bedsize, double dpi)
+  : format(format), bedsize(bedsize), resolution(25.4 / MAX(1., dpi))
+{
+  base = path.substr(0, path.size() - 4);
+}
+
+bool RasterSliceWriter::begin(uint count)
+{
+  SliceWriter::begin(count);
+  return bedsize.x() > 0 && bedsize.y() > 0;
+}
+
+// An image with y up as seen from above, the part white in an 8 bit
+// grey PNG, or set (black) in a 1 bit PBM.
+string RasterSliceWriter::render(const Layer &layer, uint layerno)
+{
+  Cairo::RefPtr<Cairo::ImageSurface> surface;
+  Cairo::RefPtr<Cairo::Context> context;
+  if (!rasterpolys(layer.GetPolygons(), Vector2d::ZERO, bedsize, resolution,
+		   surface, context)) {
+    failed = true;
+    return "";
+  }
+  surface->flush();
+  const int width  = surface->get_width();
+  const int height = surface->get_height();
+  const int stride = surface->get_stride();
+  unsigned char *data = surface->get_data();
+
+  if (format == PNG) {
+    vector<unsigned char> row(stride);
+    for (int y = 0; y < height/2; y++) {
+      unsigned char *a = data + y * stride;
+      unsigned char *b = data + (height-1-y) * stride;
+      memcpy(&row[0], a, stride);
+      memcpy(a, b, stride);
+      memcpy(b, &row[0], stride);
+    }
+    surface->mark_dirty();
+    try {
+      surface->write_to_png(layerFilename(layerno, ".png"));
+    } catch (std::exception &e) {
+      failed = true;
+    }
+    return "";
+  }
+
+  // binary PBM: rows from the top, 8 pixels per byte, first pixel high
+  const int rowbytes = (width + 7) / 8;
+  vector<unsigned char> bits(rowbytes * height, 0);
+  for (int y = 0; y < height; y++) {
+    const unsigned char *src = data + (height-1-y) * stride;
+    unsigned char *dst = &bits[y * rowbytes];
+    for (int x = 0; x < width; x++)
+      if (src[x] >= 128)
+	dst[x/8] |= 0x80 >> (x%8);
+  }
+  ofstream file(layerFilename(layerno, ".pbm").c_str(),
+		ios::out | ios::trunc | ios::binary);
+  file << "P4\n" << width << " " << height << "\n";
+  file.write((const char *)&bits[0], bits.size());
+  if (!file.good()) failed = true;
+  return "";
+}
@@ -0,0 +1,89 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <fstream>
+
+#include "stdafx.h"
+
+// Export of slices while they are made.
+// render() is called in parallel for any layer, the layer is deleted
+// after it; write() gets the rendered text in layer order.
+class SliceWriter
+{
+ public:
+  virtual ~SliceWriter() {}
+
+  // by the extension of path: .png or .pbm images, one per layer,
+  // otherwise SVG, in one file unless single_layer.
+  // The images show the bed from (0,0) to bedsize at dpi.
+  static SliceWriter *create(const string &path, bool single_layer,
+			     const Vector2d &svgsize,
+			     const Vector2d &bedsize, double dpi);
+
+  virtual bool begin(uint count) { layercount = count; return true; }
+  virtual string render(const Layer &layer, uint layerno) = 0;
+  virtual bool write(const string &/*rendered*/, uint /*layerno*/) { return true; }
+  virtual bool end() { return !failed; }
+
+ protected:
+  SliceWriter() : failed(false), layercount(0) {}
+  volatile bool failed;
+  uint layercount;
+  string base;    // file name without extension
+  // base + layer number, zero padded to the digits of layercount
+  string layerFilename(uint layerno, const string &extension) const;
+};
+
+class SVGSliceWriter : public SliceWriter
+{
+ public:
+  SVGSliceWriter(const string &path, bool single_layer, const Vector2d &size);
+
+  bool begin(uint layercount);
+  string render(const Layer &layer, uint layerno);
+  bool write(const string &rendered, uint layerno);
+  bool end();
+
+ private:
+  static string header(const Vector2d &size);
+  static string footer();
+
+  string path;
+  bool single_layer;
+  Vector2d size;
+  ofstream file;
+};
+
+class RasterSliceWriter : public SliceWriter
+{
+ public:
+  enum Format { PNG, PBM };
+  RasterSliceWriter(const string &path, Format format,
+		    const Vector2d &bedsize, double dpi);
+
+  bool begin(uint layercount);
+  string render(const Layer &layer, uint layerno);
+
+ private:
+  Format format;
+  Vector2d bedsize;
+  double resolution; // mm per pixel
+};
@@ -53,6 +53,13 @@ Matrix4f Transform3D::getFloatTransform() const
 {
   return (Matrix4f) transform;
 }
+void Transform3D::set(const Matrix4d &base, const Vector3d &scales)
+{
+  m_transform = base;
+  xyz_scale = scales;
+  update_transform();
+}
+
 void Transform3D::setTransform(const Matrix4f &matr)
 {
   m_transform = (Matrix4d) matr;
@@ -54,5 +54,9 @@ public:
 	double get_scale_x() const {return xyz_scale(0);};
 	double get_scale_y() const {return xyz_scale(1);};
 	double get_scale_z() const {return xyz_scale(2);};
+	// what the transform is made of, for saving and restoring
+	Matrix4d getBase() const {return m_transform;};
+	Vector3d getScales() const {return xyz_scale;};
+	void set(const Matrix4d &base, const Vector3d &scales);
 };
 
@@ -175,7 +175,7 @@ Vector3d Triangle::GetMin(const Matrix4d &T) const
 	return min;
 }
 
-void Triangle::AccumulateMinMax(Vector3d &min, Vector3d &max, const Matrix4d &T)
+void Triangle::AccumulateMinMax(Vector3d &min, Vector3d &max, const Matrix4d &T) const
 {
 	Vector3d tmin = GetMin(T);
 	Vector3d tmax = GetMax(T);
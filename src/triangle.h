@@ -59,7 +59,7 @@ public:
 	Vector3d GetMin(const Matrix4d &T=Matrix4d::IDENTITY) const;
 
 	void AccumulateMinMax(Vector3d &min, Vector3d &max,
-			      const Matrix4d &T=Matrix4d::IDENTITY);
+			      const Matrix4d &T=Matrix4d::IDENTITY) const;
 	void Translate(const Vector3d &vector);
 	int CutWithPlane(double z, const Matrix4d &T,
 			 Vector2d &lineStart, Vector2d &lineEnd) const;
@@ -0,0 +1,172 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "stdafx.h"
+#include "trianglebvh.h"
+
+#include <algorithm>
+
+// triangles per leaf
+const uint BVH_LEAF_SIZE = 4;
+
+bool intersectRayBox(const Vector3d &origin, const Vector3d &dir,
+		     const Vector3d &min, const Vector3d &max, double &t)
+{
+  double tnear = 0, tfar = INFTY;
+  for (uint c = 0; c < 3; c++) {
+    if (dir[c] == 0) { // parallel to the slab
+      if (origin[c] < min[c] || origin[c] > max[c]) return false;
+      continue;
+    }
+    double t1 = (min[c] - origin[c]) / dir[c];
+    double t2 = (max[c] - origin[c]) / dir[c];
+    if (t1 > t2) std::swap(t1, t2);
+    if (t1 > tnear) tnear = t1;
+    if (t2 < tfar)  tfar  = t2;
+    if (tnear > tfar) return false;
+  }
+  t = tnear;
+  return true;
+}
+
+// Moeller/Trumbore
+bool intersectRayTriangle(const Vector3d &origin, const Vector3d &dir,
+			  const Triangle &triangle, double &t)
+{
+  const Vector3d e1 = triangle.B - triangle.A;
+  const Vector3d e2 = triangle.C - triangle.A;
+  const Vector3d p = dir.cross(e2);
+  const double det = e1.dot(p);
+  if (fabs(det) < 1e-15) return false;
+  const double invdet = 1. / det;
+  const Vector3d s = origin - triangle.A;
+  const double u = s.dot(p) * invdet;
+  if (u < 0 || u > 1) return false;
+  const Vector3d q = s.cross(e1);
+  const double v = dir.dot(q) * invdet;
+  if (v < 0 || u + v > 1) return false;
+  t = e2.dot(q) * invdet;
+  return t >= 0;
+}
+
+
+struct CentroidLess
+{
+  const vector<Vector3d> &centroids;
+  uint axis;
+  CentroidLess(const vector<Vector3d> &centroids, uint axis)
+    : centroids(centroids), axis(axis) {}
+  bool operator()(uint a, uint b) const {
+    return centroids[a][axis] < centroids[b][axis];
+  }
+};
+
+void TriangleBVH::clear()
+{
+  nodes.clear();
+  indices.clear();
+}
+
+void TriangleBVH::build(const vector<Triangle> &triangles)
+{
+  clear();
+  if (triangles.empty()) return;
+  vector<Vector3d> centroids(triangles.size());
+  indices.resize(triangles.size());
+  for (uint i = 0; i < triangles.size(); i++) {
+    centroids[i] = (triangles[i].A + triangles[i].B + triangles[i].C) / 3.;
+    indices[i] = i;
+  }
+  nodes.reserve(2 * triangles.size() / BVH_LEAF_SIZE + 1);
+  buildNode(triangles, centroids, 0, triangles.size());
+}
+
+// node for indices [start, end), split at the median of the longest axis
+void TriangleBVH::buildNode(const vector<Triangle> &triangles,
+			    const vector<Vector3d> &centroids,
+			    uint start, uint end)
+{
+  const uint n = nodes.size();
+  nodes.push_back(Node());
+  Vector3d min(INFTY,INFTY,INFTY), max(-INFTY,-INFTY,-INFTY);
+  Vector3d cmin = min, cmax = max;
+  for (uint i = start; i < end; i++) {
+    const Triangle &tr = triangles[indices[i]];
+    for (uint c = 0; c < 3; c++) {
+      min[c] = MIN(min[c], MIN(tr.A[c], MIN(tr.B[c], tr.C[c])));
+      max[c] = MAX(max[c], MAX(tr.A[c], MAX(tr.B[c], tr.C[c])));
+      cmin[c] = MIN(cmin[c], centroids[indices[i]][c]);
+      cmax[c] = MAX(cmax[c], centroids[indices[i]][c]);
+    }
+  }
+  nodes[n].min = min;
+  nodes[n].max = max;
+
+  if (end - start <= BVH_LEAF_SIZE) {
+    nodes[n].first = start;
+    nodes[n].count = end - start;
+    return;
+  }
+  const Vector3d extent = cmax - cmin;
+  uint axis = 0;
+  if (extent.y() > extent[axis]) axis = 1;
+  if (extent.z() > extent[axis]) axis = 2;
+  const uint mid = (start + end) / 2;
+  std::nth_element(indices.begin() + start, indices.begin() + mid,
+		   indices.begin() + end, CentroidLess(centroids, axis));
+  nodes[n].count = 0;
+  buildNode(triangles, centroids, start, mid);
+  nodes[n].first = nodes.size();
+  buildNode(triangles, centroids, mid, end);
+}
+
+bool TriangleBVH::intersect(const vector<Triangle> &triangles,
+			    const Vector3d &origin, const Vector3d &dir,
+			    double &t, uint &triangle) const
+{
+  if (nodes.empty()) return false;
+  bool hit = false;
+  t = INFTY;
+  vector<uint> stack;
+  stack.reserve(64);
+  stack.push_back(0);
+  while (!stack.empty()) {
+    const Node &node = nodes[stack.back()];
+    const uint n = stack.back();
+    stack.pop_back();
+    double tbox;
+    if (!intersectRayBox(origin, dir, node.min, node.max, tbox) || tbox > t)
+      continue;
+    if (node.count > 0) {
+      for (uint i = node.first; i < node.first + node.count; i++) {
+	double ttri;
+	if (intersectRayTriangle(origin, dir, triangles[indices[i]], ttri)
+	    && ttri < t) {
+	  t = ttri;
+	  triangle = indices[i];
+	  hit = true;
+	}
+      }
+    } else {
+      stack.push_back(node.first); // right
+      stack.push_back(n + 1);      // left
+    }
+  }
+  return hit;
+}
@@ -0,0 +1,60 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "stdafx.h"
+#include "triangle.h"
+
+// Ray parameter t >= 0 where origin + t*dir enters the box, false if missed
+bool intersectRayBox(const Vector3d &origin, const Vector3d &dir,
+		     const Vector3d &min, const Vector3d &max, double &t);
+
+// Ray parameter t >= 0 of the hit with the triangle (both sides)
+bool intersectRayTriangle(const Vector3d &origin, const Vector3d &dir,
+			  const Triangle &triangle, double &t);
+
+// Bounding volume hierarchy over the triangles of a mesh for ray casting.
+// Keeps indices only, the triangles must be passed again for queries.
+class TriangleBVH
+{
+ public:
+  void build(const vector<Triangle> &triangles);
+  void clear();
+  bool empty() const { return nodes.empty(); }
+
+  // nearest hit of the ray origin + t*dir, t >= 0
+  bool intersect(const vector<Triangle> &triangles,
+		 const Vector3d &origin, const Vector3d &dir,
+		 double &t, uint &triangle) const;
+
+ private:
+  struct Node {
+    Vector3d min, max;
+    uint first; // triangle index start for leaves, right child for inner nodes
+    uint count; // number of triangles, 0 for inner nodes (left child follows)
+  };
+  vector<Node> nodes;
+  vector<uint> indices; // triangle indices, leaves point into this
+
+  void buildNode(const vector<Triangle> &triangles,
+		 const vector<Vector3d> &centroids, uint start, uint end);
+};
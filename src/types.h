@@ -42,6 +42,7 @@ class PrefsDlg;
 class Triangle;
 class RepRapSerial;
 class Layer;
+class Region;
 class PrintInhibitor;
 class ProcessController;
 class ObjectsTree;
@@ -50,6 +50,8 @@ RSFilechooser::RSFilechooser(View * view_)
   modelfiles.add_pattern("*.SVG");
   modelfiles.add_pattern("*.wrl");
   modelfiles.add_pattern("*.WRL");
+  modelfiles.add_pattern("*.rsp");
+  modelfiles.add_pattern("*.RSP");
 
   gcodefiles.set_name(_("GCode"));
   gcodefiles.add_pattern("*.g");
@@ -24,63 +24,92 @@
 
 //ViewProgress::ViewProgress(Progress *progress, Gtk::Box *box, Gtk::ProgressBar *bar, Gtk::Label *label) :
 ViewProgress::ViewProgress(Gtk::Box *box, Gtk::ProgressBar *bar, Gtk::Label *label) :
-  m_box (box), m_bar(bar), m_label(label), to_terminal(true)
+  m_box (box), m_bar(bar), m_label(label),
+  m_active(0), m_continue(1), m_fraction(0), m_max(0), m_text(NULL),
+  m_main_thread(g_thread_self()), m_shown_text(NULL),
+  to_terminal(true)
 {
-  m_bar_max = 0.0;
-  box->hide();
+  if (box) box->hide();
   // progress->m_signal_progress_start.connect  (sigc::mem_fun(*this, &ViewProgress::start));
   // progress->m_signal_progress_update.connect (sigc::mem_fun(*this, &ViewProgress::update));
   // progress->m_signal_progress_stop.connect   (sigc::mem_fun(*this, &ViewProgress::stop));
   // progress->m_signal_progress_label.connect  (sigc::mem_fun(*this, &ViewProgress::set_label));
 }
 
+// a float fits into a gint, which can be set and read atomically
+static gint float_bits(double value)
+{
+  union { float f; gint i; } u;
+  u.f = (float)value;
+  return u.i;
+}
+static double bits_float(gint bits)
+{
+  union { float f; gint i; } u;
+  u.i = bits;
+  return u.f;
+}
+
+double ViewProgress::maximum()
+{
+  return bits_float(g_atomic_int_get(&m_max));
+}
+
+// interned strings live forever, so any thread can pass them on
+void ViewProgress::set_text(const char *label)
+{
+  g_atomic_pointer_set(&m_text, (gpointer)g_intern_string(label));
+}
+
+void ViewProgress::print_time_used() const
+{
+  if (!to_terminal) return;
+  Glib::TimeVal now;
+  now.assign_current_time();
+  const double time_used = round((now - stage_start).as_double() * 10) / 10; // seconds
+  cerr << (const char *)g_atomic_pointer_get(&m_text) << " -- " << _(" done in ")
+       << time_used << _(" seconds") << "       " << endl;
+}
+
 void ViewProgress::start (const char *label, double max)
 {
-  do_continue = true;
-  m_box->show();
-  m_bar_max = max;
-  this->label = label;
-  m_label->set_label (label);
-  m_bar_cur = 0.0;
-  m_bar->set_fraction(0.0);
-  start_time.assign_current_time();
-  Gtk::Main::iteration(false);
+  g_atomic_int_set(&m_continue, 1);
+  g_atomic_int_set(&m_max, float_bits(max));
+  g_atomic_int_set(&m_fraction, 0);
+  set_text(label);
+  g_atomic_int_set(&m_active, 1);
+  stage_start.assign_current_time();
+  if (can_display()) {
+    display();
+    Gtk::Main::iteration(false);
+  }
 }
 bool ViewProgress::restart (const char *label, double max)
 {
-  if (!do_continue) return false;
-  //m_box->show();
-  if (to_terminal) {
-    Glib::TimeVal now;
-    now.assign_current_time();
-    const int time_used = (int) round((now - start_time).as_double()); // seconds
-    cerr << m_label->get_label() << " -- " << _(" done in ") << time_used << _(" seconds") << "       " << endl;
+  if (!do_continue()) return false;
+  print_time_used();
+  g_atomic_int_set(&m_max, float_bits(max));
+  g_atomic_int_set(&m_fraction, 0);
+  set_text(label);
+  stage_start.assign_current_time();
+  if (can_display()) {
+    display();
+    //g_main_context_iteration(NULL,false);
+    Gtk::Main::iteration(false);
   }
-  m_bar_max = max;
-  this->label = label;
-  m_label->set_label (label);
-  m_bar_cur = 0.0;
-  m_bar->set_fraction(0.0);
-  start_time.assign_current_time();
-  //g_main_context_iteration(NULL,false);
-  Gtk::Main::iteration(false);
   return true;
 }
 
 void ViewProgress::stop (const char *label)
 {
-  if (to_terminal) {
-    Glib::TimeVal now;
-    now.assign_current_time();
-    const int time_used = (int) round((now - start_time).as_double()); // seconds
-    cerr << m_label->get_label() << " -- " << _(" done in ") << time_used << _(" seconds") << "       " << endl;
+  print_time_used();
+  set_text(label);
+  g_atomic_int_set(&m_fraction, 1000000);
+  g_atomic_int_set(&m_active, 0);
+  if (can_display()) {
+    display();
+    Gtk::Main::iteration(false);
   }
-  this->label = label;
-  m_label->set_label (label);
-  m_bar_cur = m_bar_max;
-  m_bar->set_fraction(1.0);
-  m_box->hide();
-  Gtk::Main::iteration(false);
 }
 
 string timeleft_str(long seconds) {
@@ -99,49 +128,75 @@ string timeleft_str(long seconds) {
 }
 
 
+// may be called from any thread
 bool ViewProgress::update (const double value, bool take_priority)
 {
+  const double max = maximum();
+  const gint fraction = max > 0 ? (gint)(CLAMP(value / max, 0., 1.) * 1e6) : 0;
   // Don't allow progress to go backward
-  if (value < m_bar_cur)
-    return do_continue;
+  if (fraction < g_atomic_int_get(&m_fraction))
+    return do_continue();
+  g_atomic_int_set(&m_fraction, fraction);
 
-  m_bar_cur = CLAMP(value, 0, 1.0);
-  m_bar->set_fraction(value / m_bar_max);
-  ostringstream o;
-  if(floor(value) != value && floor(m_bar_max) != m_bar_max)
-    o.precision(1);
-  else
-    o.precision(0);
-  o << fixed << value <<"/"<< m_bar_max;
-  m_bar->set_text(o.str());
   if (to_terminal) {
-    int perc = (int(m_bar->get_fraction()*100));
-    cerr << m_label->get_label() << " " << o.str() << " -- " << perc << "%              \r";
+    ostringstream o;
+    o.precision(max < 10 ? 2 : 0); // small maxima are in mm
+    o << fixed << value <<"/"<< max;
+    cerr << (const char *)g_atomic_pointer_get(&m_text) << " " << o.str()
+	 << " -- " << fraction/10000 << "%              \r";
+  }
+
+  if (can_display()) {
+    display();
+    if (take_priority)
+      while( gtk_events_pending () )
+	gtk_main_iteration ();
+    Gtk::Main::iteration(false);
   }
+  return do_continue();
+}
 
-  if (value > 0) {
+void ViewProgress::display()
+{
+  if (!m_box) return;
+  if (!g_atomic_int_get(&m_active)) {
+    if (m_box->get_visible()) {
+      m_bar->set_fraction(1.0);
+      m_box->hide();
+    }
+    return;
+  }
+  m_box->show();
+  const gpointer text = g_atomic_pointer_get(&m_text);
+  if (text != m_shown_text) { // new stage
+    m_shown_text = text;
+    start_time.assign_current_time();
+  }
+  const string label = text ? (const char *)text : "";
+  const double fraction = g_atomic_int_get(&m_fraction) / 1e6;
+  const double max = maximum();
+  m_bar->set_fraction(fraction);
+  ostringstream o;
+  o.precision(max < 10 ? 2 : 0); // small maxima are in mm
+  o << fixed << fraction * max <<"/"<< max;
+  m_bar->set_text(o.str());
+  if (fraction > 0) {
     Glib::TimeVal now;
     now.assign_current_time();
     const double used = (now - start_time).as_double(); // seconds
-    const double total = used * m_bar_max  / value;
-    const long left = (long)(total-used);
+    const long left = (long)(used / fraction - used);
     m_label->set_label(label+" ("+timeleft_str(left)+")");
-  }
-
-  if (take_priority)
-    while( gtk_events_pending () )
-      gtk_main_iteration ();
-  Gtk::Main::iteration(false);
-  return do_continue;
+  } else
+    m_label->set_label(label);
 }
 
 void ViewProgress::set_label (const std::string label)
 {
-  std::string old = m_label->get_label();
-  this->label = label;
-  if (old != label)
-    m_label->set_label (label);
-  Gtk::Main::iteration(false);
+  set_text(label.c_str());
+  if (can_display()) {
+    display();
+    Gtk::Main::iteration(false);
+  }
 }
 
 void ViewProgress::set_terminal_output (bool terminal)
@@ -53,15 +53,38 @@ class Progress {
 };
 
 
+// Progress of long calculations, shown in a progress bar.
+// The calculating thread only sets the state, which is exchanged through
+// atomics; GTK is touched only in the main thread.  Calls from the main
+// thread show the state at once, a worker's state is shown when the main
+// thread calls display(), e.g. from a timeout.
+// Without widgets nothing is shown and gtk is not needed, for running
+// without a display.
 class ViewProgress {
   Gtk::Box *m_box;
   Gtk::ProgressBar *m_bar;
   Gtk::Label *m_label;
-  double m_bar_max;
-  double m_bar_cur;
 
-  Glib::TimeVal start_time;
-  string label;
+  // shared state
+  volatile gint m_active;   // box shown
+  volatile gint m_continue; // cleared to cancel
+  volatile gint m_fraction; // done, in millionths
+  volatile gint m_max;      // maximum, the bits of a float to be atomic
+  volatile gpointer m_text; // interned label string
+
+  // calculating thread only
+  Glib::TimeVal stage_start;
+
+  // main thread only
+  GThread *m_main_thread;
+  Glib::TimeVal start_time; // of the label shown
+  gpointer m_shown_text;
+
+  bool in_main_thread() const { return g_thread_self() == m_main_thread; }
+  // can show the state now
+  bool can_display() const { return m_box && in_main_thread(); }
+  void set_text(const char *label);
+  void print_time_used() const;
 
  public:
   void start (const char *label, double max);
@@ -69,15 +92,17 @@ class ViewProgress {
   void stop (const char *label = "");
   bool update (const double value, bool take_priority=true);
   //ViewProgress(Progress *model, Gtk::Box *box, Gtk::ProgressBar *bar, Gtk::Label *label);
-  ViewProgress(){};
-  ViewProgress(Gtk::Box *box, Gtk::ProgressBar *bar, Gtk::Label *label);
+  ViewProgress(Gtk::Box *box = NULL, Gtk::ProgressBar *bar = NULL,
+	       Gtk::Label *label = NULL);
   void set_label (std::string label);
-  double maximum() { return m_bar_max; }
-  double value() { return m_bar_cur; }
+  double maximum();
+  double value() { return maximum() * g_atomic_int_get(&m_fraction) / 1e6; }
   bool to_terminal;
   void set_terminal_output(bool terminal);
-  bool do_continue;
-  void stop_running(){do_continue = false;};
+  bool do_continue() { return g_atomic_int_get(&m_continue) != 0; }
+  void stop_running() { g_atomic_int_set(&m_continue, 0); }
+  // show the state in the widgets, main thread only
+  void display();
 };
 
 #endif // PROGRESS_H
@@ -114,8 +114,7 @@ void View::convert_to_gcode ()
 		     _("Converting to GCode while printing will abort the print"));
       return;
     }
-  m_model->ConvertToGCode();
-
+  m_model->StartConvertToGCode();
 }
 
 void View::preview_file (Glib::RefPtr< Gio::File > file)
@@ -240,6 +239,8 @@ void View::do_save_stl ()
     uint len = file_path.length();
     if (file_path.find(".amf") == len-4 || file_path.find(".AMF") == len-4)
       m_model->SaveAMF (files[0]);
+    else if (file_path.find(".rsp") == len-4 || file_path.find(".RSP") == len-4)
+      m_model->SaveProject (files[0]);
     else
       m_model->SaveStl (files[0]);
   }
@@ -366,8 +367,10 @@ void View::printing_changed()
 
   if ( printing )
     m_progress->start (_("Printing"), m_printer->GetTotalPrintingLines() );
-  else
+  else {
     m_progress->stop (_("Done"));
+    showSerialStats();
+  }
 
   //rGlib::Mutex::Lock lock(mutex);
   m_model->SetIsPrinting(printing);
@@ -1603,7 +1606,7 @@ void View::duplicate_selected_objects()
 	newshape = new FlatShape(*flatshape);
       else
 	newshape = new Shape(*shapes[i]);
-      // duplicate
+      // duplicate, sharing the triangles
       TreeObject* object = m_model->objtree.getParent(shapes[i]);
       if (object !=NULL)
 	m_model->AddShape (object, newshape, shapes[i]->filename);
@@ -1691,6 +1694,17 @@ bool View::statusBarMessage(Glib::ustring message)
 }
 
 
+// Keeps one status bar entry with the current serial link statistics
+void View::showSerialStats()
+{
+  Gtk::Statusbar *statusbar;
+  m_builder->get_widget("statusbar", statusbar);
+  if (!statusbar) return;
+  guint context = statusbar->get_context_id("serial_stats");
+  statusbar->pop(context);
+  statusbar->push(m_printer->GetStats().ToString(), context);
+}
+
 void View::stop_progress()
 {
   m_progress->stop_running();
@@ -1962,7 +1976,8 @@ void View::DrawGrid()
 }
 
 // called from Render::on_expose_event
-void View::Draw (vector<Gtk::TreeModel::Path> &selected, bool objects_only)
+void View::Draw (vector<Gtk::TreeModel::Path> &selected, bool objects_only,
+		 bool interactive)
 {
 	// Draw the grid, pushed back so it can be seen
 	// when viewed from below.
@@ -1988,7 +2003,7 @@ void View::Draw (vector<Gtk::TreeModel::Path> &selected, bool objects_only)
 	}
 
 	// Draw all objects
-	int layerdrawn = m_model->draw(selected);
+	int layerdrawn = m_model->draw(selected, interactive);
 	if (layerdrawn > -1) {
 	  Gtk::Label *layerlabel;
 	  m_builder->get_widget("layerno_label", layerlabel);
@@ -2014,6 +2029,7 @@ void View::showCurrentPrinting(unsigned long lineno)
   //  printing_changed();
   }
   m_model->setCurrentPrintingLine(lineno);
+  showSerialStats();
   queue_draw();
   // while(Gtk::Main::events_pending()) {
   //   Gtk::Main::iteration();
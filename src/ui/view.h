@@ -226,9 +226,12 @@ class View : public Gtk::Window
   bool logprint_timeout_cb();
 
   // view nasties ...
-  void Draw (vector<Gtk::TreeModel::Path> &selected, bool objects_only=false);
+  // interactive: the view is being rotated, shapes are drawn with less detail
+  void Draw (vector<Gtk::TreeModel::Path> &selected, bool objects_only=false,
+	     bool interactive=false);
   void DrawGrid ();
   void showCurrentPrinting(unsigned long line);
+  void showSerialStats();
 
   Glib::Mutex mutex;
 
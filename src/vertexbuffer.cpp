@@ -0,0 +1,147 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "stdafx.h"
+#include "vertexbuffer.h"
+
+#include <string.h>
+
+// Windows' opengl32 only exports GL 1.1, we use client side arrays there
+#if defined(WIN32) || !defined(GL_ARRAY_BUFFER)
+#define NO_BUFFER_OBJECTS
+#endif
+
+VertexBuffer::VertexBuffer(Format format)
+  : format(format), n_vertices(0), buffer_id(0)
+{
+  stride = (format == POSITION_COLOR) ? 3*sizeof(GLfloat) + 4
+                                      : 6*sizeof(GLfloat);
+}
+
+VertexBuffer::~VertexBuffer()
+{
+  clear();
+}
+
+void VertexBuffer::clear()
+{
+#ifndef NO_BUFFER_OBJECTS
+  if (buffer_id != 0)
+    glDeleteBuffers(1, &buffer_id);
+#endif
+  buffer_id = 0;
+  data.clear();
+  n_vertices = 0;
+}
+
+void VertexBuffer::reserve(uint vertices)
+{
+  data.reserve(vertices * stride);
+}
+
+void VertexBuffer::add(const Vector3d &pos, const Vector4f &color)
+{
+  GLfloat p[3] = { (GLfloat)pos.x(), (GLfloat)pos.y(), (GLfloat)pos.z() };
+  GLubyte c[4];
+  for (uint i = 0; i < 4; i++)
+    c[i] = (GLubyte)CLAMP(color[i] * 255.f + 0.5f, 0.f, 255.f);
+  const size_t at = data.size();
+  data.resize(at + stride);
+  memcpy(&data[at], p, sizeof(p));
+  memcpy(&data[at + sizeof(p)], c, sizeof(c));
+  n_vertices++;
+}
+
+void VertexBuffer::add(const Vector3f &pos, const Vector3f &normal)
+{
+  GLfloat p[6] = { pos.x(), pos.y(), pos.z(), normal.x(), normal.y(), normal.z() };
+  const size_t at = data.size();
+  data.resize(at + stride);
+  memcpy(&data[at], p, sizeof(p));
+  n_vertices++;
+}
+
+bool VertexBuffer::haveBufferObjects()
+{
+#ifdef NO_BUFFER_OBJECTS
+  return false;
+#else
+  static int have = -1;
+  if (have < 0) {
+    const char *version = (const char *) glGetString(GL_VERSION);
+    if (!version) return false; // no context yet
+    int major = 0, minor = 0;
+    sscanf(version, "%d.%d", &major, &minor);
+    have = (major > 1 || (major == 1 && minor >= 5)) ? 1 : 0;
+  }
+  return have == 1;
+#endif
+}
+
+// move data to the GL server, keep it in memory if that is not possible
+void VertexBuffer::upload()
+{
+#ifndef NO_BUFFER_OBJECTS
+  if (buffer_id != 0 || n_vertices == 0 || !haveBufferObjects())
+    return;
+  glGenBuffers(1, &buffer_id);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
+  glBufferData(GL_ARRAY_BUFFER, data.size(), &data[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  if (glGetError() != GL_NO_ERROR) { // out of memory etc., use client arrays
+    glDeleteBuffers(1, &buffer_id);
+    buffer_id = 0;
+    return;
+  }
+  vector<unsigned char>().swap(data);
+#endif
+}
+
+void VertexBuffer::draw(GLenum mode, uint first, uint count)
+{
+  if (first >= n_vertices || count == 0) return;
+  count = MIN(count, n_vertices - first);
+  upload();
+
+  const unsigned char *base = NULL;
+#ifndef NO_BUFFER_OBJECTS
+  if (buffer_id != 0)
+    glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
+  else
+#endif
+    base = &data[0];
+
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, stride, base);
+  if (format == POSITION_COLOR) {
+    glEnableClientState(GL_COLOR_ARRAY);
+    glColorPointer(4, GL_UNSIGNED_BYTE, stride, base + 3*sizeof(GLfloat));
+  } else {
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glNormalPointer(GL_FLOAT, stride, base + 3*sizeof(GLfloat));
+  }
+  glDrawArrays(mode, first, count);
+  glPopClientAttrib();
+
+#ifndef NO_BUFFER_OBJECTS
+  if (buffer_id != 0)
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+#endif
+}
@@ -0,0 +1,68 @@
+/*
+    This file is a part of the RepSnapper project.
+    Copyright (C) 2012  martin.dieringer@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "stdafx.h"
+
+// Interleaved float vertex data for glDrawArrays.
+// The data is collected with add() and moved into a GL buffer object
+// on the first draw, if the GL implementation has them (GL 1.5).
+// Otherwise it stays in memory and is drawn as a client side array.
+// Must be deleted or cleared with the GL context current.
+class VertexBuffer
+{
+ public:
+  enum Format {
+    POSITION_COLOR,  // 3 floats position, 4 bytes RGBA
+    POSITION_NORMAL  // 3 floats position, 3 floats normal
+  };
+
+  VertexBuffer(Format format = POSITION_COLOR);
+  ~VertexBuffer();
+
+  void clear();
+  void reserve(uint vertices);
+
+  void add(const Vector3d &pos, const Vector4f &color); // POSITION_COLOR
+  void add(const Vector3f &pos, const Vector3f &normal); // POSITION_NORMAL
+
+  uint size() const { return n_vertices; }
+  bool empty() const { return n_vertices == 0; }
+  size_t bytes() const { return n_vertices * stride; }
+
+  // draw vertices [first, first+count)
+  void draw(GLenum mode, uint first, uint count);
+  void draw(GLenum mode) { draw(mode, 0, n_vertices); }
+
+  static bool haveBufferObjects();
+
+ private:
+  VertexBuffer(const VertexBuffer &);
+  VertexBuffer &operator=(const VertexBuffer &);
+
+  Format format;
+  uint stride;  // bytes per vertex
+  uint n_vertices;
+  vector<unsigned char> data;
+  GLuint buffer_id; // 0 if not uploaded
+  void upload();
+};